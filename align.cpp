@@ -0,0 +1,208 @@
+// Insertion/deletion-aware alignment implementation
+#include "align.h"
+
+// Allocate map with one segment at the base offsets (0 if none) of all files
+void segmap::Init( uint _n, qword* sizes, qword* base ) {
+  uint i;
+  n = _n;
+  seg = new qword[MAXSEG*n];
+  for( i=0; i<n; i++ ) size[i]=sizes[i], seg[i]=base ? Min(base[i],sizes[i]) : 0;
+  scanned = 0;
+  nseg = 1;
+}
+
+// Free map (nseg=0 turns alignment off)
+void segmap::Quit( void ) {
+  nseg = 0;
+  delete[] seg; seg=0;
+}
+
+// Append segment starting at pos[i] in each file; returns 0 if the map is full
+uint segmap::Add( qword* pos ) {
+  uint i, k=nseg;
+  if( k>=MAXSEG ) return 0;
+  for( i=0; i<n; i++ ) seg[k*n+i] = pos[i];
+  nseg = k+1;  // Publish after the row is written
+  return 1;
+}
+
+// Last segment starting at or before position q of file i
+uint segmap::Find( uint i, qword q ) {
+  uint a=0, b=nseg, c;
+  // Segment starts grow monotonically in every file
+  while( b-a>1 ) {
+    c = (a+b)/2;
+    if( Pos(c,i)<=q ) a=c; else b=c;
+  }
+  return a;
+}
+
+// Position in file m paired with position q of file i
+// Unpaired positions (inserted data) map to the end of the segment in file m; *f_pair is cleared for them
+qword segmap::Map( uint i, qword q, uint m, uint* f_pair ) {
+  uint k = Find( i, q );
+  if( q<Pos(k,i) ) {  // Before the base offset: keep the base difference
+    if( f_pair ) *f_pair = 0;
+    return Pos(k,m) - Min( Pos(k,i)-q, Pos(k,m) );
+  }
+  qword r = q - Pos(k,i);
+  qword l = End(k,m) - Pos(k,m);
+  if( f_pair ) *f_pair = (r<l);
+  return Pos(k,m) + Min( r, l );
+}
+
+// Open files and start the scan from the base offsets; returns 0 on failure
+uint AlignScan::start( segmap& _map, char** names, uint _n, uint _window, qword* base ) {
+  uint i;
+  qword sizes[DK_MAXF];
+  map = &_map;
+  n = Min( _n, uint(DK_MAXF) );
+  window = _window;
+  for( hmask=1; hmask<(window>>(ANCHOR_BITS-2)); hmask<<=1 );  // ~4x the expected anchor count
+  hmask--;
+  for( i=0; i<n; i++ ) { f[i].f=0; buf[i]=0; hkey[i]=0; hpos[i]=0; }
+  for( i=0; i<n; i++ ) {
+    if( f[i].open(names[i])==0 ) { n=i; stop(); return 0; }
+    sizes[i] = f[i].size();
+    buf[i] = new byte[window];
+    beg[i] = 0; len[i] = 0;
+    hkey[i] = new qword[hmask+1];
+    hpos[i] = new uint[hmask+1];
+  }
+  map->Init( n, sizes, base );
+  f_run = 1;
+  return base::start();
+}
+
+// Stop scan, wait for thread exit and close files
+void AlignScan::stop( void ) {
+  uint i;
+  if( map==0 ) return;
+  f_run = 0;
+  if( th ) { base::quit(); th=0; }
+  for( i=0; i<n; i++ ) {
+    if( f[i].f ) f[i].close();
+    f[i].f = 0;
+    delete[] buf[i]; buf[i]=0;
+    delete[] hkey[i]; hkey[i]=0;
+    delete[] hpos[i]; hpos[i]=0;
+  }
+  map = 0;
+}
+
+// Make buf[i] hold at least need bytes from pos (less at EOF); returns bytes available from pos
+uint AlignScan::Fill( uint i, qword pos, uint need ) {
+  uint keep=0;
+  qword fsize = map->size[i];
+  if( pos>=fsize ) return 0;
+  if( (pos>=beg[i]) && (pos<=beg[i]+len[i]) ) {
+    keep = uint( beg[i]+len[i]-pos );
+    if( (keep>=need) || (beg[i]+len[i]>=fsize) ) return keep;  // Enough data, or nothing more to read
+    memmove( buf[i], buf[i]+(len[i]-keep), keep );  // Slide window, keep the tail
+  }
+  beg[i] = pos;
+  f[i].seek( pos+keep );
+  len[i] = keep + f[i].sread( buf[i]+keep, uint( Min( qword(window-keep), fsize-pos-keep ) ) );
+  return len[i];
+}
+
+// Find the first anchor within lim bytes after cur[] present in all files; a[] = start of the realigned run
+uint AlignScan::Resync( qword* cur, qword* a, uint lim ) {
+  uint i,j,t,l[DK_MAXF],w[DK_MAXF],cnt;
+  qword h,last=0;
+  byte* p[DK_MAXF];
+
+  for( i=0; i<n; i++ ) {
+    l[i] = Min( Fill( i, cur[i], lim ), lim );
+    p[i] = buf[i] + uint(cur[i]-beg[i]);
+    if( l[i]<ANCHOR_LEN ) return 0;
+  }
+
+  // Index anchors of files 1..n-1 by gear key (first occurrence wins)
+  for( i=1; i<n; i++ ) {
+    for( j=0; j<=hmask; j++ ) hpos[i][j] = uint(-1);
+    for( h=0,cnt=0,t=0; (t<l[i]) && (cnt<=hmask/2); t++ ) {
+      h = GearStep( h, p[i][t] );
+      if( (t+1<ANCHOR_LEN) || !GearCut(h,ANCHOR_BITS) ) continue;
+      for( j=uint(h)&hmask; (hpos[i][j]!=uint(-1)) && (hkey[i][j]!=h); j=(j+1)&hmask );
+      if( hpos[i][j]==uint(-1) ) hkey[i][j]=h, hpos[i][j]=t+1-ANCHOR_LEN, cnt++;
+    }
+  }
+
+  // Walk anchors of file 0 in order; the first one found and verified in all files wins
+  for( h=0,t=0; f_run && (t<l[0]); t++ ) {
+    h = GearStep( h, p[0][t] );
+    if( (t+1<ANCHOR_LEN) || !GearCut(h,ANCHOR_BITS) || (h==last) ) continue;
+    last = h;  // Runs of constant data repeat one key: test it once
+    w[0] = t+1-ANCHOR_LEN;
+    for( i=1; i<n; i++ ) {
+      for( j=uint(h)&hmask; (hpos[i][j]!=uint(-1)) && (hkey[i][j]!=h); j=(j+1)&hmask );
+      if( hpos[i][j]==uint(-1) ) break;
+      w[i] = hpos[i][j];
+      if( memcmp( p[0]+w[0], p[i]+w[i], ANCHOR_LEN )!=0 ) break;  // Key collision
+    }
+    if( i<n ) continue;
+
+    // Extend the match backwards to where the files started to agree again
+    for(;;) {
+      for( i=0; i<n; i++ ) if( (w[i]==0) || (p[i][w[i]-1]!=p[0][w[0]-1]) ) break;
+      if( i<n ) break;
+      for( i=0; i<n; i++ ) w[i]--;
+    }
+    for( i=0; i<n; i++ ) a[i] = cur[i]+w[i];
+    return 1;
+  }
+  return 0;
+}
+
+// Thread function - aligns files from start to end
+void AlignScan::thread( void ) {
+  uint i,j,m,e,d,w,f_sync;
+  qword cur[DK_MAXF],a[DK_MAXF];
+  byte* p[DK_MAXF];
+  byte* q[DK_MAXF];
+
+  for( i=0; i<n; i++ ) cur[i]=map->Pos(0,i);
+
+  while( f_run ) {
+    // Skip the run of bytes that are equal at the current alignment
+    for( m=window,i=0; i<n; i++ ) {
+      m = Min( m, Fill( i, cur[i], window/2 ) );
+      p[i] = buf[i] + uint(cur[i]-beg[i]);
+    }
+    if( m==0 ) break;  // Some file ended: the rest of the others is unpaired
+    e = DiffFirst( p, n, m );
+    for( i=0; i<n; i++ ) cur[i] += e;
+    map->scanned = cur[0];
+    if( e==m ) continue;
+
+    // Substitutions keep the offsets: look for a run of equal bytes shortly after
+    for( j=e+1; (j+ANCHOR_LEN<=m) && (j<e+SUBST_LEN); j+=d+1 ) {
+      for( i=0; i<n; i++ ) q[i] = p[i]+j;
+      d = DiffFirst( q, n, ANCHOR_LEN );
+      if( d==ANCHOR_LEN ) break;
+    }
+    if( (j+ANCHOR_LEN<=m) && (j<e+SUBST_LEN) ) {
+      for( i=0; i<n; i++ ) cur[i] += j-e;
+      continue;
+    }
+
+    // Otherwise look for the next point where all files agree, in growing windows
+    for( f_sync=0,w=window>>6; (f_sync==0) && (w<window); ) {
+      w = Min( w*4, window );
+      f_sync = Resync( cur, a, w );
+    }
+    if( f_sync ) {
+      for( d=0,i=1; i<n; i++ ) d |= ((a[i]-a[0])!=(cur[i]-cur[0]));
+      if( d && (map->Add(a)==0) ) break;  // Offsets changed: new segment (stop when the map is full)
+      for( i=0; i<n; i++ ) cur[i] = a[i];
+    } else {
+      // No common anchor in the window: keep the offsets and move on
+      for( i=0; i<n; i++ ) cur[i] = Min( cur[i]+window/2, map->size[i] );
+    }
+    map->scanned = cur[0];
+  }
+
+  if( f_run ) map->scanned = map->size[0];
+  f_run = 0;
+}
@@ -0,0 +1,86 @@
+// Insertion/deletion-aware alignment between files (rolling-hash anchors)
+#ifndef ALIGN_H
+#define ALIGN_H
+
+#include "common.h"
+#include "thread.h"
+#include "file_win.h"
+#include "diffkern.h"
+#include "gear.h"
+
+// Piecewise offset mapping between files
+// Segment k starts at Pos(k,i) in file i and runs up to the start of segment k+1.
+// Bytes of a segment are paired 1:1 from its start; where a segment is longer in
+// one file (inserted data), its tail has no counterpart in the shorter files.
+// Segments are appended by the scan thread and read by the GUI without locking.
+struct segmap {
+  enum{ MAXSEG=1<<16 };  // Segment limit (bounds memory; scan stops when full)
+
+  uint  n;                 // Number of files
+  qword size[DK_MAXF];     // File sizes
+  qword* seg;              // MAXSEG rows of n start positions
+  volatile uint  nseg;     // Segments in use (0 = no alignment)
+  volatile qword scanned;  // Scan frontier in file 0
+
+  // Allocate map with one segment at the base offsets (0 if none) of all files
+  void Init( uint _n, qword* sizes, qword* base=0 );
+
+  // Free map (nseg=0 turns alignment off)
+  void Quit( void );
+
+  // Append segment starting at pos[i] in each file; returns 0 if the map is full
+  uint Add( qword* pos );
+
+  // Start of segment k in file i
+  qword Pos( uint k, uint i ) { return seg[k*n+i]; }
+
+  // End of segment k in file i
+  qword End( uint k, uint i ) { return (k+1<nseg) ? Pos(k+1,i) : size[i]; }
+
+  // Last segment starting at or before position q of file i
+  uint Find( uint i, qword q );
+
+  // Position in file m paired with position q of file i
+  // Unpaired positions (inserted data) map to the end of the segment in file m; *f_pair is cleared for them
+  qword Map( uint i, qword q, uint m, uint* f_pair=0 );
+};
+
+// Background thread that builds the segmap by streaming through all files
+// Equal runs are skipped with DiffFirst; at a difference, gear anchors in a bounded
+// window of each file are matched to find where the files line up again.
+struct AlignScan : thread<AlignScan> {
+
+  typedef thread<AlignScan> base;
+
+  enum{ ANCHOR_BITS=6, ANCHOR_LEN=64 };  // Anchor every ~64 bytes, keyed by the 64 bytes before it
+  enum{ SUBST_LEN=4096 };  // Differences followed by equal data within this distance keep the offsets
+
+  segmap* map;          // Target map
+  volatile uint f_run;  // Cleared to stop the scan
+  uint  n;              // Number of files
+  uint  window;         // Resync search window per file (bytes)
+  filehandle0 f[DK_MAXF];  // Private file handles
+  byte* buf[DK_MAXF];   // Sliding window buffers (window bytes each)
+  qword beg[DK_MAXF];   // File position of buf[i][0]
+  uint  len[DK_MAXF];   // Valid bytes in buf[i]
+  qword* hkey[DK_MAXF]; // Anchor tables of files 1..n-1: gear key
+  uint*  hpos[DK_MAXF]; //  and window offset of first anchor with that key
+  uint  hmask;          // Anchor table size-1
+
+  // Open files and start the scan from the base offsets; returns 0 on failure
+  uint start( segmap& _map, char** names, uint _n, uint _window, qword* base=0 );
+
+  // Stop scan, wait for thread exit and close files
+  void stop( void );
+
+  // Make buf[i] hold at least need bytes from pos (less at EOF); returns bytes available from pos
+  uint Fill( uint i, qword pos, uint need );
+
+  // Find the first anchor within lim bytes after cur[] present in all files; a[] = start of the realigned run
+  uint Resync( qword* cur, qword* a, uint lim );
+
+  // Thread function - aligns files from start to end
+  void thread( void );
+};
+
+#endif // ALIGN_H
@@ -0,0 +1,258 @@
+// Headless batch comparison implementation
+#include "batch.h"
+#include "thread.h"
+#include "blockread.h"
+#include "typecmp.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+static const char batch_usage[] =
+"Usage: cmp --batch [options] file1 file2 [... file8]\n"
+"  -f, --format text|json|bin  Output format for differing ranges (default text)\n"
+"  -s, --quiet                 No output, exit code only\n"
+"      --first                 Stop after the first differing range\n"
+"  -t, --threads N             Reader threads (1-16, default 1 = no prefetch)\n"
+"  -b, --block N[K|M]          Read block size (64K-64M, default 1M)\n"
+"      --direct                Unbuffered reads (bypass the OS file cache)\n"
+"  -i, --ignore FILE           Don't report ranges listed in FILE (\"<offset> <length> [<stride>]\" per line)\n"
+"  -T, --type TYPE             Compare elements: i16, i32, i64, f32, f64 (suffix be = big-endian)\n"
+"      --tol X                 Element tolerance: absolute (1e-6), or in ULPs for floats (4ulp)\n"
+"Output: one line per differing range (text: hex offset and length; json: one object per line);\n"
+"bin: little-endian 64-bit offset and length pairs. Bytes past the end of a shorter file differ.\n"
+"Exit code: 0 = identical, 1 = different, 2 = error\n";
+
+// Differing range writer: merges differences of consecutive blocks into maximal ranges
+struct BatchOut {
+  enum{ fmt_text, fmt_json, fmt_bin };
+
+  uint  fmt;          // Output format
+  uint  f_quiet;      // No output
+  uint  f_first;      // Stop after the first range
+  uint  f_stop;       // Set when no more blocks are needed
+  qword beg, end;     // Open range (beg==end: none)
+  qword nranges;      // Ranges written
+  qword nbytes;       // Differing bytes in them
+
+  // Write the open range, if any
+  void Flush( void ) {
+    qword rec[2];
+    if( end==beg ) return;
+    nranges++; nbytes += end-beg;
+    if( f_quiet==0 ) {
+      if( fmt==fmt_json ) printf( "{\"offset\":%llu,\"length\":%llu}\n", beg, end-beg );
+      else if( fmt==fmt_bin ) { rec[0]=beg; rec[1]=end-beg; fwrite( rec, 1, sizeof(rec), stdout ); }
+      else printf( "0x%llX 0x%llX\n", beg, end-beg );
+    }
+    beg = end;
+    if( f_first ) f_stop = 1;
+  }
+
+  // Add differing range [b,e); extends the open range when adjacent
+  void Add( qword b, qword e ) {
+    if( f_stop ) return;
+    if( (end>beg) && (end==b) ) { end=e; return; }
+    Flush();
+    if( f_stop ) return;
+    beg=b; end=e;
+  }
+};
+
+// Find differing ranges in the last block read by br (l = longest file length in it)
+// keep = mask of compared bytes in the block (0 if nothing is ignored)
+static void BatchBlock( blockread& br, uint l, BatchOut& out, byte* keep ) {
+  uint i,o,d,m=br.minlen;
+  byte* p[DK_MAXF];
+  for( o=0; o<m; o+=d ) {
+    for( i=0; i<br.n; i++ ) p[i] = br.buf[i]+o;
+    d = DiffFirst( p, br.n, m-o, keep ? keep+o : 0 );  // Skip equal run
+    o += d;
+    if( o>=m ) break;
+    for( i=0; i<br.n; i++ ) p[i] = br.buf[i]+o;
+    d = SameFirst( p, br.n, m-o, keep ? keep+o : 0 );  // Length of differing run
+    out.Add( br.bpos+o, br.bpos+o+d );
+  }
+  // Some files ended: the rest differs, except ignored bytes
+  for( o=m; o<l; o+=d ) {
+    for( d=1; keep && (o+d<l) && ((keep[o+d]!=0)==(keep[o]!=0)); d++ );
+    if( keep==0 ) d = l-o;
+    if( (keep==0) || keep[o] ) out.Add( br.bpos+o, br.bpos+o+d );
+  }
+}
+
+
+// Length of the block at pos if all files have all of it at the same physical bytes (equal without reading), else 0
+static uint SameBlock( blockread& br, qword pos, uint bsize ) {
+  if( pos>=br.maxsize ) return 0;
+  uint l = uint( Min( qword(bsize), br.maxsize-pos ) );
+  return (br.Shared( pos, l )==l) ? l : 0;
+}
+
+// Prefetch thread: reads every step-th block into its own buffers while the main thread compares
+struct BatchReader : thread<BatchReader> {
+
+  typedef thread<BatchReader> base;
+
+  blockread br;          // Private handles and buffers
+  HANDLE ev_full;        // Set when a block is ready for compare
+  HANDLE ev_free;        // Set when the buffers may be reused
+  uint   k, step;        // Next block number and block stride
+  uint   bsize;          // Block size
+  uint   len;            // Longest length of last block (0 = all at EOF)
+  uint   f_same;         // Last block is at the same physical bytes in all files (not read)
+  volatile uint f_run;   // Cleared to stop
+
+  void thread( void ) {
+    for( ; ; k+=step ) {
+      WaitForSingleObject( ev_free, INFINITE );
+      if( f_run==0 ) break;
+      len = SameBlock( br, qword(k)*bsize, bsize );
+      f_same = (len!=0);
+      if( !f_same ) len = br.Read( qword(k)*bsize, bsize );
+      SetEvent( ev_full );
+      if( len==0 ) break;  // Past EOF of all files
+    }
+  }
+};
+
+// Parse size with optional K/M suffix
+static uint ParseSize( const char* s ) {
+  char* e;
+  qword x = strtoull( s, &e, 0 );
+  if( (*e=='k') || (*e=='K') ) x<<=10;
+  if( (*e=='m') || (*e=='M') ) x<<=20;
+  return uint( Min( x, qword(1U<<31) ) );
+}
+
+// Compare the files named in argv and stream differing ranges to stdout
+int BatchMain( int argc, char** argv ) {
+  uint i,k,l,n=0,nthreads=1,bsize=blockread::blklen;
+  char* names[DK_MAXF];
+  BatchOut out;
+  bzero( out );
+  ignoremask ign;         // Ranges not reported
+  ign.Clear();
+  typemode tm;            // Element type and tolerance
+  bzero( tm );
+  const char* type_name = 0;
+  const char* tol = 0;
+
+  // Options, then file names
+  for( i=1; i<uint(argc); i++ ) {
+    char* a = argv[i];
+    char* v = (i+1<uint(argc)) ? argv[i+1] : 0;
+    if( (strcmp(a,"-f")==0) || (strcmp(a,"--format")==0) ) {
+      if( v==0 ) break;
+      if( strcmp(v,"text")==0 ) out.fmt = BatchOut::fmt_text;
+      else if( strcmp(v,"json")==0 ) out.fmt = BatchOut::fmt_json;
+      else if( strcmp(v,"bin")==0 ) out.fmt = BatchOut::fmt_bin;
+      else break;
+      i++;
+    } else if( (strcmp(a,"-s")==0) || (strcmp(a,"--quiet")==0) ) {
+      out.f_quiet = 1;
+    } else if( strcmp(a,"--first")==0 ) {
+      out.f_first = 1;
+    } else if( (strcmp(a,"-t")==0) || (strcmp(a,"--threads")==0) ) {
+      if( v==0 ) break;
+      nthreads = ParseSize(v); i++;
+      if( (nthreads<1) || (nthreads>16) ) break;
+    } else if( (strcmp(a,"-b")==0) || (strcmp(a,"--block")==0) ) {
+      if( v==0 ) break;
+      bsize = ParseSize(v); i++;
+      if( (bsize<(1U<<16)) || (bsize>(1U<<26)) ) break;
+    } else if( strcmp(a,"--direct")==0 ) {
+      file_open_flags |= ffNO_BUFFERING;
+    } else if( (strcmp(a,"-i")==0) || (strcmp(a,"--ignore")==0) ) {
+      if( v==0 ) break;
+      if( ign.Load(v)<0 ) { fprintf( stderr, "cmp: can't load ignore ranges from %s\n", v ); return 2; }
+      i++;
+    } else if( (strcmp(a,"-T")==0) || (strcmp(a,"--type")==0) ) {
+      if( v==0 ) break;
+      type_name = v; i++;
+    } else if( strcmp(a,"--tol")==0 ) {
+      if( v==0 ) break;
+      tol = v; i++;
+    } else if( a[0]=='-' ) {
+      break;
+    } else {
+      if( n>=DK_MAXF ) break;
+      names[n++] = a;
+    }
+  }
+  if( (i<uint(argc)) || (n<2) || (tol && !type_name) || (type_name && !tm.Set( type_name, tol )) ) { fputs( batch_usage, stderr ); return 2; }
+  bsize = AlignUp( bsize, uint(blockread::sector) );  // Direct reads need whole sectors
+  file_open_flags |= ffSEQUENTIAL_SCAN;
+
+  setvbuf( stdout, 0, _IOFBF, 1<<16 );
+#ifdef _WIN32
+  if( out.fmt==BatchOut::fmt_bin ) _setmode( _fileno(stdout), _O_BINARY );
+#endif
+
+  blockread br;
+  bzero( br );
+  if( br.Open( names, n, 0, bsize )==0 ) {
+    fprintf( stderr, "cmp: can't open input files\n" );
+    return 2;
+  }
+  byte* kbuf = new byte[bsize];  // Keep mask of the block being compared
+
+  if( nthreads<=1 ) {
+    // Single thread: read and compare in turn
+    for( qword pos=0; out.f_stop==0; pos+=l ) {
+      if( (l = SameBlock( br, pos, bsize ))!=0 ) continue;
+      l = br.Read( pos, bsize );
+      if( l==0 ) break;
+      BatchBlock( br, l, out, BlockKeep( br, l, &ign, &tm, kbuf ) );
+    }
+  } else {
+    // Reader threads take blocks round-robin; blocks are compared in file order
+    BatchReader* rd = new BatchReader[nthreads];
+    uint nrd, f_err=0;  // Readers started, open failure
+    for( nrd=0; nrd<nthreads; nrd++ ) {
+      BatchReader& r = rd[nrd];
+      bzero( r );
+      if( r.br.Open( names, n, 0, bsize )==0 ) { f_err=1; break; }
+      r.k = nrd; r.step = nthreads; r.bsize = bsize;
+      r.ev_full = CreateEvent( 0, 0, 0, 0 );
+      r.ev_free = CreateEvent( 0, 0, 1, 0 );
+      r.f_run = 1;
+      r.start();
+    }
+    for( k=0; (f_err==0) && (out.f_stop==0); k++ ) {
+      BatchReader& r = rd[k%nthreads];
+      WaitForSingleObject( r.ev_full, INFINITE );
+      if( r.len==0 ) break;
+      if( !r.f_same ) BatchBlock( r.br, r.len, out, BlockKeep( r.br, r.len, &ign, &tm, kbuf ) );
+      SetEvent( r.ev_free );
+    }
+    // Readers already started are waiting on ev_free (or have hit EOF)
+    for( k=0; k<nrd; k++ ) {
+      rd[k].f_run = 0;
+      SetEvent( rd[k].ev_free );
+      rd[k].quit();
+      CloseHandle( rd[k].ev_full );
+      CloseHandle( rd[k].ev_free );
+      rd[k].br.Quit();
+    }
+    delete[] rd;
+    if( f_err ) {
+      fprintf( stderr, "cmp: can't open input files\n" );
+      delete[] kbuf;
+      br.Quit();
+      return 2;
+    }
+  }
+  out.Flush();
+
+  if( (out.f_quiet==0) && (out.fmt==BatchOut::fmt_json) ) {
+    printf( "{\"files\":%u,\"ranges\":%llu,\"bytes\":%llu,\"size\":[", n, out.nranges, out.nbytes );
+    for( i=0; i<n; i++ ) printf( "%s%llu", i ? "," : "", br.fsize[i] );
+    printf( "]}\n" );
+  }
+  fflush( stdout );
+  delete[] kbuf;
+  br.Quit();
+  return out.nranges ? 1 : 0;
+}
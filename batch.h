@@ -0,0 +1,12 @@
+// Headless batch comparison (no window, output to stdout)
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "common.h"
+
+// Compare the files named in argv and stream differing ranges to stdout
+// argv[0] is the mode switch ("--batch"), followed by options and 2..8 file names.
+// Returns cmp(1) exit codes: 0 = files are identical, 1 = files differ, 2 = error
+int BatchMain( int argc, char** argv );
+
+#endif // BATCH_H
@@ -0,0 +1,103 @@
+// Bit-shift detection implementation
+#include "bitshift.h"
+
+// Allocate region tables for range [_beg,_end) of n files
+void bitalign::Init( uint _n, qword _beg, qword _end ) {
+  Quit();
+  bzero( *this );
+  n = _n; beg = _beg; end = _end;
+  for( rshift=20; ((end-beg)>>rshift)>=MAXREG; rshift++ );
+  nreg = uint( (end-beg+(1ULL<<rshift)-1)>>rshift );
+  best = new signed char[nreg*DK_MAXF+1];
+  hits = new uint[nreg*DK_MAXF+1];
+  total = new uint[nreg*DK_MAXF+1];
+  bzero( best, nreg*DK_MAXF+1 );
+  bzero( hits, nreg*DK_MAXF+1 );
+  bzero( total, nreg*DK_MAXF+1 );
+  scanned = beg;
+}
+
+// Free tables
+void bitalign::Quit( void ) {
+  delete[] best; best=0;
+  delete[] hits; hits=0;
+  delete[] total; total=0;
+  nreg = 0;
+}
+
+// Bit offset covering most bytes of file i in the scanned regions (0 if none)
+int bitalign::Dominant( uint i ) {
+  uint r;
+  int t;
+  qword sum[NOFS];
+  bzero( sum, NOFS );
+  for( r=0; r<nreg; r++ ) sum[ best[r*DK_MAXF+i]-TMIN ] += total[r*DK_MAXF+i];
+  for( t=0,r=0; r<NOFS; r++ ) if( sum[r]>sum[t-TMIN] ) t = int(r)+TMIN;
+  return t;
+}
+
+// Open files and start detection over [beg,end) past the base offsets; returns 0 on failure
+uint BitScan::start( bitalign& _ba, char** names, uint n, qword* _base, qword beg, qword end, xchain* xc ) {
+  // One byte before and after each block supplies the bits shifted in at its edges
+  if( br.Open( names, n, _base, blockread::blklen+2, xc )==0 ) return 0;
+  ba = &_ba;
+  ba->Init( br.n, beg, Max( beg, Min( end, br.maxsize ) ) );
+  bzero( cnt[0], DK_MAXF*bitalign::NOFS );
+  bzero( tot, DK_MAXF );
+  f_run = 1;
+  return base::start();
+}
+
+// Stop scan and wait for thread exit
+void BitScan::stop( void ) {
+  if( ba==0 ) return;
+  f_run = 0;
+  base::quit();
+  br.Quit();
+  ba = 0;
+}
+
+// Store best offsets of region r and clear the counts
+// Ties keep the smallest shift, so unshifted data stays at 0
+void BitScan::Region( uint r ) {
+  uint i,k,b;
+  for( i=1; i<br.n; i++ ) {
+    for( b=-bitalign::TMIN,k=0; k<bitalign::NOFS; k++ ) if( cnt[i][k]>cnt[i][b] ) b=k;
+    ba->best[r*DK_MAXF+i] = int(b)+bitalign::TMIN;
+    ba->hits[r*DK_MAXF+i] = uint(cnt[i][b]);
+    ba->total[r*DK_MAXF+i] = uint(tot[i]);
+  }
+  bzero( cnt[0], DK_MAXF*bitalign::NOFS );
+  bzero( tot, DK_MAXF );
+}
+
+// Thread function - reads the range sequentially
+void BitScan::thread( void ) {
+  uint i,l,o,m,r,cur;
+  qword pos;
+  bitalign& s = *ba;
+
+  for( cur=0,pos=s.beg; f_run && (pos<s.end); pos+=l ) {
+    // Blocks counted from the range start and cut at region ends, so they never cross regions
+    r = uint( (pos-s.beg)>>s.rshift );
+    l = uint( Min( qword(blockread::blklen), Min( s.end, s.beg+(qword(r+1)<<s.rshift) )-pos ) );
+    if( r!=cur ) { Region(cur); cur=r; }
+
+    // Bytes [pos-1,pos+l+1): file 0 byte pos+j is at buf[0][o+j]
+    o = (pos>0);
+    if( br.Read( pos-o, l+o+1 )==0 ) break;
+    for( i=1; i<br.n; i++ ) {
+      if( (br.len[0]<=o) || (br.len[i]<=o+1) ) continue;
+      m = Min( br.len[0]-o, br.len[i]-o-1 );
+      m = Min( m, l );
+      // Offsets 0..7 start in byte pos+j of file i, offsets -8..-1 in byte pos+j-1
+      ShiftMatch( br.buf[0]+o, br.buf[i]+o, m, cnt[i]-bitalign::TMIN );
+      if( o ) ShiftMatch( br.buf[0]+o, br.buf[i], m, cnt[i] );
+      else if( m>1 ) ShiftMatch( br.buf[0]+1, br.buf[i], m-1, cnt[i] );  // No byte before the file
+      tot[i] += m;
+    }
+    s.scanned = pos+l;
+  }
+  if( f_run ) { Region(cur); s.scanned = s.end; s.f_done = 1; }
+  f_run = 0;
+}
@@ -0,0 +1,60 @@
+// Bit-shift detection: finds files that are other files shifted by a non-byte number of bits
+#ifndef BITSHIFT_H
+#define BITSHIFT_H
+
+#include "common.h"
+#include "thread.h"
+#include "blockread.h"
+
+// Best bit offset of each file against file 0, per region of a range
+// A file at bit offset t holds at byte p the 8 bits that start t bits after byte p of file 0's layout
+// (t in -8..7, bits MSB first). Filled by the scan thread, read by the terminal once f_done is set.
+struct bitalign {
+  enum{ MAXREG=1<<16, TMIN=-8, NOFS=16 };
+
+  uint  n;                 // Number of files
+  qword beg, end;          // Range past the base offsets
+  uint  rshift;            // log2 of region size (1MB, more for huge ranges)
+  uint  nreg;              // Regions in the range
+  signed char* best;       // Best bit offset per region and file ([r*DK_MAXF+i], file 0 unused)
+  uint* hits;              // Matching bytes at the best offset
+  uint* total;             // Bytes compared per region and file
+  volatile qword scanned;  // Scan frontier
+  volatile uint f_done;    // Set when the whole range is scanned
+
+  // Allocate region tables for range [_beg,_end) of n files
+  void Init( uint _n, qword _beg, qword _end );
+
+  // Free tables
+  void Quit( void );
+
+  // Bit offset covering most bytes of file i in the scanned regions (0 if none)
+  int Dominant( uint i );
+};
+
+// Background thread that fills a bitalign
+struct BitScan : thread<BitScan> {
+
+  typedef thread<BitScan> base;
+
+  bitalign* ba;         // Target results
+  blockread br;         // Private file handles
+  qword cnt[DK_MAXF][bitalign::NOFS];  // Matches per bit offset in the open region
+  qword tot[DK_MAXF];   // Compared bytes in the open region
+  volatile uint f_run;  // Cleared to stop the scan
+
+  // Open files and start detection over [beg,end) past the base offsets; returns 0 on failure
+  // Files with a transform chain in xc (one per file) are compared transformed
+  uint start( bitalign& _ba, char** names, uint n, qword* base, qword beg, qword end, xchain* xc=0 );
+
+  // Stop scan and wait for thread exit
+  void stop( void );
+
+  // Store best offsets of region r and clear the counts
+  void Region( uint r );
+
+  // Thread function - reads the range sequentially
+  void thread( void );
+};
+
+#endif // BITSHIFT_H
@@ -0,0 +1,160 @@
+// Block hash map implementation
+#include "blockhash.h"
+
+// XXH64 primes
+static const qword XP1 = 11400714785074694791ULL;
+static const qword XP2 = 14029467366897019727ULL;
+static const qword XP3 =  1609587929392839161ULL;
+static const qword XP4 =  9650029242287828579ULL;
+static const qword XP5 =  2870177450012600261ULL;
+
+static inline qword Rotl64( qword x, uint r ) { return (x<<r) | (x>>(64-r)); }
+static inline qword Read64( const byte* p ) { qword x; memcpy( &x, p, 8 ); return x; }
+static inline uint  Read32( const byte* p ) { uint x; memcpy( &x, p, 4 ); return x; }
+
+// One accumulator step of XXH64
+static inline qword XRound( qword acc, qword x ) {
+  acc += x*XP2; acc = Rotl64(acc,31); return acc*XP1;
+}
+
+// Fold accumulator into hash
+static inline qword XMerge( qword h, qword v ) {
+  h ^= XRound(0,v); return h*XP1 + XP4;
+}
+
+// 64-bit xxHash (XXH64) of a memory block
+qword XXH64( const void* _p, uint len, qword seed ) {
+  const byte* p = (const byte*)_p;
+  const byte* e = p+len;
+  qword h;
+
+  if( len>=32 ) {
+    // Four independent lanes over 32-byte stripes
+    qword v1=seed+XP1+XP2, v2=seed+XP2, v3=seed, v4=seed-XP1;
+    for( ; p+32<=e; p+=32 ) {
+      v1 = XRound( v1, Read64(p+0) );
+      v2 = XRound( v2, Read64(p+8) );
+      v3 = XRound( v3, Read64(p+16) );
+      v4 = XRound( v4, Read64(p+24) );
+    }
+    h = Rotl64(v1,1) + Rotl64(v2,7) + Rotl64(v3,12) + Rotl64(v4,18);
+    h = XMerge(h,v1); h = XMerge(h,v2); h = XMerge(h,v3); h = XMerge(h,v4);
+  } else {
+    h = seed+XP5;
+  }
+  h += len;
+
+  // Tail: 8, 4 and 1 byte steps
+  for( ; p+8<=e; p+=8 ) { h ^= XRound(0,Read64(p)); h = Rotl64(h,27)*XP1 + XP4; }
+  if( p+4<=e ) { h ^= qword(Read32(p))*XP1; h = Rotl64(h,23)*XP2 + XP3; p+=4; }
+  for( ; p<e; p++ ) { h ^= (*p)*XP5; h = Rotl64(h,11)*XP1; }
+
+  // Final avalanche
+  h ^= h>>33; h *= XP2;
+  h ^= h>>29; h *= XP3;
+  h ^= h>>32;
+  return h;
+}
+
+// Allocate empty map for file of given size and time
+void blockhash::Init( qword _fsize, qword _mtime ) {
+  fsize = _fsize; mtime = _mtime;
+  nblk  = uint( (fsize+hblk-1)>>hbits );
+  leaf  = new qword[nblk+1];
+  tree  = new qword[nblk+1];  // Levels above n leaves hold less than n entries
+  ntree = 0;
+  known = 0;
+  f_loaded = 0;
+}
+
+// Free map
+void blockhash::Quit( void ) {
+  delete[] leaf; leaf=0;
+  delete[] tree; tree=0;
+  nblk = ntree = known = 0;
+}
+
+// Build Merkle levels from leaves and return root hash
+qword blockhash::Tree( void ) {
+  uint i,n=nblk;
+  qword* src=leaf;
+  ntree = 0;
+  // Each node hashes its two children; an odd last child is carried up unchanged
+  while( n>1 ) {
+    qword* dst = &tree[ntree];
+    for( i=0; i+1<n; i+=2 ) dst[i/2] = XXH64( &src[i], 2*sizeof(qword) );
+    if( n&1 ) dst[n/2] = src[n-1];
+    n = (n+1)/2;
+    ntree += n;
+    src = dst;
+  }
+  return Root();
+}
+
+// Root hash (valid after Tree() or Load())
+qword blockhash::Root( void ) {
+  return ntree ? tree[ntree-1] : nblk ? leaf[0] : 0;
+}
+
+// Sidecar file header (followed by full path and leaf hashes)
+struct hashhdr {
+  uint  magic, version;  // Format signature
+  uint  hbits, nblk;     // Block size log2 and block count
+  qword fsize, mtime;    // Key: file size and modification time
+  qword root;            // Merkle root (checked after load)
+  uint  pathlen, pad;    // Length of full path following the header
+};
+
+// Build sidecar name and full path of file
+static void SidecarNames( const char* name, char* side, char* full, uint size ) {
+  DWORD l = GetFullPathNameA( name, size, full, 0 );
+  if( (l==0) || (l>=size) ) { strncpy( full, name, size-1 ); full[size-1]=0; }
+  snprintf( side, size, "%s.cmph", name );
+}
+
+// Load sidecar for file name; returns 0 if missing or stale
+uint blockhash::Load( const char* name, qword _fsize, qword _mtime ) {
+  char side[1024],full[1024],path[1024];
+  hashhdr h;
+  uint r=0;
+  filehandle0 f;
+  SidecarNames( name, side, full, sizeof(side) );
+  if( f.open(side)==0 ) return 0;
+  // Key check: format, path, size and modification time
+  if( (f.read(h)==0) && (h.magic==magic) && (h.version==version) && (h.hbits==hbits) &&
+      (h.fsize==_fsize) && (h.mtime==_mtime) && (h.pathlen<sizeof(path)) &&
+      (f.read(path,h.pathlen)==h.pathlen) ) {
+    path[h.pathlen] = 0;
+    if( strcmp(path,full)==0 ) {
+      Init( _fsize, _mtime );
+      if( (h.nblk==nblk) && (f.read(leaf,nblk*sizeof(qword))==nblk*sizeof(qword)) && (Tree()==h.root) ) {
+        known = nblk; f_loaded = 1; r = 1;
+      } else {
+        Quit();
+      }
+    }
+  }
+  f.close();
+  return r;
+}
+
+// Write sidecar for file name (map must be complete); returns 0 on failure
+uint blockhash::Save( const char* name ) {
+  char side[1024],full[1024];
+  hashhdr h;
+  uint r=0;
+  filehandle0 f;
+  if( known<nblk ) return 0;
+  SidecarNames( name, side, full, sizeof(side) );
+  bzero( h );
+  h.magic = magic; h.version = version;
+  h.hbits = hbits; h.nblk = nblk;
+  h.fsize = fsize; h.mtime = mtime;
+  h.root  = Tree();
+  h.pathlen = strlen(full);
+  if( f.make(side)==0 ) return 0;
+  r = (f.writ(h)==0) && (f.writ(full,h.pathlen)==h.pathlen) &&
+      (f.writ(leaf,nblk*sizeof(qword))==nblk*sizeof(qword));
+  f.close();
+  return r;
+}
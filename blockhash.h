@@ -0,0 +1,46 @@
+// Per-block hash map with Merkle tree, persisted as a sidecar file
+#ifndef BLOCKHASH_H
+#define BLOCKHASH_H
+
+#include "common.h"
+#include "file_win.h"
+
+// 64-bit xxHash (XXH64) of a memory block
+qword XXH64( const void* p, uint len, qword seed=0 );
+
+// Block hash map of one file: XXH64 per 64KB block, Merkle levels above it
+// Sidecar is stored next to the file as "<name>.cmph" and is only accepted when
+// the stored path, size and modification time match the file being opened
+struct blockhash {
+  enum{ hblk=1<<16, hbits=16 };  // Hashed block size (64KB)
+  enum{ magic=wc<'C','M','P','H'>::n, version=1 };
+
+  qword  fsize;     // File size the map belongs to
+  qword  mtime;     // File modification time (FILETIME as 64-bit)
+  uint   nblk;      // Number of blocks (last one may be partial)
+  qword* leaf;      // Block hashes
+  qword* tree;      // Merkle levels above leaves (level by level, root last)
+  uint   ntree;     // Number of entries in tree
+  volatile uint known;  // Leaves computed so far (nblk once complete or loaded)
+  uint   f_loaded;  // Map came from a valid sidecar
+
+  // Allocate empty map for file of given size and time
+  void Init( qword _fsize, qword _mtime );
+
+  // Free map
+  void Quit( void );
+
+  // Build Merkle levels from leaves and return root hash
+  qword Tree( void );
+
+  // Root hash (valid after Tree() or Load())
+  qword Root( void );
+
+  // Load sidecar for file name; returns 0 if missing or stale
+  uint Load( const char* name, qword _fsize, qword _mtime );
+
+  // Write sidecar for file name (map must be complete); returns 0 on failure
+  uint Save( const char* name );
+};
+
+#endif // BLOCKHASH_H
@@ -0,0 +1,84 @@
+// Block reader implementation
+#include "blockread.h"
+#include <stdint.h>
+
+// Open files by name, with optional base offsets, block size and transform chains (one per file);
+// returns 0 if any file can't be opened
+// With ffNO_BUFFERING in file_open_flags, bases and block positions must be sector multiples
+// and transforms are not supported
+uint blockread::Open( char** names, uint _n, qword* _base, uint _bufsize, xchain* _xc ) {
+  uint i;
+  n = Min( _n, uint(DK_MAXF) );
+  bufsize = AlignUp( _bufsize, uint(sector) );
+  maxsize = 0;
+  xc = _xc;
+  for( i=0; i<n; i++ ) { f[i].f=0; buf[i]=mem[i]=0; len[i]=0; base[i]=_base ? _base[i] : 0; ext[i].r=0; ext[i].n=ext[i].na=0; }
+  for( i=0; i<n; i++ ) {
+    if( f[i].open(names[i])==0 ) { Quit(); return 0; }
+    fsize[i] = f[i].size();
+    ext[i].Load( names[i], f[i], fsize[i] );
+    if( fsize[i]>base[i] ) maxsize = Max( maxsize, fsize[i]-base[i] );
+    mem[i] = new byte[bufsize+sector+xchain::PAD];  // Transforms read context around the block
+    buf[i] = (byte*)( AlignUp( uintptr_t(mem[i]), uintptr_t(sector) ) );
+  }
+  return 1;
+}
+
+// Read up to l bytes at pos(+base) from each file; returns longest length read (0 = all at EOF)
+// Files not in mask only get len[] set; their data can be loaded later with Fetch()
+uint blockread::Read( qword pos, uint l, uint mask ) {
+  uint i,r=0;
+  l = Min( l, bufsize );
+  bpos = pos;
+  minlen = l;
+  for( i=0; i<n; i++ ) {
+    len[i] = 0;
+    if( pos+base[i]<fsize[i] ) {
+      len[i] = uint( Min(qword(l),fsize[i]-base[i]-pos) );
+      if( ((mask>>i)&1) && Xform(i) ) {
+        uint rlen;
+        qword r = xc[i].Span( pos+base[i], len[i], fsize[i], &rlen );
+        f[i].seek( r );
+        len[i] = Min( len[i], xc[i].Finish( buf[i], f[i].sread( buf[i], rlen ), r, pos+base[i], fsize[i] ) );
+      } else if( (mask>>i)&1 ) {
+        f[i].seek( pos+base[i] );
+        // Direct reads must cover whole sectors; the tail past len[i] is ignored
+        if( file_open_flags & ffNO_BUFFERING ) len[i] = Min( len[i], f[i].sread( buf[i], AlignUp(len[i],uint(sector)) ) );
+        else len[i] = f[i].sread( buf[i], len[i] );
+      }
+    }
+    minlen = Min( minlen, len[i] );
+    r = Max( r, len[i] );
+  }
+  return r;
+}
+
+// Bytes from pos (up to l) that all files have at the same physical bytes (0 with transforms);
+// such ranges are equal without reading them
+uint blockread::Shared( qword pos, uint l ) {
+  uint i;
+  qword p[DK_MAXF];
+  for( i=0; i<n; i++ ) {
+    if( Xform(i) || (ext[i].n==0) ) return 0;
+    p[i] = pos+base[i];
+  }
+  return uint( SharedLen( ext, n, p, l ) );
+}
+
+// Load part [o,o+l) of the current block for file i (skipped by Read mask)
+void blockread::Fetch( uint i, uint o, uint l ) {
+  f[i].seek( bpos+base[i]+o );
+  f[i].sread( buf[i]+o, l );
+}
+
+// Close handles and free buffers
+void blockread::Quit( void ) {
+  uint i;
+  for( i=0; i<n; i++ ) {
+    if( f[i].f ) f[i].close();
+    f[i].f = 0;
+    delete[] mem[i]; mem[i] = buf[i] = 0;
+    ext[i].Quit();
+  }
+  n = 0;
+}
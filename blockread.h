@@ -0,0 +1,54 @@
+// Block reader for background scanners
+#ifndef BLOCKREAD_H
+#define BLOCKREAD_H
+
+#include "common.h"
+#include "file_win.h"
+#include "diffkern.h"
+#include "xform.h"
+
+// Reads the same range from all compared files into separate buffers
+// Each scanner opens its own handles, so background reads never move the hexfile view caches
+struct blockread {
+  enum{ blklen=1<<20 };  // Default read block size (1MB, same as the hexfile cache)
+  enum{ sector=1<<12 };  // Buffer alignment and read granularity for ffNO_BUFFERING handles
+
+  filehandle0 f[DK_MAXF];  // Private file handles
+  qword fsize[DK_MAXF];    // File sizes
+  qword base[DK_MAXF];     // Base offsets: block position pos is read at pos+base[i] in file i
+  xchain* xc;              // Transform chains of the files (0 = none); applied by Read()
+  byte* buf[DK_MAXF];      // Block buffers (bufsize bytes each, sector-aligned)
+  byte* mem[DK_MAXF];      // Allocations behind buf[]
+  uint  bufsize;           // Largest block Read() can return
+  uint  len[DK_MAXF];      // Bytes read into buf[i] by last Read()
+  uint  n;                 // Number of files
+  uint  minlen;            // Shortest length read by last Read() (all files have data below it)
+  qword maxsize;           // Largest file size past its base offset (scan range)
+  qword bpos;              // Block position of last Read()
+  extentmap ext[DK_MAXF];  // Physical layouts (files without one share nothing)
+
+  // Open files by name, with optional base offsets, block size and transform chains (one per file);
+  // returns 0 if any file can't be opened
+  // With ffNO_BUFFERING in file_open_flags, bases and block positions must be sector multiples
+  // and transforms are not supported
+  uint Open( char** names, uint _n, qword* _base=0, uint _bufsize=blklen, xchain* _xc=0 );
+
+  // File i has a transform chain (its data differs from the raw file)
+  uint Xform( uint i ) { return xc && xc[i].n; }
+
+  // Read up to l bytes at pos(+base) from each file; returns longest length read (0 = all at EOF)
+  // Files not in mask only get len[] set; their data can be loaded later with Fetch()
+  uint Read( qword pos, uint l, uint mask=-1 );
+
+  // Bytes from pos (up to l) that all files have at the same physical bytes (0 with transforms);
+  // such ranges are equal without reading them
+  uint Shared( qword pos, uint l );
+
+  // Load part [o,o+l) of the current block for file i (skipped by Read mask; not for transformed files)
+  void Fetch( uint i, uint o, uint l );
+
+  // Close handles and free buffers
+  void Quit( void );
+};
+
+#endif // BLOCKREAD_H
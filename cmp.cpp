@@ -32,6 +32,22 @@
 #include "config.h"
 #include "libterminal.h"
 #include "search.h"
+#include "minimap.h"
+#include "align.h"
+#include "stats.h"
+#include "typecmp.h"
+#include "bitshift.h"
+#include "sample.h"
+#include "treecmp.h"
+#include "minhash.h"
+#include "dedup.h"
+#include "patch.h"
+#include "manifest.h"
+#include "reloc.h"
+#include "record.h"
+#include "linediff.h"
+#include "execfmt.h"
+#include "batch.h"
 
 // Help text with ~ markers for highlighting (~ toggles between normal and highlighted colors)
 char helptext[] =
@@ -40,9 +56,11 @@ char helptext[] =
 "~Tab~ = Select a file; Navigation keys only apply to selected file\n"
 "~Ctrl~-~left~/~right~ = Change row width; ~Ctrl~-~up~/~down~ = Change row number\n"
 "~Space~,~F6~ = Skip to next difference; any key = stop\n"
+"~'E'~ = End of difference run; ~'N'~ = Next equal region after a difference\n"
 "~'+'~/~'-'~ = Change font size; ~Ctrl~-~'+'~/~'-'~ = Change font height\n"
 "~Alt~-~'+'~/~'-'~ = Change font width; ~'C'~ = Change font\n"
 "~Escape~ = Quit; ~'S'~= Save GUI config; ~'L'~ = Load config\n"
+"~'M'~ = Toggle difference overview; ~Click~ overview = Jump to region\n"
 ;
 
 enum{ N_VIEWS=8 };  // Maximum number of files to compare simultaneously
@@ -70,51 +88,467 @@ uint f_started = 0;           // First-time initialization flag (prevents re-ini
 volatile uint f_busy = 0;     // Background difference scan in progress flag
 volatile uint f_need_restart = 0;  // Flag to trigger restart from terminal commands
 
+diffmap dmap;                 // Difference density pyramid for the overview column
+MapScan mapscan;              // Background scan feeding dmap
+uint map_X, map_W;            // Overview column position and width in pixels
+blockhash F_hash[N_VIEWS];    // Per-file 64KB block hashes (sidecar or filled by mapscan)
+extentmap F_ext[N_VIEWS];     // Per-file physical layouts (shared extents are equal without reading)
+segmap amap;                  // Piecewise offset map between files (nseg=0: alignment off)
+AlignScan alignscan;          // Background scan building amap
+LineScan linescan;            // Line diff building amap instead (map set = line mode)
+sectmap F_sec;                // ELF/PE sections matched by name (n set = section mode, amap built from it)
+SectionScan secscan;          // Section by section compare filling F_sec
+diffstats dstat;              // Difference statistics of the last "stats" range
+StatScan statscan;            // Background scan filling dstat
+samplestats dsample;          // Estimate of the last "sample" range
+SampleScan samplescan;        // Background readers filling dsample
+treecmp F_tree;               // Matched files of the last "tree" roots
+TreeScan treescan;            // Background walk and compare filling F_tree
+int F_treesel = -1;           // Tree entry shown in the views (-1 = command-line files)
+char F_path[N_VIEWS][treecmp::PATHLEN];  // Names of files opened from the tree list
+simfiles F_sim;               // Near-duplicate clusters of the last "cluster" directory
+ClusterScan clusterscan;      // Background signatures and grouping filling F_sim
+dedupstats F_dedup;           // Chunk dedup report of the open files
+DedupScan dedupscan;          // Background chunking and merge filling F_dedup
+uint F_dedupview;             // Mark bytes in chunks not seen elsewhere instead of differences
+PatchExport patchexport;      // Background BPS patch export of the last "export patch"
+manifest F_mft;               // Block manifest being made or checked against
+ManifestScan mftscan;         // Background hashing for F_mft
+diffmap F_mftmap;             // Differing blocks of the manifest check for the overview column
+int F_mftfile = -1;           // File checked against F_mft (-1 = overview shows differences)
+ignoremask F_ign;             // Ranges past the base offsets excluded from comparison
+typemode F_type;              // Element type and tolerance (T_BYTE = byte compare)
+relocmap F_rel;               // Relocation deltas of the R32/R64 types
+RelocScan relscan;            // Background detection filling F_rel
+recordfmt F_rec;              // Record layout of the "record" command (rsize 0 = off)
+recordstats F_rstat;          // Per-field results of the last record scan
+RecordScan recscan;           // Record scan filling F_rstat
+RecordScan recfind;           // Search for the next record with a differing field
+uint F_cons;                  // Consensus mode: mark only files that disagree with the majority byte
+int F_base3 = -1;             // Three-way mode: base view (-1 = off); of the other two views the first is A, then B
+uint F_stop3;                 // Three-way: classes Space/F6 stop at (all C3_* bits of it set; 0 = any change)
+bitalign balign;              // Bit offsets found by the last "bitshift detect"
+BitScan bitscan;              // Background scan filling balign
+xchain F_xc[N_VIEWS];         // Transform chain per file, applied before comparison
+uint F_minrun = 1;            // Space/F6 skips difference runs shorter than this
+uint F_minsame = 16;          // Equal bytes that end a difference region for the 'N' key
+uint F_setgen;                // Bumped when comparison settings change (ignore ranges, type, consensus)
+
+// Inputs of the screen difference mask: it is recomputed only when one of them changes
+struct diffkey {
+  qword pos[N_VIEWS];   // View positions
+  qword base[N_VIEWS];  // Base offsets (ignore ranges are past them)
+  uint  gen[N_VIEWS];   // Cache loads (window moves, bit offset and transform changes)
+  uint  num, textlen;   // Files and bytes per screen
+  uint  setgen;         // Comparison settings
+  uint  nseg;           // Alignment segments
+  uint  dedup;          // Dedup marks shown (view on and results ready)
+  qword ascan;          // Alignment scan frontier (segments grow while it moves)
+};
+byte* F_diff;                 // Screen difference mask shared by the views: bit i set where file i is marked
+byte* F_pal;                  // Screen mark palettes shared by the views (three-way classes)
+byte* F_keep;                 // Screen keep mask scratch (ignored and tolerance-equal bytes), reused by each recompute
+diffkey F_dkey;               // Inputs F_diff was computed from
+
+// Collect base offsets of all views
+void GetBases( qword* base ) {
+  uint i;
+  for( i=0; i<F_num; i++ ) base[i] = F[i].base;
+}
+
+// Set all views to position pos past their base offsets
+void SetViewPos( sqword pos ) {
+  uint i;
+  for( i=0; i<F_num; i++ ) F[i].SetFilepos( qword( Max( pos+sqword(F[i].base), 0LL ) ) );
+}
+
+// (Re)start the overview scan with the current base offsets
+void StartMapScan( void ) {
+  qword base[N_VIEWS];
+  GetBases( base );
+  statscan.stop();  // Reads dmap bins
+  samplescan.stop();
+  mapscan.stop();
+  mapscan.start( dmap, F_names, F_num, F_hash, base, &F_ign, &F_type, F_xc );
+}
+
+// Clear difference marks of ignored bytes in all views; returns number of marks cleared
+// Each view is masked at its own positions past its base offset.
+uint MaskDiffs( void ) {
+  uint i,r=0;
+  qword p,q,e;
+  for( i=0; i<F_num; i++ ) {
+    if( F[i].F1pos+F[i].textlen<=F[i].base ) continue;  // View is before the base offset
+    p = (F[i].F1pos>F[i].base) ? F[i].F1pos-F[i].base : 0;
+    e = F[i].F1pos+F[i].textlen-F[i].base;
+    for( q=F_ign.Next(p); q<e; q=F_ign.Next(q+1) ) {
+      byte& d = F_diff[ uint(q+F[i].base-F[i].F1pos) ];
+      r += (d>>i)&1; d &= ~(1<<i);
+    }
+  }
+  return r;
+}
+
+// Element at column j of the views (j<0: starts above the view) is within tolerance in all files
+// Returns 0 if part of it is not cached or past EOF in some file
+uint ElemEqual( sqword j ) {
+  uint i,k,c,s=F_type.Size();
+  byte e[N_VIEWS][8];
+  byte* ep[N_VIEWS];
+  for( i=0; i<F_num; i++ ) {
+    for( k=0; k<s; k++ ) {
+      c = F[i].filedata( F[i].F1pos+j+k );
+      if( c==(uint)-1 ) return 0;
+      e[i][k] = c;
+    }
+    ep[i] = e[i];
+  }
+  return TypeEqual( ep, F_num, F_type, F[0].F1pos-F[0].base+j );
+}
+
+// Keep mask of len bytes from the view tops: ignore ranges of view 0 and tolerance-equal elements cleared
+// p = view data of all files when whole screens are cached (elements are then masked by the SSE2 kernels)
+// Returns 0 if nothing is masked (keep is not filled then)
+uint ScreenKeep( byte* keep, byte** p, uint len ) {
+  uint i,h,t,s,r=0;
+  sqword j;
+  byte* q[N_VIEWS];
+  qword vpos = F[0].F1pos-F[0].base;  // Wraps if the view starts before the base
+  if( (F[0].F1pos>=F[0].base) && (F_ign.Next(vpos)<vpos+len) ) { F_ign.Fill( vpos, keep, len ); r=1; }
+  if( F_type.type && (F_num>1) ) {
+    if( r==0 ) { memset( keep, 0xFF, len ); r=1; }
+    s = F_type.Size();
+    h = Min( uint( (0-vpos) & (s-1) ), len );  // Start of the first whole element (elements start at the base)
+    t = p ? (len-h)/s*s : 0;  // Whole elements for the kernel
+    if( t ) {
+      for( i=0; i<F_num; i++ ) q[i] = p[i]+h;
+      TypeMask( q, F_num, t, F_type, keep+h, vpos+h );
+    }
+    // Elements cut by the screen edges, or all of them without cached screens
+    for( j=sqword(h)-sqword(h ? s : 0); j<sqword(len); j+=s ) {
+      if( (j==sqword(h)) && t ) { j += t-s; continue; }
+      if( ElemEqual(j) ) memset( keep+Max(j,0LL), 0, uint( Min(j+s,sqword(len))-Max(j,0LL) ) );
+    }
+  }
+  return r;
+}
+
+// End of the run of 64KB blocks from pos (past base offsets) on where all files have known, equal block hashes
+// Returns pos if the block at pos is not known to be equal; base offsets must be multiples of the block size
+qword HashSkip( qword pos ) {
+  uint i;
+  qword b,bi;
+  for( i=0; i<F_num; i++ ) if( F[i].base & (blockhash::hblk-1) ) return pos;
+  for( b=pos>>blockhash::hbits; ; b++ ) {
+    for( i=0; i<F_num; i++ ) {
+      bi = b + (F[i].base>>blockhash::hbits);
+      if( (F_hash[i].leaf==0) || (bi>=F_hash[i].known) ) break;
+      if( (bi+1)*blockhash::hblk>F_hash[i].fsize ) break;  // Partial last block: leave to byte compare
+      if( F_hash[i].leaf[bi]!=F_hash[0].leaf[b+(F[0].base>>blockhash::hbits)] ) break;
+    }
+    if( i<F_num ) break;
+  }
+  return Max( pos, b<<blockhash::hbits );
+}
+
+// Bytes from the view tops that all files have at the same physical bytes (reflinks, block clones)
+qword ExtentSkip( void ) {
+  uint i;
+  qword p[N_VIEWS];
+  for( i=0; i<F_num; i++ ) {
+    if( (F_ext[i].n==0) || (F[i].F1pos>=F[i].F1size) ) return 0;
+    p[i] = F[i].F1pos;
+  }
+  return SharedLen( F_ext, F_num, p, ~0ULL );
+}
+
+// Move views 1..F_num-1 to the positions paired with the top of view 0
+void SyncViews( void ) {
+  uint i;
+  for( i=1; i<F_num; i++ ) F[i].SetFilepos( amap.Map( 0, F[0].F1pos, i ) );
+}
+
+// Mark differences between aligned views; returns number of differing bytes in all views
+// A byte differs if some other file has no byte paired with it (inserted data) or a different one
+uint AlignedDiffs( void ) {
+  uint i,j,k,m,x,d,r=0;
+  qword q,o;
+  bzero( F_diff, F[0].textlen );
+  for( i=0; i<F_num; i++ ) {
+    k = amap.Find( i, F[i].F1pos );
+    for( j=0; j<F[i].textlen; j++ ) {
+      q = F[i].F1pos+j;
+      while( (k+1<amap.nseg) && (amap.Pos(k+1,i)<=q) ) k++;
+      x = F[i].viewdata(j);
+      o = q - amap.Pos(k,i);  // Offset within segment
+      for( d=0,m=0; (x!=(uint)-1) && (d==0) && (m<F_num); m++ ) if( m!=i ) {
+        if( o>=amap.End(k,m)-amap.Pos(k,m) ) d=1;
+        else d = (F[m].filedata(amap.Pos(k,m)+o)!=x);
+      }
+      F_diff[j] |= d<<i; r+=d;
+    }
+  }
+  return r;
+}
+
+// Three-way mode is on (and there are 3 files)
+uint ThreeWay( void ) { return (F_base3>=0) && (F_num==3); }
+
+// Three-way views: base o, A and B (the other two views in order); returns 0 if three-way mode is off
+uint Views3( uint& o, uint& a, uint& b ) {
+  o = a = b = 0;
+  if( ThreeWay()==0 ) return 0;
+  o = F_base3; a = (o==0) ? 1 : 0; b = (o==2) ? 1 : 2;
+  return 1;
+}
+
+// Three-way marks of the screen: the base is marked where A or B changed, A and B where they changed,
+// all with the palette of the position's class in F_pal
+void ThreeWayDiffs( void ) {
+  // Palette of each class (C3_* bits; classes with a single bit can't occur)
+  static const byte pal3[8] = { pal_Hex, pal_Hex, pal_Hex, pal_ChgBoth, pal_Hex, pal_ChgA, pal_ChgB, pal_Conflict };
+  uint i,j,c,f,o,a,b,flag,len=F[0].textlen,x[N_VIEWS];
+  byte* p[N_VIEWS];
+  Views3( o, a, b );
+  byte* keep = F_keep;
+  for(flag=1,i=0;i<F_num;i++) {
+    p[i] = F[i].databuf + uint(F[i].F1pos-F[i].databeg);
+    flag &= (F[i].viewbeg==F[i].F1pos) && (F[i].viewend==F[i].F1pos+len);
+  }
+  if( flag ) {
+    f = ScreenKeep( keep, p, len );
+    Classify3( p[o], p[a], p[b], len, F_pal, f ? keep : 0 );
+  } else {
+    for( j=0; j<len; j++ ) {
+      for( i=0; i<F_num; i++ ) x[i] = F[i].viewdata(j);
+      F_pal[j] = Class3Bits( x[o], x[a], x[b] );  // Bytes past EOF are changes
+    }
+    if( ScreenKeep( keep, 0, len ) ) for( j=0; j<len; j++ ) if( keep[j]==0 ) F_pal[j]=0;
+  }
+  for( j=0; j<len; j++ ) {
+    c = F_pal[j];
+    F_diff[j] = ((c!=0)<<o) | (((c&C3_A)!=0)<<a) | (((c&C3_B)!=0)<<b);
+    F_pal[j] = pal3[c];
+  }
+  for( i=0; i<F_num; i++ ) F[i].palbuf = F_pal;
+}
+
+// Mark differences of the screen in F_diff (consensus mode: only files that disagree with the majority)
+// Skipped while the views, their caches and the comparison settings are unchanged, so idle repaints are free
+void ScreenDiffs( void ) {
+  uint i,j,c,d,f,flag,len=F[0].textlen,x[N_VIEWS];
+  byte* p[N_VIEWS];
+  diffkey k;
+  bzero( k );
+  k.num = F_num; k.textlen = len; k.setgen = F_setgen;
+  k.nseg = amap.nseg; k.ascan = amap.nseg ? amap.scanned : 0;
+  k.dedup = F_dedupview && F_dedup.f_done;
+  for( i=0; i<F_num; i++ ) { k.pos[i] = F[i].F1pos; k.base[i] = F[i].base; k.gen[i] = F[i].gen; }
+  if( memcmp( &k, &F_dkey, sizeof(k) )==0 ) return;
+  F_dkey = k;
+  for( i=0; i<F_num; i++ ) F[i].palbuf = 0;  // Plain marks unless three-way
+
+  if( k.dedup ) {
+    // Dedup view: each file is marked where its chunk occurs nowhere else, at any position
+    for( j=0; j<len; j++ ) for( F_diff[j]=0,i=0; i<F_num; i++ ) F_diff[j] |= F_dedup.Unique( i, F[i].F1pos+j )<<i;
+    MaskDiffs();
+    return;
+  }
+
+  if( amap.nseg ) {
+    AlignedDiffs();
+    MaskDiffs();
+    return;
+  }
+
+  if( ThreeWay() ) {
+    ThreeWayDiffs();
+    MaskDiffs();
+    return;
+  }
+
+  // Whole screen cached in all files: SIMD kernels
+  byte* keep = F_keep;
+  for(flag=1,i=0;i<F_num;i++) {
+    p[i] = F[i].databuf + uint(F[i].F1pos-F[i].databeg);
+    flag &= (F[i].viewbeg==F[i].F1pos) && (F[i].viewend==F[i].F1pos+len);
+  }
+  if( flag ) {
+    f = ScreenKeep( keep, p, len );  // Ignored bytes and tolerance-equal elements are not marked
+    if( F_cons ) Consensus( p, F_num, len, F_diff, f ? keep : 0 );
+    else DiffMask( p, F_num, len, F_diff, f ? keep : 0 );
+  } else {
+    for( j=0; j<len; j++ ) {
+      c=0; d=(uint)-1;
+      for(i=0;i<F_num;i++) {
+        x[i] = F[i].viewdata(j);
+        if( x[i]!=(uint)-1 ) c|=x[i],d&=x[i];
+      }
+      // Mark position as different if not all files have same byte (files past EOF are marked)
+      if( F_cons ) F_diff[j] = ConsensusBits( x, F_num );
+      else for(F_diff[j]=0,i=0;i<F_num;i++) F_diff[j] |= ((c!=x[i])||(d!=x[i]))<<i;
+    }
+    if( ScreenKeep( keep, 0, len ) ) for( j=0; j<len; j++ ) if( keep[j]==0 ) F_diff[j]=0;
+  }
+  MaskDiffs();  // Ignored bytes are never marked
+}
+
 // Background thread for scanning to next difference (Space/F6 key)
-// Scans forward through files looking for next byte that differs
+// Scans forward through files looking for next byte that differs, or for the ends of difference runs
 struct DiffScan : thread<DiffScan> {
 
   typedef thread<DiffScan> base;
 
+  // What to stop at
+  enum {
+    SCAN_DIFF=0,  // Next difference run of at least F_minrun bytes (Space/F6)
+    SCAN_RUNEND,  // End of the current difference run: first equal byte after it
+    SCAN_SYNC     // Next region after a difference where files are equal for at least F_minsame bytes
+  };
+
+  uint  mode;     // Stop condition
+  uint  st;       // Type of the open run (0 = equal, 1 = different, 2 = none yet)
+  uint  seen;     // A difference was passed
+  qword rbeg;     // Start of the open run (distance from the scan origin)
+  qword rlen;     // Length of the open run
+  qword target;   // Stop position (distance from the scan origin), -1 until found
+
   // Start thread and set busy flag
-  uint start( void ) {
+  uint start( uint _mode=SCAN_DIFF ) {
+    mode=_mode;
     f_busy=1;  // Signal that scan is in progress
     return base::start();  // Start background thread
   }
 
-  // Thread function - scans forward until difference or EOF
+  // Add n bytes of type t (0 = equal, 1 = different) at distance at from the scan origin;
+  // sets target when the stop condition is met (runs are fed in order, in pieces of any size)
+  void Add( uint t, qword at, qword n ) {
+    if( n==0 ) return;
+    if( t!=st ) {
+      if( (t==0) && seen && (mode==SCAN_RUNEND) ) { target=at; return; }
+      st=t; rbeg=at; rlen=0;
+      seen |= t;
+    }
+    rlen += n;
+    if( t && (mode==SCAN_DIFF) && (rlen>=F_minrun) ) target=rbeg;
+    if( !t && seen && (mode==SCAN_SYNC) && (rlen>=F_minsame) ) target=rbeg;
+  }
+
+  // Length of the run of type t (0 = equal, 1 = different) at the start of q[0..F_num-1]
+  // With the consensus file odd>=0, only its disagreements count as different (single bytes);
+  // in three-way mode with F_stop3 set, only positions of those change classes
+  uint RunLen( uint t, byte** q, uint l, byte* keep, int odd ) {
+    uint o,a,b;
+    if( F_stop3 && Views3( o, a, b ) ) {
+      return t ? Class3Miss( q[o], q[a], q[b], l, F_stop3, keep ) : Class3First( q[o], q[a], q[b], l, F_stop3, keep );
+    }
+    if( t==0 ) return (odd>=0) ? OutlierFirst( q, F_num, l, odd, keep ) : DiffFirst( q, F_num, l, keep );
+    return (odd>=0) ? 1 : SameFirst( q, F_num, l, keep );
+  }
+
+  // Thread function - scans forward until the stop condition or EOF
   void thread( void ) {
-    uint c,i,j,d,x[N_VIEWS],ff_num,delta,flag;
-    qword pos_delta=0;  // Total distance scanned
+    uint c,i,j,d,o,t,x[N_VIEWS],ff_num,flag,f_ign,L,vo,va,vb;
+    qword cur=0;  // Distance of the view tops from the scan origin
+    byte* p[N_VIEWS];
+    byte* q[N_VIEWS];
+
+    // Aligned mode: step view 0 by screens, keeping the other views paired with it (next difference only)
+    if( amap.nseg ) {
+      while( f_busy && (mode==SCAN_DIFF) && (F[0].F1pos+F[0].textlen<F[0].F1size) ) {
+        F[0].MoveFilepos(F[0].textlen);
+        SyncViews();
+        d = AlignedDiffs();
+        if( d>MaskDiffs() ) break;  // Differences left after masking
+      }
+      f_busy=0;
+      DisplayRedraw();
+      return;
+    }
 
-    // Start scanning from next screen (skip current view)
-    for(i=0;i<F_num;i++) F[i].MoveFilepos(F[0].textlen);
+    // Next difference starts from next screen (skip current view); run ends and resyncs from the view top
+    if( mode==SCAN_DIFF ) for(i=0;i<F_num;i++) F[i].MoveFilepos(F[0].textlen);
+    byte* keep = new byte[hexfile::datalen];  // Mask of compared bytes
+    // Consensus mode: stop where the selected file disagrees (single differences only)
+    int odd = (F_cons && (F_num>2) && (mode==SCAN_DIFF) && (F_minrun<=1) && (F_base3<0)) ? lf.cur_view : -1;
+    uint f_cls = Views3( vo, va, vb ) && F_stop3;  // Three-way: stop at the F_stop3 classes only
+    st=2; seen=0; rbeg=rlen=0; target=~0ULL;
 
     // Continue scanning while not cancelled by user
-    while( f_busy ) {
-      delta=0;  // Count of matching bytes in current view
+    while( f_busy && (target==~0ULL) ) {
+      // Skip whole screens covered by blocks with equal hashes or stored at the same physical bytes
+      // in all files (no reads needed; hashes are of unshifted bits)
+      for(flag=1,i=0;i<F_num;i++) flag &= F[i].Raw();
+      if( flag && (F_num>1) && (odd<0) ) {
+        qword pos = F[0].F1pos-F[0].base;
+        qword skip = ExtentSkip();
+        for(i=1;i<F_num;i++) if( F[i].F1pos-F[i].base!=pos ) break;
+        if( i>=F_num ) skip = Max( skip, HashSkip( pos ) - pos );  // Hash blocks pair up at equal positions only
+        skip = Min( skip, qword(1<<30) );  // MoveFilepos takes int
+        if( skip>=F[0].textlen ) {
+          skip -= skip % F[0].BX;  // Keep row alignment
+          Add( 0, cur, skip );
+          if( target!=~0ULL ) break;
+          for(i=0;i<F_num;i++) F[i].MoveFilepos(skip);
+          cur += skip;
+          continue;
+        }
+      }
+
+      // Part of the caches from the view tops on that all files have: runs are walked with the kernels
+      for(L=hexfile::datalen,i=0;i<F_num;i++) {
+        if( (F[i].F1pos<F[i].databeg) || (F[i].F1pos>=F[i].dataend) ) L=0;
+        else L = Min( L, uint(F[i].dataend-F[i].F1pos) );
+        p[i] = F[i].databuf + uint(F[i].F1pos-F[i].databeg);
+      }
+      if( L>=F[0].textlen ) {
+        // Ignored bytes and tolerance-equal elements count as matching
+        f_ign = ScreenKeep( keep, p, L );
+        for( o=0; (o<L) && (target==~0ULL); o+=d ) {
+          for(i=0;i<F_num;i++) q[i] = p[i]+o;
+          t = (st==1);  // Try to extend the open run first
+          d = RunLen( t, q, L-o, f_ign ? keep+o : 0, odd );
+          if( d==0 ) t^=1, d = RunLen( t, q, L-o, f_ign ? keep+o : 0, odd );
+          Add( t, cur+o, d );
+        }
+        if( target!=~0ULL ) break;
+        for(i=0;i<F_num;i++) F[i].MoveFilepos(L);
+        cur += L;
+        continue;
+      }
+
+      // Screen not cached in all files (EOF or shifted caches): byte by byte
       ff_num=0;  // Initialize EOF file count
+      f_ign = ScreenKeep( keep, 0, F[0].textlen );
       // Check each byte in current view
-      for( j=0; j<F[0].textlen; j++ ) {
+      for( j=0; (j<F[0].textlen) && (target==~0ULL); j++ ) {
         c=0; d=-1;
         // Compare this byte across all files
-        for(i=0;i<F_num;i++) {
+        for(ff_num=0,i=0;i<F_num;i++) {
           x[i] = F[i].viewdata(j);      // Get byte from file i
           ff_num += (x[i]==(uint)-1);   // Count how many files are at EOF
           if( x[i]!=(uint)-1 ) c|=x[i],d&=x[i];  // Accumulate OR and AND of all bytes
         }
+        // Stop if all files at EOF
+        if( ff_num>=F_num ) break;
         // Check if all files have same value (c==x[i] && d==x[i] means all bits match)
         for(flag=1,i=0;i<F_num;i++) flag &= ((c==x[i])&&(d==x[i]));
-        delta += flag;  // Count matching bytes
+        if( odd>=0 ) flag = ((ConsensusBits(x,F_num)>>odd)&1)==0;  // Only the selected file's disagreements stop
+        if( f_cls ) flag = (Class3Bits( x[vo], x[va], x[vb] )&F_stop3)!=F_stop3;
+        if( f_ign ) flag |= (keep[j]==0);
+        Add( !flag, cur+j, 1 );
       }
+      if( (target!=~0ULL) || (ff_num>=F_num) ) break;
+      // Continue to next screen
+      for(i=0;i<F_num;i++) F[i].MoveFilepos(F[0].textlen);
+      cur += F[0].textlen;
+    }
+    delete[] keep;
 
-      // Stop if all files at EOF
-      if( ff_num>=F_num ) break;
-      pos_delta += delta;
-      // Stop if found difference (delta < textlen means some bytes didn't match)
-      if( delta<F[0].textlen ) break;
-      // Continue to next screen (all bytes matched)
-      for(i=0;i<F_num;i++) F[i].MoveFilepos(delta);
+    // Next difference: screen containing it (screens step from the scan origin); run ends and resyncs: its row on top
+    if( target!=~0ULL ) {
+      target -= target % ((mode==SCAN_DIFF) ? F[0].textlen : F[0].BX);
+      for(i=0;i<F_num;i++) F[i].MoveFilepos( int(sqword(target-cur)) );
     }
 
     f_busy=0;           // Clear busy flag
@@ -126,6 +560,61 @@ struct DiffScan : thread<DiffScan> {
 
 DiffScan diffscan;  // Global difference scanner thread
 
+// Replace the compared files (tree drill-down), views at pos; the GUI restarts on the next timer tick
+// Scans and per-file settings (base and bit offsets, transforms, alignment) are reset; ignore ranges and type stay.
+// Returns 0 if a file can't be opened (the old files stay open then)
+uint OpenFiles( char** names, uint n, qword pos ) {
+  uint i;
+  filehandle0 t;
+  for( i=0; i<n; i++ ) {
+    if( t.open( names[i] )==0 ) return 0;
+    t.close();
+  }
+
+  if( f_busy ) { f_busy=0; diffscan.quit(); }
+  statscan.stop();
+  samplescan.stop();
+  dedupscan.stop();
+  F_dedup.Quit();
+  mftscan.stop();
+  F_mftfile = -1;
+  bitscan.stop();
+  alignscan.stop();
+  linescan.stop();
+  secscan.stop();
+  F_sec.Quit();
+  amap.Quit();
+  mapscan.stop();
+  relscan.stop();
+  F_rel.Quit();
+  recscan.stop();
+  recfind.stop();
+  bzero( F_rstat );
+  if( F_type.type>=typemode::T_R32 ) bzero( F_type );  // Deltas belong to the old files
+  balign.Quit();
+  dstat.Quit();
+  for( i=0; i<F_num; i++ ) { F[i].F1.close(); F_hash[i].Quit(); F_ext[i].Quit(); F_xc[i].n=0; }
+  for( i=n; i<F_num; i++ ) { tb[i].Quit(); tb[i].text=0; }  // Views no longer shown
+
+  for( i=0; i<n; i++ ) {
+    if( names[i]!=F_path[i] ) strncpy( F_path[i], names[i], sizeof(F_path[i])-1 );
+    F_names[i] = F_path[i];
+    F[i].Open( F_names[i] );
+    F[i].F1pos = pos;
+    if( F[i].F1size>0xFFFFFFFFU ) lf.f_addr64=hexfile::f_addr64;
+    qword mt = F[i].F1.mtime();
+    if( F_hash[i].Load( F_names[i], F[i].F1size, mt )==0 ) F_hash[i].Init( F[i].F1size, mt );
+    F_ext[i].Load( F_names[i], F[i].F1, F[i].F1size );
+  }
+  F_num = n;
+  if( lf.cur_view>=int(F_num) ) lf.cur_view = -1;
+  F_base3 = -1;
+  F_setgen++;
+  StartMapScan();
+  f_need_restart = 1;
+  return 1;
+}
+
 // Search functionality using Search0 from search.h
 struct SearchScan {
   Search0<256> searcher;  // Pattern searcher with 256-byte capacity
@@ -272,6 +761,27 @@ bool TerminalCommandHandler(Terminal* term, const char* cmd) {
                   "  g <file>,<addr>  - Go to address in specific file\n"
                   "  s <pattern>      - Search for pattern in file 0 (or selected file)\n"
                   "  s# <pattern>     - Search for pattern in file # (0-based index)\n"
+                  "  align <file>,<ofs> - Set base offset of file (+/-<ofs> = relative)\n"
+                  "  resync [KB|off]  - Align files across insertions/deletions\n"
+                  "  lines [next|off] - Line diff of 2 text files, views follow the hunks\n"
+                  "  sections [nodebug|next|off] - ELF/PE sections matched by name, views aligned per section\n"
+                  "  stats [<beg>,<end>|all|hist [N]|bits|off] - Difference statistics\n"
+                  "  sample [<beg>,<end>|all|off] - Quick similarity estimate from random blocks\n"
+                  "  tree [-c] <dir> <dir>... - Compare directory trees; tree [list|<N>|next|off]\n"
+                  "  cluster <dir> [<sim>] - Group near-duplicate files; cluster [list|open <C>|off]\n"
+                  "  dedup [marks on|off|all|off] - Shared/unique chunks of the open files\n"
+                  "  export patch [<N>] <file> - Write a BPS patch turning file 0 into file N\n"
+                  "  manifest [make|check] [<N>] <file> - Block hash manifest; manifest [next|off]\n"
+                  "  ignore <ofs>,<len>[,<stride>] - Exclude range from comparison\n"
+                  "  ignore load <file> | off - Load ranges from file, or clear them\n"
+                  "  type <t>[be] [<tol>|<N>ulp] - Compare elements (i16/i32/i64/f32/f64), off = bytes\n"
+                  "  reloc 32|64[be] [<KB>] | <file> <delta> [<beg>,<end>] | off - Words equal up to relocation\n"
+                  "  record <size> [<layout>] | next [<field>] | off - Fixed-size records, per-field differences\n"
+                  "  consensus [on|off] - Mark only files disagreeing with the majority\n"
+                  "  threeway [<base>|stop conflict|a|b|any|off] - Changes of 2 files vs a base\n"
+                  "  bitshift [detect|apply|<file> <bits>|off] - Bit-shifted files\n"
+                  "  xform [<file> <steps>|<file> off] - Transform before compare\n"
+                  "  run [min <N>|sync <M>] - Minimum difference run for Space, equal run for 'N'\n"
                   "Pattern syntax: \"text\", 0xHH (hex), 123 (decimal), ? (wildcard)\n"
                   "Keys: Ctrl-E = Repeat last command");
     return true;
@@ -296,158 +806,1829 @@ bool TerminalCommandHandler(Terminal* term, const char* cmd) {
         DWORD len = GetFullPathNameA(F_names[i], sizeof(fullpath), fullpath, NULL);
         const char* path_to_display = (len == 0 || len >= sizeof(fullpath)) ? F_names[i] : fullpath;
 
-        // Calculate available width: terminal cols - "N: " prefix (3 chars for single digit + ": ")
-        int prefix_len = snprintf(buf, sizeof(buf), "%u: ", i);
-        int max_path_width = term->cols - prefix_len;
-        if( max_path_width < 10 ) max_path_width = 10;  // Minimum reasonable width
+        // Calculate available width: terminal cols - "N: " prefix (3 chars for single digit + ": ")
+        int prefix_len = snprintf(buf, sizeof(buf), "%u: ", i);
+        int max_path_width = term->cols - prefix_len;
+        if( max_path_width < 10 ) max_path_width = 10;  // Minimum reasonable width
+
+        // Truncate path to fit terminal width
+        TruncatePath(truncated, path_to_display, max_path_width);
+        snprintf(buf, sizeof(buf), "%u: %s", i, truncated);
+        term->AddLine(buf);
+      }
+    }
+    return true;
+  }
+
+  // Parse "h" command: set terminal height
+  if( cmd[0] == 'h' && (cmd[1] == ' ' || cmd[1] == '\t') ) {
+    const char* arg = cmd + 2;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+    if( *arg == 0 ) {
+      sprintf(buf, "Current terminal height: %u rows", terminal_SY);
+      term->AddLine(buf);
+      term->AddLine("Usage: h <height> - Set terminal height in rows (symbols)");
+      return true;
+    }
+
+    // Parse height
+    int new_height = 0;
+    sscanf(arg, "%d", &new_height);
+
+    if( new_height < 2 || new_height > 100 ) {
+      term->AddLine("Error: height must be between 2 and 100 rows");
+      return true;
+    }
+
+    terminal_SY = new_height;
+    sprintf(buf, "Terminal height set to %u rows. Restarting...", terminal_SY);
+    term->AddLine(buf);
+    f_need_restart = 1;  // Trigger restart to apply changes
+    return true;
+  }
+
+  // Parse "s" command: search for pattern
+  // Syntax: "s <pattern>" or "s# <pattern>" where # is file index
+  if( cmd[0] == 's' && (cmd[1] == ' ' || cmd[1] == '\t' || (cmd[1] >= '0' && cmd[1] <= '9')) ) {
+    // Parse file number if present
+    int file_num = -1;  // -1 means use current selection or file 0
+    const char* pattern_start = cmd + 1;
+
+    if( cmd[1] >= '0' && cmd[1] <= '9' ) {
+      // Parse file index
+      sscanf(cmd + 1, "%d", &file_num);
+
+      if( file_num < 0 || file_num >= (int)F_num ) {
+        sprintf(buf, "Error: file number must be 0-%d", F_num-1);
+        term->AddLine(buf);
+        return true;
+      }
+
+      // Skip to pattern (find first space/tab after number)
+      pattern_start = cmd + 1;
+      while( *pattern_start >= '0' && *pattern_start <= '9' ) pattern_start++;
+      if( *pattern_start != ' ' && *pattern_start != '\t' ) {
+        term->AddLine("Usage: s <pattern> or s# <pattern>");
+        term->AddLine("  # = file index (0-based)");
+        term->AddLine("  pattern = search pattern (UTF-8 string)");
+        return true;
+      }
+    }
+
+    // Skip whitespace to get to pattern
+    while( *pattern_start == ' ' || *pattern_start == '\t' ) pattern_start++;
+
+    if( *pattern_start == 0 ) {
+      term->AddLine("Usage: s <pattern> or s# <pattern>");
+      term->AddLine("  # = file index (0-based)");
+      term->AddLine("  pattern = search pattern (UTF-8 string)");
+      return true;
+    }
+
+    // Convert OEM to UTF-8
+    char utf8_pattern[1024];
+    uint utf8_len = searchscan.OemToUtf8(pattern_start, utf8_pattern, sizeof(utf8_pattern));
+    if( utf8_len == 0 ) {
+      term->AddLine("Error: failed to convert pattern to UTF-8");
+      return true;
+    }
+
+    // Initialize search pattern
+    if( searchscan.searcher.InitPattern(utf8_pattern) == 0 ) {
+      term->AddLine("Error: invalid search pattern");
+      return true;
+    }
+
+    // Determine which file to search and whether to sync all files
+    uint search_file_idx;
+    bool sync_all_files;
+
+    if( lf.cur_view >= 0 ) {
+      // Selection exists - search only in selected file, don't sync
+      search_file_idx = lf.cur_view;
+      sync_all_files = false;
+    } else if( file_num >= 0 ) {
+      // Explicit file number given - search in that file, sync all files
+      search_file_idx = file_num;
+      sync_all_files = true;
+    } else {
+      // No selection, no file number - default to file 0, sync all files
+      search_file_idx = 0;
+      sync_all_files = true;
+    }
+
+    // Add initial searching message
+    sprintf(buf, "Searching... (pattern length: %u bytes)", searchscan.searcher.GetLength());
+    term->AddLine(buf);
+    DisplayRedraw();  // Update window immediately to show "Searching" message
+
+    // Set busy flag to enable search (and allow interruption)
+    f_busy = 1;
+
+    // Save original position in case pattern is not found
+    qword original_pos = F[search_file_idx].F1pos;
+
+    // Perform the search with progress updates (start from next position after current)
+    qword start_pos = F[search_file_idx].F1pos + 1;
+    qword found_pos = searchscan.SearchInFile(search_file_idx, start_pos, term);
+
+    // Clear busy flag
+    f_busy = 0;
+
+    if( found_pos != (qword)(-1LL) ) {
+      // Found! Update file positions
+      if( sync_all_files ) {
+        // Update all file positions to match (relative to their base offsets)
+        SetViewPos( sqword(found_pos) - sqword(F[search_file_idx].base) );
+        sprintf(buf, "Pattern found at position 0x%llX (%llu) - all files synchronized", found_pos, found_pos);
+      } else {
+        // Update only the searched file
+        F[search_file_idx].SetFilepos(found_pos);
+        sprintf(buf, "File %d: pattern found at position 0x%llX (%llu)", search_file_idx, found_pos, found_pos);
+      }
+      term->AddLine(buf);
+    } else {
+      // Pattern not found - restore original position
+      F[search_file_idx].SetFilepos(original_pos);
+      sprintf(buf, "File %d: pattern not found", search_file_idx);
+      term->AddLine(buf);
+    }
+
+    DisplayRedraw();  // Update hex view display
+    return true;
+  }
+
+  // Parse "align" command: per-file base offsets
+  // Syntax: "align" (list), "align <file>,<offset>", "align <file>,+<delta>" or "-<delta>", "align off"
+  if( strncmp(cmd, "align", 5) == 0 && (cmd[5] == 0 || cmd[5] == ' ' || cmd[5] == '\t') ) {
+    const char* arg = cmd + 5;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+    if( *arg == 0 ) {
+      for(uint i=0; i<F_num; i++) {
+        sprintf(buf, "File %u: base 0x%llX (%llu)", i, F[i].base, F[i].base);
+        term->AddLine(buf);
+      }
+      return true;
+    }
+
+    qword old_base0 = F[0].base;
+    if( strcmp(arg, "off") == 0 ) {
+      for(uint i=0; i<F_num; i++) F[i].base = 0;
+      term->AddLine("Base offsets cleared");
+    } else {
+      int file_num = -1;
+      const char* comma = strchr(arg, ',');
+      if( comma ) sscanf(arg, "%d", &file_num);
+      if( comma == 0 || file_num < 0 || file_num >= (int)F_num ) {
+        term->AddLine("Usage: align <file_num>,<offset> or align <file_num>,+<delta> / -<delta>");
+        term->AddLine("  align = list base offsets; align off = clear them");
+        return true;
+      }
+      arg = comma + 1;
+      while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+      // Optional sign makes the offset relative to the current base
+      int sign = (*arg == '+') ? 1 : (*arg == '-') ? -1 : 0;
+      if( sign ) arg++;
+      qword x = 0;
+      if( arg[0] == '0' && (arg[1] == 'x' || arg[1] == 'X') ) sscanf(arg + 2, "%llx", &x);
+      else sscanf(arg, "%llu", &x);
+
+      hexfile& file = F[file_num];
+      if( sign < 0 && x > file.base ) {
+        term->AddLine("Error: base offset can't be negative");
+        return true;
+      }
+      qword new_base = (sign > 0) ? file.base + x : (sign < 0) ? file.base - x : x;
+      if( new_base > file.F1size ) {
+        sprintf(buf, "Error: base offset 0x%llX is beyond file %d size", new_base, file_num);
+        term->AddLine(buf);
+        return true;
+      }
+      file.base = new_base;
+      sprintf(buf, "File %d: base 0x%llX (%llu)", file_num, new_base, new_base);
+      term->AddLine(buf);
+    }
+
+    // Keep view 0 at the same position past its base, move the others along
+    if( f_busy ) { f_busy=0; diffscan.quit(); }
+    SetViewPos( sqword(F[0].F1pos) - sqword(old_base0) );
+
+    // Restart background scans for the new offsets
+    StartMapScan();
+    if( amap.nseg && (F_sec.n==0) ) {  // Section alignment uses file offsets, not bases
+      qword base[N_VIEWS];
+      GetBases( base );
+      if( linescan.map ) {
+        linescan.stop();
+        amap.Quit();
+        linescan.start( amap, F_names, base );
+      } else {
+        alignscan.stop();
+        amap.Quit();
+        alignscan.start( amap, F_names, F_num, alignscan.window, base );
+      }
+    }
+    DisplayRedraw();
+    return true;
+  }
+
+  // Parse "resync" command: insertion/deletion-aware alignment
+  // Syntax: "resync" (start, or show progress), "resync <KB>" (restart with search window), "resync off"
+  if( strncmp(cmd, "resync", 6) == 0 && (cmd[6] == 0 || cmd[6] == ' ' || cmd[6] == '\t') ) {
+    const char* arg = cmd + 6;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+    if( strcmp(arg, "off") == 0 ) {
+      if( f_busy ) { f_busy=0; diffscan.quit(); }
+      alignscan.stop();
+      linescan.stop();
+      secscan.stop();
+      F_sec.Quit();
+      amap.Quit();
+      term->AddLine("Alignment off");
+      DisplayRedraw();
+      return true;
+    }
+
+    if( *arg == 0 && amap.nseg ) {
+      sprintf(buf, "Alignment: %u segments, file 0 scanned to 0x%llX of 0x%llX%s",
+              amap.nseg, amap.scanned, amap.size[0], alignscan.f_run ? " (running)" : "");
+      term->AddLine(buf);
+      return true;
+    }
+
+    if( F_num < 2 ) {
+      term->AddLine("Error: alignment needs at least 2 files");
+      return true;
+    }
+
+    uint window_kb = 1024;  // Resync search window per file
+    if( *arg ) sscanf(arg, "%u", &window_kb);
+    if( window_kb < 64 || window_kb > 65536 ) {
+      term->AddLine("Error: window must be between 64 and 65536 KB");
+      return true;
+    }
+
+    if( f_busy ) { f_busy=0; diffscan.quit(); }
+    qword base[N_VIEWS];
+    GetBases( base );
+    alignscan.stop();
+    linescan.stop();
+    secscan.stop();
+    F_sec.Quit();
+    amap.Quit();
+    if( alignscan.start( amap, F_names, F_num, window_kb<<10, base ) == 0 ) {
+      term->AddLine("Error: can't open files for alignment");
+      return true;
+    }
+    sprintf(buf, "Alignment started (window %u KB); views follow file 0 across insertions/deletions", window_kb);
+    term->AddLine(buf);
+    DisplayRedraw();
+    return true;
+  }
+
+  // Parse "lines" command: line diff of two text files into the alignment map
+  // Syntax: "lines" (start, or show progress), "lines next" (next hunk below the view), "lines off"
+  if( strncmp(cmd, "lines", 5) == 0 && (cmd[5] == 0 || cmd[5] == ' ' || cmd[5] == '\t') ) {
+    const char* arg = cmd + 5;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+    if( strcmp(arg, "off") == 0 ) {
+      if( f_busy ) { f_busy=0; diffscan.quit(); }
+      linescan.stop();
+      amap.Quit();
+      term->AddLine("Line diff off");
+      DisplayRedraw();
+      return true;
+    }
+
+    if( *arg == 0 && linescan.map ) {
+      snprintf(buf, sizeof(buf), "Line diff: %u hunks, -%llu +%llu lines, file 0 scanned to 0x%llX of 0x%llX%s", linescan.nhunk,
+               linescan.ndel, linescan.nins, amap.scanned, amap.size[0],
+               linescan.f_run ? " (running)" : linescan.f_full ? " (segment limit reached)" : "");
+      term->AddLine(buf);
+      return true;
+    }
+
+    if( strcmp(arg, "next") == 0 ) {
+      // Hunks start at odd segments; the first one past the top of view 0
+      if( linescan.map == 0 ) {
+        term->AddLine("Line diff is off: use lines first");
+        return true;
+      }
+      uint k = amap.Find( 0, F[0].F1pos ) + 1;
+      if( (k & 1) == 0 ) k++;
+      if( k >= amap.nseg ) {
+        term->AddLine(linescan.f_run ? "lines next: no more hunks found yet" : "lines next: no more hunks");
+        return true;
+      }
+      SetViewPos( sqword(amap.Pos(k,0)) - sqword(amap.Pos(0,0)) );
+      snprintf(buf, sizeof(buf), "Hunk %u: file 0 at 0x%llX, file 1 at 0x%llX", k/2+1, amap.Pos(k,0), amap.Pos(k,1));
+      term->AddLine(buf);
+      DisplayRedraw();
+      return true;
+    }
+
+    if( *arg ) {
+      term->AddLine("Usage: lines | lines next | lines off");
+      return true;
+    }
+    if( F_num != 2 ) {
+      term->AddLine("Error: line diff needs exactly 2 files");
+      return true;
+    }
+
+    if( f_busy ) { f_busy=0; diffscan.quit(); }
+    qword base[N_VIEWS];
+    GetBases( base );
+    alignscan.stop();
+    linescan.stop();
+    secscan.stop();
+    F_sec.Quit();
+    amap.Quit();
+    if( linescan.start( amap, F_names, base ) == 0 ) {
+      term->AddLine("Error: can't open files for line diff");
+      return true;
+    }
+    term->AddLine("Line diff started; views follow file 0 hunk by hunk (lines next = next hunk)");
+    DisplayRedraw();
+    return true;
+  }
+
+  // Parse "sections" command: ELF/PE sections matched by name, views aligned section by section
+  // Syntax: "sections" (start, or list differing sections), "sections nodebug" (start, skip debug sections and padding),
+  // "sections next" (next differing section below the view), "sections off"
+  if( strncmp(cmd, "sections", 8) == 0 && (cmd[8] == 0 || cmd[8] == ' ' || cmd[8] == '\t') ) {
+    const char* arg = cmd + 8;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+    sectmap& m = F_sec;
+
+    if( strcmp(arg, "off") == 0 ) {
+      if( f_busy ) { f_busy=0; diffscan.quit(); }
+      secscan.stop();
+      m.Quit();
+      amap.Quit();
+      term->AddLine("Section mode off");
+      DisplayRedraw();
+      return true;
+    }
+
+    if( *arg == 0 && m.n ) {
+      uint k, nsame = 0, ndone = 0;
+      for( k=0; k<m.ne; k++ ) ndone += (m.e[k].ndiff != ~0ULL);
+      snprintf(buf, sizeof(buf), "%s: %u sections matched, %u of file 0 missing in some file, %u entries compared%s", m.t[0].Format(),
+               m.nmatch, m.nonly, ndone, secscan.f_run ? " (running)" : secscan.f_skip ? " (debug sections and padding skipped)" : "");
+      term->AddLine(buf);
+      for( k=0; k<m.ne; k++ ) {
+        sectmap::entry& q = m.e[k];
+        if( !m.Differs(k) ) { nsame += (q.ndiff != ~0ULL); continue; }
+        int l = snprintf(buf, sizeof(buf), "  %-20s", q.name);
+        for( uint i=0; (i<m.n) && (l < int(sizeof(buf))-48); i++ ) {  // Offsets and sizes, as many as fit
+          if( (i > 0) && (q.type == sectmap::E_ONLY) ) break;
+          l += snprintf(buf + l, sizeof(buf) - l, "%s0x%llX+0x%llX", i ? " | " : " ", q.off[i], q.size[i]);
+        }
+        if( q.type == sectmap::E_ONLY ) snprintf(buf + l, sizeof(buf) - l, "  missing in some file");
+        else if( q.ndiff == ~0ULL ) snprintf(buf + l, sizeof(buf) - l, "  sizes differ, contents not compared");
+        else snprintf(buf + l, sizeof(buf) - l, "  %llu bytes differ%s", q.ndiff, (q.ndiff == 0) ? " (sizes only)" : "");
+        term->AddLine(buf);
+      }
+      snprintf(buf, sizeof(buf), "  %u entries equal", nsame);
+      term->AddLine(buf);
+      return true;
+    }
+
+    if( strcmp(arg, "next") == 0 ) {
+      // First differing entry past the top of view 0, at its first differing byte
+      if( m.n == 0 ) {
+        term->AddLine("Section mode is off: use sections first");
+        return true;
+      }
+      uint k;
+      qword o = 0;
+      for( k=0; k<m.ne; k++ ) {
+        o = (m.e[k].first != ~0ULL) ? m.e[k].first : 0;
+        if( m.Differs(k) && (m.e[k].off[0]+o > F[0].F1pos) ) break;
+      }
+      if( k >= m.ne ) {
+        term->AddLine(secscan.f_run ? "sections next: no more differing sections found yet" : "sections next: no more differing sections");
+        return true;
+      }
+      sectmap::entry& q = m.e[k];
+      for( uint i=0; i<F_num; i++ ) if( (i == 0) || (q.type != sectmap::E_ONLY) ) F[i].SetFilepos( q.off[i]+o );
+      snprintf(buf, sizeof(buf), "%s: file 0 at 0x%llX", q.name, q.off[0]+o);
+      term->AddLine(buf);
+      DisplayRedraw();
+      return true;
+    }
+
+    if( *arg && strcmp(arg, "nodebug") != 0 ) {
+      term->AddLine("Usage: sections [nodebug] | sections next | sections off");
+      return true;
+    }
+    if( F_num < 2 ) {
+      term->AddLine("Error: section mode needs at least 2 files");
+      return true;
+    }
+
+    if( f_busy ) { f_busy=0; diffscan.quit(); }
+    alignscan.stop();
+    linescan.stop();
+    secscan.stop();
+    m.Quit();
+    amap.Quit();
+    if( m.Load( F_names, F_num ) == 0 ) {
+      term->AddLine("Error: not all files are ELF or PE executables");
+      return true;
+    }
+    m.Align( amap );
+    if( secscan.start( m, F_names, *arg != 0 ) == 0 ) {
+      term->AddLine("Error: can't open files");
+      return true;
+    }
+    snprintf(buf, sizeof(buf), "Section mode: %u sections matched, %u alignment segments; sections = list differing sections",
+             m.nmatch, amap.nseg);
+    term->AddLine(buf);
+    DisplayRedraw();
+    return true;
+  }
+
+  // Parse "ignore" command: ranges excluded from comparison
+  // Syntax: "ignore" (list), "ignore <ofs>,<len>[,<stride>]", "ignore load <file>", "ignore off"
+  if( strncmp(cmd, "ignore", 6) == 0 && (cmd[6] == 0 || cmd[6] == ' ' || cmd[6] == '\t') ) {
+    const char* arg = cmd + 6;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+    if( *arg == 0 ) {
+      if( F_ign.n == 0 ) term->AddLine("No ignored ranges");
+      for(uint i=0; i<F_ign.n; i++) {
+        ignorerange& r = F_ign.r[i];
+        if( r.stride ) sprintf(buf, "%u: 0x%llX, 0x%llX bytes every 0x%llX", i, r.ofs, r.len, r.stride);
+        else sprintf(buf, "%u: 0x%llX, 0x%llX bytes", i, r.ofs, r.len);
+        term->AddLine(buf);
+      }
+      return true;
+    }
+
+    // Scans read the mask: stop them before changing it
+    if( f_busy ) { f_busy=0; diffscan.quit(); }
+    statscan.stop();
+    samplescan.stop();
+    mapscan.stop();
+
+    if( strcmp(arg, "off") == 0 ) {
+      F_ign.Clear();
+      term->AddLine("Ignored ranges cleared");
+    } else if( strncmp(arg, "load ", 5) == 0 ) {
+      arg += 5;
+      while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+      int cnt = F_ign.Load(arg);
+      if( cnt < 0 ) sprintf(buf, "Error: can't load ranges from %s (or too many ranges)", arg);
+      else sprintf(buf, "%d ranges loaded, %u in use", cnt, F_ign.n);
+      term->AddLine(buf);
+    } else {
+      qword v[3] = {0,0,0};
+      uint k;
+      const char* e;
+      for( k=0; k<3; k++ ) {
+        while( *arg == ' ' || *arg == '\t' || (k && *arg == ',') ) arg++;
+        e = ParseNum(arg, &v[k]);
+        if( e == arg ) break;
+        arg = e;
+      }
+      if( k < 2 || *arg ) {
+        term->AddLine("Usage: ignore <offset>,<length>[,<stride>] (repeats every stride bytes)");
+        term->AddLine("  ignore = list; ignore load <file>; ignore off = clear");
+      } else if( F_ign.Add(v[0], v[1], v[2]) == 0 ) {
+        term->AddLine("Error: too many ranges or zero length");
+      } else {
+        sprintf(buf, "Ignoring 0x%llX bytes at 0x%llX", v[1], v[0]);
+        if( v[2] ) sprintf(buf+strlen(buf), " every 0x%llX bytes", v[2]);
+        term->AddLine(buf);
+      }
+    }
+
+    F_setgen++;
+    StartMapScan();
+    DisplayRedraw();
+    return true;
+  }
+
+  // Parse "type" command: typed element compare with tolerance
+  // Syntax: "type" (show), "type <i16|i32|i64|f32|f64>[le|be] [<tolerance>|<N>ulp]", "type off"
+  if( strncmp(cmd, "type", 4) == 0 && (cmd[4] == 0 || cmd[4] == ' ' || cmd[4] == '\t') ) {
+    const char* arg = cmd + 4;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+    if( *arg == 0 ) {
+      strcpy(buf, "Compare: ");
+      F_type.Print(buf + strlen(buf));
+      term->AddLine(buf);
+      return true;
+    }
+
+    // Split "<type> <tolerance>"
+    char name[16];
+    uint k;
+    for( k=0; arg[k] && arg[k] != ' ' && arg[k] != '\t' && k<sizeof(name)-1; k++ ) name[k] = arg[k];
+    name[k] = 0;
+    arg += k;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+    typemode tm;
+    bzero(tm);
+    if( strcmp(name, "off") != 0 && tm.Set(name, arg) == 0 ) {
+      term->AddLine("Usage: type <i16|i32|i64|f32|f64>[le|be] [<tolerance>|<N>ulp] or type off");
+      term->AddLine("  type f32 1e-6 - floats equal within 1e-6; type f64be 4ulp - within 4 units in the last place");
+      return true;
+    }
+
+    // Scans read the type: stop them before changing it
+    if( f_busy ) { f_busy=0; diffscan.quit(); }
+    statscan.stop();
+    samplescan.stop();
+    mapscan.stop();
+    F_type = tm;
+    F_setgen++;
+    strcpy(buf, "Compare: ");
+    F_type.Print(buf + strlen(buf));
+    term->AddLine(buf);
+    StartMapScan();
+    DisplayRedraw();
+    return true;
+  }
+
+  // Parse "reloc" command: words equal up to relocation deltas (memory dumps, rebased binaries)
+  // Syntax: "reloc" (progress/deltas), "reloc 32|64[le|be] [<KB>]" (detect deltas per region, default 64KB),
+  // "reloc <file> <delta> [<beg>,<end>]" (delta of file vs file 0, whole file by default), "reloc off"
+  if( strncmp(cmd, "reloc", 5) == 0 && (cmd[5] == 0 || cmd[5] == ' ' || cmd[5] == '\t') ) {
+    const char* arg = cmd + 5;
+    relocmap& m = F_rel;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+    if( *arg == 0 ) {
+      if( F_type.type < typemode::T_R32 ) {
+        term->AddLine("Relocation compare: off (reloc 32|64 [<KB>] = detect deltas)");
+        return true;
+      }
+      uint s = F_type.Size(), i, r, e, lines = 0;
+      qword mask = (s == 4) ? 0xFFFFFFFFULL : ~0ULL;
+      if( relscan.rm ) {
+        snprintf(buf, sizeof(buf), "Relocation compare: %u-bit words, detecting deltas per %u KB region, %u%%", s*8,
+                 (1 << m.rbits) >> 10, uint( m.size ? relscan.scanned*100/m.size : 100 ));
+        term->AddLine(buf);
+        return true;
+      }
+      snprintf(buf, sizeof(buf), "Relocation compare: %u-bit words%s, deltas per %u KB region (words differing by them are equal)",
+               s*8, F_type.f_be ? " big-endian" : "", (1 << m.rbits) >> 10);
+      term->AddLine(buf);
+      // Runs of regions with the same delta per file
+      for( i=1; i<m.n; i++ ) for( r=0; r<m.nreg; r=e ) {
+        qword d = m.delta[r*DK_MAXF+i], words = 0;
+        if( m.cnt[r*DK_MAXF+i] == 0 ) { e = r+1; continue; }
+        for( e=r; (e<m.nreg) && m.cnt[e*DK_MAXF+i] && (m.delta[e*DK_MAXF+i] == d); e++ ) words += m.cnt[e*DK_MAXF+i];
+        if( ++lines > 16 ) break;
+        snprintf(buf, sizeof(buf), "  file %u: %c0x%llX at 0x%llX-0x%llX (%llu words)", i, (d >> (s*8-1)) & 1 ? '-' : '+',
+                 ((d >> (s*8-1)) & 1 ? 0-d : d) & mask, qword(r) << m.rbits, Min( qword(e) << m.rbits, m.size ), words);
+        term->AddLine(buf);
+      }
+      if( lines > 16 ) term->AddLine("  ...");
+      if( lines == 0 ) term->AddLine("  no deltas detected");
+      for( i=0; i<m.nuser; i++ ) {
+        relocmap::userrange& u = m.user[i];
+        snprintf(buf, sizeof(buf), "  file %u: %c0x%llX at 0x%llX-0x%llX (given)", u.file, (u.delta >> (s*8-1)) & 1 ? '-' : '+',
+                 ((u.delta >> (s*8-1)) & 1 ? 0-u.delta : u.delta) & mask, u.beg, u.end);
+        term->AddLine(buf);
+      }
+      return true;
+    }
+
+    uint f_off = (strcmp(arg, "off") == 0);
+    uint f_32 = (strncmp(arg, "32", 2) == 0), f_64 = (strncmp(arg, "64", 2) == 0);
+    if( f_32 || f_64 ) {
+      // Word size, byte order and region size
+      uint be = 0, kb = 64, rbits;
+      qword v;
+      arg += 2;
+      if( (strncmp(arg, "be", 2) == 0) || (strncmp(arg, "le", 2) == 0) ) { be = (arg[0] == 'b'); arg += 2; }
+      if( (*arg != 0) && (*arg != ' ') && (*arg != '\t') ) f_32 = f_64 = 0;
+      while( *arg == ' ' || *arg == '\t' ) arg++;
+      if( *arg ) {
+        const char* e = ParseNum(arg, &v);
+        kb = uint(v);
+        if( (e == arg) || *e || (v < 4) || (v > 1024) || (v & (v-1)) ) f_32 = f_64 = 0;
+      }
+      if( (f_32 || f_64) == 0 ) {
+        term->AddLine("Usage: reloc 32|64[le|be] [<KB>] - region size 4..1024 KB, a power of 2 (default 64)");
+        return true;
+      }
+      for( rbits=12; (1U << rbits) < kb*1024; rbits++ );
+      if( F_num < 2 ) {
+        term->AddLine("Relocation compare needs 2 or more files");
+        return true;
+      }
+      // Scans read the type: stop them before changing it
+      if( f_busy ) { f_busy=0; diffscan.quit(); }
+      statscan.stop();
+      samplescan.stop();
+      mapscan.stop();
+      relscan.stop();
+      typemode tm;
+      bzero(tm);
+      tm.type = f_32 ? typemode::T_R32 : typemode::T_R64;
+      tm.f_be = be;
+      tm.rel = &m;
+      qword base[N_VIEWS];
+      GetBases( base );
+      if( relscan.start( m, F_names, F_num, base, F_xc, tm, &F_ign, rbits ) == 0 ) {
+        term->AddLine("Error: can't open files");
+        StartMapScan();
+        return true;
+      }
+      F_type = tm;
+      F_setgen++;
+      snprintf(buf, sizeof(buf), "Detecting %u-bit relocation deltas per %u KB region; reloc = show progress and deltas", f_32 ? 32 : 64, kb);
+      term->AddLine(buf);
+      DisplayRedraw();  // The overview restarts when the deltas are done
+      return true;
+    }
+
+    if( !f_off && ((arg[0] < '1') || (arg[0] > '9') || ((arg[1] != ' ') && (arg[1] != '\t'))) ) {
+      term->AddLine("Usage: reloc 32|64[le|be] [<KB>] | reloc <file> <delta> [<beg>,<end>] | reloc off");
+      return true;
+    }
+
+    // Scans read the type and the deltas
+    if( f_busy ) { f_busy=0; diffscan.quit(); }
+    statscan.stop();
+    samplescan.stop();
+    mapscan.stop();
+
+    if( f_off ) {
+      relscan.stop();
+      if( F_type.type >= typemode::T_R32 ) bzero( F_type );
+      m.Quit();
+      term->AddLine("Relocation compare: off");
+    } else {
+      // "<file> <delta> [<beg>,<end>]": delta may be negative
+      uint file = arg[0]-'0', neg = 0;
+      qword d, beg = 0, end = ~0ULL;
+      for( arg++; *arg == ' ' || *arg == '\t'; arg++ );
+      if( (*arg == '-') || (*arg == '+') ) neg = (*arg++ == '-');
+      const char* e = ParseNum(arg, &d);
+      uint ok = (e != arg) && (F_type.type >= typemode::T_R32);
+      for( arg=e; *arg == ' ' || *arg == '\t'; arg++ );
+      if( ok && *arg ) {
+        e = ParseNum(arg, &beg);
+        ok = (e != arg) && (*e == ',') && (ParseNum(e+1, &end) != e+1);
+      }
+      if( !ok || (m.AddUser( file, neg ? 0-d : d, beg, end ) == 0) ) {
+        term->AddLine(F_type.type >= typemode::T_R32 ? "Usage: reloc <file> <delta> [<beg>,<end>] - file 1..number of files-1, up to 64 ranges"
+                                                     : "Relocation compare is off: use reloc 32|64 first");
+      } else {
+        snprintf(buf, sizeof(buf), "File %u: words differing by %s0x%llX are equal at 0x%llX-0x%llX", file, neg ? "-" : "+", d, beg, end);
+        term->AddLine(buf);
+      }
+    }
+    F_setgen++;
+    StartMapScan();
+    DisplayRedraw();
+    return true;
+  }
+
+  // Parse "bitshift" command: detection and view of files shifted by a non-byte number of bits
+  // Syntax: "bitshift" (progress/results), "bitshift detect [<beg>,<end>]", "bitshift apply" (use detected offsets),
+  // "bitshift <file> <bits>" (set offset -8..7 of one view), "bitshift off" (unshifted views)
+  if( strncmp(cmd, "bitshift", 8) == 0 && (cmd[8] == 0 || cmd[8] == ' ' || cmd[8] == '\t') ) {
+    const char* arg = cmd + 8;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+    bitalign& s = balign;
+
+    if( *arg == 0 ) {
+      if( s.best == 0 ) {
+        term->AddLine("No detection yet: use bitshift detect [<beg>,<end>]");
+        return true;
+      }
+      if( s.f_done == 0 ) {
+        qword len = s.end - s.beg;
+        sprintf(buf, "Bit offsets 0x%llX-0x%llX: scanned to 0x%llX (%u%%)%s", s.beg, s.end, s.scanned,
+                uint( len ? (s.scanned-s.beg)*100/len : 100 ), bitscan.f_run ? "" : " (stopped)");
+        term->AddLine(buf);
+        return true;
+      }
+      // Runs of regions with the same best offset, per file
+      sprintf(buf, "Bit offsets against file 0 per %u KB region, 0x%llX-0x%llX:", 1U << (s.rshift-10), s.beg, s.end);
+      term->AddLine(buf);
+      for(uint i=1; i<s.n; i++) {
+        uint r, e, lines = 0;
+        for( r=0; r<s.nreg; r=e ) {
+          qword h=0, t=0;
+          int b = s.best[r*DK_MAXF+i];
+          for( e=r; (e<s.nreg) && (s.best[e*DK_MAXF+i]==b); e++ ) h += s.hits[e*DK_MAXF+i], t += s.total[e*DK_MAXF+i];
+          if( lines++ >= 16 ) continue;
+          sprintf(buf, "  file %u: 0x%llX-0x%llX: %+d bits, %.2f%% equal", i, s.beg + (qword(r) << s.rshift),
+                  Min( s.beg + (qword(e) << s.rshift), s.end ), b, t ? h*100.0/t : 0.0);
+          term->AddLine(buf);
+        }
+        if( lines > 16 ) {
+          sprintf(buf, "  file %u: ... %u more runs", i, lines - 16);
+          term->AddLine(buf);
+        }
+      }
+      term->AddLine("  bitshift apply = show files at their most common offset");
+      return true;
+    }
+
+    if( strncmp(arg, "detect", 6) == 0 ) {
+      // Range: whole file past the base offsets, or "<beg>,<end>"
+      qword beg = 0, end = ~0ULL;
+      arg += 6;
+      while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+      if( *arg ) {
+        const char* e = ParseNum(arg, &beg);
+        while( *e == ' ' || *e == '\t' ) e++;  // skip whitespace
+        if( (e == arg) || (*e != ',') || (ParseNum(e+1, &end) == e+1) || (end <= beg) ) {
+          term->AddLine("Usage: bitshift detect [<beg>,<end>]");
+          return true;
+        }
+      }
+      if( F_num < 2 ) {
+        term->AddLine("Error: bit offsets need 2 or more files");
+        return true;
+      }
+      qword base[N_VIEWS];
+      GetBases( base );
+      bitscan.stop();
+      if( bitscan.start( balign, F_names, F_num, base, beg, end, F_xc ) == 0 ) {
+        term->AddLine("Error: can't open files for bit offset detection");
+        return true;
+      }
+      sprintf(buf, "Bit offset detection started for 0x%llX-0x%llX; bitshift = show progress/results", s.beg, s.end);
+      term->AddLine(buf);
+      return true;
+    }
+
+    // Change view offsets: Space/F6 reads the views
+    if( f_busy ) { f_busy=0; diffscan.quit(); }
+
+    if( strcmp(arg, "off") == 0 ) {
+      bitscan.stop();
+      for(uint i=0; i<F_num; i++) if( F[i].bits ) F[i].SetBits(0);
+      term->AddLine("Bit offsets cleared");
+    } else if( strcmp(arg, "apply") == 0 ) {
+      if( s.best == 0 ) {
+        term->AddLine("No detection yet: use bitshift detect [<beg>,<end>]");
+        return true;
+      }
+      for(uint i=1; i<F_num && i<s.n; i++) {
+        F[i].SetBits( s.Dominant(i) );
+        sprintf(buf, "  file %u: %+d bits", i, F[i].bits);
+        term->AddLine(buf);
+      }
+    } else {
+      uint i = F_num;
+      int b = 0;
+      if( (sscanf(arg, "%u %d", &i, &b) != 2) || (i >= F_num) || (b < bitalign::TMIN) || (b >= bitalign::TMIN+bitalign::NOFS) ) {
+        term->AddLine("Usage: bitshift [detect [<beg>,<end>]|apply|<file> <bits>|off]");
+        term->AddLine("  bitshift 1 3 - show file 1 from 3 bits into each byte; bits -8..7");
+        return true;
+      }
+      F[i].SetBits( b );
+      sprintf(buf, "  file %u: %+d bits", i, b);
+      term->AddLine(buf);
+    }
+    DisplayRedraw();
+    return true;
+  }
+
+  // Parse "xform" command: per-file transform chain applied before comparison
+  // Syntax: "xform" (list), "xform <file> <steps>" (xor <hexkey>, swap16, swap32, swap64, nibble, delta), "xform <file> off"
+  if( strncmp(cmd, "xform", 5) == 0 && (cmd[5] == 0 || cmd[5] == ' ' || cmd[5] == '\t') ) {
+    const char* arg = cmd + 5;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+    if( *arg ) {
+      uint i = F_num;
+      int k = 0;
+      xchain xc;
+      bzero(xc);
+      sscanf(arg, "%u%n", &i, &k);
+      arg += k;
+      while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+      if( (k == 0) || (i >= F_num) || (*arg == 0) || ((strcmp(arg, "off") != 0) && (xc.Parse(arg) == 0)) ) {
+        term->AddLine("Usage: xform <file> <steps> | xform <file> off");
+        term->AddLine("  steps: xor <hexkey>, swap16, swap32, swap64, nibble, delta (applied in order)");
+        term->AddLine("  xform 1 xor 5A3C swap16 - XOR file 1 with 5A 3C 5A 3C ..., then swap byte pairs");
+        return true;
+      }
+      if( strcmp(arg, "off") == 0 ) xc.n = 0;
+
+      // Scans read the transformed files: stop them before changing a chain
+      if( f_busy ) { f_busy=0; diffscan.quit(); }
+      statscan.stop();
+      samplescan.stop();
+      bitscan.stop();
+      mapscan.stop();
+      F_xc[i] = xc;
+      F[i].xc = xc.n ? &F_xc[i] : 0;
+      F[i].Reload();
+      StartMapScan();
+      DisplayRedraw();
+    }
+
+    for(uint i=0; i<F_num; i++) {
+      sprintf(buf, "  file %u: ", i);
+      F_xc[i].Print(buf + strlen(buf));
+      term->AddLine(buf);
+    }
+    return true;
+  }
+
+  // Parse "consensus" command: majority vote across 3+ files
+  // Syntax: "consensus" (show), "consensus on", "consensus off"
+  if( strncmp(cmd, "consensus", 9) == 0 && (cmd[9] == 0 || cmd[9] == ' ' || cmd[9] == '\t') ) {
+    const char* arg = cmd + 9;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+    if( strcmp(arg, "on") == 0 || strcmp(arg, "off") == 0 ) {
+      if( f_busy ) { f_busy=0; diffscan.quit(); }  // Scan reads the mode
+      F_cons = (arg[1] == 'n');
+      F_setgen++;
+      DisplayRedraw();
+    } else if( *arg ) {
+      term->AddLine("Usage: consensus [on|off]");
+      return true;
+    }
+    sprintf(buf, "Consensus: %s", F_cons ? "on (only files disagreeing with the majority byte are marked)" : "off");
+    term->AddLine(buf);
+    if( F_cons ) {
+      if( F_num < 3 ) term->AddLine("  needs 3 or more files to find the odd one out");
+      term->AddLine("  Tab selects a file: Space/F6 then stop where that file disagrees; stats counts disagreements per file");
+    }
+    return true;
+  }
+
+  // Parse "threeway" command: two branches compared with their common base
+  // Syntax: "threeway" (show), "threeway <N>" (view N is the base), "threeway stop conflict|a|b|any" (what Space/F6
+  // stops at), "threeway off"
+  if( strncmp(cmd, "threeway", 8) == 0 && (cmd[8] == 0 || cmd[8] == ' ' || cmd[8] == '\t') ) {
+    const char* arg = cmd + 8;
+    uint o,a,b;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+    if( strncmp(arg, "stop", 4) == 0 && (arg[4] == ' ' || arg[4] == '\t') ) {
+      for( arg += 4; *arg == ' ' || *arg == '\t'; arg++ );
+      uint m;
+      if( strcmp(arg, "conflict") == 0 ) m = C3_A|C3_B|C3_AB;
+      else if( (strcmp(arg, "a") == 0) || (strcmp(arg, "A") == 0) ) m = C3_A;
+      else if( (strcmp(arg, "b") == 0) || (strcmp(arg, "B") == 0) ) m = C3_B;
+      else if( strcmp(arg, "any") == 0 ) m = 0;
+      else {
+        term->AddLine("Usage: threeway stop conflict|a|b|any");
+        return true;
+      }
+      if( f_busy ) { f_busy=0; diffscan.quit(); }  // Scan reads the mode
+      F_stop3 = m;
+    } else if( strcmp(arg, "off") == 0 ) {
+      if( f_busy ) { f_busy=0; diffscan.quit(); }
+      F_base3 = -1;
+      F_setgen++;
+      DisplayRedraw();
+    } else if( (arg[0] >= '0') && (arg[0] <= '9') && (arg[1] == 0) ) {
+      if( F_num != 3 ) {
+        term->AddLine("Three-way mode needs exactly 3 files: a base and two changed versions");
+        return true;
+      }
+      if( uint(arg[0]-'0') >= F_num ) {
+        term->AddLine("Error: no such file");
+        return true;
+      }
+      if( f_busy ) { f_busy=0; diffscan.quit(); }
+      F_base3 = arg[0]-'0';
+      F_setgen++;
+      DisplayRedraw();
+    } else if( *arg ) {
+      term->AddLine("Usage: threeway [<base>|stop conflict|a|b|any|off]");
+      return true;
+    }
+
+    if( Views3( o, a, b ) == 0 ) {
+      term->AddLine("Three-way: off (threeway <N> = compare the other two files with base file N)");
+      return true;
+    }
+    static const char* stopname[8] = { "any change", "changes in A", "changes in B", "", "", "", "", "conflicts" };
+    sprintf(buf, "Three-way: base %u, A = %u, B = %u; Space/F6 stops at %s", o, a, b, stopname[F_stop3]);
+    term->AddLine(buf);
+    // Classes on the screen, from the marks of the last paint
+    uint j, n[pal_GRAY_START];
+    bzero( n );
+    for( j=0; j<F[0].textlen; j++ ) if( F_diff[j] ) n[F_pal[j]]++;
+    sprintf(buf, "  screen: %u changed in A only (green), %u in B only (magenta), %u same in both (cyan), %u conflicts (red)",
+            n[pal_ChgA], n[pal_ChgB], n[pal_ChgBoth], n[pal_Conflict]);
+    term->AddLine(buf);
+    return true;
+  }
+
+  // Parse "run" command: run lengths for difference navigation
+  // Syntax: "run" (show), "run min <N>" (Space/F6 skips shorter difference runs), "run sync <M>" ('N' needs M equal bytes)
+  if( strncmp(cmd, "run", 3) == 0 && (cmd[3] == 0 || cmd[3] == ' ' || cmd[3] == '\t') ) {
+    const char* arg = cmd + 3;
+    qword v;
+    uint* dst = 0;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+    if( strncmp(arg, "min", 3) == 0 ) dst = &F_minrun, arg += 3;
+    else if( strncmp(arg, "sync", 4) == 0 ) dst = &F_minsame, arg += 4;
+    if( dst ) {
+      while( *arg == ' ' || *arg == '\t' ) arg++;
+      const char* e = ParseNum( arg, &v );
+      while( *e == ' ' || *e == '\t' ) e++;
+      if( (e == arg) || *e || (v == 0) || (v > 0xFFFFFFFFULL) ) dst = 0, arg = "?";
+      else {
+        if( f_busy ) { f_busy=0; diffscan.quit(); }  // Scan reads the lengths
+        *dst = uint(v);
+      }
+    }
+    if( *arg && (dst == 0) ) {
+      term->AddLine("Usage: run [min <N>|sync <M>]");
+      term->AddLine("  run min 4 - Space/F6 skips difference runs shorter than 4 bytes");
+      term->AddLine("  run sync 64 - 'N' stops where files are equal again for 64 bytes");
+      return true;
+    }
+    sprintf(buf, "Space/F6: difference runs of %u+ bytes; 'E': end of run; 'N': %u+ equal bytes after a difference", F_minrun, F_minsame);
+    term->AddLine(buf);
+    return true;
+  }
+
+  // Parse "stats" command: difference statistics
+  // Syntax: "stats" (start over whole file, or show progress/results), "stats <beg>,<end>" (range past the base offsets),
+  // "stats all" (restart over whole file), "stats hist [N]" (histogram), "stats bits" (bit flips), "stats off"
+  if( strncmp(cmd, "stats", 5) == 0 && (cmd[5] == 0 || cmd[5] == ' ' || cmd[5] == '\t') ) {
+    const char* arg = cmd + 5;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+    if( strcmp(arg, "off") == 0 ) {
+      statscan.stop();
+      dstat.Quit();
+      term->AddLine("Statistics cleared");
+      return true;
+    }
+
+    if( F_num < 2 ) {
+      term->AddLine("Error: statistics need at least 2 files");
+      return true;
+    }
+
+    // Results of the last run, or its progress
+    uint f_show = (*arg == 0) || (strncmp(arg, "hist", 4) == 0) || (strcmp(arg, "bits") == 0);
+    if( f_show && dstat.hist ) {
+      diffstats& s = dstat;
+      qword len = s.end - s.beg;
+      if( s.f_done == 0 ) {
+        sprintf(buf, "Stats 0x%llX-0x%llX: counted to 0x%llX (%u%%)%s", s.beg, s.end, s.scanned,
+                uint( len ? (s.scanned-s.beg)*100/len : 100 ), statscan.f_run ? "" : " (stopped; stats all = restart)");
+        term->AddLine(buf);
+        return true;
+      }
+
+      if( strncmp(arg, "hist", 4) == 0 ) {
+        // Non-empty bins in file order, with a density bar
+        uint max_lines = 16, lines = 0, k;
+        sscanf(arg + 4, "%u", &max_lines);
+        sprintf(buf, "Differences per %u KB, 0x%llX-0x%llX:", 1U << (s.hshift-10), s.beg, s.end);
+        term->AddLine(buf);
+        for( k=0; k<s.nhist; k++ ) {
+          if( s.hist[k] == 0 ) continue;
+          if( lines++ >= max_lines ) continue;
+          qword bpos = s.beg + (qword(k) << s.hshift);
+          qword blen = Min( 1ULL << s.hshift, s.end - bpos );
+          char bar[33];
+          uint w = uint( (s.hist[k]*32 + blen-1) / blen );
+          memset(bar, '#', w); bar[w] = 0;
+          sprintf(buf, "  0x%010llX: %10llu (%6.2f%%) %s", bpos, s.hist[k], s.hist[k]*100.0/blen, bar);
+          term->AddLine(buf);
+        }
+        if( lines > max_lines ) {
+          sprintf(buf, "  ... %u more non-empty bins (stats hist <N> to show more)", lines - max_lines);
+          term->AddLine(buf);
+        }
+        if( lines == 0 ) term->AddLine("  (no differences)");
+        return true;
+      }
+
+      if( strcmp(arg, "bits") == 0 ) {
+        // Flips per bit position (bit 7 = MSB first)
+        term->AddLine("Bit flips per pair, bit 7 (MSB) .. bit 0:");
+        for(uint i=0; i<s.n; i++) for(uint j=i+1; j<s.n; j++) {
+          qword* b = s.bits[s.Pair(i,j)];
+          sprintf(buf, "  %u-%u: %llu %llu %llu %llu %llu %llu %llu %llu", i, j, b[7], b[6], b[5], b[4], b[3], b[2], b[1], b[0]);
+          term->AddLine(buf);
+        }
+        return true;
+      }
+
+      sprintf(buf, "Stats 0x%llX-0x%llX: %llu bytes differ in some file (%.2f%%)", s.beg, s.end, s.adiff, len ? s.adiff*100.0/len : 0.0);
+      term->AddLine(buf);
+      sprintf(buf, "  longest equal run 0x%llX at 0x%llX, longest differing run 0x%llX at 0x%llX",
+              s.arun.lmax[0], s.arun.pmax[0], s.arun.lmax[1], s.arun.pmax[1]);
+      term->AddLine(buf);
+      for(uint i=0; i<s.n; i++) for(uint j=i+1; j<s.n; j++) {
+        uint t = s.Pair(i,j);
+        qword flips = 0;
+        for(uint k=0; k<8; k++) flips += s.bits[t][k];
+        sprintf(buf, "  %u-%u: %llu bytes (%.2f%%), %llu bit flips; equal run 0x%llX at 0x%llX, differing 0x%llX at 0x%llX",
+                i, j, s.ndiff[t], len ? s.ndiff[t]*100.0/len : 0.0, flips,
+                s.prun[t].lmax[0], s.prun[t].pmax[0], s.prun[t].lmax[1], s.prun[t].pmax[1]);
+        term->AddLine(buf);
+      }
+      if( s.n > 2 ) {
+        // Bytes where each file is the odd one out
+        strcpy(buf, "  disagreeing with the consensus:");
+        for(uint i=0; i<s.n; i++) sprintf(buf + strlen(buf), " %u: %llu", i, s.odd[i]);
+        term->AddLine(buf);
+      }
+      if( s.skipped ) {
+        sprintf(buf, "  0x%llX bytes skipped as equal by the difference overview", s.skipped);
+        term->AddLine(buf);
+      }
+      return true;
+    }
+    if( f_show && *arg ) {
+      term->AddLine("No statistics yet: use stats, stats all or stats <beg>,<end>");
+      return true;
+    }
+
+    // Range: whole file past the base offsets, or "<beg>,<end>" (hex 0x..., decimal, end may be EOF)
+    qword beg = 0, end = ~0ULL;
+    if( *arg && strcmp(arg, "all") != 0 ) {
+      const char* comma = strchr(arg, ',');
+      if( comma == 0 ) {
+        term->AddLine("Usage: stats [<beg>,<end>|all|hist [N]|bits|off]");
+        term->AddLine("  stats = start over whole file, or show progress/results");
+        return true;
+      }
+      if( arg[0] == '0' && (arg[1] == 'x' || arg[1] == 'X') ) sscanf(arg + 2, "%llx", &beg);
+      else sscanf(arg, "%llu", &beg);
+      arg = comma + 1;
+      while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+      if( strcasecmp(arg, "EOF") == 0 ) end = ~0ULL;
+      else if( arg[0] == '0' && (arg[1] == 'x' || arg[1] == 'X') ) sscanf(arg + 2, "%llx", &end);
+      else sscanf(arg, "%llu", &end);
+      if( end <= beg ) {
+        term->AddLine("Error: range end must be above its start");
+        return true;
+      }
+    }
+
+    // The overview scan uses the same base offsets, so its equal bins can be skipped
+    qword base[N_VIEWS];
+    GetBases( base );
+    statscan.stop();
+    if( statscan.start( dstat, F_names, F_num, base, beg, end, dmap.nlevels ? &dmap : 0, &F_ign, &F_type, F_xc ) == 0 ) {
+      term->AddLine("Error: can't open files for statistics");
+      return true;
+    }
+    sprintf(buf, "Statistics started for 0x%llX-0x%llX; stats = show progress/results", dstat.beg, dstat.end);
+    term->AddLine(buf);
+    return true;
+  }
+
+  // Parse "record" command: files as arrays of fixed-size records, differences counted per field
+  // Syntax: "record <size> [<layout>]" (layout = comma-separated [name:]width), "record" (progress/summary),
+  // "record next [<field>]" (next record where the field, or any field, differs), "record off"
+  if( strncmp(cmd, "record", 6) == 0 && (cmd[6] == 0 || cmd[6] == ' ' || cmd[6] == '\t') ) {
+    const char* arg = cmd + 6;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+    recordfmt& f = F_rec;
+    recordstats& s = F_rstat;
+
+    if( strcmp(arg, "off") == 0 ) {
+      recscan.stop();
+      recfind.stop();
+      f.rsize = 0;
+      term->AddLine("Record mode: off");
+      return true;
+    }
+
+    if( *arg == 0 ) {
+      if( f.rsize == 0 ) {
+        term->AddLine("Record mode: off (record <size> [<layout>] = start)");
+        return true;
+      }
+      if( s.f_done == 0 ) {
+        snprintf(buf, sizeof(buf), "Records of %u bytes: compared %llu of %llu (%u%%)%s", f.rsize, s.scanned, s.nrec,
+                 uint( s.nrec ? s.scanned*100/s.nrec : 100 ), recscan.f_run ? "" : " (stopped)");
+        term->AddLine(buf);
+        return true;
+      }
+      snprintf(buf, sizeof(buf), "Records of %u bytes: %llu of %llu differ (%.2f%%), %llu missing in some file", f.rsize,
+               s.ndiff, s.nrec, s.nrec ? s.ndiff*100.0/s.nrec : 0.0, s.nmiss);
+      term->AddLine(buf);
+      for( uint k=0; k<f.nf; k++ ) {
+        int l = snprintf(buf, sizeof(buf), "  %2u %-15s 0x%04X+%-4u %llu records (%.2f%%), %llu bytes", k, f.name[k], f.off[k],
+                         f.off[k+1]-f.off[k], s.fdiff[k], s.nrec ? s.fdiff[k]*100.0/s.nrec : 0.0, s.fbytes[k]);
+        if( s.fdiff[k] ) snprintf(buf + l, sizeof(buf) - l, ", first #%llu at 0x%llX", s.ffirst[k], s.ffirst[k]*f.rsize);
+        term->AddLine(buf);
+      }
+      if( s.skipped ) {
+        snprintf(buf, sizeof(buf), "  %llu records skipped as equal by the difference overview or shared extents", s.skipped);
+        term->AddLine(buf);
+      }
+      return true;
+    }
+
+    qword base[N_VIEWS];
+    GetBases( base );
+
+    if( strncmp(arg, "next", 4) == 0 && (arg[4] == 0 || arg[4] == ' ' || arg[4] == '\t') ) {
+      // From the record after the one at the top of view 0
+      qword want = ~0ULL, from = 0;
+      int k = -1;
+      for( arg += 4; *arg == ' ' || *arg == '\t'; arg++ );
+      if( f.rsize == 0 ) {
+        term->AddLine("Record mode is off: use record <size> [<layout>] first");
+        return true;
+      }
+      if( *arg && ((k = f.Find(arg)) < 0) ) {
+        term->AddLine("Error: no such field (record = list fields)");
+        return true;
+      }
+      if( k >= 0 ) want = 1ULL << k;
+      if( F[0].F1pos >= F[0].base ) from = (F[0].F1pos - F[0].base) / f.rsize + 1;
+      recfind.stop();
+      if( recfind.start( f, 0, want, from, F_names, F_num, base, dmap.nlevels ? &dmap : 0, &F_ign, &F_type, F_xc ) == 0 ) {
+        term->AddLine("Error: can't open files");
+        return true;
+      }
+      if( k >= 0 ) snprintf(buf, sizeof(buf), "Searching from record #%llu for field %d%s%s", from, k, f.name[k][0] ? " " : "", f.name[k]);
+      else snprintf(buf, sizeof(buf), "Searching from record #%llu for any differing field", from);
+      term->AddLine(buf);
+      return true;
+    }
+
+    // "<size> [<layout>]"
+    qword size;
+    const char* e = ParseNum(arg, &size);
+    while( *e == ' ' || *e == '\t' ) e++;
+    if( F_num < 2 ) {
+      term->AddLine("Record mode needs 2 or more files");
+      return true;
+    }
+    recscan.stop();
+    recfind.stop();
+    if( (e == arg) || (size > recordfmt::MAXSIZE) || (f.Set( uint(size), e ) == 0) ) {
+      term->AddLine("Usage: record <size> [<layout>] | record next [<field>] | record off");
+      term->AddLine("  size 1..65536 bytes; layout = comma-separated field widths, each optionally name:width");
+      return true;
+    }
+    if( recscan.start( f, &s, 0, 0, F_names, F_num, base, dmap.nlevels ? &dmap : 0, &F_ign, &F_type, F_xc ) == 0 ) {
+      term->AddLine("Error: can't open files");
+      return true;
+    }
+    snprintf(buf, sizeof(buf), "Record mode: %u-byte records, %u fields; record = show progress and per-field summary", f.rsize, f.nf);
+    term->AddLine(buf);
+    return true;
+  }
+
+  // Parse "sample" command: similarity estimate from stratified random blocks
+  // Syntax: "sample" (start over whole file, or show the current estimate), "sample <beg>,<end>" (range past the base offsets),
+  // "sample all" (restart over whole file), "sample off"
+  if( strncmp(cmd, "sample", 6) == 0 && (cmd[6] == 0 || cmd[6] == ' ' || cmd[6] == '\t') ) {
+    const char* arg = cmd + 6;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+    if( strcmp(arg, "off") == 0 ) {
+      samplescan.stop();
+      term->AddLine("Sampling stopped");
+      return true;
+    }
+
+    if( F_num < 2 ) {
+      term->AddLine("Error: sampling needs at least 2 files");
+      return true;
+    }
+
+    // Current estimate; it keeps improving while the readers run
+    if( (*arg == 0) && dsample.bsize ) {
+      samplestats& s = dsample;
+      double p, lo, hi;
+      qword dblocks, total = 0, len = s.end - s.beg;
+      qword cnt = s.Estimate( &p, &lo, &hi, &dblocks );
+      for(uint h=0; h<s.nstrata; h++) total += s.nblk[h];
+      uint f_done = s.Done();
+      sprintf(buf, "Sample 0x%llX-0x%llX: %llu of %llu blocks of %u KB (%.2f%%)%s", s.beg, s.end, cnt, total, s.bsize >> 10,
+              total ? cnt*100.0/total : 100.0, f_done ? ", all read: exact" : samplescan.Running() ? ", refining" : " (stopped; sample all = restart)");
+      term->AddLine(buf);
+      if( cnt == 0 ) return true;
+      if( dblocks == 0 ) {
+        if( f_done ) sprintf(buf, "  identical");
+        else sprintf(buf, "  no differences found; at least %.4f%% identical (95%%)", (1-hi)*100);
+        term->AddLine(buf);
+        return true;
+      }
+      sprintf(buf, "  estimated %.4f%% identical, 95%% interval %.4f%%-%.4f%% (about %.0f differing bytes)",
+              (1-p)*100, (1-hi)*100, (1-lo)*100, p*len);
+      term->AddLine(buf);
+      sprintf(buf, "  %llu sampled blocks differ", dblocks);
+      term->AddLine(buf);
+      // Regions holding most of the estimated differences
+      uint hot[4], nh = s.Hot( hot, 4 );
+      for(uint k=0; k<nh; k++) {
+        uint h = hot[k];
+        qword b = s.beg + h*s.slen;
+        double e = double(s.diff[h]) / double(s.bytes[h]) * double(s.Len(h));
+        sprintf(buf, "  %s 0x%llX-0x%llX: %.1f%% of the differences", k ? "     " : "near", b, b + s.Len(h), p*len > 0 ? e*100/(p*len) : 0.0);
+        term->AddLine(buf);
+      }
+      if( s.skipped ) {
+        sprintf(buf, "  %llu blocks taken as equal from the difference overview", s.skipped);
+        term->AddLine(buf);
+      }
+      return true;
+    }
+
+    // Range: whole file past the base offsets, or "<beg>,<end>" (hex 0x..., decimal, end may be EOF)
+    qword beg = 0, end = ~0ULL;
+    if( *arg && strcmp(arg, "all") != 0 ) {
+      const char* comma = strchr(arg, ',');
+      if( comma == 0 ) {
+        term->AddLine("Usage: sample [<beg>,<end>|all|off]");
+        term->AddLine("  sample = start over whole file, or show the current estimate");
+        return true;
+      }
+      if( arg[0] == '0' && (arg[1] == 'x' || arg[1] == 'X') ) sscanf(arg + 2, "%llx", &beg);
+      else sscanf(arg, "%llu", &beg);
+      arg = comma + 1;
+      while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+      if( strcasecmp(arg, "EOF") == 0 ) end = ~0ULL;
+      else if( arg[0] == '0' && (arg[1] == 'x' || arg[1] == 'X') ) sscanf(arg + 2, "%llx", &end);
+      else sscanf(arg, "%llu", &end);
+      if( end <= beg ) {
+        term->AddLine("Error: range end must be above its start");
+        return true;
+      }
+    }
+
+    qword base[N_VIEWS];
+    GetBases( base );
+    samplescan.stop();
+    if( samplescan.start( dsample, F_names, F_num, base, beg, end, dmap.nlevels ? &dmap : 0, &F_ign, &F_type, F_xc ) == 0 ) {
+      term->AddLine("Error: can't open files for sampling");
+      return true;
+    }
+    sprintf(buf, "Sampling started for 0x%llX-0x%llX; sample = show the estimate", dsample.beg, dsample.end);
+    term->AddLine(buf);
+    return true;
+  }
+
+  // Parse "tree" command: directory tree comparison with drill-down into the hex views
+  // Syntax: "tree [-c] <dir> <dir> [...]" (start; -c compares files with equal size and time too), "tree" (progress),
+  // "tree list [N]" (changed files), "tree <N>" (open entry N), "tree next" (open next changed file), "tree off"
+  if( strncmp(cmd, "tree", 4) == 0 && (cmd[4] == 0 || cmd[4] == ' ' || cmd[4] == '\t') ) {
+    static const char* stname[] = { "pending", "same", "same size and time", "differs", "size differs", "missing", "unreadable" };
+    const char* arg = cmd + 4;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+
+    if( strcmp(arg, "off") == 0 ) {
+      treescan.stop();
+      F_tree.Quit();
+      F_tree.n = F_tree.f_listed = 0;
+      term->AddLine("Tree comparison cleared");
+      return true;
+    }
+
+    // Progress, or the list of changed files
+    if( (*arg == 0) || (strncmp(arg, "list", 4) == 0) ) {
+      treecmp& t = F_tree;
+      if( t.n == 0 ) {
+        term->AddLine("No tree comparison yet: use tree <dir> <dir> [...]");
+        return true;
+      }
+      if( t.f_listed == 0 ) {
+        term->AddLine(treescan.f_run ? "Tree: listing files..." : "Tree: stopped while listing (tree off = clear)");
+        return true;
+      }
+      uint cnt[treecmp::NSTATES], done = t.Count( cnt );
+      sprintf(buf, "Tree: %u of %u files checked%s (%llu MB read); %u same, %u same size and time, %u differ, %u size differs, %u missing, %u unreadable",
+              done, t.ne, t.f_done ? "" : treescan.f_run ? ", comparing" : " (stopped)", treescan.Bytes() >> 20,
+              cnt[treecmp::T_SAME], cnt[treecmp::T_QUICK], cnt[treecmp::T_DIFF], cnt[treecmp::T_SIZE], cnt[treecmp::T_MISSING], cnt[treecmp::T_ERROR]);
+      term->AddLine(buf);
+      if( t.nerr ) {
+        sprintf(buf, "  %u directories could not be read", t.nerr);
+        term->AddLine(buf);
+      }
+      // Changed files in path order; tree <N> opens one
+      uint max_lines = (*arg == 0) ? 16 : 64, lines = 0;
+      if( *arg ) sscanf(arg + 4, "%u", &max_lines);
+      for(uint i=0; i<t.ne; i++) {
+        uint s = t.e[i].state;
+        if( (s == treecmp::T_SAME) || (s == treecmp::T_QUICK) || (s == treecmp::T_PENDING) ) continue;
+        if( lines++ >= max_lines ) continue;
+        char nm[128];  // Path shortened to fit the line
+        TruncatePath(nm, t.e[i].name, sizeof(nm)-1);
+        if( s == treecmp::T_DIFF ) snprintf(buf, sizeof(buf), "%c%6u: %s - differs at 0x%llX", (int(i) == F_treesel) ? '>' : ' ', i, nm, t.e[i].diffpos);
+        else if( s == treecmp::T_MISSING ) {
+          snprintf(buf, sizeof(buf), "%c%6u: %s - only in", (int(i) == F_treesel) ? '>' : ' ', i, nm);
+          for(uint r=0, l=strlen(buf); (r<t.n) && (l+4<sizeof(buf)); r++) if( (t.e[i].mask >> r) & 1 ) l += snprintf(buf + l, sizeof(buf) - l, " %u", r);
+        } else snprintf(buf, sizeof(buf), "%c%6u: %s - %s", (int(i) == F_treesel) ? '>' : ' ', i, nm, stname[s]);
+        term->AddLine(buf);
+      }
+      if( lines > max_lines ) {
+        sprintf(buf, "  ... %u more (tree list <N> to show more)", lines - max_lines);
+        term->AddLine(buf);
+      }
+      return true;
+    }
+
+    // Open an entry: its files from the roots holding it, views at the first difference
+    // Only an argument made of digits alone is an entry number; a root such as "2024_build" starts a comparison
+    uint nd = strspn(arg, "0123456789");
+    if( ((nd > 0) && (arg[nd + strspn(arg + nd, " \t")] == 0)) || (strcmp(arg, "next") == 0) ) {
+      treecmp& t = F_tree;
+      uint i;
+      if( t.f_listed == 0 ) {
+        term->AddLine("No file list yet: use tree <dir> <dir> [...]");
+        return true;
+      }
+      if( *arg == 'n' ) {
+        for( i = F_treesel+1; i < t.ne; i++ ) if( (t.e[i].state == treecmp::T_DIFF) || (t.e[i].state == treecmp::T_SIZE) || (t.e[i].state == treecmp::T_MISSING) ) break;
+        if( i >= t.ne ) {
+          term->AddLine("No more changed files (compared so far)");
+          return true;
+        }
+      } else if( (sscanf(arg, "%u", &i) != 1) || (i >= t.ne) ) {
+        term->AddLine("Error: no such entry");
+        return true;
+      }
+      char* names[N_VIEWS];
+      char paths[N_VIEWS][treecmp::PATHLEN];
+      uint n = 0;
+      for(uint r=0; (r<t.n) && (n<N_VIEWS); r++) if( (t.e[i].mask >> r) & 1 ) {
+        t.Path( i, r, paths[n] );
+        names[n] = paths[n]; n++;
+      }
+      qword pos = (t.e[i].state == treecmp::T_DIFF) ? t.e[i].diffpos - t.e[i].diffpos % lf.BX : 0;
+      if( OpenFiles( names, n, pos ) == 0 ) {
+        term->AddLine("Error: can't open the files of this entry");
+        return true;
+      }
+      F_treesel = i;
+      char nm[128];  // Path shortened to fit the line
+      TruncatePath(nm, t.e[i].name, sizeof(nm)-1);
+      snprintf(buf, sizeof(buf), "Opened %u: %s (%s)", i, nm, stname[t.e[i].state]);
+      term->AddLine(buf);
+      return true;
+    }
 
-        // Truncate path to fit terminal width
-        TruncatePath(truncated, path_to_display, max_path_width);
-        snprintf(buf, sizeof(buf), "%u: %s", i, truncated);
-        term->AddLine(buf);
+    // Roots, separated by spaces; "quoted" roots may contain spaces
+    char roots[N_VIEWS][MAX_PATH];
+    char* rp[N_VIEWS];
+    uint n = 0, f_check = 0;
+    if( strncmp(arg, "-c", 2) == 0 && (arg[2] == ' ' || arg[2] == '\t') ) {
+      f_check = 1;
+      for( arg += 2; *arg == ' ' || *arg == '\t'; arg++ );
+    }
+    while( *arg && (n < N_VIEWS) ) {
+      uint l = 0;
+      char q = (*arg == '"') ? *arg++ : 0;
+      while( *arg && (q ? (*arg != q) : (*arg != ' ' && *arg != '\t')) ) {
+        if( l < MAX_PATH-1 ) roots[n][l++] = *arg;
+        arg++;
       }
+      if( q && *arg ) arg++;
+      roots[n][l] = 0;
+      rp[n] = roots[n]; n++;
+      while( *arg == ' ' || *arg == '\t' ) arg++;
     }
+    if( n < 2 ) {
+      term->AddLine("Usage: tree [-c] <dir> <dir> [...] | tree [list [N]|<N>|next|off]");
+      term->AddLine("  -c = compare contents even where size and modification time match");
+      return true;
+    }
+    treescan.stop();
+    F_treesel = -1;
+    if( treescan.start( F_tree, rp, n, f_check ) == 0 ) {
+      term->AddLine("Error: can't start tree comparison");
+      return true;
+    }
+    sprintf(buf, "Tree comparison of %u roots started; tree = show progress and changed files", n);
+    term->AddLine(buf);
     return true;
   }
 
-  // Parse "h" command: set terminal height
-  if( cmd[0] == 'h' && (cmd[1] == ' ' || cmd[1] == '\t') ) {
-    const char* arg = cmd + 2;
+  // Parse "cluster" command: near-duplicate grouping of the files under a directory
+  // Syntax: "cluster <dir> [<similarity 0..1>]" (start; default 0.5), "cluster" (progress or clusters),
+  // "cluster list [N]" (N files per cluster), "cluster open <C>" (files of cluster C in the views), "cluster off"
+  if( strncmp(cmd, "cluster", 7) == 0 && (cmd[7] == 0 || cmd[7] == ' ' || cmd[7] == '\t') ) {
+    const char* arg = cmd + 7;
     while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+    simfiles& s = F_sim;
 
-    if( *arg == 0 ) {
-      sprintf(buf, "Current terminal height: %u rows", terminal_SY);
-      term->AddLine(buf);
-      term->AddLine("Usage: h <height> - Set terminal height in rows (symbols)");
+    if( strcmp(arg, "off") == 0 ) {
+      clusterscan.stop();
+      s.Quit();
+      s.list.n = s.f_listed = s.f_done = 0;
+      term->AddLine("Clusters cleared");
       return true;
     }
 
-    // Parse height
-    int new_height = 0;
-    sscanf(arg, "%d", &new_height);
+    // Progress, or the clusters with their files
+    if( (*arg == 0) || (strncmp(arg, "list", 4) == 0) ) {
+      if( s.list.n == 0 ) {
+        term->AddLine("No clustering yet: use cluster <dir> [<similarity>]");
+        return true;
+      }
+      if( s.f_listed == 0 ) {
+        term->AddLine(clusterscan.f_run ? "Cluster: listing files..." : "Cluster: stopped while listing (cluster off = clear)");
+        return true;
+      }
+      if( s.f_done == 0 ) {
+        sprintf(buf, "Cluster: %u of %u files signed%s (%llu MB read)", uint(s.ndone), s.nf,
+                clusterscan.f_run ? "" : " (stopped)", clusterscan.Bytes() >> 20);
+        term->AddLine(buf);
+        return true;
+      }
+      uint i, c, k, cnt[simfiles::S_SKIP+1], grouped = s.ncl ? s.cbeg[s.ncl] : 0;
+      bzero(cnt, simfiles::S_SKIP+1);
+      for( i=0; i<s.nf; i++ ) cnt[s.state[i]]++;
+      sprintf(buf, "Cluster: %u files (%llu MB read), %u in %u clusters at >= %u%% similarity; %u empty, %u unreadable",
+              cnt[simfiles::S_DONE], clusterscan.Bytes() >> 20, grouped, s.ncl, s.thr*100/simfiles::K,
+              cnt[simfiles::S_EMPTY], cnt[simfiles::S_ERROR]);
+      term->AddLine(buf);
+      if( s.list.nerr ) {
+        sprintf(buf, "  %u directories could not be read", s.list.nerr);
+        term->AddLine(buf);
+      }
+      // Files of each cluster with their estimated similarity to its first file
+      uint max_files = (*arg == 0) ? 4 : 64, max_cl = (*arg == 0) ? 16 : ~0U;
+      if( *arg ) sscanf(arg + 4, "%u", &max_files);
+      for( c=0; (c<s.ncl) && (c<max_cl); c++ ) {
+        uint b = s.cbeg[c], e = s.cbeg[c+1];
+        sprintf(buf, "  cluster %u: %u files", c, e-b);
+        term->AddLine(buf);
+        for( k=b; (k<e) && (k-b<max_files); k++ ) {
+          snprintf(buf, sizeof(buf), "    %3u%% %s", s.Same( s.cl[b], s.cl[k] )*100/simfiles::K, s.list.e[s.cl[k]].name);
+          term->AddLine(buf);
+        }
+        if( e-b > max_files ) {
+          sprintf(buf, "    ... %u more", e-b-max_files);
+          term->AddLine(buf);
+        }
+      }
+      if( s.ncl > max_cl ) {
+        sprintf(buf, "  ... %u more clusters (cluster list to show all)", s.ncl - max_cl);
+        term->AddLine(buf);
+      }
+      return true;
+    }
 
-    if( new_height < 2 || new_height > 100 ) {
-      term->AddLine("Error: height must be between 2 and 100 rows");
+    // Open the first files of a cluster side by side
+    if( strncmp(arg, "open", 4) == 0 ) {
+      uint c, k, n;
+      if( s.f_done == 0 ) {
+        term->AddLine("No clusters yet: use cluster <dir> [<similarity>]");
+        return true;
+      }
+      if( (sscanf(arg + 4, "%u", &c) != 1) || (c >= s.ncl) ) {
+        term->AddLine("Error: no such cluster");
+        return true;
+      }
+      char* names[N_VIEWS];
+      char paths[N_VIEWS][treecmp::PATHLEN];
+      for( n=0,k=s.cbeg[c]; (k<s.cbeg[c+1]) && (n<N_VIEWS); k++ ) {
+        s.list.Path( s.cl[k], 0, paths[n] );
+        names[n] = paths[n]; n++;
+      }
+      if( OpenFiles( names, n, 0 ) == 0 ) {
+        term->AddLine("Error: can't open the files of this cluster");
+        return true;
+      }
+      F_treesel = -1;
+      sprintf(buf, "Opened %u of %u files of cluster %u", n, s.cbeg[c+1]-s.cbeg[c], c);
+      term->AddLine(buf);
       return true;
     }
 
-    terminal_SY = new_height;
-    sprintf(buf, "Terminal height set to %u rows. Restarting...", terminal_SY);
+    // Directory ("quoted" if it contains spaces), then the optional threshold
+    char dir[MAX_PATH];
+    double sim = 0.5;
+    uint l = 0;
+    char q = (*arg == '"') ? *arg++ : 0;
+    while( *arg && (q ? (*arg != q) : (*arg != ' ' && *arg != '\t')) ) {
+      if( l < MAX_PATH-1 ) dir[l++] = *arg;
+      arg++;
+    }
+    if( q && *arg ) arg++;
+    dir[l] = 0;
+    while( *arg == ' ' || *arg == '\t' ) arg++;
+    if( (l == 0) || (*arg && ((sscanf(arg, "%lf", &sim) != 1) || (sim <= 0) || (sim > 1))) ) {
+      term->AddLine("Usage: cluster <dir> [<similarity 0..1, default 0.5>] | cluster [list [N]|open <C>|off]");
+      return true;
+    }
+    clusterscan.stop();
+    if( clusterscan.start( s, dir, sim ) == 0 ) {
+      term->AddLine("Error: can't start clustering");
+      return true;
+    }
+    char nm[64];  // Directory shortened to fit the line
+    TruncatePath(nm, dir, sizeof(nm)-1);
+    snprintf(buf, sizeof(buf), "Clustering of %s started; cluster = show progress and clusters", nm);
     term->AddLine(buf);
-    f_need_restart = 1;  // Trigger restart to apply changes
     return true;
   }
 
-  // Parse "s" command: search for pattern
-  // Syntax: "s <pattern>" or "s# <pattern>" where # is file index
-  if( cmd[0] == 's' && (cmd[1] == ' ' || cmd[1] == '\t' || (cmd[1] >= '0' && cmd[1] <= '9')) ) {
-    // Parse file number if present
-    int file_num = -1;  // -1 means use current selection or file 0
-    const char* pattern_start = cmd + 1;
+  // Parse "dedup" command: content-defined chunk dedup report across the open files
+  // Syntax: "dedup" (start, or show progress/report), "dedup all" (restart), "dedup marks on|off" (mark unique chunks
+  // in the views instead of differences), "dedup off" (stop and clear)
+  if( strncmp(cmd, "dedup", 5) == 0 && (cmd[5] == 0 || cmd[5] == ' ' || cmd[5] == '\t') ) {
+    const char* arg = cmd + 5;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+    dedupstats& s = F_dedup;
 
-    if( cmd[1] >= '0' && cmd[1] <= '9' ) {
-      // Parse file index
-      sscanf(cmd + 1, "%d", &file_num);
+    if( strcmp(arg, "off") == 0 ) {
+      dedupscan.stop();
+      s.Quit();
+      term->AddLine("Dedup report cleared");
+      return true;
+    }
 
-      if( file_num < 0 || file_num >= (int)F_num ) {
-        sprintf(buf, "Error: file number must be 0-%d", F_num-1);
-        term->AddLine(buf);
+    if( strncmp(arg, "marks", 5) == 0 ) {
+      for( arg += 5; *arg == ' ' || *arg == '\t'; arg++ );
+      if( strcmp(arg, "on") == 0 || strcmp(arg, "off") == 0 ) {
+        F_dedupview = (arg[1] == 'n');
+        DisplayRedraw();
+      } else if( *arg ) {
+        term->AddLine("Usage: dedup marks [on|off]");
         return true;
       }
+      sprintf(buf, "Dedup marks: %s", F_dedupview ? "on (bytes in chunks found nowhere else are marked)" : "off");
+      term->AddLine(buf);
+      if( F_dedupview && !s.f_done ) term->AddLine("  shown once the report is ready (dedup = start)");
+      return true;
+    }
 
-      // Skip to pattern (find first space/tab after number)
-      pattern_start = cmd + 1;
-      while( *pattern_start >= '0' && *pattern_start <= '9' ) pattern_start++;
-      if( *pattern_start != ' ' && *pattern_start != '\t' ) {
-        term->AddLine("Usage: s <pattern> or s# <pattern>");
-        term->AddLine("  # = file index (0-based)");
-        term->AddLine("  pattern = search pattern (UTF-8 string)");
+    // Progress of the running analysis, or its report
+    if( (*arg == 0) && s.n ) {
+      if( s.f_err ) {
+        term->AddLine(dedupscan.f_run ? "Dedup: incomplete - can't read a file or write a spill file (dedup all = restart)" : "Dedup: stopped");
         return true;
       }
+      if( s.f_done == 0 ) {
+        qword done = 0, total = 0;
+        for(uint i=0; i<s.n; i++) { done += s.done[i]; total += s.size[i]; }
+        char nm[64];  // Spill directory shortened to fit the line
+        TruncatePath(nm, s.tmpdir, sizeof(nm)-1);
+        snprintf(buf, sizeof(buf), "Dedup: %s, %u%% chunked, %u runs spilled to %s%s", s.f_merge ? "merging" : "chunking",
+                 uint( total ? done*100/total : 100 ), uint(s.nspill), nm, dedupscan.f_run ? "" : " (stopped; dedup all = restart)");
+        term->AddLine(buf);
+        return true;
+      }
+      qword chunks = 0, total = 0;
+      for(uint i=0; i<s.n; i++) { chunks += s.chunks[i]; total += s.size[i]; }
+      sprintf(buf, "Dedup: %llu chunks, %llu distinct; %llu of %llu bytes are distinct content (%.2f%%)",
+              chunks, s.distinct, s.dbytes, total, total ? s.dbytes*100.0/total : 0.0);
+      term->AddLine(buf);
+      for(uint i=0; i<s.n; i++) {
+        double sz = s.size[i] ? 100.0/s.size[i] : 0.0;
+        sprintf(buf, "  %u: %llu bytes, unique %llu (%.2f%%), in other files %llu (%.2f%%), repeated within %llu (%.2f%%)",
+                i, s.size[i], s.uniq[i], s.uniq[i]*sz, s.other[i], s.other[i]*sz, s.self[i], s.self[i]*sz);
+        term->AddLine(buf);
+      }
+      // Pairs: how much of file i is present anywhere in file j
+      for(uint i=0; i<s.n; i++) for(uint j=0; j<s.n; j++) if( (i != j) && s.size[i] ) {
+        sprintf(buf, "  of %u present in %u: %llu bytes (%.2f%%)", i, j, s.pair[i][j], s.pair[i][j]*100.0/s.size[i]);
+        term->AddLine(buf);
+      }
+      return true;
     }
 
-    // Skip whitespace to get to pattern
-    while( *pattern_start == ' ' || *pattern_start == '\t' ) pattern_start++;
-
-    if( *pattern_start == 0 ) {
-      term->AddLine("Usage: s <pattern> or s# <pattern>");
-      term->AddLine("  # = file index (0-based)");
-      term->AddLine("  pattern = search pattern (UTF-8 string)");
+    if( *arg && strcmp(arg, "all") != 0 ) {
+      term->AddLine("Usage: dedup [all|marks on|off|off]");
       return true;
     }
-
-    // Convert OEM to UTF-8
-    char utf8_pattern[1024];
-    uint utf8_len = searchscan.OemToUtf8(pattern_start, utf8_pattern, sizeof(utf8_pattern));
-    if( utf8_len == 0 ) {
-      term->AddLine("Error: failed to convert pattern to UTF-8");
+    dedupscan.stop();
+    if( dedupscan.start( s, F_names, F_num ) == 0 ) {
+      term->AddLine("Error: can't open files for the dedup report");
       return true;
     }
+    sprintf(buf, "Dedup report started for %u files; dedup = show progress and results", F_num);
+    term->AddLine(buf);
+    return true;
+  }
 
-    // Initialize search pattern
-    if( searchscan.searcher.InitPattern(utf8_pattern) == 0 ) {
-      term->AddLine("Error: invalid search pattern");
+  // Parse "export" command: patch files built from the differences
+  // Syntax: "export patch [<N>] <file>" (BPS patch turning file 0 into file N, default 1), "export" (progress/result),
+  // "export stop"
+  if( strncmp(cmd, "export", 6) == 0 && (cmd[6] == 0 || cmd[6] == ' ' || cmd[6] == '\t') ) {
+    const char* arg = cmd + 6;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+    PatchExport& e = patchexport;
+
+    if( strcmp(arg, "stop") == 0 ) {
+      e.stop();
+      term->AddLine("Export stopped");
       return true;
     }
 
-    // Determine which file to search and whether to sync all files
-    uint search_file_idx;
-    bool sync_all_files;
+    if( *arg == 0 ) {
+      if( e.phase == PatchExport::P_IDLE ) {
+        term->AddLine("No export yet: use export patch [<N>] <file>");
+        return true;
+      }
+      char nm[64];  // Patch name shortened to fit the line
+      TruncatePath(nm, e.pname, sizeof(nm)-1);
+      if( (e.phase == PatchExport::P_ENCODE) || (e.phase == PatchExport::P_VERIFY) ) {
+        snprintf(buf, sizeof(buf), "Patch %s: %s, %u%%", nm, (e.phase == PatchExport::P_ENCODE) ? "encoding" : "verifying",
+                 uint( e.tsize ? e.done*100/e.tsize : 100 ));
+        term->AddLine(buf);
+        return true;
+      }
+      if( e.phase == PatchExport::P_ERROR ) {
+        snprintf(buf, sizeof(buf), "Patch %s: failed - %s", nm, e.err);
+        term->AddLine(buf);
+        return true;
+      }
+      snprintf(buf, sizeof(buf), "Patch %s: %llu bytes, verified", nm, e.psize);
+      term->AddLine(buf);
+      sprintf(buf, "  target %llu bytes: %llu read from the source, %llu encoded as literals and runs; CRC32 source %08X, target %08X",
+              e.tsize, e.nsame, e.ndiff, e.scrc, e.tcrc);
+      term->AddLine(buf);
+      return true;
+    }
 
-    if( lf.cur_view >= 0 ) {
-      // Selection exists - search only in selected file, don't sync
-      search_file_idx = lf.cur_view;
-      sync_all_files = false;
-    } else if( file_num >= 0 ) {
-      // Explicit file number given - search in that file, sync all files
-      search_file_idx = file_num;
-      sync_all_files = true;
-    } else {
-      // No selection, no file number - default to file 0, sync all files
-      search_file_idx = 0;
-      sync_all_files = true;
+    if( (strncmp(arg, "patch", 5) == 0) && ((arg[5] == ' ') || (arg[5] == '\t')) ) {
+      uint n = 1;
+      for( arg += 5; *arg == ' ' || *arg == '\t'; arg++ );
+      if( (*arg >= '0') && (*arg <= '9') && ((arg[1] == ' ') || (arg[1] == '\t')) ) {
+        n = *arg - '0';
+        for( arg++; *arg == ' ' || *arg == '\t'; arg++ );
+      }
+      if( (n == 0) || (n >= F_num) || (*arg == 0) ) {
+        term->AddLine("Usage: export patch [<N>] <file> - N = target file (1..number of files-1, default 1)");
+        return true;
+      }
+      // File name, "quoted" if it contains spaces
+      char name[MAX_PATH];
+      uint l = 0;
+      char q = (*arg == '"') ? *arg++ : 0;
+      while( *arg && (q ? (*arg != q) : 1) ) {
+        if( l < MAX_PATH-1 ) name[l++] = *arg;
+        arg++;
+      }
+      while( l && ((name[l-1] == ' ') || (name[l-1] == '\t')) ) l--;
+      name[l] = 0;
+      e.stop();
+      if( e.start( F_names[0], F_names[n], name ) == 0 ) {
+        term->AddLine("Error: can't start the export");
+        return true;
+      }
+      char nm[64];  // Name shortened to fit the line
+      TruncatePath(nm, name, sizeof(nm)-1);
+      snprintf(buf, sizeof(buf), "Exporting patch 0 -> %u to %s; export = show progress", n, nm);
+      term->AddLine(buf);
+      return true;
     }
 
-    // Add initial searching message
-    sprintf(buf, "Searching... (pattern length: %u bytes)", searchscan.searcher.GetLength());
-    term->AddLine(buf);
-    DisplayRedraw();  // Update window immediately to show "Searching" message
+    term->AddLine("Usage: export patch [<N>] <file> | export [stop]");
+    return true;
+  }
 
-    // Set busy flag to enable search (and allow interruption)
-    f_busy = 1;
+  // Parse "manifest" command: compare a file against a block hash manifest made on another machine
+  // Syntax: "manifest make [<N>] [<file>]" (hash file N, default 0, into <file>, default <name>.cmpm),
+  // "manifest check [<N>] <file>" (compare file N with the manifest), "manifest" (progress/result),
+  // "manifest next" (go to the next differing block), "manifest off"
+  if( strncmp(cmd, "manifest", 8) == 0 && (cmd[8] == 0 || cmd[8] == ' ' || cmd[8] == '\t') ) {
+    const char* arg = cmd + 8;
+    while( *arg == ' ' || *arg == '\t' ) arg++;  // skip whitespace
+    manifest& m = F_mft;
+    ManifestScan& s = mftscan;
 
-    // Save original position in case pattern is not found
-    qword original_pos = F[search_file_idx].F1pos;
+    if( strcmp(arg, "off") == 0 ) {
+      s.stop();
+      F_mftfile = -1;
+      term->AddLine("Manifest off: overview shows differences");
+      return true;
+    }
 
-    // Perform the search with progress updates (start from next position after current)
-    qword start_pos = F[search_file_idx].F1pos + 1;
-    qword found_pos = searchscan.SearchInFile(search_file_idx, start_pos, term);
+    if( *arg == 0 ) {
+      if( s.st == 0 ) {
+        term->AddLine("No manifest yet: use manifest make [<N>] [<file>] or manifest check [<N>] <file>");
+        return true;
+      }
+      qword total = s.f_check ? s.loc.fsize : m.fsize, done = s.Bytes();
+      char nm[64];  // File names shortened to fit the line
+      if( s.f_done == 0 ) {
+        TruncatePath(nm, s.fname, sizeof(nm)-1);
+        snprintf(buf, sizeof(buf), "Manifest %s: hashing %s, %u%%%s", s.f_check ? "check" : "make", nm,
+                 uint( total ? Min( done, total )*100/total : 100 ), s.f_run ? "" : " (stopped)");
+        term->AddLine(buf);
+        if( s.f_check ) {
+          snprintf(buf, sizeof(buf), "  %u differing blocks so far", s.ndiff);
+          term->AddLine(buf);
+        }
+        return true;
+      }
+      char root[17];
+      for( uint k=0; k<8; k++ ) sprintf(root+2*k, "%02x", m.root[k]);
+      if( s.f_check == 0 ) {
+        TruncatePath(nm, s.mname, sizeof(nm)-1);
+        snprintf(buf, sizeof(buf), "Manifest %s: %llu bytes, %u blocks of %u KB, root %s...%s%s", nm, m.fsize, m.nblk,
+                 uint( 1 << (m.bbits-10) ), root, s.err ? " - " : "", s.err ? s.err : "");
+        term->AddLine(buf);
+        return true;
+      }
+      TruncatePath(nm, m.name, sizeof(nm)-1);
+      snprintf(buf, sizeof(buf), "Manifest of %s (%llu bytes, root %s...) vs file %d (%llu bytes): %u of %u blocks differ%s%s",
+               nm, m.fsize, root, F_mftfile, s.loc.fsize, s.ndiff, Max( m.nblk, s.nblk ), s.err ? " - " : "", s.err ? s.err : "");
+      term->AddLine(buf);
+      // Differing blocks as ranges of consecutive blocks
+      uint b, e, nb = Max( m.nblk, s.nblk ), lines = 0;
+      for( b=0; b<nb; b=e ) {
+        if( !s.Diff(b) ) { e = b+1; continue; }
+        for( e=b+1; (e<nb) && s.Diff(e); e++ );
+        if( ++lines > 16 ) { term->AddLine("  ..."); break; }
+        qword beg = qword(b) << m.bbits, end = Min( qword(e) << m.bbits, Max( m.fsize, s.loc.fsize ) );
+        snprintf(buf, sizeof(buf), "  0x%llX-0x%llX (blocks %u-%u)%s", beg, end, b, e-1,
+                 (b >= s.nblk) ? " past the local end" : (e > m.nblk) ? " past the manifest end" : "");
+        term->AddLine(buf);
+      }
+      return true;
+    }
 
-    // Clear busy flag
-    f_busy = 0;
+    if( strcmp(arg, "next") == 0 ) {
+      if( (F_mftfile < 0) || (s.st == 0) ) {
+        term->AddLine("No manifest check: use manifest check [<N>] <file>");
+        return true;
+      }
+      uint b, nb = Max( m.nblk, s.nblk );
+      for( b = uint( F[F_mftfile].F1pos >> m.bbits )+1; (b<nb) && !s.Diff(b); b++ );
+      if( b >= nb ) {
+        term->AddLine(s.f_done ? "No differing block after this one" : "No differing block after this one yet");
+        return true;
+      }
+      SetViewPos( sqword(qword(b) << m.bbits) - sqword(F[F_mftfile].base) );
+      snprintf(buf, sizeof(buf), "Block %u at 0x%llX", b, qword(b) << m.bbits);
+      term->AddLine(buf);
+      return true;
+    }
 
-    if( found_pos != (qword)(-1LL) ) {
-      // Found! Update file positions
-      if( sync_all_files ) {
-        // Update all file positions to match
-        for(uint i=0; i<F_num; i++) {
-          F[i].SetFilepos(found_pos);
+    uint f_make = (strncmp(arg, "make", 4) == 0) && ((arg[4] == 0) || (arg[4] == ' ') || (arg[4] == '\t'));
+    uint f_check = (strncmp(arg, "check", 5) == 0) && ((arg[5] == ' ') || (arg[5] == '\t'));
+    if( f_make || f_check ) {
+      uint n = 0;
+      for( arg += f_make ? 4 : 5; *arg == ' ' || *arg == '\t'; arg++ );
+      if( (*arg >= '0') && (*arg <= '9') && ((arg[1] == 0) || (arg[1] == ' ') || (arg[1] == '\t')) ) {
+        n = *arg - '0';
+        for( arg++; *arg == ' ' || *arg == '\t'; arg++ );
+      }
+      if( (n >= F_num) || (f_check && (*arg == 0)) ) {
+        term->AddLine("Usage: manifest make [<N>] [<file>] | manifest check [<N>] <file> - N = file (default 0)");
+        return true;
+      }
+      // File name, "quoted" if it contains spaces
+      char name[MAX_PATH];
+      uint l = 0;
+      char q = (*arg == '"') ? *arg++ : 0;
+      while( *arg && (q ? (*arg != q) : 1) ) {
+        if( l < MAX_PATH-1 ) name[l++] = *arg;
+        arg++;
+      }
+      while( l && ((name[l-1] == ' ') || (name[l-1] == '\t')) ) l--;
+      name[l] = 0;
+      if( l == 0 ) snprintf(name, sizeof(name), "%s.cmpm", F_names[n]);
+      s.stop();
+      F_mftfile = -1;
+      char nm[64];  // Name shortened to fit the line
+      TruncatePath(nm, name, sizeof(nm)-1);
+      if( f_make ) {
+        if( s.make( m, F_names[n], name ) == 0 ) {
+          term->AddLine("Error: can't open the file");
+          return true;
         }
-        sprintf(buf, "Pattern found at position 0x%llX (%llu) - all files synchronized", found_pos, found_pos);
-      } else {
-        // Update only the searched file
-        F[search_file_idx].SetFilepos(found_pos);
-        sprintf(buf, "File %d: pattern found at position 0x%llX (%llu)", search_file_idx, found_pos, found_pos);
+        snprintf(buf, sizeof(buf), "Making manifest of file %u in %s; manifest = show progress", n, nm);
+        term->AddLine(buf);
+        return true;
       }
+      m.Quit();
+      if( m.Load( name ) == 0 ) {
+        snprintf(buf, sizeof(buf), "Error: %s is not a manifest or is damaged (root mismatch)", nm);
+        term->AddLine(buf);
+        return true;
+      }
+      if( s.check( m, F_names[n], F_mftmap ) == 0 ) {
+        term->AddLine("Error: can't open the file");
+        return true;
+      }
+      F_mftfile = n;
+      snprintf(buf, sizeof(buf), "Checking file %u against %s (%u blocks of %u KB); overview shows differing blocks", n, nm,
+               m.nblk, uint( 1 << (m.bbits-10) ));
       term->AddLine(buf);
-    } else {
-      // Pattern not found - restore original position
-      F[search_file_idx].SetFilepos(original_pos);
-      sprintf(buf, "File %d: pattern not found", search_file_idx);
-      term->AddLine(buf);
+      return true;
     }
 
-    DisplayRedraw();  // Update hex view display
+    term->AddLine("Usage: manifest make [<N>] [<file>] | manifest check [<N>] <file> | manifest [next|off]");
     return true;
   }
 
@@ -520,10 +2701,10 @@ bool TerminalCommandHandler(Terminal* term, const char* cmd) {
         sprintf(buf, "Error: address 0x%llX is beyond selected file size", addr);
       }
     } else {
-      // No selection - change all files
+      // No selection - change all files (address is relative to their base offsets)
       qword hexview_size = lf.BX * lf.BY;
       for(uint i=0; i<F_num; i++) {
-        qword file_addr = is_eof ? ((F[i].F1size > hexview_size) ? F[i].F1size - hexview_size : 0) : addr;
+        qword file_addr = is_eof ? ((F[i].F1size > hexview_size) ? F[i].F1size - hexview_size : 0) : addr+F[i].base;
         if( file_addr < F[i].F1size ) {
           F[i].SetFilepos(file_addr);
         }
@@ -563,6 +2744,9 @@ WNDCLASS wndclass = {
 int __stdcall WinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow ) {
   int argc=__argc; char **argv=__argv;  // Get command-line arguments
 
+  // Headless comparison: no window, results on stdout
+  if( (argc>1) && (strcmp(argv[1],"--batch")==0) ) return BatchMain( argc-1, argv+1 );
+
   uint c,i,j,l;
 
   char* fil1 = argv[0];  // First filename (defaults to exe name)
@@ -633,6 +2817,16 @@ int __stdcall WinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmd
   lb.lbHatch = HS_HORIZONTAL;
   hPen_help = ExtCreatePen( PS_GEOMETRIC, 2, &lb, 0, NULL );  // Solid white pen for help separator
 
+  // Load block hash sidecars (files without a valid one get theirs built by the scan) and physical layouts
+  for( i=0; i<F_num; i++ ) {
+    qword mt = F[i].F1.mtime();
+    if( F_hash[i].Load( F_names[i], F[i].F1size, mt )==0 ) F_hash[i].Init( F[i].F1size, mt );
+    F_ext[i].Load( F_names[i], F[i].F1, F[i].F1size );
+  }
+
+  // Start background difference scan for the overview (restarted when base offsets change)
+  StartMapScan();
+
   int delta;      // Movement delta for navigation
   int rp1,rp,alt,ctr,shift;  // Key repeat flags, alt key, control key, shift key
   uint mBX,mBY;   // Maximum bytes per line and lines that fit on screen
@@ -669,6 +2863,7 @@ int __stdcall WinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmd
     // Calculate required width for all file views side-by-side
     WX = 2*wfr_x;  // Start with frame borders
     for(i=0;i<F_num;i++) WX += F[i].Calc_WCX( mBX, lf.f_addr64, (i!=F_num-1), lf.display_mode ) * ch1.wmax;
+    WX += lf.f_minimap * 2*ch1.wmax;  // Overview column
 
     // Calculate required height (hex grid + optional help text + optional terminal + frame)
     WY = mBY*ch1.hmax + lf.f_help* help_SY*ch1.hmax + lf.f_terminal* terminal_SY*ch1.hmax + 2*wfr_y+wfr_c;
@@ -696,6 +2891,19 @@ int __stdcall WinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmd
     F[i].SetTextbuf( tb[i], lf.BX, ((i!=F_num-1)?hexfile::f_vertline:0) | lf.f_addr64, lf.display_mode);
     F[i].SetFilepos( F[i].F1pos );  // Initialize file position (loads cache)
   }
+  // Difference mask shared by the views, one bit per file
+  delete[] F_diff;
+  F_diff = new byte[F[0].textlen];
+  bzero( F_diff, F[0].textlen );
+  delete[] F_pal;
+  F_pal = new byte[F[0].textlen];
+  delete[] F_keep;
+  F_keep = new byte[F[0].textlen];
+  bzero( F_dkey );  // Recompute on next paint
+  for(i=0;i<F_num;i++) { F[i].diffbuf = F_diff; F[i].dbit = 1<<i; }
+  map_X = WX;  // Overview column goes right of the last file view
+  map_W = lf.f_minimap * 2*ch1.wmax;
+  WX += map_W;
   WX+=2*wfr_x;  // Add frame borders to total width
 
   // Initialize help text buffer if enabled
@@ -759,6 +2967,26 @@ int __stdcall WinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmd
       delta = (short)HIWORD(msg.wParam);  // Get scroll delta (positive=up, negative=down)
       delta = (delta<0) ? 9 : 8; goto MovePos;
 
+    case WM_LBUTTONDOWN:
+      // Click in overview column: jump all views to that region
+      {
+        uint mx = LOWORD(msg.lParam), my = HIWORD(msg.lParam);
+        if( lf.f_minimap && (f_busy==0) && (mx>=map_X) && (mx<map_X+map_W) && (my<tb[0].WSY) ) {
+          if( F_mftfile>=0 ) {
+            // Manifest overview positions are offsets in the checked file
+            qword pos = F_mftmap.RowPos( my, tb[0].WSY );
+            pos -= pos % lf.BX;
+            SetViewPos( sqword(pos) - sqword(F[F_mftfile].base) );
+          } else {
+            qword pos = dmap.RowPos( my, tb[0].WSY );
+            pos -= pos % lf.BX;  // Keep rows aligned
+            SetViewPos( pos );  // Overview positions are past the base offsets
+          }
+          DisplayRedraw();
+        }
+      }
+      break;
+
     case WM_CLOSE: case WM_NULL:
       // Window close: exit message loop
       goto m_break;
@@ -769,6 +2997,24 @@ int __stdcall WinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmd
         MSG dummy_msg = {0};
         term.HandleMessage(dummy_msg, win);  // Check cursor blink timer
       }
+      // Relocation deltas detected: recompute marks and the overview with them
+      if( relscan.rm && relscan.f_done ) {
+        relscan.stop();
+        F_setgen++;
+        StartMapScan();
+      }
+      // Record search finished: move the views to the record found
+      if( recfind.fmt && recfind.f_done ) {
+        char line[128];
+        qword r = recfind.found;
+        recfind.stop();
+        if( r == ~0ULL ) strcpy( line, "record next: no more differing records" );
+        else {
+          SetViewPos( sqword(r*F_rec.rsize) );
+          snprintf( line, sizeof(line), "Record #%llu at 0x%llX", r, r*F_rec.rsize );
+        }
+        term.AddLine( line );
+      }
       // Check if terminal command requested a restart
       if( f_need_restart ) {
         f_need_restart = 0;
@@ -784,25 +3030,24 @@ int __stdcall WinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmd
 
         bm1.Reset();
 
-        // Compare all files and mark differences
-        {
-          uint d,x[N_VIEWS];
-          for( j=0; j<F[0].textlen; j++ ) {
-            c=0; d=(uint)-1;
-            for(i=0;i<F_num;i++) {
-              x[i] = F[i].viewdata(j);
-              if( x[i]!=(uint)-1 )
-              c|=x[i],d&=x[i];
-            }
-            // Mark position as different if not all files have same byte
-            for(i=0;i<F_num;i++) F[i].diffbuf[j]=((c!=x[i])||(d!=x[i]));
-          }
-        }
+        // Compare all files and mark differences (only if the screen or the settings changed)
+        if( amap.nseg && (lf.cur_view==-1) ) SyncViews();  // Views follow file 0 through insertions/deletions
+        ScreenDiffs();
 
         // Render all file views
         for(i=0;i<F_num;i++) F[i].hexdump(tb[i]);
         for(i=0;i<F_num;i++) tb[i].Print(ch1,bm1);
 
+        // Render difference overview next to the views (marks selected or first view)
+        if( lf.f_minimap && (F_mftfile>=0) ) {
+          i = F_mftfile;  // Manifest check: differing blocks of the checked file
+          F_mftmap.Draw( bm1, map_X,0, map_W,tb[0].WSY, F[i].F1pos, F[i].F1pos+F[i].textlen );
+        } else if( lf.f_minimap ) {
+          i = (lf.cur_view>=0) ? lf.cur_view : 0;
+          qword pos = (F[i].F1pos>F[i].base) ? F[i].F1pos-F[i].base : 0;
+          dmap.Draw( bm1, map_X,0, map_W,tb[0].WSY, pos, pos+F[i].textlen );
+        }
+
         // Render help text
         if( lf.f_help ) {
           DrawLine(dibDC,hPen_help, tb_help.WPX,tb_help.WPY, tb_help.WPX+tb_help.WSX,tb_help.WPY );
@@ -907,6 +3152,14 @@ int __stdcall WinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmd
             diffscan.start();
             break;
 
+          case 'E': // End of the difference run at or after the view top
+            diffscan.start( DiffScan::SCAN_RUNEND );
+            break;
+
+          case 'N': // Next region where files are equal again
+            diffscan.start( DiffScan::SCAN_SYNC );
+            break;
+
           case 'R': // Reload file data
             for(j=0;j<F_num;j++) {
               i = (lf.cur_view==-1) ? j : lf.cur_view;
@@ -931,6 +3184,10 @@ int __stdcall WinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmd
             LoadConfig();
             goto Restart;
 
+          case 'M': // Toggle difference overview column
+            lf.f_minimap ^= 1;
+            goto Restart;
+
           case VK_OEM_MINUS: case VK_SUBTRACT:
             if( ( ctr) || (!alt) ) if( lf.lf.lfHeight<-1 ) lf.lf.lfHeight++;
             if( (!ctr) || ( alt) ) if( lf.lf.lfWidth<-1 ) lf.lf.lfWidth++;
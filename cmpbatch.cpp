@@ -0,0 +1,12 @@
+// Headless comparator - same as "cmp --batch", linked without any window or rendering code
+// Usable on machines without a display (CI jobs, scheduled tasks)
+
+#include <windows.h>
+
+#include "common.h"
+#include "batch.h"
+
+// Entry point - all arguments go to the batch comparison
+int __stdcall WinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow ) {
+  return BatchMain( __argc, __argv );  // argv[0] (program name) stands in for "--batch"
+}
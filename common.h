@@ -24,7 +24,7 @@ typedef signed long long sqword;   // 64-bit signed (for position deltas)
 
 // Zero-initialization templates for various data types
 // Single object: zero out all bytes of the object
-template <class T> void bzero( T &_p ) { int i; byte* p = (byte*)&_p; for( i=0; i<sizeof(_p); i++ ) p[i]=0; }
+template <class T> void bzero( T &_p ) { size_t i; byte* p = (byte*)&_p; for( i=0; i<sizeof(_p); i++ ) p[i]=0; }
 // Fixed-size array: call default constructor (which may zero) for each element
 template <class T, int N> void bzero( T (&p)[N] ) { int i; for( i=0; i<N; i++ ) p[i]=0; }
 // Pointer + count: zero out N elements
@@ -0,0 +1,283 @@
+// Content-defined chunking dedup report implementation
+#include "dedup.h"
+#include "blockhash.h"
+
+// Order of chunk records by hash
+static int CmpHash( const void* a, const void* b ) {
+  qword x = ((const chunkrec*)a)->hash, y = ((const chunkrec*)b)->hash;
+  return (x<y) ? -1 : (x>y);
+}
+
+// Read the next piece of a spilled run into rec
+void chunkrun::Load( void ) {
+  uint k = uint( Min( left, qword(dedupstats::RDRECS) ) );
+  i = n = 0;
+  if( f.sread( rec, k*sizeof(chunkrec) )!=k*sizeof(chunkrec) ) { left=0; return; }  // Truncated: ends the run
+  n = k; left -= k;
+}
+
+// Free buffers and remove the spill file
+void chunkrun::Quit( void ) {
+  delete[] rec; rec=0;
+  if( f.f ) { f.close(); f.f=0; }
+  if( path[0] ) { DeleteFileA( path ); path[0]=0; }
+  n = i = 0; left = 0;
+}
+
+// Set up for n files of the given sizes
+void dedupstats::Init( uint _n, qword* _size ) {
+  uint i;
+  Quit();
+  bzero( *this );
+  n = Min( _n, uint(DK_MAXF) );
+  for( i=0; i<n; i++ ) {
+    size[i] = _size[i];
+    // Granules of at least 512 bytes, at most 2^MAPBITS of them per file
+    for( gbits[i]=9; (size[i]>>gbits[i])>=(1ULL<<MAPBITS); gbits[i]++ );
+    uint l = uint( (size[i]>>gbits[i])/8+1 );
+    umap[i] = new byte[l];
+    bzero( umap[i], l );
+  }
+}
+
+// Free maps
+void dedupstats::Quit( void ) {
+  uint i;
+  for( i=0; i<DK_MAXF; i++ ) { delete[] umap[i]; umap[i]=0; }
+  n = 0; f_done = 0;
+}
+
+// Mark chunk r of a group as unique in its file's map
+// Granules whose first byte lies in the chunk get the mark, so every granule belongs to exactly one chunk.
+void dedupstats::MarkUnique( const chunkrec& r ) {
+  uint s = gbits[r.file];
+  qword g, e = (r.pos+r.len+(1ULL<<s)-1)>>s;
+  for( g=(r.pos+(1ULL<<s)-1)>>s; g<e; g++ ) umap[r.file][g>>3] |= 1<<(g&7);
+}
+
+// Sort the pending records into a run; spill it unless it is the last one
+// Returns 0 if the spill file can't be written
+uint DedupChunker::Flush( uint f_last ) {
+  if( (nrec==0) && !f_last ) return 1;
+  if( nrun>=arun ) {
+    chunkrun* q = new chunkrun[arun*2+8];
+    if( run ) memcpy( q, run, nrun*sizeof(chunkrun) );
+    delete[] run;
+    run = q; arun = arun*2+8;
+  }
+  chunkrun& r = run[nrun++];
+  bzero( r );
+  qsort( rec, nrec, sizeof(chunkrec), CmpHash );
+  if( f_last ) {
+    // Last run stays in memory
+    r.rec = rec; r.n = nrec;
+    rec = 0; nrec = 0;
+    return 1;
+  }
+  snprintf( r.path, sizeof(r.path), "%scmpdd_%u_%u_%u.tmp", ds->tmpdir, uint(GetCurrentProcessId()), file, nrun-1 );
+  uint l = nrec*sizeof(chunkrec), ok = r.f.make( r.path );
+  if( ok ) { ok = (r.f.writ( rec, l )==l); r.f.close(); }
+  r.f.f = 0;
+  if( ok==0 ) return 0;  // The caller removes the partial file with the run
+  r.left = nrec;
+  nrec = 0;
+  InterlockedIncrement( &ds->nspill );
+  return 1;
+}
+
+// Thread function - chunks the file
+void DedupChunker::thread( void ) {
+  uint l,o,have=0,got,end,f_eof=0;
+  qword pos=0;  // File offset of buf[0]
+  filehandle0 f;
+  nrun = arun = 0; run = 0;
+  nrec = 0;
+  buf = new byte[(1<<20)+dedupstats::CHUNK_MAX];
+  rec = new chunkrec[maxrec];
+  if( f.open( name )==0 ) ds->f_err = 1;
+  else {
+    while( *f_run && !f_eof && !ds->f_err ) {
+      got = f.read( buf+have, 1<<20 );
+      f_eof = (got==0);
+      for( end=have+got,o=0; o<end; o+=l ) {
+        l = GearChunk( buf+o, end-o, dedupstats::CHUNK_MIN, dedupstats::CHUNK_AVG, dedupstats::CHUNK_MAX, dedupstats::CHUNK_BITS, f_eof );
+        if( l==0 ) break;  // Needs more data
+        chunkrec& c = rec[nrec++];
+        c.hash = XXH64( buf+o, l ); c.pos = pos+o; c.len = l; c.file = file;
+        ds->chunks[file]++;
+        if( (nrec==maxrec) && (Flush(0)==0) ) { ds->f_err = 1; break; }  // rec is still full: stop chunking
+      }
+      have = end-o; pos += o;
+      memmove( buf, buf+o, have );
+      ds->done[file] += got;
+    }
+    f.close();
+  }
+  if( *f_run && !ds->f_err ) Flush( 1 );
+  delete[] rec; rec=0;
+  delete[] buf; buf=0;
+}
+
+// Start analysing n files; returns 0 if a file can't be opened
+uint DedupScan::start( dedupstats& _ds, char** names, uint n ) {
+  uint i;
+  qword size[DK_MAXF];
+  filehandle0 t;
+  n = Min( n, uint(DK_MAXF) );
+  for( i=0; i<n; i++ ) {
+    if( t.open( names[i] )==0 ) return 0;
+    size[i] = t.size();
+    t.close();
+  }
+  ds = &_ds;
+  ds->Init( n, size );
+  if( GetTempPathA( sizeof(ds->tmpdir), ds->tmpdir )-1>=sizeof(ds->tmpdir)-1 ) strcpy( ds->tmpdir, "./" );
+  for( i=0; i<n; i++ ) {
+    DedupChunker& c = ck[i];
+    c.ds = ds; c.file = i; c.name = names[i]; c.f_run = &f_run;
+    c.maxrec = dedupstats::MEMRECS/n;  // Memory share of each chunker
+  }
+  f_run = 1;
+  return base::start();
+}
+
+// Stop and wait for all threads; removes spill files
+void DedupScan::stop( void ) {
+  if( ds==0 ) return;
+  f_run = 0;
+  base::quit();
+  ds = 0;
+}
+
+// Heap of runs ordered by the hash of their current record
+static void SiftDown( chunkrun** h, uint nh, uint k ) {
+  uint c;
+  chunkrun* x = h[k];
+  for( ; (c=2*k+1)<nh; k=c ) {
+    if( (c+1<nh) && (h[c+1]->Head()->hash<h[c]->Head()->hash) ) c++;
+    if( x->Head()->hash<=h[c]->Head()->hash ) break;
+    h[k] = h[c];
+  }
+  h[k] = x;
+}
+
+// Open a spilled run and read its first piece; returns 0 if the file can't be opened
+static uint OpenRun( chunkrun& r ) {
+  if( r.left ) {
+    if( r.f.open( r.path )==0 ) { r.f.f=0; return 0; }
+    r.rec = new chunkrec[dedupstats::RDRECS];
+    r.Load();
+  }
+  return 1;
+}
+
+// Merge spilled runs in[0..nin-1] into spilled run out (number id), removing the inputs; returns 0 on failure or stop
+uint DedupScan::Pass( chunkrun** in, uint nin, chunkrun& out, uint id ) {
+  uint k,nh=0,nb=0,ok=1;
+  uint l = dedupstats::RDRECS*sizeof(chunkrec);
+  chunkrun** h = new chunkrun*[nin];
+  chunkrec* b = new chunkrec[dedupstats::RDRECS];  // Write buffer
+  bzero( out );
+  snprintf( out.path, sizeof(out.path), "%scmpdd_%u_m%u.tmp", ds->tmpdir, uint(GetCurrentProcessId()), id );
+  if( out.f.make( out.path )==0 ) { out.f.f=0; ok=0; }
+  for( k=0; ok && (k<nin); k++ ) {
+    if( OpenRun( *in[k] )==0 ) ok=0;
+    else if( in[k]->Head() ) h[nh++] = in[k];
+  }
+  for( k=nh/2; k-->0; ) SiftDown( h, nh, k );
+  while( ok && nh && f_run ) {
+    chunkrun* r = h[0];
+    b[nb++] = *r->Head();
+    if( nb==dedupstats::RDRECS ) { ok = (out.f.writ( b, l )==l); out.left += nb; nb = 0; }
+    r->Next();
+    if( r->Head()==0 ) h[0] = h[--nh];
+    if( nh ) SiftDown( h, nh, 0 );
+  }
+  if( ok && nb ) { l = nb*sizeof(chunkrec); ok = (out.f.writ( b, l )==l); out.left += nb; }
+  if( out.f.f ) { out.f.close(); out.f.f=0; }
+  for( k=0; k<nin; k++ ) in[k]->Quit();  // Inputs are fully read (or useless after a failure)
+  delete[] b;
+  delete[] h;
+  return ok && f_run;
+}
+
+// Merge the runs of all chunkers in hash order and count each group of equal chunks
+// Groups are counted on the fly (per-file counts and bytes), so a chunk repeated millions of times needs no memory.
+// At most MAXFAN spilled runs are open at once: while there are more, passes merge the oldest MAXFAN into one.
+void DedupScan::Merge( void ) {
+  uint i,j,k,m,nh=0,nr=0,ns=0,b=0,cnt[DK_MAXF],f_other;
+  qword len[DK_MAXF];
+  chunkrec first;
+  dedupstats& s = *ds;
+  for( i=0; i<s.n; i++ ) nr += ck[i].nrun;
+  chunkrun** h = new chunkrun*[nr+1];
+  // Spilled runs, in order, with room for the pass runs (each pass takes MAXFAN and adds one)
+  chunkrun** a = new chunkrun*[nr+nr/(dedupstats::MAXFAN-1)+1];
+  mrun = new chunkrun[nr/(dedupstats::MAXFAN-1)+1];
+  nmrun = 0;
+  for( i=0; i<s.n; i++ ) for( k=0; k<ck[i].nrun; k++ ) {
+    chunkrun& r = ck[i].run[k];
+    if( r.left ) a[ns++] = &r;
+    else if( r.Head() ) h[nh++] = &r;  // Last run of a chunker, in memory
+  }
+  for( ; f_run && (ns-b>dedupstats::MAXFAN); b+=dedupstats::MAXFAN ) {
+    uint ok = Pass( a+b, dedupstats::MAXFAN, mrun[nmrun], nmrun );
+    a[ns++] = &mrun[nmrun++];  // Counted even on failure, so its file is removed with the runs
+    if( ok==0 ) {
+      if( f_run ) s.f_err = 1;
+      delete[] a;
+      delete[] h;
+      return;
+    }
+  }
+  for( ; b<ns; b++ ) {
+    if( OpenRun( *a[b] )==0 ) { s.f_err=1; continue; }
+    if( a[b]->Head() ) h[nh++] = a[b];
+  }
+  delete[] a;
+  for( k=nh/2; k-->0; ) SiftDown( h, nh, k );
+
+  for( m=0; ; ) {
+    // Close the group when the hash changes (or the runs end)
+    if( m && ((nh==0) || (h[0]->Head()->hash!=first.hash)) ) {
+      s.distinct++; s.dbytes += first.len;
+      if( m==1 ) { s.uniq[first.file] += first.len; s.MarkUnique( first ); }
+      else for( i=0; i<s.n; i++ ) if( cnt[i] ) {
+        for( f_other=0,j=0; j<s.n; j++ ) if( (j!=i) && cnt[j] ) { s.pair[i][j] += len[i]; f_other=1; }
+        if( f_other ) s.other[i] += len[i];
+        if( cnt[i]>1 ) s.self[i] += len[i];
+      }
+      m = 0;
+    }
+    if( (nh==0) || (f_run==0) ) break;
+    chunkrun* r = h[0];
+    chunkrec& c = *r->Head();
+    if( m==0 ) { first = c; bzero( cnt ); bzero( len ); }
+    cnt[c.file]++; len[c.file] += c.len; m++;
+    r->Next();
+    if( r->Head()==0 ) h[0] = h[--nh];
+    if( nh ) SiftDown( h, nh, 0 );
+  }
+  delete[] h;
+}
+
+// Thread function - runs the chunkers and merges their runs
+void DedupScan::thread( void ) {
+  uint i,k;
+  dedupstats& s = *ds;
+
+  for( i=0; i<s.n; i++ ) ck[i].start();
+  for( i=0; i<s.n; i++ ) ck[i].quit();
+  if( f_run && !s.f_err ) {
+    s.f_merge = 1;
+    Merge();
+    if( f_run && !s.f_err ) s.f_done = 1;
+  }
+  // Runs are freed and spill files removed whether the merge finished or not
+  for( i=0; i<s.n; i++ ) {
+    for( k=0; k<ck[i].nrun; k++ ) ck[i].run[k].Quit();
+    delete[] ck[i].run; ck[i].run=0; ck[i].nrun=0;
+  }
+  for( k=0; k<nmrun; k++ ) mrun[k].Quit();
+  delete[] mrun; mrun=0; nmrun=0;
+}
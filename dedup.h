@@ -0,0 +1,133 @@
+// Content-defined chunking dedup report: how much of each open file is present elsewhere, at any position
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include "common.h"
+#include "thread.h"
+#include "file_win.h"
+#include "gear.h"
+#include "diffkern.h"
+
+// Chunk of an open file
+struct chunkrec {
+  qword hash;  // XXH64 of the chunk
+  qword pos;   // Offset in the file
+  uint  len;   // Chunk length
+  uint  file;  // File number
+};
+
+// Run of chunk records sorted by hash: kept in memory, or spilled to a temporary file and read back in pieces
+struct chunkrun {
+  chunkrec* rec;       // Records (in memory) or read buffer (spilled)
+  uint  n, i;          // Records in rec, current record
+  qword left;          // Spilled records not yet read into rec
+  filehandle0 f;       // Spill file (0 while in memory)
+  char  path[MAX_PATH+64];  // Spill file name (tmpdir, process, file and run numbers)
+
+  // Current record (0 past the end)
+  chunkrec* Head( void ) { return (i<n) ? &rec[i] : 0; }
+
+  // Read the next piece of a spilled run into rec
+  void Load( void );
+
+  // Move to the next record, refilling the buffer of a spilled run
+  void Next( void ) { if( (++i>=n) && left ) Load(); }
+
+  // Free buffers and remove the spill file
+  void Quit( void );
+};
+
+// Dedup results of the open files
+// Chunks are grouped by hash across all files: a chunk is unique when no other chunk of any file has its hash,
+// "in other files" when some other file holds it too, and "repeated" when the same file holds it more than once.
+// Filled by DedupScan; the terminal reads it once f_done is set (progress counters at any time).
+struct dedupstats {
+  enum{ CHUNK_MIN=1<<11, CHUNK_AVG=1<<13, CHUNK_MAX=1<<16, CHUNK_BITS=13 };  // 2KB min, ~8KB average, 64KB max
+  enum{ MEMRECS=1<<21, RDRECS=1<<12, MAPBITS=23 };  // Records in memory before spilling (48MB), per read-back, map bits per file
+  enum{ MAXFAN=64 };  // Spilled runs read back at once; beyond that they are merged in passes first
+
+  uint  n;                        // Files
+  qword size[DK_MAXF];            // File sizes
+  qword chunks[DK_MAXF];          // Chunks per file
+  qword uniq[DK_MAXF];            // Bytes in unique chunks
+  qword other[DK_MAXF];           // Bytes in chunks also present in another file
+  qword self[DK_MAXF];            // Bytes in chunks present more than once in the same file
+  qword pair[DK_MAXF][DK_MAXF];   // Bytes of file i in chunks also present in file j
+  qword distinct, dbytes;         // Distinct chunks and their bytes (each counted once)
+  uint  gbits[DK_MAXF];           // Map granule log2 per file
+  byte* umap[DK_MAXF];            // Bit per granule: the chunk holding its first byte is unique
+  volatile qword done[DK_MAXF];   // Bytes chunked per file
+  volatile LONG nspill;           // Runs spilled to disk
+  volatile uint f_merge;          // All files chunked; merging runs
+  volatile uint f_done;           // Results are ready
+  volatile uint f_err;            // A file could not be read or a spill file written
+  char  tmpdir[MAX_PATH];         // Spill directory (with trailing separator)
+
+  // Set up for n files of the given sizes
+  void Init( uint _n, qword* _size );
+
+  // Free maps
+  void Quit( void );
+
+  // File i's byte at pos is in a unique chunk (granule resolution)
+  uint Unique( uint i, qword pos ) {
+    qword g = pos>>gbits[i];
+    return umap[i] && (pos<size[i]) && ((umap[i][g>>3]>>(g&7))&1);
+  }
+
+  // Mark chunk r of a group as unique in its file's map
+  void MarkUnique( const chunkrec& r );
+};
+
+// Chunker of one file: records of its chunks, sorted and spilled whenever the memory share is full
+struct DedupChunker : thread<DedupChunker> {
+
+  typedef thread<DedupChunker> base;
+
+  dedupstats* ds;           // Target results
+  uint  file;               // File number
+  char* name;               // File name
+  volatile uint* f_run;     // Shared stop flag
+  byte* buf;                // Read buffer (1MB plus one unfinished chunk)
+  chunkrec* rec;            // Records not spilled yet
+  uint  nrec, maxrec;       // Records used / memory share
+  chunkrun* run;            // Sorted runs
+  uint  nrun, arun;         // Runs used / allocated
+
+  // Sort the pending records into a run; spill it unless it is the last one
+  uint Flush( uint f_last );
+
+  // Thread function - chunks the file
+  void thread( void );
+};
+
+// Background dedup analysis: one chunker per file, then one merge of all sorted runs
+// Memory is bounded by MEMRECS records plus MAXFAN read buffers, whatever the file sizes: when more runs
+// were spilled, the oldest MAXFAN are merged into one spilled run until the rest fit.
+struct DedupScan : thread<DedupScan> {
+
+  typedef thread<DedupScan> base;
+
+  dedupstats* ds;                 // Target results
+  DedupChunker ck[DK_MAXF];       // Per-file chunkers
+  chunkrun* mrun;                 // Runs made by merge passes
+  uint  nmrun;                    // Merge pass runs used
+  volatile uint f_run;            // Cleared to stop
+
+  // Start analysing n files; returns 0 if a file can't be opened
+  uint start( dedupstats& _ds, char** names, uint n );
+
+  // Stop and wait for all threads; removes spill files
+  void stop( void );
+
+  // Merge spilled runs in[0..nin-1] into spilled run out (number id), removing the inputs; returns 0 on failure or stop
+  uint Pass( chunkrun** in, uint nin, chunkrun& out, uint id );
+
+  // Merge the runs of all chunkers in hash order and count each group of equal chunks
+  void Merge( void );
+
+  // Thread function - runs the chunkers and merges their runs
+  void thread( void );
+};
+
+#endif // DEDUP_H
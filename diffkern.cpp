@@ -0,0 +1,336 @@
+// Difference kernels implementation
+#include "diffkern.h"
+
+#ifdef DK_SSE2
+#include <emmintrin.h>
+#endif
+
+// Count positions in [0,len) where the n buffers don't all hold the same byte
+uint DiffCount( byte** p, uint n, uint len, const byte* keep ) {
+  uint i,j=0,k,r=0;
+  if( n<2 ) return 0;  // Single file never differs
+
+#ifdef DK_SSE2
+  // Equality of all buffers is AND of (p[0]==p[i]) lane masks; equal lanes are -1,
+  // so subtracting the mask counts matches per lane, summed with SAD every 255 steps
+  // Ignored lanes are ORed into the equal mask (the difference mask is ANDed with keep)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sum = zero;
+  while( j+16<=len ) {
+    __m128i acc = zero;
+    for( k=0; (k<255) && (j+16<=len); k++,j+=16 ) {
+      __m128i a = _mm_loadu_si128( (const __m128i*)&p[0][j] );
+      __m128i e = _mm_cmpeq_epi8( a, _mm_loadu_si128( (const __m128i*)&p[1][j] ) );
+      for( i=2; i<n; i++ ) e = _mm_and_si128( e, _mm_cmpeq_epi8( a, _mm_loadu_si128( (const __m128i*)&p[i][j] ) ) );
+      if( keep ) e = _mm_or_si128( e, _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)&keep[j] ), zero ) );
+      acc = _mm_sub_epi8( acc, e );
+    }
+    sum = _mm_add_epi64( sum, _mm_sad_epu8( acc, zero ) );
+  }
+  r = j - uint(_mm_cvtsi128_si32(sum)) - uint(_mm_cvtsi128_si32(_mm_srli_si128(sum,8)));
+#endif
+
+  // Scalar tail (or whole buffer without SSE2)
+  for( ; j<len; j++ ) {
+    if( keep && (keep[j]==0) ) continue;
+    for( i=1; i<n; i++ ) if( p[i][j]!=p[0][j] ) break;
+    r += (i<n);
+  }
+  return r;
+}
+
+// Index of first position in [0,len) where the n buffers don't all hold the same byte (len if none)
+uint DiffFirst( byte** p, uint n, uint len, const byte* keep ) {
+  uint i,j=0,m;
+  if( n<2 ) return len;
+
+#ifdef DK_SSE2
+  // Same lane masks as DiffCount; movemask has a zero bit for every differing lane
+  const __m128i zero = _mm_setzero_si128();
+  for( ; j+16<=len; j+=16 ) {
+    __m128i a = _mm_loadu_si128( (const __m128i*)&p[0][j] );
+    __m128i e = _mm_cmpeq_epi8( a, _mm_loadu_si128( (const __m128i*)&p[1][j] ) );
+    for( i=2; i<n; i++ ) e = _mm_and_si128( e, _mm_cmpeq_epi8( a, _mm_loadu_si128( (const __m128i*)&p[i][j] ) ) );
+    if( keep ) e = _mm_or_si128( e, _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)&keep[j] ), zero ) );
+    m = _mm_movemask_epi8(e) ^ 0xFFFF;
+    if( m ) return j + Ctz32(m);
+  }
+#endif
+
+  for( ; j<len; j++ ) {
+    if( keep && (keep[j]==0) ) continue;
+    for( i=1; i<n; i++ ) if( p[i][j]!=p[0][j] ) return j;
+  }
+  return len;
+}
+
+// Index of first position in [0,len) where all n buffers hold the same byte (len if none)
+uint SameFirst( byte** p, uint n, uint len, const byte* keep ) {
+  uint i,j=0,m;
+  if( n<2 ) return 0;
+
+#ifdef DK_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for( ; j+16<=len; j+=16 ) {
+    __m128i a = _mm_loadu_si128( (const __m128i*)&p[0][j] );
+    __m128i e = _mm_cmpeq_epi8( a, _mm_loadu_si128( (const __m128i*)&p[1][j] ) );
+    for( i=2; i<n; i++ ) e = _mm_and_si128( e, _mm_cmpeq_epi8( a, _mm_loadu_si128( (const __m128i*)&p[i][j] ) ) );
+    if( keep ) e = _mm_or_si128( e, _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)&keep[j] ), zero ) );
+    m = _mm_movemask_epi8(e);
+    if( m ) return j + Ctz32(m);
+  }
+#endif
+
+  for( ; j<len; j++ ) {
+    if( keep && (keep[j]==0) ) return j;
+    for( i=1; i<n; i++ ) if( p[i][j]!=p[0][j] ) break;
+    if( i>=n ) return j;
+  }
+  return len;
+}
+
+// Store m[j] = (1<<n)-1 (all buffers marked) where the n buffers don't all hold the same byte, else 0
+void DiffMask( byte** p, uint n, uint len, byte* m, const byte* keep ) {
+  uint i,j=0;
+  byte all = byte( (1U<<n)-1 );
+
+#ifdef DK_SSE2
+  // Same lane masks as DiffCount; the equal mask clears the all-files byte
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i va = _mm_set1_epi8( char(all) );
+  for( ; (n>1) && (j+16<=len); j+=16 ) {
+    __m128i a = _mm_loadu_si128( (const __m128i*)&p[0][j] );
+    __m128i e = _mm_cmpeq_epi8( a, _mm_loadu_si128( (const __m128i*)&p[1][j] ) );
+    for( i=2; i<n; i++ ) e = _mm_and_si128( e, _mm_cmpeq_epi8( a, _mm_loadu_si128( (const __m128i*)&p[i][j] ) ) );
+    if( keep ) e = _mm_or_si128( e, _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)&keep[j] ), zero ) );
+    _mm_storeu_si128( (__m128i*)&m[j], _mm_andnot_si128( e, va ) );
+  }
+#endif
+
+  for( ; j<len; j++ ) {
+    for( i=1; i<n; i++ ) if( p[i][j]!=p[0][j] ) break;
+    m[j] = ( (i<n) && ((keep==0) || keep[j]) ) ? all : 0;
+  }
+}
+
+// Add per-bit-position counts of set bits in a^b over [0,len) to cnt[0..7] (bit 0 = LSB)
+void BitFlips( const byte* a, const byte* b, uint len, qword* cnt ) {
+  uint j=0,k;
+
+#ifdef DK_SSE2
+  // Shifting 16-bit lanes left by 7-k moves bit k of both bytes to their top bits,
+  // so movemask collects bit k of all 16 XOR bytes and popcount sums them
+  uint c[8] = {0,0,0,0,0,0,0,0};
+  for( ; j+16<=len; j+=16 ) {
+    __m128i x = _mm_xor_si128( _mm_loadu_si128( (const __m128i*)&a[j] ), _mm_loadu_si128( (const __m128i*)&b[j] ) );
+    c[7] += Popcnt32( _mm_movemask_epi8(x) );
+    c[6] += Popcnt32( _mm_movemask_epi8( _mm_slli_epi16(x,1) ) );
+    c[5] += Popcnt32( _mm_movemask_epi8( _mm_slli_epi16(x,2) ) );
+    c[4] += Popcnt32( _mm_movemask_epi8( _mm_slli_epi16(x,3) ) );
+    c[3] += Popcnt32( _mm_movemask_epi8( _mm_slli_epi16(x,4) ) );
+    c[2] += Popcnt32( _mm_movemask_epi8( _mm_slli_epi16(x,5) ) );
+    c[1] += Popcnt32( _mm_movemask_epi8( _mm_slli_epi16(x,6) ) );
+    c[0] += Popcnt32( _mm_movemask_epi8( _mm_slli_epi16(x,7) ) );
+  }
+  for( k=0; k<8; k++ ) cnt[k] += c[k];  // len<2^32, so per-call counts fit in uint
+#endif
+
+  for( ; j<len; j++ ) {
+    for( k=0; k<8; k++ ) cnt[k] += ((a[j]^b[j])>>k)&1;
+  }
+}
+
+// Bit alignment: add to cnt[s] (s=0..7) the number of positions j in [0,len) where a[j] equals the byte
+// of b that starts s bits into b[j] (bits taken MSB first, so b[j+1] supplies the low s bits); b needs len+1 bytes
+void ShiftMatch( const byte* a, const byte* b, uint len, qword* cnt ) {
+  uint j=0,k,s;
+
+#ifdef DK_SSE2
+  // Funnel shift of 16 bytes: SSE2 has no byte shifts, so 16-bit lane shifts are masked
+  // to drop the bits that crossed into the neighbouring byte. All 8 shifts share the loads;
+  // match counts per lane are summed with SAD every 255 steps as in DiffCount
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sl[8], sr[8], ml[8], mr[8], sum[8];
+  for( s=0; s<8; s++ ) {
+    sl[s] = _mm_cvtsi32_si128(s); sr[s] = _mm_cvtsi32_si128(8-s);
+    ml[s] = _mm_set1_epi8( char(0xFF<<s) ); mr[s] = _mm_set1_epi8( char(0xFF>>(8-s)) );
+    sum[s] = zero;
+  }
+  while( j+16<=len ) {
+    __m128i acc[8];
+    for( s=0; s<8; s++ ) acc[s] = zero;
+    for( k=0; (k<255) && (j+16<=len); k++,j+=16 ) {
+      __m128i x = _mm_loadu_si128( (const __m128i*)&a[j] );
+      __m128i lo = _mm_loadu_si128( (const __m128i*)&b[j] );
+      __m128i hi = _mm_loadu_si128( (const __m128i*)&b[j+1] );
+      acc[0] = _mm_sub_epi8( acc[0], _mm_cmpeq_epi8( x, lo ) );
+      for( s=1; s<8; s++ ) {
+        __m128i y = _mm_or_si128( _mm_and_si128( _mm_sll_epi16(lo,sl[s]), ml[s] ), _mm_and_si128( _mm_srl_epi16(hi,sr[s]), mr[s] ) );
+        acc[s] = _mm_sub_epi8( acc[s], _mm_cmpeq_epi8( x, y ) );
+      }
+    }
+    for( s=0; s<8; s++ ) sum[s] = _mm_add_epi64( sum[s], _mm_sad_epu8( acc[s], zero ) );
+  }
+  for( s=0; s<8; s++ ) cnt[s] += uint(_mm_cvtsi128_si32(sum[s])) + uint(_mm_cvtsi128_si32(_mm_srli_si128(sum[s],8)));
+#endif
+
+  for( ; j<len; j++ ) {
+    cnt[0] += (a[j]==b[j]);
+    for( s=1; s<8; s++ ) cnt[s] += (a[j]==byte((b[j]<<s)|(b[j+1]>>(8-s))));
+  }
+}
+
+// Disagreement mask of values x[0..n-1] (-1 = missing byte, which is a value of its own)
+uint ConsensusBits( const uint* x, uint n ) {
+  uint i,j,c[DK_MAXF],mx=0,nmax=0,r=0;
+  // c[i] = number of buffers holding the value of buffer i; the consensus is unique
+  // if the number of buffers with the largest count equals that count
+  for( i=0; i<n; i++ ) {
+    for( c[i]=0,j=0; j<n; j++ ) c[i] += (x[j]==x[i]);
+    mx = Max( mx, c[i] );
+  }
+  for( i=0; i<n; i++ ) nmax += (c[i]==mx);
+  for( i=0; i<n; i++ ) if( (nmax!=mx) || (c[i]!=mx) ) r |= 1<<i;
+  return r;
+}
+
+#ifdef DK_SSE2
+// Disagreement masks of 16 positions at j: same counts as ConsensusBits, per lane
+// Equal lanes are -1, so subtracting each pair's equality mask from both counts counts matches
+static inline __m128i ConsVec( byte** p, uint n, uint j, const byte* keep ) {
+  uint i,k;
+  const __m128i zero = _mm_setzero_si128();
+  __m128i v[DK_MAXF], c[DK_MAXF], mx, nmax, uniq, r=zero;
+  for( i=0; i<n; i++ ) {
+    v[i] = _mm_loadu_si128( (const __m128i*)&p[i][j] );
+    c[i] = _mm_set1_epi8(1);
+  }
+  for( i=0; i<n; i++ ) for( k=i+1; k<n; k++ ) {
+    __m128i e = _mm_cmpeq_epi8( v[i], v[k] );
+    c[i] = _mm_sub_epi8( c[i], e );
+    c[k] = _mm_sub_epi8( c[k], e );
+  }
+  for( mx=c[0],i=1; i<n; i++ ) mx = _mm_max_epu8( mx, c[i] );
+  for( nmax=zero,i=0; i<n; i++ ) nmax = _mm_sub_epi8( nmax, _mm_cmpeq_epi8( c[i], mx ) );
+  uniq = _mm_cmpeq_epi8( nmax, mx );
+  for( i=0; i<n; i++ ) r = _mm_or_si128( r, _mm_andnot_si128( _mm_and_si128( uniq, _mm_cmpeq_epi8( c[i], mx ) ), _mm_set1_epi8(char(1<<i)) ) );
+  if( keep ) r = _mm_and_si128( r, _mm_loadu_si128( (const __m128i*)&keep[j] ) );
+  return r;
+}
+#endif
+
+// Disagreement mask of position j of the n buffers (scalar)
+static uint ConsAt( byte** p, uint n, uint j, const byte* keep ) {
+  uint i,x[DK_MAXF];
+  if( keep && (keep[j]==0) ) return 0;
+  for( i=0; i<n; i++ ) x[i] = p[i][j];
+  return ConsensusBits( x, n );
+}
+
+// Store disagreement masks of positions [0,len) to dis[0..len-1]
+void Consensus( byte** p, uint n, uint len, byte* dis, const byte* keep ) {
+  uint j=0;
+#ifdef DK_SSE2
+  for( ; j+16<=len; j+=16 ) _mm_storeu_si128( (__m128i*)&dis[j], ConsVec( p, n, j, keep ) );
+#endif
+  for( ; j<len; j++ ) dis[j] = ConsAt( p, n, j, keep );
+}
+
+// Index of first position in [0,len) where buffer f disagrees with the consensus (len if none)
+uint OutlierFirst( byte** p, uint n, uint len, uint f, const byte* keep ) {
+  uint j=0,m;
+#ifdef DK_SSE2
+  // Shifting 16-bit lanes left by 7-f moves bit f of every byte to its top bit for movemask
+  for( ; j+16<=len; j+=16 ) {
+    m = _mm_movemask_epi8( _mm_sll_epi16( ConsVec( p, n, j, keep ), _mm_cvtsi32_si128(7-f) ) );
+    if( m ) return j + Ctz32(m);
+  }
+#endif
+  for( ; j<len; j++ ) if( (ConsAt( p, n, j, keep )>>f)&1 ) return j;
+  return len;
+}
+
+// Add number of positions in [0,len) where buffer i disagrees with the consensus to cnt[i]
+void OutlierCount( byte** p, uint n, uint len, qword* cnt, const byte* keep ) {
+  uint i,j=0,m;
+#ifdef DK_SSE2
+  // Same bit gathering as BitFlips, one bit position per buffer
+  uint c[DK_MAXF] = {0,0,0,0,0,0,0,0};
+  for( ; j+16<=len; j+=16 ) {
+    __m128i r = ConsVec( p, n, j, keep );
+    for( i=0; i<n; i++ ) c[i] += Popcnt32( _mm_movemask_epi8( _mm_sll_epi16( r, _mm_cvtsi32_si128(7-i) ) ) );
+  }
+  for( i=0; i<n; i++ ) cnt[i] += c[i];
+#endif
+  for( ; j<len; j++ ) {
+    m = ConsAt( p, n, j, keep );
+    for( i=0; i<n; i++ ) cnt[i] += (m>>i)&1;
+  }
+}
+
+#ifdef DK_SSE2
+// Lanes of 16 positions at j whose class lacks a bit of m: a lane misses if any inequality m asks for is an equality
+// (ignored lanes always miss)
+static inline __m128i Miss3Vec( const byte* o, const byte* a, const byte* b, uint j, uint m, const byte* keep ) {
+  __m128i vo = _mm_loadu_si128( (const __m128i*)&o[j] );
+  __m128i va = _mm_loadu_si128( (const __m128i*)&a[j] );
+  __m128i vb = _mm_loadu_si128( (const __m128i*)&b[j] );
+  __m128i r = _mm_setzero_si128();
+  if( m&C3_A ) r = _mm_or_si128( r, _mm_cmpeq_epi8( va, vo ) );
+  if( m&C3_B ) r = _mm_or_si128( r, _mm_cmpeq_epi8( vb, vo ) );
+  if( m&C3_AB ) r = _mm_or_si128( r, _mm_cmpeq_epi8( va, vb ) );
+  if( keep ) r = _mm_or_si128( r, _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)&keep[j] ), _mm_setzero_si128() ) );
+  return r;
+}
+#endif
+
+// Store change classes of positions [0,len) to cls[0..len-1] (ignored positions are class 0)
+void Classify3( const byte* o, const byte* a, const byte* b, uint len, byte* cls, const byte* keep ) {
+  uint j=0;
+
+#ifdef DK_SSE2
+  // Each inequality mask selects its class bit; the three loads are shared
+  const __m128i ba = _mm_set1_epi8(C3_A), bb = _mm_set1_epi8(C3_B), bab = _mm_set1_epi8(C3_AB);
+  for( ; j+16<=len; j+=16 ) {
+    __m128i vo = _mm_loadu_si128( (const __m128i*)&o[j] );
+    __m128i va = _mm_loadu_si128( (const __m128i*)&a[j] );
+    __m128i vb = _mm_loadu_si128( (const __m128i*)&b[j] );
+    __m128i r = _mm_or_si128( _mm_andnot_si128( _mm_cmpeq_epi8( va, vo ), ba ), _mm_andnot_si128( _mm_cmpeq_epi8( vb, vo ), bb ) );
+    r = _mm_or_si128( r, _mm_andnot_si128( _mm_cmpeq_epi8( va, vb ), bab ) );
+    if( keep ) r = _mm_and_si128( r, _mm_loadu_si128( (const __m128i*)&keep[j] ) );
+    _mm_storeu_si128( (__m128i*)&cls[j], r );
+  }
+#endif
+
+  for( ; j<len; j++ ) cls[j] = ( (keep==0) || keep[j] ) ? Class3Bits( o[j], a[j], b[j] ) : 0;
+}
+
+// Index of first position in [0,len) whose class has all bits of m (len if none)
+uint Class3First( const byte* o, const byte* a, const byte* b, uint len, uint m, const byte* keep ) {
+  uint j=0,k;
+
+#ifdef DK_SSE2
+  for( ; j+16<=len; j+=16 ) {
+    k = _mm_movemask_epi8( Miss3Vec( o, a, b, j, m, keep ) ) ^ 0xFFFF;
+    if( k ) return j + Ctz32(k);
+  }
+#endif
+
+  for( ; j<len; j++ ) if( ((keep==0) || keep[j]) && ((Class3Bits( o[j], a[j], b[j] )&m)==m) ) return j;
+  return len;
+}
+
+// Index of first position in [0,len) whose class lacks a bit of m (len if none)
+uint Class3Miss( const byte* o, const byte* a, const byte* b, uint len, uint m, const byte* keep ) {
+  uint j=0,k;
+
+#ifdef DK_SSE2
+  for( ; j+16<=len; j+=16 ) {
+    k = _mm_movemask_epi8( Miss3Vec( o, a, b, j, m, keep ) );
+    if( k ) return j + Ctz32(k);
+  }
+#endif
+
+  for( ; j<len; j++ ) if( (keep && (keep[j]==0)) || ((Class3Bits( o[j], a[j], b[j] )&m)!=m) ) return j;
+  return len;
+}
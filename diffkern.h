@@ -0,0 +1,87 @@
+// Difference kernels shared by the views and the background scanners
+#ifndef DIFFKERN_H
+#define DIFFKERN_H
+
+#include "common.h"
+
+// SSE2 is baseline on x64 and on the -march=k8 builds from g.bat; older targets use the scalar loops
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP>=2))
+ #define DK_SSE2
+#endif
+
+enum{ DK_MAXF=8 };  // Maximum number of buffers compared at once (same as N_VIEWS)
+
+// Population count helpers (number of set bits)
+#ifdef __GNUC__
+inline uint Popcnt32( uint x ) { return __builtin_popcount(x); }
+inline uint Popcnt64( qword x ) { return __builtin_popcountll(x); }
+#else
+inline uint Popcnt32( uint x ) {
+  x = x - ((x>>1)&0x55555555); x = (x&0x33333333) + ((x>>2)&0x33333333);
+  return (((x+(x>>4))&0x0F0F0F0F)*0x01010101)>>24;
+}
+inline uint Popcnt64( qword x ) { return Popcnt32(uint(x)) + Popcnt32(uint(x>>32)); }
+#endif
+
+// Index of lowest set bit (x must be non-zero)
+#ifdef __GNUC__
+inline uint Ctz32( uint x ) { return __builtin_ctz(x); }
+#else
+inline uint Ctz32( uint x ) { uint r=0; while( ((x>>r)&1)==0 ) r++; return r; }
+#endif
+
+// Optional keep mask for the kernels below: keep[j]=0xFF compares position j, keep[j]=0 ignores it
+// (ignored positions count as equal)
+
+// Count positions in [0,len) where the n buffers don't all hold the same byte
+uint DiffCount( byte** p, uint n, uint len, const byte* keep=0 );
+
+// Index of first position in [0,len) where the n buffers don't all hold the same byte (len if none)
+uint DiffFirst( byte** p, uint n, uint len, const byte* keep=0 );
+
+// Index of first position in [0,len) where all n buffers hold the same byte (len if none)
+uint SameFirst( byte** p, uint n, uint len, const byte* keep=0 );
+
+// Store m[j] = (1<<n)-1 (all buffers marked) where the n buffers don't all hold the same byte, else 0
+void DiffMask( byte** p, uint n, uint len, byte* m, const byte* keep=0 );
+
+// Add per-bit-position counts of set bits in a^b over [0,len) to cnt[0..7] (bit 0 = LSB)
+void BitFlips( const byte* a, const byte* b, uint len, qword* cnt );
+
+// Bit alignment: add to cnt[s] (s=0..7) the number of positions j in [0,len) where a[j] equals the byte
+// of b that starts s bits into b[j] (bits taken MSB first, so b[j+1] supplies the low s bits); b needs len+1 bytes
+void ShiftMatch( const byte* a, const byte* b, uint len, qword* cnt );
+
+// Consensus of n buffers: the byte held by the most buffers at a position, if no other byte is held as often.
+// Bit i of a disagreement mask is set where buffer i doesn't hold the consensus byte; without a consensus
+// all buffers disagree (so 2 files or a tie behave like plain difference marking). Ignored positions agree.
+
+// Disagreement mask of values x[0..n-1] (-1 = missing byte, which is a value of its own)
+uint ConsensusBits( const uint* x, uint n );
+
+// Store disagreement masks of positions [0,len) to dis[0..len-1]
+void Consensus( byte** p, uint n, uint len, byte* dis, const byte* keep=0 );
+
+// Index of first position in [0,len) where buffer f disagrees with the consensus (len if none)
+uint OutlierFirst( byte** p, uint n, uint len, uint f, const byte* keep=0 );
+
+// Add number of positions in [0,len) where buffer i disagrees with the consensus to cnt[i]
+void OutlierCount( byte** p, uint n, uint len, qword* cnt, const byte* keep=0 );
+
+// Three-way classes: bits of a change class of base o and branches a, b at a position
+// (a only = C3_A|C3_AB, b only = C3_B|C3_AB, same change in both = C3_A|C3_B, conflict = all three)
+enum{ C3_A=1, C3_B=2, C3_AB=4 };  // a!=o, b!=o, a!=b
+
+// Change class of values o, a, b (-1 = missing byte, which is a value of its own)
+inline uint Class3Bits( uint o, uint a, uint b ) { return (a!=o) | ((b!=o)<<1) | ((a!=b)<<2); }
+
+// Store change classes of positions [0,len) to cls[0..len-1] (ignored positions are class 0)
+void Classify3( const byte* o, const byte* a, const byte* b, uint len, byte* cls, const byte* keep=0 );
+
+// Index of first position in [0,len) whose class has all bits of m (len if none)
+uint Class3First( const byte* o, const byte* a, const byte* b, uint len, uint m, const byte* keep=0 );
+
+// Index of first position in [0,len) whose class lacks a bit of m (len if none)
+uint Class3Miss( const byte* o, const byte* a, const byte* b, uint len, uint m, const byte* keep=0 );
+
+#endif // DIFFKERN_H
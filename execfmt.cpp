@@ -0,0 +1,380 @@
+// Executable-aware compare implementation
+#include "execfmt.h"
+
+#include <stdio.h>
+
+// Read l bytes at pos; returns bytes read
+static uint ReadAt( filehandle0& f, qword pos, void* p, uint l ) {
+  f.seek( pos );
+  return f.sread( p, l );
+}
+
+// Little- or big-endian integer of l bytes
+static qword Get( const byte* p, uint l, uint be ) {
+  uint i;
+  qword x=0;
+  for( i=0; i<l; i++ ) x |= qword( p[be ? i : l-1-i] ) << ((l-1-i)*8);
+  return x;
+}
+
+// Name of ELF program header type (buf is used for unknown types)
+static const char* PtName( uint type, char* buf ) {
+  static const struct { uint type; const char* name; } pt[] = {
+    { 1, "LOAD" }, { 2, "DYNAMIC" }, { 3, "INTERP" }, { 4, "NOTE" }, { 6, "PHDR" }, { 7, "TLS" },
+    { 0x6474E550, "GNU_EH_FRAME" }, { 0x6474E552, "GNU_RELRO" }, { 0x6474E553, "GNU_PROPERTY" }, { 0, 0 }
+  };
+  uint i;
+  for( i=0; pt[i].name; i++ ) if( pt[i].type==type ) return pt[i].name;
+  sprintf( buf, "PT_%X", type );
+  return buf;
+}
+
+// Append section (clamped to the file), unless the table is full or it has no contents in the file
+static void AddSect( sectable& t, const char* name, uint nlen, qword off, qword size, qword addr, qword fsize ) {
+  if( (t.n>=sectable::MAXSECT) || (size==0) || (off>=fsize) ) return;
+  sectable::sect& s = t.s[t.n++];
+  nlen = Min( nlen, uint(sectable::NAMELEN-1) );
+  memcpy( s.name, name, nlen );
+  s.name[nlen] = 0;
+  s.off = off;
+  s.size = Min( size, fsize-off );
+  s.addr = addr;
+}
+
+// Read the headers of file f of fsize bytes; returns 0 if it is not an ELF or PE file
+uint sectable::Load( filehandle0& f, qword fsize ) {
+  uint i,j,k,l,be,c64,es,num,sx,type,nlen,ssize=0;
+  qword o,sz,ad,tab;
+  byte h[64];
+  byte* p=0;
+  char* str=0;
+  char nm[NAMELEN],tn[16];
+
+  fmt = X_NONE; n = 0;
+  s = new sect[MAXSECT];
+  bzero( h );
+  l = ReadAt( f, 0, h, uint( Min( qword(sizeof(h)), fsize ) ) );
+
+  if( (l>=52) && (h[0]==0x7F) && (h[1]=='E') && (h[2]=='L') && (h[3]=='F') && (h[4]>=1) && (h[4]<=2) ) {
+    c64 = (h[4]==2);
+    be = (h[5]==2);
+    fmt = c64 ? X_ELF64 : X_ELF32;
+    tab = c64 ? Get( h+0x28, 8, be ) : Get( h+0x20, 4, be );
+    es  = Get( h+(c64 ? 0x3A : 0x2E), 2, be );
+    num = Get( h+(c64 ? 0x3C : 0x30), 2, be );
+    sx  = Get( h+(c64 ? 0x3E : 0x32), 2, be );
+
+    // Section headers; counts that don't fit the header are in section 0
+    if( tab && (tab<fsize) && (es>=(c64 ? 64U : 40U)) && (es<=256) ) {
+      byte s0[64];
+      if( ((num==0) || (sx==0xFFFF)) && (ReadAt( f, tab, s0, c64 ? 64 : 40 )==(c64 ? 64U : 40U)) ) {
+        if( num==0 ) num = uint( Min( Get( s0+(c64 ? 0x20 : 0x14), c64 ? 8 : 4, be ), qword(1<<16) ) );
+        if( sx==0xFFFF ) sx = Get( s0+(c64 ? 0x28 : 0x18), 4, be );
+      }
+      num = uint( Min( qword(num), (fsize-tab)/es ) );
+      p = new byte[num*es+1];
+      num = ReadAt( f, tab, p, num*es ) / es;
+      if( sx<num ) {  // Section name table
+        byte* e = p+sx*es;
+        o  = Get( e+(c64 ? 0x18 : 0x10), c64 ? 8 : 4, be );
+        sz = Get( e+(c64 ? 0x20 : 0x14), c64 ? 8 : 4, be );
+        if( o<fsize ) {
+          ssize = uint( Min( Min( sz, fsize-o ), qword(1<<20) ) );
+          str = new char[ssize+1];
+          ssize = ReadAt( f, o, str, ssize );
+          str[ssize] = 0;
+        }
+      }
+      for( j=0; j<num; j++ ) {
+        byte* e = p+j*es;
+        type = Get( e+4, 4, be );
+        if( (type==0) || (type==8) ) continue;  // SHT_NULL, SHT_NOBITS
+        k  = Get( e, 4, be );
+        ad = Get( e+(c64 ? 0x10 : 0x0C), c64 ? 8 : 4, be );
+        o  = Get( e+(c64 ? 0x18 : 0x10), c64 ? 8 : 4, be );
+        sz = Get( e+(c64 ? 0x20 : 0x14), c64 ? 8 : 4, be );
+        if( str && (k<ssize) ) AddSect( *this, str+k, strlen(str+k), o, sz, ad, fsize );
+        else { nlen = snprintf( nm, sizeof(nm), "#%u", j ); AddSect( *this, nm, nlen, o, sz, ad, fsize ); }
+      }
+      delete[] p; p=0;
+      delete[] str; str=0;
+    }
+
+    // No section headers: program header segments, named by type and index within the type
+    tab = c64 ? Get( h+0x20, 8, be ) : Get( h+0x1C, 4, be );
+    es  = Get( h+(c64 ? 0x36 : 0x2A), 2, be );
+    num = Get( h+(c64 ? 0x38 : 0x2C), 2, be );
+    if( (n==0) && tab && (tab<fsize) && (es>=(c64 ? 56U : 32U)) && (es<=256) ) {
+      num = uint( Min( qword(num), (fsize-tab)/es ) );
+      p = new byte[num*es+1];
+      num = ReadAt( f, tab, p, num*es ) / es;
+      for( j=0; j<num; j++ ) {
+        byte* e = p+j*es;
+        type = Get( e, 4, be );
+        for( k=0,i=0; i<j; i++ ) k += (Get( p+i*es, 4, be )==type);
+        o  = Get( e+(c64 ? 0x08 : 0x04), c64 ? 8 : 4, be );
+        ad = Get( e+(c64 ? 0x10 : 0x08), c64 ? 8 : 4, be );
+        sz = Get( e+(c64 ? 0x20 : 0x10), c64 ? 8 : 4, be );
+        nlen = snprintf( nm, sizeof(nm), "%s.%u", PtName( type, tn ), k );
+        AddSect( *this, nm, nlen, o, sz, ad, fsize );
+      }
+      delete[] p; p=0;
+    }
+    return 1;
+  }
+
+  if( (l>=64) && (h[0]=='M') && (h[1]=='Z') ) {
+    byte c[26];
+    o = Get( h+0x3C, 4, 0 );
+    if( (ReadAt( f, o, c, 26 )<26) || (memcmp( c, "PE\0\0", 4 )!=0) ) { Quit(); return 0; }
+    num = Get( c+6, 2, 0 );
+    qword sym = Get( c+12, 4, 0 ) + Get( c+16, 4, 0 )*18;  // COFF string table (long section names)
+    tab = o + 24 + Get( c+20, 2, 0 );
+    fmt = (Get( c+24, 2, 0 )==0x20B) ? X_PE64 : X_PE32;
+    if( tab>=fsize ) return 1;
+    num = uint( Min( qword(num), (fsize-tab)/40 ) );
+    p = new byte[num*40+1];
+    num = ReadAt( f, tab, p, num*40 ) / 40;
+    for( j=0; j<num; j++ ) {
+      byte* e = p+j*40;
+      ad = Get( e+12, 4, 0 );
+      sz = Get( e+16, 4, 0 );
+      o  = Get( e+20, 4, 0 );
+      memcpy( nm, e, 8 ); nm[8] = 0;
+      if( (nm[0]=='/') && (Get( c+12, 4, 0 )!=0) ) {  // "/<offset>" into the string table
+        qword x = strtoul( nm+1, 0, 10 );
+        nlen = ReadAt( f, sym+x, nm, NAMELEN-1 );
+        nm[nlen] = 0;
+      }
+      AddSect( *this, nm, strlen(nm), o, sz, ad, fsize );
+    }
+    delete[] p;
+    return 1;
+  }
+
+  Quit();
+  return 0;
+}
+
+// Free table
+void sectable::Quit( void ) {
+  delete[] s; s=0;
+  n = 0;
+  fmt = X_NONE;
+}
+
+// Format name
+const char* sectable::Format( void ) {
+  static const char* names[] = { "?", "ELF32", "ELF64", "PE32", "PE32+" };
+  return names[fmt];
+}
+
+// k-th section (from 0) named name, -1 if none
+int sectable::Find( const char* name, uint k ) {
+  uint j;
+  for( j=0; j<n; j++ ) if( strcmp( s[j].name, name )==0 ) {
+    if( k==0 ) return j;
+    k--;
+  }
+  return -1;
+}
+
+// Debug information section (DWARF, stabs, CodeView)
+uint sectable::IsDebug( const char* name ) {
+  static const char* pre[] = { ".debug", ".zdebug", ".gnu_debug", ".stab", ".line", 0 };
+  uint i;
+  for( i=0; pre[i]; i++ ) if( strncmp( name, pre[i], strlen(pre[i]) )==0 ) return 1;
+  return 0;
+}
+
+// Read the headers of all files and match their sections; returns 0 unless all are ELF or PE files
+uint sectmap::Load( char** names, uint _n ) {
+  uint i,j,k,m,c,f_ord,nc=0;
+  int x;
+  filehandle0 f;
+  qword end[DK_MAXF];
+  uint* cand;  // Matched sections: cand[c*n+i] = section of file i
+
+  n = Min( _n, uint(DK_MAXF) );
+  for( i=0; i<n; i++ ) t[i].s = 0;
+  e = 0; ne = 0; nmatch = 0; nonly = 0;
+  for( i=0; i<n; i++ ) {
+    if( f.open(names[i])==0 ) { Quit(); return 0; }
+    fsize[i] = f.size();
+    k = t[i].Load( f, fsize[i] );
+    f.close();
+    if( k==0 ) { Quit(); return 0; }
+  }
+
+  // k-th section of a name in file 0 matches the k-th of that name in the other files
+  e = new entry[MAXENT];
+  cand = new uint[sectable::MAXSECT*n];
+  for( j=0; j<t[0].n; j++ ) {
+    sectable::sect& s = t[0].s[j];
+    for( k=0,m=0; m<j; m++ ) k += (strcmp( t[0].s[m].name, s.name )==0);
+    cand[nc*n] = j;
+    for( i=1; i<n; i++ ) {
+      x = t[i].Find( s.name, k );
+      if( x<0 ) break;
+      cand[nc*n+i] = x;
+    }
+    if( i<n ) {
+      entry& q = e[ne++];
+      bzero( q );
+      strcpy( q.name, s.name );
+      q.type = E_ONLY;
+      q.off[0] = s.off; q.size[0] = s.size;
+      q.ndiff = ~0ULL; q.first = ~0ULL;
+      nonly++;
+    } else nc++;
+  }
+
+  // Matched sections in file 0 order (insertion sort, a few hundred at most)
+  for( c=1; c<nc; c++ ) {
+    for( k=c; (k>0) && (t[0].s[cand[(k-1)*n]].off>t[0].s[cand[k*n]].off); k-- ) {
+      for( i=0; i<n; i++ ) { m=cand[k*n+i]; cand[k*n+i]=cand[(k-1)*n+i]; cand[(k-1)*n+i]=m; }
+    }
+  }
+
+  // Sections in the same order in all files are aligned, with padding entries up to each of them
+  for( i=0; i<n; i++ ) end[i] = 0;
+  for( c=0; c<nc; c++ ) {
+    for( f_ord=1,i=0; i<n; i++ ) f_ord &= (t[i].s[cand[c*n+i]].off>=end[i]);
+    if( f_ord ) {
+      for( m=0,i=0; i<n; i++ ) m |= (t[i].s[cand[c*n+i]].off>end[i]);
+      if( m ) {
+        entry& q = e[ne++];
+        bzero( q );
+        strcpy( q.name, (end[0]==0) ? "(headers)" : "(padding)" );
+        q.type = E_PAD;
+        for( m=0,i=0; i<n; i++ ) {
+          q.off[i] = end[i];
+          q.size[i] = t[i].s[cand[c*n+i]].off-end[i];
+          m |= (end[i]!=0);
+        }
+        q.f_align = m;  // Padding at the start of all files is segment 0
+        q.ndiff = ~0ULL; q.first = ~0ULL;
+      }
+    }
+    entry& q = e[ne++];
+    bzero( q );
+    strcpy( q.name, t[0].s[cand[c*n]].name );
+    q.type = E_SECT;
+    q.f_align = f_ord;
+    q.f_debug = sectable::IsDebug( q.name );
+    for( i=0; i<n; i++ ) {
+      q.off[i] = t[i].s[cand[c*n+i]].off;
+      q.size[i] = t[i].s[cand[c*n+i]].size;
+      if( f_ord ) end[i] = q.off[i]+q.size[i];
+    }
+    q.ndiff = ~0ULL; q.first = ~0ULL;
+    nmatch++;
+  }
+  for( m=0,i=0; i<n; i++ ) m |= (end[i]<fsize[i]);
+  if( m && (nc>0) ) {
+    entry& q = e[ne++];
+    bzero( q );
+    strcpy( q.name, "(tail)" );
+    q.type = E_PAD;
+    q.f_align = 1;
+    for( i=0; i<n; i++ ) { q.off[i] = end[i]; q.size[i] = fsize[i]-end[i]; }
+    q.ndiff = ~0ULL; q.first = ~0ULL;
+  }
+  delete[] cand;
+
+  // Missing sections were added in header order: move them to their place in file 0 order
+  for( c=1; c<ne; c++ ) {
+    for( k=c; (k>0) && (e[k-1].off[0]>e[k].off[0]) && ((e[k].type==E_ONLY) || (e[k-1].type==E_ONLY)); k-- ) {
+      entry q = e[k]; e[k] = e[k-1]; e[k-1] = q;
+    }
+  }
+  return 1;
+}
+
+// Free tables and entries
+void sectmap::Quit( void ) {
+  uint i;
+  for( i=0; i<n; i++ ) t[i].Quit();
+  delete[] e; e=0;
+  ne = 0;
+  n = 0;
+}
+
+// Fill map with a segment at each aligned entry
+void sectmap::Align( segmap& map ) {
+  uint k;
+  map.Init( n, fsize, 0 );
+  for( k=0; k<ne; k++ ) if( e[k].f_align && (map.Add( e[k].off )==0) ) break;
+  map.scanned = fsize[0];
+}
+
+// Entry k differs: contents, length, or missing in some file
+uint sectmap::Differs( uint k ) {
+  uint i,d;
+  entry& q = e[k];
+  if( q.type==E_ONLY ) return 1;
+  for( d=0,i=1; (q.type==E_SECT) && (i<n); i++ ) d |= (q.size[i]!=q.size[0]);  // Padding only shifts
+  return d || ((q.ndiff!=~0ULL) && (q.ndiff>0));
+}
+
+// Open files and start; returns 0 on failure
+uint SectionScan::start( sectmap& _sm, char** names, uint _f_skip ) {
+  uint i,k;
+  sm = &_sm;
+  f_skip = _f_skip;
+  for( i=0; i<sm->n; i++ ) { f[i].f=0; buf[i]=0; }
+  for( i=0; i<sm->n; i++ ) {
+    if( f[i].open(names[i])==0 ) { stop(); return 0; }
+    buf[i] = new byte[BUFLEN];
+  }
+  for( k=0; k<sm->ne; k++ ) { sm->e[k].ndiff = ~0ULL; sm->e[k].first = ~0ULL; }
+  cur = 0;
+  f_run = 1;
+  return base::start();
+}
+
+// Stop, wait for thread exit and close files
+void SectionScan::stop( void ) {
+  uint i;
+  if( sm==0 ) return;
+  f_run = 0;
+  if( th ) { base::quit(); th=0; }
+  for( i=0; i<sm->n; i++ ) {
+    if( f[i].f ) f[i].close();
+    f[i].f = 0;
+    delete[] buf[i]; buf[i]=0;
+  }
+  sm = 0;
+}
+
+// Thread function - compares entries in order
+// Each entry is read in 1MB blocks from its own offset in every file, over the length all files have;
+// equal blocks cost one pass of the SSE2 difference kernel.
+void SectionScan::thread( void ) {
+  uint i,k,l,d,n=sm->n;
+  qword pos,len,nd,first;
+  byte* p[DK_MAXF];
+
+  for( k=0; f_run && (k<sm->ne); k++ ) {
+    sectmap::entry& q = sm->e[k];
+    cur = k;
+    if( q.type==sectmap::E_ONLY ) continue;
+    if( f_skip && (q.f_debug || (q.type==sectmap::E_PAD)) ) continue;
+    for( len=q.size[0],i=1; i<n; i++ ) len = Min( len, q.size[i] );
+    for( nd=0,first=~0ULL,pos=0; f_run && (pos<len); pos+=l ) {
+      for( l=uint( Min( qword(BUFLEN), len-pos ) ),i=0; i<n; i++ ) {
+        l = Min( l, ReadAt( f[i], q.off[i]+pos, buf[i], l ) );
+        p[i] = buf[i];
+      }
+      if( l==0 ) break;
+      d = DiffCount( p, n, l );
+      if( d && (first==~0ULL) ) first = pos + DiffFirst( p, n, l );
+      nd += d;
+    }
+    if( f_run==0 ) break;
+    q.first = first;
+    q.ndiff = nd;
+  }
+  if( f_run ) cur = sm->ne;
+  f_run = 0;
+}
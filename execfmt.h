@@ -0,0 +1,108 @@
+// Executable-aware compare: ELF/PE sections matched by name across files
+#ifndef EXECFMT_H
+#define EXECFMT_H
+
+#include "common.h"
+#include "thread.h"
+#include "file_win.h"
+#include "diffkern.h"
+#include "align.h"
+
+// Section table of an ELF or PE file, read from its headers only
+// ELF files without section headers list their program header segments instead ("LOAD.0", "PT_4.0", ...).
+struct sectable {
+  enum{ MAXSECT=1024, NAMELEN=32 };
+  enum{ X_NONE, X_ELF32, X_ELF64, X_PE32, X_PE64 };
+
+  struct sect {
+    char  name[NAMELEN];  // Section name (k-th of a name matches the k-th in other files)
+    qword off;            // File offset of the contents
+    qword size;           // Bytes stored in the file
+    qword addr;           // Load address (ELF) or RVA (PE)
+  };
+
+  uint  fmt;   // X_* format (X_NONE = not an executable)
+  uint  n;     // Sections with contents in the file (empty and .bss-like ones are left out)
+  sect* s;     // Sections, in header order
+
+  // Read the headers of file f of fsize bytes; returns 0 if it is not an ELF or PE file
+  uint Load( filehandle0& f, qword fsize );
+
+  // Free table
+  void Quit( void );
+
+  // Format name
+  const char* Format( void );
+
+  // k-th section (from 0) named name, -1 if none
+  int Find( const char* name, uint k );
+
+  // Debug information section (DWARF, stabs, CodeView)
+  static uint IsDebug( const char* name );
+};
+
+// Sections of file 0 matched by name in all files, with the padding between them
+// Entries are in file 0 order. Sections in the same order in all files start segments of the alignment
+// map, and each is followed by a padding entry up to the next such section (alignment gaps, headers,
+// symbol and section tables), so the views line up section by section.
+struct sectmap {
+  enum{ MAXENT=2*sectable::MAXSECT+2 };
+  enum{ E_SECT, E_PAD, E_ONLY };  // Matched section, padding, section of file 0 missing in another file
+
+  struct entry {
+    char  name[sectable::NAMELEN];
+    qword off[DK_MAXF];     // Start in each file
+    qword size[DK_MAXF];    // Length in each file
+    uint  type;             // E_* type
+    uint  f_align;          // Starts a segment of the alignment map
+    uint  f_debug;          // Debug information section
+    volatile qword ndiff;   // Differing bytes over the common length (-1 = not compared)
+    volatile qword first;   // Offset of the first differing byte in the entry (-1 = none)
+  };
+
+  uint  n;                  // Number of files (0 = section mode off)
+  sectable t[DK_MAXF];      // Section tables
+  qword fsize[DK_MAXF];     // File sizes
+  entry* e;                 // Entries
+  uint  ne;                 // Entries in use
+  uint  nmatch;             // Matched sections
+  uint  nonly;              // Sections of file 0 missing in some other file
+
+  // Read the headers of all files and match their sections; returns 0 unless all are ELF or PE files
+  uint Load( char** names, uint _n );
+
+  // Free tables and entries
+  void Quit( void );
+
+  // Fill map with a segment at each aligned entry
+  void Align( segmap& map );
+
+  // Entry k differs: contents, section length, or missing in some file
+  uint Differs( uint k );
+};
+
+// Background compare of all entries, section by section; contents are only read here
+struct SectionScan : thread<SectionScan> {
+
+  typedef thread<SectionScan> base;
+
+  enum{ BUFLEN=1<<20 };
+
+  sectmap* sm;             // Entries to compare
+  uint  f_skip;            // Skip debug sections and padding
+  filehandle0 f[DK_MAXF];  // Private file handles
+  byte* buf[DK_MAXF];      // Read buffers
+  volatile uint cur;       // Entry being compared
+  volatile uint f_run;     // Cleared to stop
+
+  // Open files and start; returns 0 on failure
+  uint start( sectmap& _sm, char** names, uint _f_skip );
+
+  // Stop, wait for thread exit and close files
+  void stop( void );
+
+  // Thread function - compares entries in order
+  void thread( void );
+};
+
+#endif // EXECFMT_H
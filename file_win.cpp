@@ -8,6 +8,8 @@ uint file_open_mode = GENERIC_READ;
 uint file_make_mode = GENERIC_WRITE;
 // Default: file_make() always creates new file (overwrites existing)
 uint file_make_cmode = CREATE_ALWAYS;
+// Default: no extra flags for file_open()
+uint file_open_flags = 0;
 
 // Low-level Win32 file opening wrapper (unused - more specific functions below are used instead)
 HANDLE Win32_Open( const wchar_t* s, uint Flags, uint Attrs ) {
@@ -66,7 +68,7 @@ HANDLE file_open( const wchar_t* name ) {
      FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE,  // Allow full sharing
      0,                                          // Default security
      OPEN_EXISTING,                              // File must exist (fail if not found)
-     0,                                          // No special flags
+     file_open_flags,                            // Extra flags (controlled by global)
      0                                           // No template
   );
   // Convert INVALID_HANDLE_VALUE to NULL for easier error checking
@@ -81,7 +83,7 @@ HANDLE file_open( const char* name ) {
      FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE,  // Allow full sharing
      0,                                          // Default security
      OPEN_EXISTING,                              // File must exist
-     0,                                          // No special flags
+     file_open_flags,                            // Extra flags (controlled by global)
      0                                           // No template
   );
   // Convert INVALID_HANDLE_VALUE to NULL
@@ -181,6 +183,13 @@ qword file_tell( HANDLE file ) {
   return file_seek( file, 0, FILE_CURRENT );
 }
 
+// Get last modification time (FILETIME as 64-bit value, 0 on error)
+qword file_mtime( HANDLE file ) {
+  FILETIME ft;
+  if( GetFileTime( file, 0, 0, &ft )==0 ) return 0;
+  return (qword(ft.dwHighDateTime)<<32) + ft.dwLowDateTime;
+}
+
 // Get file size using binary search (for files where normal method fails)
 // This is a fallback for special files (e.g., raw disk devices) where seeking to end doesn't work
 qword getfilesize( HANDLE f ) {
@@ -272,6 +281,10 @@ qword filehandle0::tell( void ) {
   return file_tell(f);
 }
 
+qword filehandle0::mtime( void ) {
+  return file_mtime(f);
+}
+
 uint filehandle0::read( void* _buf, uint len ) { return file_read( f, _buf, len ); }
 
 uint filehandle0::sread( void* _buf, uint len ) { return file_sread( f, _buf, len ); }
@@ -288,3 +301,87 @@ uint filehandle0::writ( void* _buf, uint len ) {
 
 // filehandle implementations
 filehandle::filehandle() { f=0; }
+
+// Query the layout of file name (opened as f) of size fsize; returns 0 if the file system doesn't report it
+uint extentmap::Load( const char* name, filehandle0& f, qword fsize ) {
+  char root[MAX_PATH];
+  DWORD spc,bps,nf,nt,rl;
+  BY_HANDLE_FILE_INFORMATION fi;
+  STARTING_VCN_INPUT_BUFFER in;
+  union { RETRIEVAL_POINTERS_BUFFER rp; byte mem[1<<14]; } u;
+  uint k,ok;
+  qword cl,beg,end,lcn;
+  Quit();
+  if( (fsize==0) || (GetFileInformationByHandle( f.f, &fi )==0) ) return 0;
+  if( (GetVolumePathNameA( name, root, sizeof(root) )==0) || (GetDiskFreeSpaceA( root, &spc, &bps, &nf, &nt )==0) ) return 0;
+  vol = fi.dwVolumeSerialNumber;
+  cl = qword(spc)*bps;
+  if( cl==0 ) return 0;
+  in.StartingVcn.QuadPart = 0;
+  for( end=0; (end<fsize) && (n<MAXRUNS); ) {
+    ok = DeviceIoControl( f.f, FSCTL_GET_RETRIEVAL_POINTERS, &in, sizeof(in), &u.rp, sizeof(u), &rl, 0 );
+    if( (ok==0) && (GetLastError()!=ERROR_MORE_DATA) ) break;
+    if( u.rp.ExtentCount==0 ) break;
+    beg = qword(u.rp.StartingVcn.QuadPart)*cl;
+    if( beg>end ) Add( Min(beg,fsize), ~0ULL );  // Clusters not reported: unknown
+    for( k=0; (k<u.rp.ExtentCount) && (beg<fsize) && (n<MAXRUNS); k++,beg=end ) {
+      end = Min( qword(u.rp.Extents[k].NextVcn.QuadPart)*cl, fsize );
+      lcn = u.rp.Extents[k].Lcn.QuadPart;
+      Add( end, (lcn==~0ULL) ? lcn : lcn*cl );
+    }
+    if( ok ) break;
+    in.StartingVcn.QuadPart = end/cl;
+  }
+  if( n==0 ) return 0;
+  if( r[n-1].end<fsize ) Add( fsize, ~0ULL );  // Tail not reported (resident data, runs limit)
+  return 1;
+}
+
+// Append run up to end at volume byte phys; continuations of the previous run are merged into it
+void extentmap::Add( qword end, qword phys ) {
+  qword beg = n ? r[n-1].end : 0;
+  if( end<=beg ) return;
+  if( n && (r[n-1].phys==~0ULL) && (phys==~0ULL) ) { r[n-1].end=end; return; }
+  if( n && (phys!=~0ULL) && (r[n-1].phys!=~0ULL) && (r[n-1].phys+beg-(n>1?r[n-2].end:0)==phys) ) { r[n-1].end=end; return; }
+  if( n>=na ) {
+    run* t = new run[na=Max(2*na,64U)];
+    if( n ) memcpy( t, r, n*sizeof(run) );
+    delete[] r; r=t;
+  }
+  r[n].end = end;
+  r[n].phys = phys;
+  n++;
+}
+
+// Free runs
+void extentmap::Quit( void ) {
+  delete[] r;
+  r=0; n=na=0;
+}
+
+// Volume byte of file offset pos (-1 = unknown); *len = bytes from pos that follow it on the volume
+qword extentmap::Phys( qword pos, qword* len ) {
+  uint a=0,b=n,c;
+  *len = 0;
+  if( (n==0) || (pos>=r[n-1].end) ) return ~0ULL;
+  while( a<b ) { c=(a+b)>>1; if( r[c].end<=pos ) a=c+1; else b=c; }  // First run ending past pos
+  *len = r[a].end-pos;
+  if( r[a].phys==~0ULL ) return ~0ULL;
+  return r[a].phys + pos-(a ? r[a-1].end : 0);
+}
+
+// Bytes from pos[i] in each of n files (up to lim) that lie at the same physical bytes in all of them
+qword SharedLen( extentmap* m, uint n, qword* pos, qword lim ) {
+  uint i;
+  qword s,l,p,p0=0,step;
+  if( n<2 ) return 0;
+  for( s=0; s<lim; s+=step ) {
+    for( step=lim-s,i=0; i<n; i++ ) {
+      p = m[i].Phys( pos[i]+s, &l );
+      if( (p==~0ULL) || (m[i].vol!=m[0].vol) ) return s;
+      if( i==0 ) p0=p; else if( p!=p0 ) return s;
+      step = Min( step, l );
+    }
+  }
+  return lim;
+}
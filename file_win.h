@@ -44,6 +44,7 @@ int file_mkdir( const wchar_t* name );
 extern uint file_open_mode;
 extern uint file_make_mode;
 extern uint file_make_cmode;
+extern uint file_open_flags;  // Extra ff* flags for file_open() (e.g. ffNO_BUFFERING for direct reads)
 
 // Set file_open() to read-only mode
 void file_open_mode_r( void );
@@ -90,6 +91,9 @@ qword file_seek( HANDLE file, qword ofs, int typ = FILE_BEGIN );
 // Get current file position
 qword file_tell( HANDLE file );
 
+// Get last modification time (FILETIME as 64-bit value, 0 on error)
+qword file_mtime( HANDLE file );
+
 // Get file size using binary search (for files where normal method fails)
 qword getfilesize( HANDLE f );
 
@@ -137,6 +141,9 @@ struct filehandle0 {
   // Get current position
   qword tell( void );
 
+  // Get last modification time
+  qword mtime( void );
+
   // Read into structure/variable (template deduces size automatically)
   template< typename BUF >
   uint read( BUF& buf ) { return read( &buf, sizeof(buf) )!=sizeof(buf); }
@@ -178,4 +185,34 @@ struct filehandle : filehandle0 {
   }
 };
 
+// Physical layout of a file: runs of file bytes and where they are on the volume (FSCTL_GET_RETRIEVAL_POINTERS)
+// Ranges of two files on the same volume at the same physical bytes hold the same data without reading
+// them: block clones, reflinked copies, hardlinks or the same file opened twice.
+struct extentmap {
+  enum{ MAXRUNS=1<<20 };  // Runs kept per file (the rest counts as unknown)
+  struct run {
+    qword end;   // File offset past the run (runs are contiguous from 0)
+    qword phys;  // Volume byte of the run start (-1 = unknown, e.g. sparse or compressed)
+  };
+  run*  r;       // Runs (0 = no layout)
+  uint  n;       // Number of runs
+  uint  na;      // Allocated runs
+  uint  vol;     // Volume serial number
+
+  // Query the layout of file name (opened as f) of size fsize; returns 0 if the file system doesn't report it
+  uint Load( const char* name, filehandle0& f, qword fsize );
+
+  // Append run up to end at volume byte phys; continuations of the previous run are merged into it
+  void Add( qword end, qword phys );
+
+  // Free runs
+  void Quit( void );
+
+  // Volume byte of file offset pos (-1 = unknown); *len = bytes from pos that follow it on the volume
+  qword Phys( qword pos, qword* len );
+};
+
+// Bytes from pos[i] in each of n files (up to lim) that lie at the same physical bytes in all of them
+qword SharedLen( extentmap* m, uint n, qword* pos, qword lim );
+
 #endif // FILE_WIN_H
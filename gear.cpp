@@ -0,0 +1,34 @@
+// Gear rolling hash implementation
+#include "gear.h"
+
+qword GearTab[256];
+
+// Fill GearTab (fixed pseudo-random values, same in every run)
+static void GearInit( void ) {
+  uint i;
+  qword x = 0x9E3779B97F4A7C15ULL;
+  // splitmix64 sequence
+  for( i=0; i<256; i++ ) {
+    qword z = (x += 0x9E3779B97F4A7C15ULL);
+    z = (z^(z>>30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z^(z>>27)) * 0x94D049BB133111EBULL;
+    GearTab[i] = z^(z>>31);
+  }
+}
+
+// Filled during static initialization, before main() starts any scanner thread; read-only afterwards
+static struct GearTabInit { GearTabInit() { GearInit(); } } gear_init;
+
+// Length of the content-defined chunk at the start of p[0..len), between min and max bytes
+uint GearChunk( const byte* p, uint len, uint min, uint avg, uint max, uint bits, uint f_eof ) {
+  uint t,e=Min(len,max);
+  qword h=0;
+  if( len<=min ) return f_eof ? len : 0;
+  // The hash covers the last 64 bytes, so starting 64 bytes early makes the first test depend on content only
+  for( t=(min>64)?min-64:0; t<e; t++ ) {
+    h = GearStep( h, p[t] );
+    if( (t+1>=min) && GearCut( h, (t+1<avg) ? bits+1 : bits-1 ) ) return t+1;
+  }
+  if( e==max ) return max;
+  return f_eof ? len : 0;
+}
@@ -0,0 +1,24 @@
+// Gear rolling hash for content-defined anchors
+#ifndef GEAR_H
+#define GEAR_H
+
+#include "common.h"
+
+// Gear hash: h = (h<<1) + GearTab[byte], so h depends only on the last 64 bytes.
+// Positions where the top bits of h are zero are content-defined anchors (cut points):
+// they land on the same content in every file, whatever its offset.
+// Filled with fixed pseudo-random values at program start, same in every run.
+extern qword GearTab[256];
+
+// One rolling step
+inline qword GearStep( qword h, byte c ) { return (h<<1) + GearTab[c]; }
+
+// Anchor test for an average distance of 2^bits bytes
+inline uint GearCut( qword h, uint bits ) { return (h>>(64-bits))==0; }
+
+// Length of the content-defined chunk at the start of p[0..len), between min and max bytes
+// FastCDC normalized cut: a stricter anchor test (bits+1) before avg bytes and a looser one (bits-1) after,
+// so chunk sizes cluster around avg. Returns 0 if more data is needed (len<max and not f_eof).
+uint GearChunk( const byte* p, uint len, uint min, uint avg, uint max, uint bits, uint f_eof );
+
+#endif // GEAR_H
@@ -49,13 +49,18 @@ void hexfile::SetTextbuf( textblock& tb1, uint _BX, uint _flags, uint _display_m
   }
 
   textlen = BX*tb1.WCY;  // Total bytes that can be displayed
-  diffbuf = new byte[textlen];  // Allocate difference highlight buffer
-  if( diffbuf!=0 ) bzero( diffbuf, textlen );  // Clear to "no differences"
 }
 
-// Cleanup resources
+// Cleanup resources (the difference mask belongs to the caller)
 void hexfile::Quit( void ) {
-  delete diffbuf;
+  diffbuf = 0;
+  palbuf = 0;
+}
+
+// Palette of byte k of the screen: pal_Hex, or the mark palette where this file is marked
+uint hexfile::Attr( uint k ) {
+  if( (diffbuf[k]&dbit)==0 ) return pal_Hex;
+  return palbuf ? palbuf[k] : pal_Diff;
 }
 
 // Get byte at offset i from current view (returns -1 if beyond EOF)
@@ -66,24 +71,17 @@ uint hexfile::viewdata( uint i ) {
   return c;
 }
 
-// Compare this file with another (unused - comparison now done in main loop)
-void hexfile::Compare( hexfile& F2 ) {
-  uint c1,c2,i;
-
-  // For each byte in the visible view
-  for( i=0; i<textlen; i++ ) {
-    c1 = (*this).viewdata(i);  // Get byte from this file
-    c2 = F2.viewdata(i);       // Get byte from other file
-    diffbuf[i] = (c1!=c2);     // Mark as different if bytes don't match
-  }
+// Get byte at absolute file position from the cache (returns -1 if not cached or beyond EOF)
+uint hexfile::filedata( qword pos ) {
+  return ((pos>=databeg) && (pos<dataend)) ? databuf[pos-databeg] : -1;
 }
 
 // Move view position by predefined navigation type
 void hexfile::MovePos( uint m_type ) {
   // Navigation deltas for: left, right, up, down, pgup, pgdn, wheel-up, wheel-dn
   const int delta[] = { -1,1, -int(BX),int(BX), -int(textlen),int(textlen), -int(BX*4), int(BX*4) };
-  // m_type: 0=home, 1=end, 2-9=use delta array
-  SetFilepos( (m_type==0)? 0 : (m_type==1) ? F1size-textlen : F1pos+sqword(delta[m_type-2]) );
+  // m_type: 0=home (base offset), 1=end, 2-9=use delta array
+  SetFilepos( (m_type==0)? base : (m_type==1) ? F1size-textlen : F1pos+sqword(delta[m_type-2]) );
 }
 
 // Move view by relative byte offset
@@ -110,8 +108,8 @@ void hexfile::SetFilepos( qword newpos ) {
     // Need to load new data from disk
     // Align to 64KB boundary for better disk I/O performance and read-ahead
     databeg = newpos - (newpos % datalign);
-    F1.seek( databeg );  // Seek to aligned position
-    len = F1.read( databuf, datalen );  // Read 1MB into cache
+    len = Load();  // Read 1MB into cache (transformed if needed)
+    gen++;
     dataend = databeg + len;  // Calculate end of cached region
     if( newend>=dataend ) newend=dataend;  // Adjust if near EOF
   }
@@ -120,9 +118,57 @@ void hexfile::SetFilepos( qword newpos ) {
   viewend = newend;
 }
 
+// Read len bytes at pos with the bit offset applied into p; returns number of valid bytes
+uint hexfile::SrcRead( qword pos, byte* p, uint len ) {
+  uint k,s=bits&7,d=(bits<0);  // Raw bytes start d bytes before pos
+  if( bits==0 ) {
+    F1.seek( pos );
+    return F1.read( p, len );
+  }
+  if( pos<d ) {
+    p[0] = 0;  // Zero bits before the start of the file
+    F1.seek( 0 );
+    len = 1 + F1.read( p+1, len-1 );
+  } else {
+    F1.seek( pos-d );
+    len = F1.read( p, len );
+  }
+  if( len==0 ) return 0;
+  // Each shown byte takes bits from two raw bytes (funnel shift); the byte after the buffer
+  // is unknown, so the last one is valid only at EOF (zero bits shifted in)
+  for( k=0; k+1<len; k++ ) p[k] = (p[k]<<s) | (p[k+1]>>(8-s));
+  p[k] <<= s;
+  if( pos-d+len<F1size ) len--;
+  return uint( Min( qword(len), F1size-pos ) );
+}
+
+// Load the cache at databeg: bit offset and transform chain applied; returns number of valid bytes
+uint hexfile::Load( void ) {
+  uint rlen;
+  if( (xc==0) || (xc->n==0) ) return SrcRead( databeg, databuf, datalen );
+  // Context before the cache and the rest of the last element are read too
+  qword r = xc->Span( databeg, datalen-xchain::PAD, F1size, &rlen );
+  return xc->Finish( databuf, SrcRead( r, databuf, rlen ), r, databeg, F1size );
+}
+
+// Drop the cache and reload the view (after the bit offset or transform chain changed)
+void hexfile::Reload( void ) {
+  databeg = dataend = 0;
+  SetFilepos( F1pos );
+}
+
+// Set bit offset and reload the cache
+void hexfile::SetBits( int _bits ) {
+  bits = _bits;
+  Reload();
+}
+
 // Open file and get size
 size_t hexfile::Open( char* fnam ) {
   F1pos=0;           // Start at beginning of file
+  base=0;            // No base offset
+  bits=0;            // No bit offset
+  xc=0;              // No transforms
   databeg = dataend=0;  // Cache is empty
   if( F1.open(fnam) ) {  // Open file for reading
     F1size = F1.size();  // Get total file size
@@ -179,7 +225,7 @@ void hexfile::hexdump( textblock& tb1 ) {
         // If byte is within viewable range
         if( ((ofs+i)>=viewbeg) && ((ofs+i)<viewend) ) {
           // Print byte as character with correct attribute (pal_Diff for differences)
-          c = tb1.ch( p[j*BX+i], diffbuf[j*BX+i]?pal_Diff:pal_Hex );
+          c = tb1.ch( p[j*BX+i], Attr(j*BX+i) );
         }
         *s++ = c;  // Write character with attribute (preserves diff highlighting)
       }
@@ -189,11 +235,11 @@ void hexfile::hexdump( textblock& tb1 ) {
         c = tb1.ch(' ',pal_Hex);  // Default to space with normal palette
         // If byte is within viewable range
         if( ((ofs+i)>=viewbeg) && ((ofs+i)<viewend) ) {
-          // Map byte value (0-255) to grayscale palette index (6-255)
+          // Map byte value (0-255) to grayscale palette index (10-255)
           byte byte_val = p[j*BX+i];
           uint gray_idx = pal_GRAY_START + ((byte_val * (pal_MAX - pal_GRAY_START - 1)) / 255);
           // Display 'X' for different bytes, space for same bytes
-          char display_char = diffbuf[j*BX+i] ? 'X' : ' ';
+          char display_char = (diffbuf[j*BX+i]&dbit) ? 'X' : ' ';
           c = tb1.ch( display_char, gray_idx );  // Display with grayscale background
         }
         *s++ = c;  // Write character with grayscale attribute
@@ -205,7 +251,7 @@ void hexfile::hexdump( textblock& tb1 ) {
         // If byte is within viewable range (not past EOF)
         if( ((ofs+i)>=viewbeg) && ((ofs+i)<viewend) ) {
           // Print 2-digit hex value, use pal_Diff if byte differs from other files
-          HexPrint( s, p[j*BX+i], 2, diffbuf[j*BX+i]?pal_Diff:pal_Hex );
+          HexPrint( s, p[j*BX+i], 2, Attr(j*BX+i) );
         }
         s+=3;  // Move to next byte position (2 hex + 1 space)
       }
@@ -218,7 +264,7 @@ void hexfile::hexdump( textblock& tb1 ) {
         // If byte is within viewable range (not past EOF)
         if( ((ofs+i)>=viewbeg) && ((ofs+i)<viewend) ) {
           // Print 2-digit hex value, use pal_Diff if byte differs from other files
-          HexPrint( s, p[j*BX+i], 2, diffbuf[j*BX+i]?pal_Diff:pal_Hex );
+          HexPrint( s, p[j*BX+i], 2, Attr(j*BX+i) );
         }
         s+=3;  // Move to next byte position (2 hex + 1 space)
       }
@@ -232,7 +278,7 @@ void hexfile::hexdump( textblock& tb1 ) {
         // If byte is within viewable range
         if( ((ofs+i)>=viewbeg) && ((ofs+i)<viewend) ) {
           // Print byte as character with correct attribute (pal_Diff for differences)
-          c = tb1.ch( p[j*BX+i], diffbuf[j*BX+i]?pal_Diff:pal_Hex );
+          c = tb1.ch( p[j*BX+i], Attr(j*BX+i) );
         }
         *s++ = c;  // Write character with attribute (preserves diff highlighting)
       }
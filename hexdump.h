@@ -5,6 +5,7 @@
 #include "common.h"
 #include "file_win.h"
 #include "textblock.h"
+#include "xform.h"
 
 // Hex file viewer with caching and difference highlighting
 // Displays hex dump and ASCII view of a file, with intelligent caching for large files
@@ -12,6 +13,9 @@ struct hexfile {
   filehandle0 F1;  // File handle
   qword F1size;    // Total file size in bytes
   qword F1pos;     // Current view position in file (top-left byte being displayed)
+  qword base;      // Base offset: file position that lines up with the base of the other files
+  int   bits;      // Bit offset (-8..7): byte p shows the 8 bits starting bits bits after byte p (MSB first)
+  xchain* xc;      // Transform chain applied after the bit offset (0 = none)
 
   // Display flags
   enum {
@@ -33,7 +37,9 @@ struct hexfile {
   uint  F1cpl;    // Chars per line (visible - may be < BX if window too narrow)
   uint  F1dpl;    // Unused chars in line (horizontal slack space)
   uint  textlen;  // Total bytes visible in current view (BX * number_of_rows)
-  byte* diffbuf;  // Difference highlight flags per byte (1=different, 0=same)
+  byte* diffbuf;  // Difference mask per byte, shared by all views (bit dbit set = this file differs)
+  byte  dbit;     // Bit of this view in diffbuf
+  byte* palbuf;   // Palette of marked bytes, shared by all views (0 = all pal_Diff)
 
   // File data caching - keeps a 1MB sliding window of file data
   // This allows viewing multi-GB files without loading everything into RAM
@@ -43,6 +49,7 @@ struct hexfile {
   qword databeg;  // Start of cached region in file
   qword dataend;  // End of cached region in file
   byte  databuf[datalen];  // Cached file data (1MB sliding window)
+  uint  gen;      // Cache loads so far (changes whenever databuf is refilled)
 
   // Calculate required text buffer width in characters for hex display
   uint Calc_WCX( uint mBX, uint f_addr64, uint f_vertline, uint mode );
@@ -53,11 +60,14 @@ struct hexfile {
   // Cleanup resources
   void Quit( void );
 
+  // Palette of byte k of the screen: pal_Hex, or the mark palette where this file is marked
+  uint Attr( uint k );
+
   // Get byte at offset i from current view (returns -1 if beyond EOF)
   uint viewdata( uint i );
 
-  // Compare this file with another (unused - comparison now done in main loop)
-  void Compare( hexfile& F2 );
+  // Get byte at absolute file position from the cache (returns -1 if not cached or beyond EOF)
+  uint filedata( qword pos );
 
   // Move view position by predefined navigation type
   void MovePos( uint m_type=0 );
@@ -68,6 +78,21 @@ struct hexfile {
   // Set absolute view position and update cache if needed (intelligent cache management)
   void SetFilepos( qword newpos );
 
+  // Read len bytes at pos with the bit offset applied into p; returns number of valid bytes
+  uint SrcRead( qword pos, byte* p, uint len );
+
+  // Load the cache at databeg: bit offset and transform chain applied; returns number of valid bytes
+  uint Load( void );
+
+  // Drop the cache and reload the view (after the bit offset or transform chain changed)
+  void Reload( void );
+
+  // Set bit offset and reload the cache
+  void SetBits( int _bits );
+
+  // View shows the file's own bytes (no bit offset or transforms)
+  uint Raw( void ) { return (bits==0) && ((xc==0) || (xc->n==0)); }
+
   // Open file and get size
   size_t Open( char* fnam );
 
@@ -0,0 +1,87 @@
+// Ignore mask implementation
+#include "ignore.h"
+
+// Parse hex (0x...) or decimal number at s; returns pointer past it (s if no number)
+const char* ParseNum( const char* s, qword* x ) {
+  char* e;
+  if( (s[0]=='0') && ((s[1]=='x') || (s[1]=='X')) ) {
+    *x = strtoull( s+2, &e, 16 );
+    return (e==s+2) ? s : e;
+  }
+  if( (*s<'0') || (*s>'9') ) return s;
+  *x = strtoull( s, &e, 10 );
+  return e;
+}
+
+// Add range of len bytes at ofs, repeated every stride bytes if stride>0; returns 0 if full or invalid
+uint ignoremask::Add( qword ofs, qword len, qword stride ) {
+  if( (n>=MAXRANGES) || (len==0) ) return 0;
+  if( stride && (len>=stride) ) stride=0, len=~0ULL-ofs;  // Occurrences overlap: everything from ofs on
+  r[n].ofs = ofs; r[n].len = len; r[n].stride = stride;
+  n++;
+  return 1;
+}
+
+// Load ranges from a text file, one "<offset> <length> [<stride>]" per line (hex 0x... or decimal, # = comment)
+// Returns number of ranges added, or -1 if the file can't be read or a line is malformed
+int ignoremask::Load( const char* fname ) {
+  char line[256];
+  const char* s;
+  const char* e;
+  qword v[3];
+  uint k,cnt=0;
+  FILE* f = fopen( fname, "rb" );
+  if( f==0 ) return -1;
+  while( fgets( line, sizeof(line), f ) ) {
+    for( s=line,k=0; k<3; k++ ) {
+      while( (*s==' ') || (*s=='\t') || (*s==',') ) s++;
+      e = ParseNum( s, &v[k] );
+      if( e==s ) break;
+      s = e;
+    }
+    while( (*s==' ') || (*s=='\t') ) s++;
+    if( (*s!=0) && (*s!='#') && (*s!='\r') && (*s!='\n') ) { fclose(f); return -1; }  // Junk after the numbers
+    if( k==0 ) continue;  // Empty or comment line
+    if( (k<2) || (Add( v[0], v[1], (k>2) ? v[2] : 0 )==0) ) { fclose(f); return -1; }
+    cnt++;
+  }
+  fclose(f);
+  return cnt;
+}
+
+// First ignored position at or after pos (-1 if none)
+qword ignoremask::Next( qword pos ) {
+  uint i;
+  qword q,k,best=~0ULL;
+  for( i=0; i<n; i++ ) {
+    ignorerange& a = r[i];
+    if( pos<a.ofs ) q = a.ofs;
+    else if( a.stride==0 ) q = (pos-a.ofs<a.len) ? pos : ~0ULL;
+    else {
+      k = (pos-a.ofs)/a.stride;
+      q = (pos-a.ofs-k*a.stride<a.len) ? pos : a.ofs+(k+1)*a.stride;
+    }
+    best = Min( best, q );
+  }
+  return best;
+}
+
+// Set keep[j] for [pos,pos+len): 0 where ignored, 0xFF where compared
+// Callers check Next() first and skip the mask when no range overlaps.
+void ignoremask::Fill( qword pos, byte* keep, uint len ) {
+  uint i;
+  qword b,e,end=pos+len;
+  memset( keep, 0xFF, len );
+  for( i=0; i<n; i++ ) {
+    ignorerange& a = r[i];
+    if( a.ofs>=end ) continue;
+    // First occurrence that may overlap the block
+    b = a.ofs;
+    if( a.stride && (pos>a.ofs) ) b += (pos-a.ofs)/a.stride*a.stride;
+    for( ; b<end; b+=a.stride ) {
+      e = (a.len>end-b) ? end : b+a.len;
+      if( e>pos ) memset( keep+uint(Max(b,pos)-pos), 0, uint(e-Max(b,pos)) );
+      if( a.stride==0 ) break;
+    }
+  }
+}
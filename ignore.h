@@ -0,0 +1,43 @@
+// Ignore mask: ranges excluded from difference scanning (timestamps, build IDs, ...)
+#ifndef IGNORE_H
+#define IGNORE_H
+
+#include "common.h"
+
+// Ignored range, optionally repeated every stride bytes up to the end of the file
+struct ignorerange {
+  qword ofs;     // Start of first occurrence
+  qword len;     // Bytes per occurrence
+  qword stride;  // Distance between occurrences (0 = single range)
+};
+
+// Set of ignored ranges in positions past the base offsets
+// Modified by the terminal only while no scan thread is using it.
+struct ignoremask {
+  enum{ MAXRANGES=256 };
+
+  uint n;                        // Ranges in use
+  ignorerange r[MAXRANGES];
+
+  // Add range of len bytes at ofs, repeated every stride bytes if stride>0; returns 0 if full or invalid
+  uint Add( qword ofs, qword len, qword stride=0 );
+
+  // Remove all ranges
+  void Clear( void ) { n=0; }
+
+  // Load ranges from a text file, one "<offset> <length> [<stride>]" per line (hex 0x... or decimal, # = comment)
+  // Returns number of ranges added, or -1 if the file can't be read or a line is malformed
+  int Load( const char* fname );
+
+  // First ignored position at or after pos (-1 if none)
+  qword Next( qword pos );
+
+  // Set keep[j] for [pos,pos+len): 0 where ignored, 0xFF where compared
+  // Callers check Next() first and skip the mask when no range overlaps.
+  void Fill( qword pos, byte* keep, uint len );
+};
+
+// Parse hex (0x...) or decimal number at s; returns pointer past it (s if no number)
+const char* ParseNum( const char* s, qword* x );
+
+#endif // IGNORE_H
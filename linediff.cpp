@@ -0,0 +1,377 @@
+// Line diff implementation
+#include "linediff.h"
+
+#ifdef DK_SSE2
+#include <emmintrin.h>
+#endif
+
+// Offsets of up to max newlines in p[0..len) into out[]; returns the count
+static uint LineEnds( const byte* p, uint len, uint* out, uint max ) {
+  uint i=0,k=0,m;
+#ifdef DK_SSE2
+  // 16 bytes per compare; movemask gives one bit per newline
+  const __m128i nl = _mm_set1_epi8( '\n' );
+  for( ; i+16<=len; i+=16 ) {
+    m = _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)(p+i) ), nl ) );
+    for( ; m; m&=m-1 ) {
+      out[k++] = i + Ctz32(m);
+      if( k==max ) return k;
+    }
+  }
+#endif
+  for( ; i<len; i++ ) if( p[i]=='\n' ) {
+    out[k++] = i;
+    if( k==max ) break;
+  }
+  return k;
+}
+
+// Open both files and start the diff from the base offsets; returns 0 on failure
+uint LineScan::start( segmap& _map, char** names, qword* _base ) {
+  uint i;
+  map = &_map;
+  for( i=0; i<2; i++ ) { f[i].f=0; buf[i]=0; lofs[i]=0; lhash[i]=0; }
+  ends=0; runs=0; v1=0; v2=0; sofs=0; shash=0; htab[0]=0; htab[1]=0;
+  for( i=0; i<2; i++ ) {
+    if( f[i].open(names[i])==0 ) { stop(); return 0; }
+    size[i] = f[i].size();
+    buf[i] = new byte[BUFLEN];
+    lofs[i] = new qword[WLINES+1];
+    lhash[i] = new qword[WLINES];
+    htab[i] = new uint[1<<HBITS];
+  }
+  ends = new uint[WLINES];
+  runs = new run[WLINES+1];
+  v1 = new int[2*DMAX+4];
+  v2 = new int[2*DMAX+4];
+  sofs = new qword[WLINES+1];
+  shash = new qword[WLINES];
+  map->Init( 2, size, _base );
+  nhunk = 0; ndel = 0; nins = 0;
+  f_full = 0;
+  f_run = 1;
+  return base::start();
+}
+
+// Stop scan, wait for thread exit and close files
+void LineScan::stop( void ) {
+  uint i;
+  if( map==0 ) return;
+  f_run = 0;
+  if( th ) { base::quit(); th=0; }
+  for( i=0; i<2; i++ ) {
+    if( f[i].f ) f[i].close();
+    f[i].f = 0;
+    delete[] buf[i]; buf[i]=0;
+    delete[] lofs[i]; lofs[i]=0;
+    delete[] lhash[i]; lhash[i]=0;
+    delete[] htab[i]; htab[i]=0;
+  }
+  delete[] ends; ends=0;
+  delete[] runs; runs=0;
+  delete[] v1; v1=0;
+  delete[] v2; v2=0;
+  delete[] sofs; sofs=0;
+  delete[] shash; shash=0;
+  map = 0;
+}
+
+// Skip bytes equal in both files from cur[], then back up to the start of the differing line;
+// returns 0 if the files are equal to their ends
+uint LineScan::Skip( qword* cur ) {
+  uint i,m,d,k,l[2];
+  byte* p[2];
+  while( f_run ) {
+    for( i=0; i<2; i++ ) {
+      l[i] = 0;
+      if( cur[i]<size[i] ) {
+        f[i].seek( cur[i] );
+        l[i] = f[i].sread( buf[i], uint( Min( qword(BUFLEN), size[i]-cur[i] ) ) );
+      }
+      p[i] = buf[i];
+    }
+    m = Min( l[0], l[1] );
+    if( m==0 ) return (l[0]|l[1])!=0;  // Both ended: equal; one ended: the rest of the other differs
+    d = DiffFirst( p, 2, m );
+    if( (d==m) && (l[0]==l[1]) ) {
+      cur[0] += m; cur[1] += m;
+      map->scanned = cur[0];
+      continue;
+    }
+    for( k=d; (k>0) && (buf[0][k-1]!='\n'); k-- );
+    cur[0] += k; cur[1] += k;
+    return 1;
+  }
+  return 0;
+}
+
+// Index up to WLINES lines of file i from pos into ofs[] (line starts, ofs[n] = end) and hash[];
+// returns lines indexed n. Lines longer than the read buffer are split into buffer-sized pieces.
+uint LineScan::Index( uint i, qword pos, qword* ofs, qword* hash ) {
+  uint n=0,l,k,j,s,e;
+  while( f_run && (n<WLINES) && (pos<size[i]) ) {
+    f[i].seek( pos );
+    l = f[i].sread( buf[i], uint( Min( qword(BUFLEN), size[i]-pos ) ) );
+    if( l==0 ) break;
+    k = LineEnds( buf[i], l, ends, WLINES-n );
+    for( s=0,j=0; j<k; j++,s=e,n++ ) {
+      e = ends[j]+1;
+      ofs[n] = pos+s;
+      hash[n] = XXH64( buf[i]+s, e-s );
+    }
+    if( (n<WLINES) && (s<l) && ((s==0) || (pos+l>=size[i])) ) {  // Last line without a newline, or a long line piece
+      ofs[n] = pos+s;
+      hash[n] = XXH64( buf[i]+s, l-s );
+      n++; s=l;
+    }
+    pos += s;
+  }
+  ofs[n] = pos;
+  return n;
+}
+
+// Count lines of file i from pos to its end
+qword LineScan::Lines( uint i, qword pos ) {
+  uint l,k,s;
+  qword n=0;
+  byte last='\n';
+  for( ; f_run && (pos<size[i]); pos+=l ) {
+    f[i].seek( pos );
+    l = f[i].sread( buf[i], uint( Min( qword(BUFLEN), size[i]-pos ) ) );
+    if( l==0 ) break;
+    for( s=0; s<l; s+=ends[k-1]+1 ) {
+      k = LineEnds( buf[i]+s, l-s, ends, WLINES );
+      n += k;
+      if( k<WLINES ) break;
+    }
+    last = buf[i][l-1];
+  }
+  return n + (last!='\n');
+}
+
+// Append matched run (merged with the previous one if it continues it)
+void LineScan::Match( uint a, uint b, uint l ) {
+  if( l==0 ) return;
+  if( nrun ) {
+    run& r = runs[nrun-1];
+    if( (r.a+r.l==a) && (r.b+r.l==b) ) { r.l+=l; return; }
+  }
+  runs[nrun].a = a; runs[nrun].b = b; runs[nrun].l = l;
+  nrun++;
+}
+
+// Split point of lines [a,a+n) and [b,b+m) on a middle snake (or the furthest forward point)
+// Forward and backward Myers searches run until their paths overlap, which bounds the edit
+// distance of both halves by about half of the whole. Past DMAX edits the search gives up and
+// splits at the forward point that got furthest, so strongly differing windows stay cheap.
+void LineScan::Bisect( uint a, uint n, uint b, uint m, uint* x, uint* y ) {
+  const qword* A = lhash[0]+a;
+  const qword* B = lhash[1]+b;
+  int N=n, M=m, delta=N-M, front=delta&1;
+  int vo=DMAX+2, vl=2*DMAX+4;
+  int dmax = Min( (N+M+1)/2, int(DMAX) );
+  int d,k,o,x1,y1,x2,y2,k1s=0,k1e=0,k2s=0,k2e=0,bx=-1,by=0;
+
+  for( k=0; k<vl; k++ ) v1[k]=v2[k]=-1;
+  v1[vo+1] = 0; v2[vo+1] = 0;
+  for( d=0; d<dmax; d++ ) {
+    // Forward paths
+    for( k=-d+k1s; k<=d-k1e; k+=2 ) {
+      o = vo+k;
+      x1 = ((k==-d) || ((k!=d) && (v1[o-1]<v1[o+1]))) ? v1[o+1] : v1[o-1]+1;
+      y1 = x1-k;
+      while( (x1<N) && (y1<M) && (A[x1]==B[y1]) ) x1++,y1++;
+      v1[o] = x1;
+      if( x1>N ) k1e+=2;       // Off the right edge
+      else if( y1>M ) k1s+=2;  // Off the bottom edge
+      else if( front ) {
+        o = vo+delta-k;
+        if( (o>=0) && (o<vl) && (v2[o]!=-1) && (x1>=N-v2[o]) ) { *x=x1; *y=y1; return; }
+      }
+    }
+    // Backward paths (x2, y2 counted from the ends)
+    for( k=-d+k2s; k<=d-k2e; k+=2 ) {
+      o = vo+k;
+      x2 = ((k==-d) || ((k!=d) && (v2[o-1]<v2[o+1]))) ? v2[o+1] : v2[o-1]+1;
+      y2 = x2-k;
+      while( (x2<N) && (y2<M) && (A[N-x2-1]==B[M-y2-1]) ) x2++,y2++;
+      v2[o] = x2;
+      if( x2>N ) k2e+=2;
+      else if( y2>M ) k2s+=2;
+      else if( !front ) {
+        o = vo+delta-k;
+        if( (o>=0) && (o<vl) && (v1[o]!=-1) && (v1[o]>=N-x2) ) { *x=v1[o]; *y=v1[o]-(o-vo); return; }
+      }
+    }
+  }
+
+  // Edit limit reached: furthest forward point short of the end
+  for( k=-dmax; k<=dmax; k++ ) {
+    x1 = v1[vo+k]; y1 = x1-k;
+    if( (x1<0) || (x1>N) || (y1<0) || (y1>M) || (x1+y1>=N+M) ) continue;
+    if( x1+y1>bx+by ) { bx=x1; by=y1; }
+  }
+  if( bx+by<=0 ) { bx=(N+1)/2; by=(M+1)/2; }
+  *x = bx; *y = by;
+}
+
+// Matched runs of lines [a,a+n) of file 0 and [b,b+m) of file 1
+void LineScan::Lcs( uint a, uint n, uint b, uint m ) {
+  uint p,s,j,x,y;
+  const qword* A = lhash[0];
+  const qword* B = lhash[1];
+
+  // Common prefix and suffix
+  for( p=0; (p<n) && (p<m) && (A[a+p]==B[b+p]); p++ );
+  Match( a, b, p );
+  a+=p; b+=p; n-=p; m-=p;
+  for( s=0; (s<n) && (s<m) && (A[a+n-1-s]==B[b+m-1-s]); s++ );
+  n-=s; m-=s;
+
+  if( (n==1) || (m==1) ) {
+    // One line against many: it matches at most once
+    for( j=0; (n==1) && (j<m); j++ ) if( A[a]==B[b+j] ) { Match( a, b+j, 1 ); break; }
+    for( j=0; (m==1) && (j<n); j++ ) if( A[a+j]==B[b] ) { Match( a+j, b, 1 ); break; }
+  } else if( n && m && f_run ) {
+    Bisect( a, n, b, m, &x, &y );
+    if( ((x==0) && (y==0)) || ((x==n) && (y==m)) ) { x=(n+1)/2; y=(m+1)/2; }  // Never recurse on the whole
+    Lcs( a, x, b, y );
+    Lcs( a+x, n-x, b+y, m-y );
+  }
+  Match( a+n, b+m, s );
+}
+
+// Look past windows with nothing in common: each file is read on against a table of the other's window
+// lines, up to SEEKLINES lines, for the nearest RUNLINES lines in a row that match. Returns 1 with the
+// positions a[] where the files meet again and the lines nlines[] of each file before them.
+uint LineScan::Seek( qword* a, qword* nlines ) {
+  uint i,j,k,c,n,h,x,hmask=(1<<HBITS)-1;
+  qword pos[2],cnt[2];
+
+  // Window lines by hash (first occurrence)
+  for( i=0; i<2; i++ ) {
+    memset( htab[i], 0, sizeof(uint)<<HBITS );
+    for( k=0; k<nl[i]; k++ ) {
+      for( h=uint(lhash[i][k])&hmask; htab[i][h] && (lhash[i][htab[i][h]-1]!=lhash[i][k]); h=(h+1)&hmask );
+      if( htab[i][h]==0 ) htab[i][h] = k+1;
+    }
+    pos[i] = lofs[i][nl[i]];
+    cnt[i] = nl[i];
+  }
+
+  // Read both files on in turns, a chunk at a time
+  while( f_run && (cnt[0]<SEEKLINES || cnt[1]<SEEKLINES) && (pos[0]<size[0] || pos[1]<size[1]) ) {
+    for( j=0; j<2; j++ ) {
+      i = 1-j;
+      if( (cnt[j]>=SEEKLINES) || (pos[j]>=size[j]) ) continue;
+      n = Index( j, pos[j], sofs, shash );
+      for( k=0; k<n; k++ ) {
+        for( h=uint(shash[k])&hmask; htab[i][h] && (lhash[i][htab[i][h]-1]!=shash[k]); h=(h+1)&hmask );
+        if( htab[i][h]==0 ) continue;
+        x = htab[i][h]-1;
+        for( c=1; (c<RUNLINES) && (k+c<n) && (x+c<nl[i]) && (shash[k+c]==lhash[i][x+c]); c++ );
+        if( (c<RUNLINES) && (x+c<nl[i]) ) continue;  // Too short, unless it runs to the end of the window
+        a[i] = lofs[i][x]; nlines[i] = x;
+        a[j] = sofs[k]; nlines[j] = cnt[j]+k;
+        return 1;
+      }
+      pos[j] = sofs[n];
+      cnt[j] += n;
+    }
+  }
+  return 0;
+}
+
+// Add hunk from beg[] to end[] with nl[] lines per file (continuing an open one); unless f_tail, close it
+// with a segment at end[], where the files are equal again. Returns 0 if the map is full.
+uint LineScan::Hunk( qword* beg, qword* end, qword* nl, uint f_tail ) {
+  if( f_open==0 ) {
+    if( (beg[0]==end[0]) && (beg[1]==end[1]) ) return 1;  // Nothing differs
+    if( map->Add(beg)==0 ) return 0;
+    nhunk++;
+    f_open = 1;
+  }
+  ndel += nl[0];
+  nins += nl[1];
+  if( f_tail ) return 1;
+  f_open = 0;
+  return map->Add(end);
+}
+
+// Hunk of window lines [pa,a) and [pb,b)
+uint LineScan::Hunk( uint pa, uint pb, uint a, uint b, uint f_tail ) {
+  qword beg[2],end[2],n[2];
+  beg[0] = lofs[0][pa]; end[0] = lofs[0][a]; n[0] = a-pa;
+  beg[1] = lofs[1][pb]; end[1] = lofs[1][b]; n[1] = b-pb;
+  return Hunk( beg, end, n, f_tail );
+}
+
+// Thread function - diffs the files from start to end
+void LineScan::thread( void ) {
+  uint i,r,c,e,pa,pb,f_end;
+  qword cur[2],a[2],n[2];
+
+  for( i=0; i<2; i++ ) cur[i]=map->Pos(0,i);
+  f_open = 0;
+  nquiet = 0;
+
+  while( f_run ) {
+    // Skip equal data (an open hunk continues at the window ends instead)
+    if( (f_open==0) && (Skip(cur)==0) ) break;
+    map->scanned = cur[0];
+
+    // Some file ended: the rest of the other is one hunk
+    if( (cur[0]>=size[0]) || (cur[1]>=size[1]) ) {
+      i = (cur[0]>=size[0]);
+      if( f_open==0 ) {
+        if( map->Add(cur)==0 ) { f_full=1; break; }
+        nhunk++;
+      }
+      if( i ) nins += Lines( 1, cur[1] ); else ndel += Lines( 0, cur[0] );
+      break;
+    }
+
+    // Diff the next window of lines
+    for( i=0; i<2; i++ ) nl[i] = Index( i, cur[i], lofs[i], lhash[i] );
+    nrun = 0;
+    Lcs( 0, nl[0], 0, nl[1] );
+    if( f_run==0 ) break;
+    f_end = (lofs[0][nl[0]]>=size[0]) && (lofs[1][nl[1]]>=size[1]);
+
+    // Commit hunks up to the first run past half of a window (the last run if none; everything at the end of both files)
+    for( c=0; (c<nrun) && (runs[c].a<nl[0]/2) && (runs[c].b<nl[1]/2); c++ );
+    if( c==nrun ) c = nrun-1;
+    if( (nrun>0) && (f_open==0) && (runs[c].a==0) && (runs[c].b==0) ) {  // No progress at the window start
+      if( c+1<nrun ) c++; else nrun=0;
+    }
+    e = f_end ? nrun : Min( c+1, nrun );
+    for( pa=pb=0,r=0; r<e; r++ ) {
+      if( Hunk( pa, pb, runs[r].a, runs[r].b )==0 ) break;
+      pa = runs[r].a+runs[r].l;
+      pb = runs[r].b+runs[r].l;
+    }
+    if( r<e ) { f_full=1; break; }
+    if( f_end ) {
+      if( Hunk( pa, pb, nl[0], nl[1], 1 )==0 ) f_full=1;
+      break;
+    }
+    if( nrun==0 ) {
+      // Nothing in common: look ahead for where the files meet again, else the hunk goes on past the windows
+      if( (nquiet==0) && Seek( a, n ) ) {
+        if( Hunk( cur, a, n )==0 ) { f_full=1; break; }
+        for( i=0; i<2; i++ ) cur[i] = a[i];
+      } else {
+        if( nquiet ) nquiet--; else nquiet = SEEKLINES/WLINES;  // Don't read the same look-ahead again for each window
+        if( Hunk( 0, 0, nl[0], nl[1], 1 )==0 ) { f_full=1; break; }
+        for( i=0; i<2; i++ ) cur[i] = lofs[i][nl[i]];
+      }
+    } else {
+      cur[0] = lofs[0][runs[c].a];
+      cur[1] = lofs[1][runs[c].b];
+    }
+    map->scanned = cur[0];
+  }
+
+  if( f_run && !f_full ) map->scanned = map->size[0];
+  f_run = 0;
+}
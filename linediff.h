@@ -0,0 +1,93 @@
+// Line-oriented diff of two text files into an alignment map (linear-memory Myers)
+#ifndef LINEDIFF_H
+#define LINEDIFF_H
+
+#include "common.h"
+#include "thread.h"
+#include "file_win.h"
+#include "align.h"
+#include "blockhash.h"
+
+// Background line diff that fills a segmap, so the views follow each other hunk by hunk
+// Equal data is skipped with DiffFirst. At a difference, windows of up to WLINES lines of both files
+// are indexed (line starts and XXH64 of each line) and diffed with the linear-space Myers algorithm
+// (middle snakes, divide and conquer). Hunks up to the first matched run past half of a window are
+// committed and the scan resumes at that run, so memory is bounded by the windows whatever the file
+// sizes. Each hunk adds two segments: one where it starts, one where the files are equal again.
+struct LineScan : thread<LineScan> {
+
+  typedef thread<LineScan> base;
+
+  enum{ WLINES=1<<14, BUFLEN=1<<20 };  // Lines per window, read buffer (longer lines are split)
+  enum{ DMAX=512 };  // Edit distance searched per split; beyond it the furthest forward point is taken
+  enum{ SEEKLINES=1<<20, RUNLINES=4, HBITS=15 };  // Look-ahead of windows with nothing in common: lines per file,
+                                                 // matched run needed, line table size (2x WLINES)
+
+  struct run { uint a, b, l; };  // Matched lines [a,a+l) of file 0 and [b,b+l) of file 1
+
+  segmap* map;             // Target map
+  volatile uint f_run;     // Cleared to stop the scan
+  volatile uint f_full;    // Segment limit reached (scan stopped early)
+  filehandle0 f[2];        // Private file handles
+  qword size[2];           // File sizes
+  byte* buf[2];            // Read buffers (BUFLEN bytes)
+  qword* lofs[2];          // Line starts of the windows (WLINES+1, last = window end)
+  qword* lhash[2];         // Line hashes of the windows
+  uint  nl[2];             // Lines in the windows
+  uint* ends;              // Line ends found in a read buffer
+  run*  runs;              // Matched runs of the windows, in order
+  uint  nrun;              // Runs in use
+  int*  v1;                // Myers furthest reaching x per diagonal, forward
+  int*  v2;                //  and backward
+  qword* sofs;             // Line starts of a look-ahead chunk (WLINES+1)
+  qword* shash;            //  and its line hashes
+  uint* htab[2];           // Window lines by hash (index+1, 0 = empty)
+  uint  nquiet;            // Windows to go before the next look-ahead (after one that found nothing)
+  uint  f_open;            // Hunk started but not closed yet (its start segment is in the map)
+  volatile uint  nhunk;    // Hunks committed
+  volatile qword ndel;     // Lines of file 0 in hunks
+  volatile qword nins;     // Lines of file 1 in hunks
+
+  // Open both files and start the diff from the base offsets; returns 0 on failure
+  uint start( segmap& _map, char** names, qword* base=0 );
+
+  // Stop scan, wait for thread exit and close files
+  void stop( void );
+
+  // Skip bytes equal in both files from cur[], then back up to the start of the differing line;
+  // returns 0 if the files are equal to their ends
+  uint Skip( qword* cur );
+
+  // Index up to WLINES lines of file i from pos into ofs[] (line starts, ofs[n] = end) and hash[];
+  // returns lines indexed n
+  uint Index( uint i, qword pos, qword* ofs, qword* hash );
+
+  // Count lines of file i from pos to its end
+  qword Lines( uint i, qword pos );
+
+  // Append matched run (merged with the previous one if it continues it)
+  void Match( uint a, uint b, uint l );
+
+  // Split point of lines [a,a+n) and [b,b+m) on a middle snake (or the furthest forward point)
+  void Bisect( uint a, uint n, uint b, uint m, uint* x, uint* y );
+
+  // Matched runs of lines [a,a+n) of file 0 and [b,b+m) of file 1
+  void Lcs( uint a, uint n, uint b, uint m );
+
+  // Look past windows with nothing in common: each file is read on against a table of the other's window
+  // lines, up to SEEKLINES lines, for the nearest RUNLINES lines in a row that match. Returns 1 with the
+  // positions a[] where the files meet again and the lines nlines[] of each file before them.
+  uint Seek( qword* a, qword* nlines );
+
+  // Add hunk from beg[] to end[] with nl[] lines per file (continuing an open one); unless f_tail, close it
+  // with a segment at end[], where the files are equal again. Returns 0 if the map is full.
+  uint Hunk( qword* beg, qword* end, qword* nl, uint f_tail=0 );
+
+  // Hunk of window lines [pa,a) and [pb,b)
+  uint Hunk( uint pa, uint pb, uint a, uint b, uint f_tail=0 );
+
+  // Thread function - diffs the files from start to end
+  void thread( void );
+};
+
+#endif // LINEDIFF_H
@@ -0,0 +1,290 @@
+// Block manifest implementation
+#include "manifest.h"
+
+// SHA-256 round constants
+static const uint K256[64] = {
+  0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+  0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+  0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+  0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+  0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+  0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+  0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+  0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+};
+
+static inline uint Ror( uint x, uint r ) { return (x>>r) | (x<<(32-r)); }
+
+// Compress one 64-byte block into state h
+static void Sha256Block( uint* h, const byte* p ) {
+  uint i,t1,t2,w[64];
+  uint a=h[0],b=h[1],c=h[2],d=h[3],e=h[4],f=h[5],g=h[6],k=h[7];
+  for( i=0; i<16; i++ ) w[i] = (p[4*i]<<24) | (p[4*i+1]<<16) | (p[4*i+2]<<8) | p[4*i+3];
+  for( ; i<64; i++ ) {
+    uint s0 = Ror(w[i-15],7) ^ Ror(w[i-15],18) ^ (w[i-15]>>3);
+    uint s1 = Ror(w[i-2],17) ^ Ror(w[i-2],19) ^ (w[i-2]>>10);
+    w[i] = w[i-16] + s0 + w[i-7] + s1;
+  }
+  for( i=0; i<64; i++ ) {
+    t1 = k + (Ror(e,6) ^ Ror(e,11) ^ Ror(e,25)) + ((e&f) ^ (~e&g)) + K256[i] + w[i];
+    t2 = (Ror(a,2) ^ Ror(a,13) ^ Ror(a,22)) + ((a&b) ^ (a&c) ^ (b&c));
+    k=g; g=f; f=e; e=d+t1; d=c; c=b; b=a; a=t1+t2;
+  }
+  h[0]+=a; h[1]+=b; h[2]+=c; h[3]+=d; h[4]+=e; h[5]+=f; h[6]+=g; h[7]+=k;
+}
+
+void sha256::Init( void ) {
+  static const uint h0[8] = { 0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19 };
+  memcpy( h, h0, sizeof(h) );
+  n = 0; len = 0;
+}
+
+void sha256::Update( const void* _p, uint l ) {
+  const byte* p = (const byte*)_p;
+  uint k;
+  len += l;
+  if( n ) {
+    k = Min( l, 64-n );
+    memcpy( buf+n, p, k ); n+=k; p+=k; l-=k;
+    if( n<64 ) return;
+    Sha256Block( h, buf ); n=0;
+  }
+  for( ; l>=64; l-=64,p+=64 ) Sha256Block( h, p );
+  memcpy( buf, p, l ); n = l;
+}
+
+void sha256::Final( byte* out ) {
+  uint i;
+  qword bits = len*8;
+  buf[n++] = 0x80;
+  if( n>56 ) { memset( buf+n, 0, 64-n ); Sha256Block( h, buf ); n=0; }
+  memset( buf+n, 0, 56-n );
+  for( i=0; i<8; i++ ) buf[56+i] = byte( bits>>(56-8*i) );
+  Sha256Block( h, buf );
+  for( i=0; i<32; i++ ) out[i] = byte( h[i/4]>>(24-8*(i&3)) );
+}
+
+// Allocate for a file of size _fsize; _bbits=0 picks the block size
+void manifest::Init( qword _fsize, uint _bbits ) {
+  fsize = _fsize;
+  if( _bbits==0 ) for( _bbits=MINBITS; (_bbits<MAXBITS) && (((fsize-1)>>_bbits)>=MAXBLK); _bbits++ );
+  bbits = _bbits;
+  nblk = uint( (fsize+(qword(1)<<bbits)-1)>>bbits );
+  hash = new byte[nblk+1][32];
+  bzero( root );
+}
+
+// Free hashes
+void manifest::Quit( void ) {
+  delete[] hash; hash=0;
+  nblk = 0; fsize = 0;
+}
+
+// Compute root from the block hashes
+void manifest::Tree( void ) {
+  uint i,n=nblk;
+  byte (*t)[32];
+  if( n==0 ) { bzero( root ); return; }
+  t = new byte[n][32];
+  memcpy( t, hash, n*32 );
+  // Each node hashes its two children; an odd last child is carried up unchanged
+  for( ; n>1; n=(n+1)/2 ) {
+    for( i=0; i+1<n; i+=2 ) {
+      sha256 s;
+      s.Init(); s.Update( t[i], 64 ); s.Final( t[i/2] );
+    }
+    if( n&1 ) memcpy( t[n/2], t[n-1], 32 );
+  }
+  memcpy( root, t[0], 32 );
+  delete[] t;
+}
+
+// Manifest file header (followed by the file name and the block hashes)
+struct manifesthdr {
+  uint  magic, version;
+  uint  bbits, nblk;
+  qword fsize;
+  byte  root[32];
+  uint  namelen, pad;
+};
+
+// Load a manifest file; returns 0 if it is missing or damaged (bad header or root mismatch)
+uint manifest::Load( const char* file ) {
+  manifesthdr h;
+  uint r=0;
+  filehandle0 f;
+  if( f.open( file )==0 ) return 0;
+  // Header fields are checked before anything is allocated from them
+  if( (f.read(h)==0) && (h.magic==magic) && (h.version==version) && (h.bbits>=MINBITS) && (h.bbits<=MAXBITS) &&
+      (h.nblk<=MAXBLK) && (h.nblk==(h.fsize>>h.bbits)+((h.fsize&((qword(1)<<h.bbits)-1))!=0)) &&
+      (h.namelen<MAX_PATH) && (f.read( name, h.namelen )==h.namelen) ) {
+    name[h.namelen] = 0;
+    Init( h.fsize, h.bbits );
+    if( f.read( hash, nblk*32 )==nblk*32 ) {
+      Tree();
+      r = (memcmp( root, h.root, 32 )==0);
+    }
+    if( r==0 ) Quit();
+  }
+  f.close();
+  return r;
+}
+
+// Write the manifest file; returns 0 on failure
+uint manifest::Save( const char* file ) {
+  manifesthdr h;
+  uint r;
+  filehandle0 f;
+  bzero( h );
+  h.magic = magic; h.version = version;
+  h.bbits = bbits; h.nblk = nblk;
+  h.fsize = fsize;
+  memcpy( h.root, root, 32 );
+  h.namelen = strlen( name );
+  if( f.make( file )==0 ) return 0;
+  r = (f.writ(h)==0) && (f.writ( name, h.namelen )==h.namelen) && (f.writ( hash, nblk*32 )==nblk*32);
+  f.close();
+  return r;
+}
+
+// Thread function - hashes blocks until none are left
+void ManifestWorker::thread( void ) {
+  uint b,k,s;
+  qword pos,len;
+  byte h[32];
+  ManifestScan& m = *ms;
+  manifest& o = m.f_check ? m.loc : *m.ref;  // Hashes being computed
+  while( m.f_run ) {
+    b = InterlockedIncrement( &m.next )-1;
+    if( b>=m.nblk ) break;
+    pos = qword(b)<<o.bbits;
+    len = o.BlkLen(b);
+    sha256 sh;
+    sh.Init();
+    f.seek( pos );
+    for( s=ManifestScan::B_SAME; m.f_run && len; len-=k ) {
+      k = uint( Min( len, qword(ManifestScan::BUFLEN) ) );
+      if( f.sread( buf, k )!=k ) { m.err = "read error"; s = ManifestScan::B_DIFF; break; }
+      sh.Update( buf, k );
+      bytes += k;
+    }
+    if( m.f_run==0 ) break;  // Block stays pending
+    sh.Final( h );
+    memcpy( o.hash[b], h, 32 );
+    if( m.f_check && ((b>=m.ref->nblk) || (m.ref->BlkLen(b)!=o.BlkLen(b)) || memcmp( h, m.ref->hash[b], 32 )) ) s = ManifestScan::B_DIFF;
+    m.st[b] = s;  // Set last: the owner reads the state without locking
+  }
+}
+
+// Hash file into a new manifest written to mfile; returns 0 if the file can't be opened
+uint ManifestScan::make( manifest& m, const char* file, const char* mfile, uint bbits ) {
+  filehandle0 t;
+  if( t.open( file )==0 ) return 0;
+  qword size = t.size();
+  t.close();
+  ref = &m;
+  m.Quit();
+  m.Init( size, bbits );
+  strncpy( m.name, file, MAX_PATH-1 ); m.name[MAX_PATH-1]=0;
+  strncpy( fname, file, MAX_PATH-1 ); fname[MAX_PATH-1]=0;
+  strncpy( mname, mfile, MAX_PATH-1 ); mname[MAX_PATH-1]=0;
+  f_check = 0; map = 0;
+  nblk = m.nblk;
+  Reset();
+  return base::start();
+}
+
+// Compare file with manifest m, marking differing blocks in _map; returns 0 if the file can't be opened
+uint ManifestScan::check( manifest& m, const char* file, diffmap& _map ) {
+  filehandle0 t;
+  if( t.open( file )==0 ) return 0;
+  qword size = t.size();
+  t.close();
+  ref = &m;
+  loc.Quit();
+  loc.Init( size, m.bbits );
+  strncpy( fname, file, MAX_PATH-1 ); fname[MAX_PATH-1]=0;
+  mname[0] = 0;
+  f_check = 1;
+  map = &_map;
+  map->Quit();
+  map->Init( Max( size, m.fsize ) );
+  nblk = loc.nblk;
+  Reset();
+  return base::start();
+}
+
+// Clear block states and results for a new scan of nblk blocks
+void ManifestScan::Reset( void ) {
+  delete[] st;
+  st = new byte[nblk+1];
+  bzero( st, nblk+1 );
+  next = 0; frontier = 0; ndiff = 0;
+  f_done = 0; err = 0;
+  for( uint k=0; k<NWORKERS; k++ ) wk[k].bytes = 0;
+  f_run = 1;
+}
+
+// Stop and wait for all threads
+void ManifestScan::stop( void ) {
+  if( ref==0 ) return;
+  f_run = 0;
+  base::quit();
+  ref = 0;
+}
+
+// Bytes hashed so far
+qword ManifestScan::Bytes( void ) {
+  uint k;
+  qword s=0;
+  for( k=0; k<NWORKERS; k++ ) s += wk[k].bytes;
+  return s;
+}
+
+// End of the level-0 overview bin holding pos: Add() credits a single bin, so blocks are added bin by bin
+static qword BinEnd( diffmap& map, qword pos ) {
+  return (pos|((qword(1)<<map.shift)-1))+1;
+}
+
+// Thread function - runs the workers and feeds the overview in block order
+void ManifestScan::thread( void ) {
+  uint k,b;
+  qword p,l,e;
+  manifest& o = f_check ? loc : *ref;
+  for( k=0; k<NWORKERS; k++ ) {
+    ManifestWorker& w = wk[k];
+    w.ms = this;
+    w.buf = new byte[BUFLEN];
+    if( w.f.open( fname )==0 ) w.f.f = 0;  // Can't happen after the open in make()/check()
+    w.start();
+  }
+  // Blocks finish out of order; the overview gets them in order, from this thread only
+  for( b=0; f_run && (b<nblk); ) {
+    if( st[b]==B_PENDING ) { Sleep(10); continue; }
+    if( st[b]==B_DIFF ) {
+      ndiff++;
+      // A last block that is shorter on one side is marked to the longer end
+      if( map ) for( p=qword(b)<<o.bbits,e=p+Max( o.BlkLen(b), (b<ref->nblk) ? ref->BlkLen(b) : 0 ); p<e; p+=l ) { l = Min( e-p, Min( qword(1)<<30, BinEnd( *map, p )-p ) ); map->Add( p, uint(l) ); }
+    }
+    frontier = ++b;
+    if( map ) map->scanned = Min( qword(b)<<o.bbits, map->size );
+  }
+  for( k=0; k<NWORKERS; k++ ) {
+    wk[k].quit();
+    if( wk[k].f.f ) { wk[k].f.close(); wk[k].f.f=0; }
+    delete[] wk[k].buf; wk[k].buf=0;
+  }
+  if( f_run==0 ) return;
+  if( f_check ) {
+    // Blocks of the manifest past the end of the local file
+    for( b=nblk; b<ref->nblk; b++ ) {
+      ndiff++;
+      for( p=qword(b)<<ref->bbits,e=p+ref->BlkLen(b); p<e; p+=l ) { l = Min( e-p, Min( qword(1)<<30, BinEnd( *map, p )-p ) ); map->Add( p, uint(l) ); }
+    }
+    map->scanned = map->size;
+  } else {
+    ref->Tree();
+    if( ref->Save( mname )==0 ) err = "can't write the manifest";
+  }
+  f_done = 1;
+}
@@ -0,0 +1,116 @@
+// Block manifests: SHA-256 per block plus a Merkle root, to compare a file against a copy on another machine
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include "common.h"
+#include "thread.h"
+#include "file_win.h"
+#include "minimap.h"
+
+// Incremental SHA-256
+struct sha256 {
+  uint  h[8];      // State
+  byte  buf[64];   // Partial block
+  uint  n;         // Bytes in buf
+  qword len;       // Bytes hashed
+
+  void Init( void );
+  void Update( const void* p, uint l );
+  void Final( byte* out );  // 32 bytes
+};
+
+// Block manifest of one file
+// Blocks are at least 1MB and sized so a file has at most MAXBLK of them, which keeps a manifest of any file
+// within about 128KB. The Merkle root hashes pairs of children (an odd last child is carried up unchanged).
+struct manifest {
+  enum{ magic=wc<'C','M','P','M'>::n, version=1 };
+  enum{ MAXBLK=1<<12, MINBITS=20, MAXBITS=40 };
+
+  qword fsize;            // File size
+  uint  bbits;            // Block size log2
+  uint  nblk;             // Blocks (last one may be partial)
+  byte  (*hash)[32];      // Block hashes
+  byte  root[32];         // Merkle root
+  char  name[MAX_PATH];   // File the manifest was made from (as given)
+
+  // Allocate for a file of size _fsize; _bbits=0 picks the block size
+  void Init( qword _fsize, uint _bbits=0 );
+
+  // Free hashes
+  void Quit( void );
+
+  // Length of block b
+  qword BlkLen( uint b ) { return Min( qword(1)<<bbits, fsize-(qword(b)<<bbits) ); }
+
+  // Compute root from the block hashes
+  void Tree( void );
+
+  // Load a manifest file; returns 0 if it is missing or damaged (root mismatch)
+  uint Load( const char* file );
+
+  // Write the manifest file; returns 0 on failure
+  uint Save( const char* file );
+};
+
+// Hash worker: takes blocks from a shared counter and hashes each with its own handle
+struct ManifestWorker : thread<ManifestWorker> {
+
+  typedef thread<ManifestWorker> base;
+
+  struct ManifestScan* ms;  // Owner
+  filehandle0 f;            // Private handle
+  byte* buf;                // Read buffer
+  volatile qword bytes;     // Bytes hashed so far
+
+  // Thread function - hashes blocks until none are left
+  void thread( void );
+};
+
+// Background hashing of a file into a manifest, or against a loaded one
+// Check mode marks blocks whose hashes differ (or that exist on one side only) in its own overview pyramid;
+// the pyramid is fed in file order, so the unscanned part stays gray as in the difference overview.
+struct ManifestScan : thread<ManifestScan> {
+  enum{ NWORKERS=4, BUFLEN=1<<20 };
+  enum{ B_PENDING=0, B_SAME, B_DIFF };
+
+  typedef thread<ManifestScan> base;
+
+  manifest* ref;                // Loaded manifest (check) or the one being built (make)
+  manifest  loc;                // Hashes of the local file (check mode)
+  char      fname[MAX_PATH];    // Local file
+  char      mname[MAX_PATH];    // Manifest file (written in make mode)
+  uint      f_check;            // Check mode
+  diffmap*  map;                // Overview of differing blocks (check mode)
+  byte*     st;                 // B_* per block of the local file
+  uint      nblk;               // Blocks to hash
+  volatile LONG next;           // Next block for the workers
+  volatile uint frontier;       // Blocks below it are done and in the overview
+  uint      ndiff;              // Differing blocks (check mode)
+  volatile uint f_run;          // Cleared to stop
+  volatile uint f_done;         // Finished (manifest written in make mode)
+  const char* err;              // Error text (0 = none)
+  ManifestWorker wk[NWORKERS];
+
+  // Hash file into a new manifest written to mfile; returns 0 if the file can't be opened
+  uint make( manifest& m, const char* file, const char* mfile, uint bbits=0 );
+
+  // Compare file with manifest m, marking differing blocks in _map; returns 0 if the file can't be opened
+  uint check( manifest& m, const char* file, diffmap& _map );
+
+  // Clear block states and results for a new scan of nblk blocks
+  void Reset( void );
+
+  // Stop and wait for all threads
+  void stop( void );
+
+  // Bytes hashed so far
+  qword Bytes( void );
+
+  // Block b of the local file differs from the manifest (known so far)
+  uint Diff( uint b ) { return st && (b<nblk) ? st[b]==B_DIFF : (f_check && f_done && (b<ref->nblk)); }
+
+  // Thread function - runs the workers and feeds the overview in block order
+  void thread( void );
+};
+
+#endif // MANIFEST_H
@@ -0,0 +1,226 @@
+// Near-duplicate clustering implementation
+#include "minhash.h"
+#include "blockhash.h"
+
+// LSH band key of one file
+struct bandkey {
+  qword key;  // Hash of the band's signature values
+  uint  f;    // File
+};
+
+// Cluster and its size
+struct clsize {
+  uint size;  // Files in it
+  uint root;  // Union-find root
+};
+
+// Order of band keys by key, then file
+static int CmpKey( const void* a, const void* b ) {
+  const bandkey& x = *(const bandkey*)a;
+  const bandkey& y = *(const bandkey*)b;
+  if( x.key!=y.key ) return (x.key<y.key) ? -1 : 1;
+  return (x.f<y.f) ? -1 : (x.f>y.f);
+}
+
+// Order of clusters by size (largest first), then by first file
+static int CmpSize( const void* a, const void* b ) {
+  const clsize& x = *(const clsize*)a;
+  const clsize& y = *(const clsize*)b;
+  if( x.size!=y.size ) return (x.size>y.size) ? -1 : 1;
+  return (x.root<y.root) ? -1 : (x.root>y.root);
+}
+
+// Union-find root of i (with path halving)
+static uint Find( uint* up, uint i ) {
+  while( up[i]!=i ) i = up[i] = up[up[i]];
+  return i;
+}
+
+// Hash function k of a chunk hash (splitmix64 finalizer of a per-function offset)
+static inline qword MixK( qword h, uint k ) {
+  h += (k+1)*0x9E3779B97F4A7C15ULL;
+  h = (h^(h>>30)) * 0xBF58476D1CE4E5B9ULL;
+  h = (h^(h>>27)) * 0x94D049BB133111EBULL;
+  return h^(h>>31);
+}
+
+// Free tables and list
+void simfiles::Quit( void ) {
+  list.Quit();
+  delete[] sig; sig=0;
+  delete[] state; state=0;
+  delete[] cl; cl=0;
+  delete[] cbeg; cbeg=0;
+  nf = ncl = 0;
+}
+
+// Allocate tables for the listed files
+void simfiles::Alloc( void ) {
+  nf = list.ne;
+  sig = new uint[nf*K+1];
+  state = new byte[nf+1];
+  bzero( state, nf+1 );
+  cl = new uint[nf+1];
+  cbeg = new uint[nf+2];
+}
+
+// Signature values that files i and j share
+uint simfiles::Same( uint i, uint j ) {
+  uint k,c=0;
+  for( k=0; k<K; k++ ) c += (sig[i*K+k]==sig[j*K+k]);
+  return c;
+}
+
+// Group signed files: LSH band matches with at least thr shared values are joined
+// Files that share a band are compared with up to 16 earlier files of the same band key, so large
+// groups of copies cost linear time.
+void simfiles::Cluster( void ) {
+  uint b,i,j,t,m,s,e,c,r;
+  uint* up = new uint[nf+1];
+  bandkey* bk = new bandkey[nf+1];
+  for( i=0; i<nf; i++ ) up[i] = i;
+  for( b=0; b<BANDS; b++ ) {
+    for( m=0,i=0; i<nf; i++ ) if( state[i]==S_DONE ) {
+      bk[m].key = XXH64( sig+i*K+b*ROWS, ROWS*sizeof(uint), b );
+      bk[m].f = i; m++;
+    }
+    qsort( bk, m, sizeof(bandkey), CmpKey );
+    for( s=0; s<m; s=e ) {
+      for( e=s+1; (e<m) && (bk[e].key==bk[s].key); e++ );
+      for( j=s+1; j<e; j++ ) for( t=j; (t>s) && (t+16>j); t-- ) {
+        uint x = Find( up, bk[j].f ), y = Find( up, bk[t-1].f );
+        if( (x!=y) && (Same( bk[j].f, bk[t-1].f )>=thr) ) up[Max(x,y)] = Min(x,y);
+      }
+    }
+  }
+  // Clusters of 2+ files, largest first; files keep directory order inside a cluster
+  uint* size = new uint[nf+1];
+  clsize* cs = new clsize[nf+1];
+  bzero( size, nf+1 );
+  for( i=0; i<nf; i++ ) if( state[i]==S_DONE ) size[ Find(up,i) ]++;
+  for( ncl=0,i=0; i<nf; i++ ) if( (up[i]==i) && (size[i]>1) ) { cs[ncl].size = size[i]; cs[ncl].root = i; ncl++; }
+  qsort( cs, ncl, sizeof(clsize), CmpSize );
+  for( i=0; i<nf; i++ ) size[i] = ~0U;  // Reused as cluster number of each root
+  for( c=0; c<ncl; c++ ) size[ cs[c].root ] = c;
+  for( cbeg[0]=0,c=0; c<ncl; c++ ) cbeg[c+1] = cbeg[c]+cs[c].size;
+  for( c=0; c<=ncl; c++ ) cs[c].size = cbeg[c];  // Fill positions
+  for( i=0; i<nf; i++ ) {
+    if( state[i]!=S_DONE ) continue;
+    r = Find( up, i );
+    if( size[r]!=~0U ) cl[ cs[size[r]].size++ ] = i;
+  }
+  delete[] cs;
+  delete[] size;
+  delete[] bk;
+  delete[] up;
+}
+
+// Add one chunk to the signature
+void ClusterWorker::Chunk( const byte* p, uint l ) {
+  uint k;
+  qword h = XXH64( p, l ), v;
+  for( k=0; k<simfiles::K; k++ ) {
+    v = MixK( h, k );
+    if( v<mins[k] ) mins[k] = v;
+  }
+}
+
+// Sign file i; returns its state
+// The file is read once in 1MB blocks; the unfinished last chunk moves to the buffer start before the next read.
+uint ClusterWorker::Sign( uint i ) {
+  uint k,l,o,have=0,got,end,nchunk=0,f_eof=0;
+  char path[treecmp::PATHLEN];
+  filehandle0 f;
+  sf->list.Path( i, 0, path );
+  if( f.open( path )==0 ) return simfiles::S_ERROR;
+  for( k=0; k<simfiles::K; k++ ) mins[k] = ~0ULL;
+  while( *f_run && !f_eof ) {
+    got = f.read( buf+have, ClusterScan::BUFLEN );
+    f_eof = (got==0);
+    bytes += got;
+    for( end=have+got,o=0; o<end; o+=l ) {
+      l = GearChunk( buf+o, end-o, simfiles::CHUNK_MIN, simfiles::CHUNK_AVG, simfiles::CHUNK_MAX, simfiles::CHUNK_BITS, f_eof );
+      if( l==0 ) break;  // Needs more data
+      Chunk( buf+o, l );
+      nchunk++;
+    }
+    have = end-o;
+    memmove( buf, buf+o, have );
+  }
+  f.close();
+  if( *f_run==0 ) return simfiles::S_PENDING;
+  if( nchunk==0 ) return simfiles::S_EMPTY;
+  for( k=0; k<simfiles::K; k++ ) sf->sig[i*simfiles::K+k] = uint(mins[k]>>32);
+  return simfiles::S_DONE;
+}
+
+// Thread function - signs files until none are left
+void ClusterWorker::thread( void ) {
+  uint i;
+  while( *f_run ) {
+    i = InterlockedIncrement( next )-1;
+    if( i>=sf->nf ) break;
+    if( sf->state[i]!=simfiles::S_PENDING ) continue;
+    sf->state[i] = Sign( i );
+    InterlockedIncrement( &sf->ndone );
+  }
+}
+
+// Start clustering the files under dir with similarity threshold sim (0..1); returns 0 on failure
+uint ClusterScan::start( simfiles& _sf, char* dir, double sim ) {
+  sf = &_sf;
+  sf->Quit();
+  sf->list.Init( &dir, 1, 1 );
+  sf->thr = uint( sim*simfiles::K+0.999 );
+  sf->ndone = 0;
+  sf->f_listed = sf->f_done = 0;
+  next = 0;
+  f_run = 1;
+  return base::start();
+}
+
+// Stop scan and wait for all threads
+void ClusterScan::stop( void ) {
+  if( sf==0 ) return;
+  f_run = 0;
+  base::quit();
+  sf = 0;
+}
+
+// Bytes read by the workers so far
+qword ClusterScan::Bytes( void ) {
+  uint k;
+  qword s=0;
+  for( k=0; k<NWORKERS; k++ ) s += wk[k].bytes;
+  return s;
+}
+
+// Thread function - walks, signs and clusters
+void ClusterScan::thread( void ) {
+  uint k;
+  simfiles& s = *sf;
+
+  s.list.Walk( 0, "", &f_run );
+  if( f_run==0 ) return;
+  s.list.Match();
+  s.Alloc();
+  for( k=0; k<s.nf; k++ ) {
+    uint l = strlen( s.list.e[k].name );
+    if( (l>5) && (strcmp( s.list.e[k].name+l-5, ".cmph" )==0) ) s.state[k] = simfiles::S_SKIP, s.ndone++;
+  }
+  s.f_listed = 1;
+
+  for( k=0; k<NWORKERS; k++ ) {
+    ClusterWorker& w = wk[k];
+    w.sf = sf; w.next = &next; w.f_run = &f_run; w.bytes = 0;
+    w.buf = new byte[BUFLEN+simfiles::CHUNK_MAX];
+    w.start();
+  }
+  for( k=0; k<NWORKERS; k++ ) {
+    wk[k].quit();
+    delete[] wk[k].buf; wk[k].buf=0;
+  }
+  if( f_run==0 ) return;
+  s.Cluster();
+  s.f_done = 1;
+}
@@ -0,0 +1,92 @@
+// Near-duplicate clustering: MinHash signatures of content-defined chunks, grouped with LSH
+#ifndef MINHASH_H
+#define MINHASH_H
+
+#include "common.h"
+#include "thread.h"
+#include "file_win.h"
+#include "gear.h"
+#include "treecmp.h"
+
+// Files of a directory with their signatures and clusters
+// A signature holds, for K seeded hash functions, the smallest hash of any chunk of the file, so the share of
+// equal signature values estimates the Jaccard similarity of the chunk sets. Chunks are cut by the gear hash,
+// so inserted or shifted data changes only the chunks around the edit.
+// Filled by ClusterScan; the terminal reads it once f_done is set (progress counters at any time).
+struct simfiles {
+  enum{ K=64, BANDS=16, ROWS=K/BANDS };                      // Signature size, LSH bands of ROWS values
+  enum{ CHUNK_MIN=1<<11, CHUNK_AVG=1<<13, CHUNK_BITS=13, CHUNK_MAX=1<<16 };  // Chunk sizes: 2KB min, ~8KB average, 64KB max
+  enum{ S_PENDING=0, S_DONE, S_EMPTY, S_ERROR, S_SKIP };  // S_SKIP: block hash sidecar (.cmph)
+
+  treecmp list;              // Files of the directory (walked as a one-root tree)
+  uint   nf;                 // Files (list.ne)
+  uint*  sig;                // K values per file
+  byte*  state;              // S_* per file
+  uint   thr;                // Similarity threshold in signature values (of K)
+  uint*  cl;                 // Files grouped by cluster, largest clusters first
+  uint*  cbeg;               // Start of cluster c in cl (ncl+1 entries)
+  uint   ncl;                // Clusters of 2 or more files
+  volatile LONG ndone;       // Files signed (or skipped) so far
+  volatile uint f_listed;    // Directory walked; nf is valid
+  volatile uint f_done;      // Clusters are ready
+
+  // Free tables and list
+  void Quit( void );
+
+  // Allocate tables for the listed files
+  void Alloc( void );
+
+  // Signature values that files i and j share
+  uint Same( uint i, uint j );
+
+  // Group signed files: LSH band matches with at least thr shared values are joined
+  void Cluster( void );
+};
+
+// Signature worker: takes files from a shared counter and streams each file once
+struct ClusterWorker : thread<ClusterWorker> {
+
+  typedef thread<ClusterWorker> base;
+
+  simfiles* sf;             // Target tables
+  volatile LONG* next;      // Shared next file
+  volatile uint* f_run;     // Shared stop flag
+  byte* buf;                // Read buffer (BUFLEN plus one unfinished chunk)
+  volatile qword bytes;     // Bytes read so far
+  qword mins[simfiles::K];  // Signature being built
+
+  // Add one chunk to the signature
+  void Chunk( const byte* p, uint l );
+
+  // Sign file i; returns its state
+  uint Sign( uint i );
+
+  // Thread function - signs files until none are left
+  void thread( void );
+};
+
+// Background clustering: directory walk, parallel signatures, then LSH grouping
+struct ClusterScan : thread<ClusterScan> {
+  enum{ NWORKERS=4, BUFLEN=1<<20 };
+
+  typedef thread<ClusterScan> base;
+
+  simfiles* sf;                   // Target tables
+  ClusterWorker wk[NWORKERS];     // Signature workers
+  volatile LONG next;             // Next file for the workers
+  volatile uint f_run;            // Cleared to stop
+
+  // Start clustering the files under dir with similarity threshold sim (0..1); returns 0 on failure
+  uint start( simfiles& _sf, char* dir, double sim );
+
+  // Stop scan and wait for all threads
+  void stop( void );
+
+  // Bytes read by the workers so far
+  qword Bytes( void );
+
+  // Thread function - walks, signs and clusters
+  void thread( void );
+};
+
+#endif // MINHASH_H
@@ -0,0 +1,197 @@
+// Difference density overview implementation
+#include "minimap.h"
+
+// Allocate pyramid for given range (clears counts)
+void diffmap::Init( qword _size ) {
+  uint k;
+  size = _size;
+  scanned = 0;
+  // Smallest bin size (at least 16 bytes) that keeps level 0 within MAP_BINS bins
+  for( shift=4; (size>0) && (((size-1)>>shift)>=MAP_BINS); shift++ );
+  nbins[0] = (size>0) ? uint((size-1)>>shift)+1 : 1;
+  for( k=0; k<MAP_LEVELS; k++ ) {
+    level[k] = new qword[nbins[k]];
+    bzero( level[k], nbins[k] );
+    if( nbins[k]==1 ) break;
+    nbins[k+1] = (nbins[k]+1)/2;  // Each level merges pairs of bins
+  }
+  nlevels = k+1;
+}
+
+// Free pyramid
+void diffmap::Quit( void ) {
+  uint k;
+  for( k=0; k<nlevels; k++ ) delete[] level[k];
+  nlevels = 0;
+}
+
+// Add cnt differing bytes at pos (on all levels)
+void diffmap::Add( qword pos, uint cnt ) {
+  uint k;
+  qword b = pos>>shift;
+  for( k=0; k<nlevels; k++ ) level[k][b>>k] += cnt;
+}
+
+// Difference count for [beg,end) at the level matching range size; *cover = bytes summed
+qword diffmap::Count( qword beg, qword end, qword* cover ) {
+  uint k=0,s;
+  qword b,b0,b1,r=0;
+  if( end>size ) end=size;
+  if( (nlevels==0) || (beg>=end) ) { *cover=0; return 0; }
+  // Coarsest level whose bins still fit into the range (1-2 bins summed per query)
+  while( (k+1<nlevels) && ((2ULL<<(shift+k))<=(end-beg)) ) k++;
+  s = shift+k;
+  b0 = beg>>s; b1 = (end-1)>>s;
+  for( b=b0; b<=b1; b++ ) r += level[k][b];
+  *cover = Min( (b1+1)<<s, size ) - (b0<<s);
+  return r;
+}
+
+// File position of pixel row y of H rows
+qword diffmap::RowPos( uint y, uint H ) {
+  return (size/H)*y + (size%H)*y/H;  // Avoids overflow of size*y
+}
+
+// Render overview into bitmap column; [vbeg,vend) is marked as current view
+void diffmap::Draw( mybitmap& bm, uint X, uint Y, uint W, uint H, qword vbeg, qword vend ) {
+  uint x,y,t,rg,col;
+  qword beg,end,c,cover,v;
+  for( y=0; y<H; y++ ) {
+    beg = RowPos(y,H);
+    end = Max( RowPos(y+1,H), beg+1 );
+    if( beg>=scanned ) {
+      col = 0x303030;  // Not scanned yet: gray
+    } else {
+      c = Count( beg, end, &cover );
+      if( c==0 ) {
+        col = 0x101010;  // Equal: near black
+      } else {
+        // Log-scale density: bit length of (16.16 fixed point fraction), 1..17 -> 15..255
+        v = (c<<16)/Max(cover,1ULL);
+        for( t=0; v; v>>=1 ) t++;
+        t = Min( t*15, 255U );
+        rg = (t>160) ? (t-160)*255/95 : 0;  // Dense regions fade from blue to white
+        col = (rg<<16) | (rg<<8) | Min( 0x50+t, 255U );
+      }
+    }
+    uint mark = (end>vbeg) && (beg<vend);  // Row overlaps current view
+    for( x=0; x<W; x++ ) bm.pixel(X+x,Y+y) = (mark && (x<3)) ? 0x00AA00 : col;
+  }
+}
+
+// Open files and start scanning; returns 0 on failure
+uint MapScan::start( diffmap& _map, char** _names, uint n, blockhash* _bh, qword* base, ignoremask* _ign, typemode* _tm, xchain* xc ) {
+  names = _names;
+  bh = _bh;
+  ign = (_ign && _ign->n) ? _ign : 0;
+  tm = (_tm && _tm->type) ? _tm : 0;
+  if( br.Open( names, n, base, blockread::blklen, xc )==0 ) return 0;
+  map = &_map;  // Set once there is something for stop() to release
+  keep = (ign || tm) ? new byte[blockread::blklen] : 0;
+  map->Init( br.maxsize );
+  f_run = 1;
+  return base::start();
+}
+
+// Stop scan and wait for thread exit
+void MapScan::stop( void ) {
+  if( map==0 ) return;
+  f_run = 0;
+  if( th ) { base::quit(); th=0; }
+  br.Quit();
+  delete[] keep; keep=0;
+  map->Quit();
+  map = 0;
+}
+
+// Thread function - reads all files sequentially and feeds the pyramid
+void MapScan::thread( void ) {
+  uint i,j,k,o,l,m,s,c,nk,gmask=0,hmask=0,rmask,f_blk,f_ext;
+  byte* kp;
+  qword pos,h,b[DK_MAXF];
+  byte* p[DK_MAXF];
+  byte eqh[blockread::blklen>>blockhash::hbits];  // Per 64KB block: all hashes equal
+  byte eqx[blockread::blklen>>blockhash::hbits];  // Per 64KB block: same physical bytes in all files
+  // Piece size: one level-0 bin, but not more than a hash block,
+  // so each Add() lands in exactly one bin and each piece in one hash block
+  uint step = Min( (map->shift<blockhash::hbits) ? (1U<<map->shift) : uint(blockhash::hblk), uint(blockhash::hblk) );
+
+  // Hash blocks line up only if all base offsets are block-aligned; hashes are of untransformed data
+  for( f_blk=1,i=0; i<br.n; i++ ) f_blk &= ((br.base[i]&(blockhash::hblk-1))==0) && !br.Xform(i);
+
+  // Files with a valid sidecar ("golden") are only read where hashes disagree;
+  // maps are built for the files read from offset 0
+  for( i=0; i<br.n; i++ ) {
+    gmask |= (f_blk && bh[i].f_loaded)<<i;
+    hmask |= (!bh[i].f_loaded && (br.base[i]==0) && (bh[i].leaf!=0) && !br.Xform(i))<<i;
+  }
+  rmask = ((1U<<br.n)-1) & ~gmask;
+
+  // All files have sidecars with the same root at the same offset: identical, nothing to read
+  for( i=1; (rmask==0) && (i<br.n); i++ ) if( (br.base[i]!=br.base[0]) || (bh[i].fsize!=bh[0].fsize) || (bh[i].Root()!=bh[0].Root()) ) break;
+  if( (rmask==0) && (i>=br.n) ) pos = map->size;
+  else pos = 0;
+
+  for( ; f_run && (pos<map->size); pos+=l ) {
+    // Hash blocks stored at the same physical bytes in all files are equal; if the whole block is,
+    // only the files whose hash maps are being built are read
+    l = uint( Min( qword(blockread::blklen), br.maxsize-pos ) );
+    nk = (l+blockhash::hblk-1)>>blockhash::hbits;
+    for( f_ext=1,k=0; k<nk; k++ ) {
+      o = k<<blockhash::hbits;
+      s = Min( uint(blockhash::hblk), l-o );
+      eqx[k] = br.Shared( pos+o, s )==s;
+      f_ext &= eqx[k];
+    }
+    l = br.Read( pos, blockread::blklen, f_ext ? hmask : rmask );
+    if( l==0 ) break;
+    nk = (l+blockhash::hblk-1)>>blockhash::hbits;
+    for( i=0; i<br.n; i++ ) b[i] = (pos+br.base[i])>>blockhash::hbits;  // First hash block of each file
+
+    // Hash freshly read blocks into the maps being built
+    for( i=0; i<br.n; i++ ) if( (hmask>>i)&1 ) {
+      for( k=0; k<nk; k++ ) {
+        o = k<<blockhash::hbits;
+        if( o<br.len[i] ) bh[i].leaf[b[i]+k] = XXH64( br.buf[i]+o, Min(uint(blockhash::hblk),br.len[i]-o) );
+      }
+      bh[i].known = uint( (pos+br.len[i]+blockhash::hblk-1)>>blockhash::hbits );
+    }
+
+    // Compare hashes per block; load golden data only where they disagree
+    for( k=0; k<nk; k++ ) {
+      o = k<<blockhash::hbits;
+      s = Min( uint(blockhash::hblk), l-o );
+      eqh[k] = f_blk;
+      if( eqx[k] ) { eqh[k]=1; continue; }
+      for( i=0; eqh[k] && (i<br.n); i++ ) {
+        if( (bh[i].leaf==0) || (br.len[i]<o+s) || (b[i]+k>=bh[i].known) ) { eqh[k]=0; break; }
+        h = bh[i].leaf[b[i]+k];
+        if( (i>0) && (h!=bh[0].leaf[b[0]+k]) ) { eqh[k]=0; break; }
+      }
+      if( eqh[k]==0 ) for( i=0; i<br.n; i++ ) if( ((gmask>>i)&1) && (o<br.len[i]) ) br.Fetch( i, o, Min(s,br.len[i]-o) );
+    }
+
+    // Ignored ranges and tolerance-equal elements in this block: mask them out
+    kp = ((ign || tm) && !f_ext) ? BlockKeep( br, l, ign, tm, keep ) : 0;
+
+    // Count differences per piece
+    for( o=0; o<l; o+=s ) {
+      s = Min( step, l-o );
+      if( eqh[o>>blockhash::hbits] ) continue;  // Equal by hash or physical location
+      m = (o<br.minlen) ? Min( s, br.minlen-o ) : 0;  // Bytes present in all files
+      for( i=0; i<br.n; i++ ) p[i] = br.buf[i]+o;
+      c = DiffCount( p, br.n, m, kp ? kp+o : 0 );
+      if( kp ) { for( j=m; j<s; j++ ) c += (kp[o+j]!=0); }
+      else c += s-m;  // Bytes past EOF of some file are different
+      if( c ) map->Add( pos+o, c );
+    }
+    map->scanned = pos+l;
+  }
+
+  // Complete scan: store hash maps of the files that had no valid sidecar
+  if( f_run ) {
+    map->scanned = map->size;
+    for( i=0; i<br.n; i++ ) if( ((hmask>>i)&1) && (bh[i].known>=bh[i].nblk) ) bh[i].Save( names[i] );
+  }
+  f_run = 0;
+}
@@ -0,0 +1,74 @@
+// Difference density overview (minimap) for the whole file
+#ifndef MINIMAP_H
+#define MINIMAP_H
+
+#include "common.h"
+#include "thread.h"
+#include "bitmap.h"
+#include "blockread.h"
+#include "blockhash.h"
+#include "typecmp.h"
+
+// Multi-resolution difference density pyramid
+// Level 0 has up to MAP_BINS bins of 2^shift bytes; each next level halves the bin count.
+// Counts are updated by the background scan and read by WM_PAINT without locking.
+struct diffmap {
+  enum{ MAP_BINS=1<<16, MAP_LEVELS=24 };
+
+  qword size;     // Mapped range in bytes (largest file size)
+  uint  shift;    // log2 of level-0 bin size
+  uint  nlevels;  // Number of pyramid levels in use
+  uint  nbins[MAP_LEVELS];   // Bins per level
+  qword* level[MAP_LEVELS];  // Differing byte counts per bin
+  volatile qword scanned;    // Scan frontier: everything below is counted
+
+  // Allocate pyramid for given range (clears counts)
+  void Init( qword _size );
+
+  // Free pyramid
+  void Quit( void );
+
+  // Add cnt differing bytes at pos (on all levels)
+  void Add( qword pos, uint cnt );
+
+  // Difference count for [beg,end) at the level matching range size; *cover = bytes summed
+  qword Count( qword beg, qword end, qword* cover );
+
+  // File position of pixel row y of H rows
+  qword RowPos( uint y, uint H );
+
+  // Render overview into bitmap column; [vbeg,vend) is marked as current view
+  void Draw( mybitmap& bm, uint X, uint Y, uint W, uint H, qword vbeg, qword vend );
+};
+
+// Background thread that fills the diffmap (started once files are open)
+struct MapScan : thread<MapScan> {
+
+  typedef thread<MapScan> base;
+
+  diffmap* map;       // Target pyramid
+  blockread br;       // Private file handles
+  volatile uint f_run;  // Cleared to stop the scan
+  char** names;       // File names (for saving hash sidecars)
+  blockhash* bh;      // Per-file block hash maps (loaded ones are used to skip reads)
+  ignoremask* ign;    // Ranges not counted as differences (0 if none)
+  typemode* tm;       // Element type: tolerance-equal elements are not counted (0 if none)
+  byte* keep;         // Keep mask buffer (blklen bytes)
+
+  // Open files and start scanning; returns 0 on failure
+  // Files whose hash map was loaded from a sidecar are only read where block hashes differ;
+  // maps of the other files are filled during the scan and saved when it completes.
+  // With base offsets, file i is compared from base[i]; hashes are only used when all
+  // bases are multiples of the hash block size, and only built for files with base 0.
+  // Bytes in ign ranges (positions past the base offsets) and tolerance-equal elements are not counted.
+  // Files with a transform chain in xc (one per file) are compared transformed and never use hashes.
+  uint start( diffmap& _map, char** _names, uint n, blockhash* _bh, qword* base=0, ignoremask* _ign=0, typemode* _tm=0, xchain* xc=0 );
+
+  // Stop scan and wait for thread exit
+  void stop( void );
+
+  // Thread function - reads all files sequentially and feeds the pyramid
+  void thread( void );
+};
+
+#endif // MINIMAP_H
@@ -3,15 +3,19 @@
 
 // Compile-time constexpr function to compute palette color for given index
 constexpr color compute_palette_color(int i) {
-  // UI color entries (0-5)
+  // UI color entries (0-9)
   if (i == pal_Sep)   return {0xFFFFFF, 0x000000};  // white on black
   if (i == pal_Hex)   return {0xFFFF55, 0x000000};  // light yellow on black
   if (i == pal_Addr)  return {0x00AA00, 0x000000};  // green on black
   if (i == pal_Diff)  return {0xFFFFFF, 0x0000AA};  // white on dark blue
   if (i == pal_Help1) return {0x00FFFF, 0x000080};  // cyan on navy
   if (i == pal_Help2) return {0xFFFFFF, 0x000080};  // white on navy
+  if (i == pal_ChgA)     return {0xFFFFFF, 0x006000};  // white on dark green
+  if (i == pal_ChgB)     return {0xFFFFFF, 0x800080};  // white on dark magenta
+  if (i == pal_ChgBoth)  return {0xFFFFFF, 0x007070};  // white on dark cyan
+  if (i == pal_Conflict) return {0xFFFFFF, 0xC00000};  // white on dark red
 
-  // Grayscale entries (6-255): map index to grayscale with 0x0000AA foreground
+  // Grayscale entries (10-255): map index to grayscale with 0x0000AA foreground
   if (i >= pal_GRAY_START && i < pal_MAX) {
     int gray_val = ((i - pal_GRAY_START) * 255) / (pal_MAX - pal_GRAY_START - 1);
     uint gray = (gray_val << 16) | (gray_val << 8) | gray_val;  // 0x00BBGGRR format
@@ -37,8 +41,12 @@ color palette[pal_MAX] = {
   compute_palette_color(pal_Diff),   // white on dark blue
   compute_palette_color(pal_Help1),  // cyan on navy
   compute_palette_color(pal_Help2),  // white on navy
+  compute_palette_color(pal_ChgA),      // white on dark green
+  compute_palette_color(pal_ChgB),      // white on dark magenta
+  compute_palette_color(pal_ChgBoth),   // white on dark cyan
+  compute_palette_color(pal_Conflict),  // white on dark red
 
-  // Remaining entries (6-255) are initialized by init_palette()
+  // Remaining entries (10-255) are initialized by init_palette()
 };
 
 // Static initializer to fill grayscale palette on startup using constexpr function
@@ -20,8 +20,13 @@ enum pal_ {
   pal_Help1,    // Help text normal (cyan on dark blue)
   pal_Help2,    // Help text highlighted sections (white on dark blue)
 
-  pal_GRAY_START = 6,  // Start of grayscale region (indices 6-255)
-  pal_MAX = 256        // Total palette entries (6 UI colors + 250 grayscale)
+  pal_ChgA,     // Three-way: changed in A only (white on dark green)
+  pal_ChgB,     // Three-way: changed in B only (white on dark magenta)
+  pal_ChgBoth,  // Three-way: same change in A and B (white on dark cyan)
+  pal_Conflict, // Three-way: A and B changed differently (white on dark red)
+
+  pal_GRAY_START = 10, // Start of grayscale region (indices 10-255)
+  pal_MAX = 256        // Total palette entries (10 UI colors + 246 grayscale)
 };
 
 // Color palette definition (RGB values: 0x00BBGGRR)
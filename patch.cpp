@@ -0,0 +1,346 @@
+// Binary patch export implementation
+#include "patch.h"
+
+static uint crctab[8][256];  // Slicing-by-8 tables
+
+// Fill the CRC-32 tables (once, before threads use Crc32)
+void Crc32Init( void ) {
+  uint i,k,c;
+  if( crctab[0][1] ) return;  // Already done
+  for( i=0; i<256; i++ ) {
+    for( c=i,k=0; k<8; k++ ) c = (c&1) ? 0xEDB88320^(c>>1) : c>>1;
+    crctab[0][i] = c;
+  }
+  for( i=0; i<256; i++ ) for( k=1; k<8; k++ ) crctab[k][i] = (crctab[k-1][i]>>8) ^ crctab[0][crctab[k-1][i]&0xFF];
+}
+
+// CRC-32 (IEEE, as in zip and BPS) of l bytes continuing from crc (0 for a new stream)
+// Eight bytes per step through eight tables, so the CRC keeps up with sequential reads
+uint Crc32( uint crc, const byte* p, uint l ) {
+  uint a,b;
+  crc = ~crc;
+  for( ; l && (size_t(p)&7); l-- ) crc = crctab[0][(crc^*p++)&0xFF] ^ (crc>>8);
+  for( ; l>=8; l-=8,p+=8 ) {
+    a = ((const uint*)p)[0] ^ crc;
+    b = ((const uint*)p)[1];
+    crc = crctab[7][a&0xFF] ^ crctab[6][(a>>8)&0xFF] ^ crctab[5][(a>>16)&0xFF] ^ crctab[4][a>>24] ^
+          crctab[3][b&0xFF] ^ crctab[2][(b>>8)&0xFF] ^ crctab[1][(b>>16)&0xFF] ^ crctab[0][b>>24];
+  }
+  for( ; l; l-- ) crc = crctab[0][(crc^*p++)&0xFF] ^ (crc>>8);
+  return ~crc;
+}
+
+// Create the patch file and write the header; returns 0 on failure
+uint bpsenc::Open( const char* name, qword ssize, qword tsize ) {
+  bzero( *this );
+  if( f.make( name )==0 ) return 0;
+  obuf = new byte[OBUFLEN];
+  lit = new byte[LITMAX];
+  Bytes( (const byte*)"BPS1", 4 );
+  Num( ssize ); Num( tsize );
+  Num( 0 );  // No metadata
+  return 1;
+}
+
+// Raw bytes
+void bpsenc::Bytes( const byte* p, uint n ) {
+  uint k;
+  for( ; n; n-=k,p+=k ) {
+    if( on==OBUFLEN ) Drain();
+    k = Min( n, OBUFLEN-on );
+    memcpy( obuf+on, p, k );
+    on += k;
+  }
+}
+
+// BPS number: 7 bits per byte, last byte flagged with bit 7; each continuation subtracts one, so encodings are unique
+void bpsenc::Num( qword x ) {
+  for(;;) {
+    byte c = x & 0x7F;
+    x >>= 7;
+    if( x==0 ) { Put( 0x80|c ); break; }
+    Put( c );
+    x--;
+  }
+}
+
+// Write the output buffer
+void bpsenc::Drain( void ) {
+  crc = Crc32( crc, obuf, on );
+  if( f.writ( obuf, on )!=on ) f_err = 1;
+  size += on;
+  on = 0;
+}
+
+// Emit the pending SourceRead
+void bpsenc::FlushSrc( void ) {
+  if( src==0 ) return;
+  Cmd( SourceRead, src );
+  out += src;
+  src = 0;
+}
+
+// Emit the pending literal, with runs as TargetCopy
+// A run of RUNMIN or more equal bytes is sent as its first byte plus a copy of that byte from one position back.
+void bpsenc::FlushLit( void ) {
+  uint r,e,s=0;
+  qword at;
+  sqword d;
+  for( r=0; r+RUNMIN<=nlit; r=e ) {
+    for( e=r+1; (e<nlit) && (lit[e]==lit[r]); e++ );
+    if( e-r<RUNMIN ) continue;
+    Cmd( TargetRead, r+1-s );
+    Bytes( lit+s, r+1-s );
+    at = out + (r-s);  // Target offset of the run's first byte
+    out += r+1-s;
+    d = sqword(at-tofs);
+    Cmd( TargetCopy, e-r-1 );
+    Num( (d<0) ? (qword(-d)<<1)|1 : qword(d)<<1 );
+    tofs = at + (e-r-1);
+    out += e-r-1;
+    s = e;
+  }
+  if( s<nlit ) {
+    Cmd( TargetRead, nlit-s );
+    Bytes( lit+s, nlit-s );
+    out += nlit-s;
+  }
+  nlit = 0;
+}
+
+// Target bytes p[0..n) equal to the source at the same offset
+// Short equal gaps between differences stay in the literal: a SourceRead command would cost as much
+void bpsenc::Same( const byte* p, uint n ) {
+  if( n==0 ) return;
+  if( nlit && (n<GAPMIN) ) { Diff( p, n ); return; }
+  FlushLit();
+  src += n;
+}
+
+// Target bytes p[0..n) that differ from the source (or lie past its end)
+void bpsenc::Diff( const byte* p, uint n ) {
+  uint k;
+  FlushSrc();
+  for( ; n; n-=k,p+=k ) {
+    k = Min( n, LITMAX-nlit );
+    memcpy( lit+nlit, p, k );
+    nlit += k;
+    if( nlit==LITMAX ) FlushLit();
+  }
+}
+
+// Flush pending commands, write the footer (source, target and patch CRCs) and close; returns 0 on failure
+uint bpsenc::Close( uint scrc, uint tcrc ) {
+  uint c[3];
+  FlushSrc(); FlushLit();
+  c[0] = scrc; c[1] = tcrc;
+  Bytes( (const byte*)c, 8 );
+  Drain();
+  c[2] = crc;  // Covers everything before it
+  if( f.writ( &c[2], 4 )!=4 ) f_err = 1;
+  size += 4;
+  f.close();
+  delete[] obuf; obuf=0;
+  delete[] lit; lit=0;
+  return f_err==0;
+}
+
+// Buffered reader with seeking, for the verify pass
+struct seqread {
+  enum{ BUFLEN=1<<20 };
+  filehandle0 f;
+  byte* buf;
+  uint  n, i;     // Bytes in buf, read position in it
+  qword pos;      // File offset of buf[0]
+  uint  f_crc;    // Keep crc (the patch stream)
+  uint  crc;      // CRC-32 of all bytes returned by Get
+
+  uint Open( const char* name ) {
+    bzero( *this );
+    if( f.open( name )==0 ) return 0;
+    buf = new byte[BUFLEN];
+    return 1;
+  }
+  void Quit( void ) {
+    if( buf ) { f.close(); delete[] buf; buf=0; }
+  }
+  qword Tell( void ) { return pos+i; }
+  void Seek( qword p ) {
+    if( (p>=pos) && (p<=pos+n) ) { i = uint(p-pos); return; }
+    f.seek( p ); pos = p; n = i = 0;
+  }
+  // Copy up to l bytes to d; returns bytes copied (less at EOF)
+  uint Get( byte* d, uint l ) {
+    uint k,r=0;
+    for( ; r<l; r+=k ) {
+      if( i==n ) { pos += n; n = f.read( buf, BUFLEN ); i = 0; if( n==0 ) break; }
+      k = Min( l-r, n-i );
+      memcpy( d+r, buf+i, k );
+      i += k;
+    }
+    if( f_crc ) crc = Crc32( crc, d, r );
+    return r;
+  }
+  // BPS number (see bpsenc::Num); sets *f_eof when the data ends inside it
+  qword Num( uint* f_eof ) {
+    qword x=0, s=1;
+    byte c;
+    for(;;) {
+      if( Get( &c, 1 )==0 ) { *f_eof=1; return 0; }
+      x += (c&0x7F)*s;
+      if( c&0x80 ) break;
+      s <<= 7;
+      x += s;
+    }
+    return x;
+  }
+};
+
+// len bytes from a equal the next len bytes of t
+static uint Match( seqread& a, seqread& t, qword len, byte* x, byte* y ) {
+  uint k;
+  for( ; len; len-=k ) {
+    k = uint( Min( len, qword(seqread::BUFLEN) ) );
+    if( (a.Get( x, k )!=k) || (t.Get( y, k )!=k) || memcmp( x, y, k ) ) return 0;
+  }
+  return 1;
+}
+
+// Start exporting the patch turning source into target; returns 0 if the thread can't be started
+uint PatchExport::start( const char* source, const char* target, const char* patch ) {
+  strncpy( sname, source, MAX_PATH-1 ); sname[MAX_PATH-1]=0;
+  strncpy( tname, target, MAX_PATH-1 ); tname[MAX_PATH-1]=0;
+  strncpy( pname, patch, MAX_PATH-1 ); pname[MAX_PATH-1]=0;
+  phase = P_ENCODE; done = 0;
+  tsize = psize = nsame = ndiff = 0;
+  err = 0;
+  Crc32Init();
+  f_run = 1;
+  if( base::start()==0 ) { phase = P_IDLE; return 0; }
+  return 1;
+}
+
+// Stop and wait for the thread
+void PatchExport::stop( void ) {
+  if( th==0 ) return;
+  f_run = 0;
+  base::quit();
+  th = 0;
+}
+
+// Encode pass: returns 0 on failure (err set)
+// Both files are read in lockstep; equal runs are skipped with the SSE2 first-difference kernel.
+uint PatchExport::Encode( void ) {
+  uint o,d,l,m;
+  qword pos;
+  byte* p[2];
+  char* names[2] = { sname, tname };
+  blockread br;
+  bpsenc e;
+  bzero( br );
+  if( br.Open( names, 2 )==0 ) { err = "can't open the files"; return 0; }
+  tsize = br.fsize[1];
+  if( e.Open( pname, br.fsize[0], tsize )==0 ) { br.Quit(); err = "can't create the patch file"; return 0; }
+  scrc = tcrc = 0;
+  for( pos=0; f_run && !e.f_err; pos+=l ) {
+    l = br.Read( pos, blockread::blklen );
+    if( l==0 ) break;
+    m = br.minlen;
+    scrc = Crc32( scrc, br.buf[0], br.len[0] );
+    tcrc = Crc32( tcrc, br.buf[1], br.len[1] );
+    for( o=0; o<m; o+=d ) {
+      p[0] = br.buf[0]+o; p[1] = br.buf[1]+o;
+      d = DiffFirst( p, 2, m-o );  // Equal run
+      e.Same( br.buf[1]+o, d ); nsame += d;
+      o += d;
+      if( o>=m ) break;
+      p[0] = br.buf[0]+o; p[1] = br.buf[1]+o;
+      d = SameFirst( p, 2, m-o );  // Differing run
+      e.Diff( br.buf[1]+o, d ); ndiff += d;
+    }
+    if( br.len[1]>m ) { e.Diff( br.buf[1]+m, br.len[1]-m ); ndiff += br.len[1]-m; }  // Past the end of the source
+    done = Min( pos+l, tsize );
+  }
+  br.Quit();
+  uint r = e.Close( scrc, tcrc );
+  psize = e.size;
+  if( r==0 ) { err = "can't write the patch file"; return 0; }
+  return 1;
+}
+
+// Verify pass: applies the patch to the source and compares the output with the target; returns 0 on mismatch
+// The output is never stored: each command's bytes are compared with the target file as they are produced.
+// Target copies read the target file itself, which matches the output up to the current offset.
+uint PatchExport::Verify( void ) {
+  uint c[3],pcrc,f_eof=0,r=0;
+  qword x,len,d,out=0,sofs=0,tofs=0,ssize;
+  byte hdr[4];
+  seqread P,S,T,C;
+  byte* xb = new byte[seqread::BUFLEN];
+  byte* yb = new byte[seqread::BUFLEN];
+  bzero( P ); bzero( S ); bzero( T ); bzero( C );
+  err = "can't open the files";
+  if( P.Open( pname ) && S.Open( sname ) && T.Open( tname ) && C.Open( tname ) ) {
+    P.f_crc = 1;
+    err = "bad patch header";
+    ssize = S.f.size();
+    if( (P.Get( hdr, 4 )==4) && (memcmp( hdr, "BPS1", 4 )==0) && (P.Num(&f_eof)==ssize) && (P.Num(&f_eof)==tsize) ) {
+      for( len=P.Num(&f_eof); len && !f_eof; len-- ) f_eof = (P.Get( hdr, 1 )==0);  // Skip metadata
+      err = "patch output differs from the target";
+      for( r=1; r && f_run && (P.Tell()+12<psize); ) {
+        x = P.Num(&f_eof);
+        len = (x>>2)+1;
+        if( f_eof || (out+len>tsize) ) { r=0; break; }
+        switch( x&3 ) {
+        case bpsenc::SourceRead:
+          r = (out+len<=ssize);
+          if( r ) { S.Seek( out ); r = Match( S, T, len, xb, yb ); }
+          break;
+        case bpsenc::TargetRead:
+          r = Match( P, T, len, xb, yb );
+          break;
+        case bpsenc::SourceCopy:
+          d = P.Num(&f_eof);
+          sofs += (d&1) ? 0-(d>>1) : (d>>1);
+          r = (sofs+len<=ssize) && !f_eof;
+          if( r ) { S.Seek( sofs ); r = Match( S, T, len, xb, yb ); }
+          sofs += len;
+          break;
+        case bpsenc::TargetCopy:
+          d = P.Num(&f_eof);
+          tofs += (d&1) ? 0-(d>>1) : (d>>1);
+          r = (tofs<out) && !f_eof;
+          if( r ) { C.Seek( tofs ); r = Match( C, T, len, xb, yb ); }
+          tofs += len;
+          break;
+        }
+        out += len;
+        done = out;
+      }
+      if( r && f_run ) {
+        // Footer: CRCs of the source and target, then of the patch before the last field
+        P.Get( (byte*)c, 8 );
+        pcrc = P.crc;
+        P.Get( (byte*)&c[2], 4 );
+        if( out!=tsize ) r = 0;
+        else if( (c[0]!=scrc) || (c[1]!=tcrc) || (c[2]!=pcrc) ) { r = 0; err = "patch checksum mismatch"; }
+      }
+    }
+  }
+  P.Quit(); S.Quit(); T.Quit(); C.Quit();
+  delete[] xb; delete[] yb;
+  return r && f_run;
+}
+
+// Thread function - encodes, then verifies
+void PatchExport::thread( void ) {
+  if( Encode()==0 ) { phase = P_ERROR; return; }
+  if( f_run==0 ) { err = "stopped"; phase = P_ERROR; return; }
+  phase = P_VERIFY; done = 0;
+  if( Verify()==0 ) {
+    if( f_run==0 ) err = "stopped";
+    phase = P_ERROR; return;
+  }
+  err = 0;
+  phase = P_DONE;
+}
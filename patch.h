@@ -0,0 +1,88 @@
+// Binary patch export: BPS patches built from the differences of two files, verified by re-applying them
+#ifndef PATCH_H
+#define PATCH_H
+
+#include "common.h"
+#include "thread.h"
+#include "file_win.h"
+#include "blockread.h"
+
+// Fill the CRC-32 tables (once, before threads use Crc32)
+void Crc32Init( void );
+
+// CRC-32 (IEEE, as in zip and BPS) of l bytes continuing from crc (0 for a new stream)
+uint Crc32( uint crc, const byte* p, uint l );
+
+// Streaming BPS encoder
+// Equal runs become SourceRead commands and differing runs TargetRead literals; runs of one repeated byte inside
+// the differences become one literal byte plus a TargetCopy of it. Memory is one output and one literal buffer.
+struct bpsenc {
+  enum{ SourceRead=0, TargetRead, SourceCopy, TargetCopy };  // BPS commands
+  enum{ OBUFLEN=1<<20, LITMAX=1<<16, RUNMIN=16, GAPMIN=4 };  // Buffers; shortest run and equal gap encoded as such
+
+  filehandle0 f;         // Patch file
+  byte* obuf;            // Output buffer
+  uint  on;              // Bytes in it
+  uint  crc;             // CRC-32 of the patch so far
+  qword size;            // Patch bytes written
+  qword out;             // Target bytes covered by emitted commands
+  qword src;             // Pending SourceRead length
+  byte* lit;             // Pending literal bytes
+  uint  nlit;            // Bytes in it
+  qword tofs;            // Decoder's target copy offset
+  uint  f_err;           // Write failed
+
+  // Create the patch file and write the header; returns 0 on failure
+  uint Open( const char* name, qword ssize, qword tsize );
+
+  // Target bytes p[0..n) equal to the source at the same offset
+  void Same( const byte* p, uint n );
+
+  // Target bytes p[0..n) that differ from the source (or lie past its end)
+  void Diff( const byte* p, uint n );
+
+  // Flush pending commands, write the footer (source, target and patch CRCs) and close; returns 0 on failure
+  uint Close( uint scrc, uint tcrc );
+
+  void Put( byte c ) { if( on==OBUFLEN ) Drain(); obuf[on++] = c; }
+  void Bytes( const byte* p, uint n );   // Raw bytes
+  void Num( qword x );                   // BPS number (7 bits per byte, bijective)
+  void Cmd( uint cmd, qword len ) { Num( ((len-1)<<2) | cmd ); }
+  void Drain( void );                    // Write the output buffer
+  void FlushSrc( void );                 // Emit the pending SourceRead
+  void FlushLit( void );                 // Emit the pending literal, with runs as TargetCopy
+};
+
+// Background export of a patch from file 0 to file N, then a verifying pass that re-applies it
+struct PatchExport : thread<PatchExport> {
+  enum{ P_IDLE=0, P_ENCODE, P_VERIFY, P_DONE, P_ERROR };
+
+  typedef thread<PatchExport> base;
+
+  char  sname[MAX_PATH], tname[MAX_PATH], pname[MAX_PATH];  // Source, target and patch file names
+  volatile uint  phase;   // P_*
+  volatile qword done;    // Bytes of the target processed in the current phase
+  qword tsize;            // Target size
+  qword psize;            // Patch size
+  qword nsame, ndiff;     // Target bytes encoded as source reads / as literals and runs
+  uint  scrc, tcrc;       // Source and target CRC-32 (encode pass)
+  const char* err;        // Error text (P_ERROR)
+  volatile uint f_run;    // Cleared to stop
+
+  // Start exporting the patch turning source into target; returns 0 if the thread can't be started
+  uint start( const char* source, const char* target, const char* patch );
+
+  // Stop and wait for the thread (results of a finished export stay)
+  void stop( void );
+
+  // Encode pass: returns 0 on failure (err set)
+  uint Encode( void );
+
+  // Verify pass: applies the patch to the source and compares the output with the target; returns 0 on mismatch
+  uint Verify( void );
+
+  // Thread function - encodes, then verifies
+  void thread( void );
+};
+
+#endif // PATCH_H
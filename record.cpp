@@ -0,0 +1,213 @@
+// Record mode implementation
+#include "record.h"
+
+#ifdef DK_SSE2
+#include <emmintrin.h>
+#endif
+
+// Set record size and layout: comma-separated field widths, each optionally "name:width";
+// bytes past the last field form one more field. Without a layout the record is split into
+// equal fields of 4 bytes or more (at most MAXFIELDS). Returns 0 on a bad size or layout.
+uint recordfmt::Set( uint size, const char* layout ) {
+  uint k,w,b,e,c,n=0;
+  uint o[MAXFIELDS+1];
+  char nm[MAXFIELDS][NAMELEN];
+  char* q;
+  const char* s;
+  if( (size==0) || (size>MAXSIZE) ) return 0;
+  bzero( nm );
+  o[0] = 0;
+  if( layout && *layout ) {
+    for( s=layout; *s; n++ ) {
+      if( n>=MAXFIELDS ) return 0;
+      const char* colon = strchr( s, ':' );
+      const char* comma = strchr( s, ',' );
+      if( colon && (!comma || (colon<comma)) ) {
+        k = Min( uint(colon-s), uint(NAMELEN-1) );
+        memcpy( nm[n], s, k );
+        s = colon+1;
+      }
+      w = strtoul( s, &q, 0 );
+      if( (q==s) || (w==0) || (o[n]+w>size) ) return 0;
+      o[n+1] = o[n]+w;
+      s = q;
+      while( (*s==' ') || (*s==',') ) s++;
+    }
+    if( o[n]<size ) {  // Rest of the record
+      if( n>=MAXFIELDS ) return 0;
+      o[++n] = size;
+    }
+  } else {
+    for( w=4; size>w*MAXFIELDS; w*=2 );
+    for( n=0; o[n]<size; n++ ) o[n+1] = Min( o[n]+w, size );
+  }
+  rsize = size;
+  nf = n;
+  nchunk = (size+63)>>6;
+  memcpy( off, o, sizeof(off) );
+  memcpy( name, nm, sizeof(name) );
+
+  // Field pieces per chunk, in chunk order
+  for( npart=0,k=0; k<nf; k++ ) {
+    for( b=off[k]; b<off[k+1]; b=e ) {
+      c = b>>6;
+      e = Min( off[k+1], (c+1)<<6 );
+      parts[npart].c = c;
+      parts[npart].k = k;
+      parts[npart].m = ((e-b==64) ? ~0ULL : ((1ULL<<(e-b))-1)) << (b&63);
+      npart++;
+    }
+  }
+  return 1;
+}
+
+// Field index of a number or name, -1 if none
+int recordfmt::Find( const char* s ) {
+  uint k;
+  char* e;
+  for( k=0; k<nf; k++ ) if( name[k][0] && (strcmp( name[k], s )==0) ) return k;
+  k = strtoul( s, &e, 0 );
+  return ((e!=s) && (*e==0) && (k<nf)) ? int(k) : -1;
+}
+
+// Difference bitmaps of nc 64-byte chunks of mask m (bit j of bits[c] = byte 64c+j differs)
+static void ChunkBits( const byte* m, uint nc, qword* bits ) {
+  uint c;
+#ifdef DK_SSE2
+  // Four compares against zero per chunk; movemask gathers one bit per byte
+  const __m128i z = _mm_setzero_si128();
+  for( c=0; c<nc; c++,m+=64 ) {
+    qword e0 = uint( _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)(m+ 0) ), z ) ) );
+    qword e1 = uint( _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)(m+16) ), z ) ) );
+    qword e2 = uint( _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)(m+32) ), z ) ) );
+    qword e3 = uint( _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)(m+48) ), z ) ) );
+    bits[c] = ~(e0 | (e1<<16) | (e2<<32) | (e3<<48));
+  }
+#else
+  uint j;
+  for( c=0; c<nc; c++,m+=64 ) {
+    for( bits[c]=0,j=0; j<64; j++ ) bits[c] |= qword(m[j]!=0)<<j;
+  }
+#endif
+}
+
+// Differing fields of one record from its difference mask m (nchunk*64 bytes, 0 = equal byte);
+// adds differing bytes per field to nbytes (0 = don't count)
+qword recordfmt::Fields( const byte* m, qword* nbytes ) {
+  uint i;
+  qword r=0,x;
+  qword bits[MAXCHUNK];
+  ChunkBits( m, nchunk, bits );
+  for( i=0; i<npart; i++ ) {
+    x = bits[parts[i].c] & parts[i].m;
+    if( x==0 ) continue;
+    r |= 1ULL<<parts[i].k;
+    if( nbytes ) nbytes[parts[i].k] += Popcnt64(x);
+  }
+  return r;
+}
+
+// Open files and start: count mode with _st, or find mode from record _from with fields _want;
+// returns 0 on failure. map, ign, tm and xc are used as by StatScan.
+uint RecordScan::start( recordfmt& _fmt, recordstats* _st, qword _want, qword _from, char** names, uint n, qword* _base,
+                        diffmap* _map, ignoremask* _ign, typemode* _tm, xchain* xc ) {
+  bsize = Max( 1U, uint(blockread::blklen)/_fmt.rsize ) * _fmt.rsize;  // Whole records per block
+  if( br.Open( names, n, _base, bsize, xc )==0 ) return 0;
+  fmt = &_fmt;
+  ign = (_ign && _ign->n) ? _ign : 0;
+  tm = (_tm && _tm->type) ? _tm : 0;
+  kbuf = (ign || tm) ? new byte[br.bufsize] : 0;
+  rmask = new byte[fmt->nchunk*64];
+  map = _map;
+  want = _want;
+  from = _from;
+  found = ~0ULL;
+  scanned = from;
+  st = want ? 0 : _st;
+  if( st ) {
+    bzero( *st );
+    st->n = br.n;
+    st->nrec = (br.maxsize+fmt->rsize-1)/fmt->rsize;
+    memset( st->ffirst, 0xFF, sizeof(st->ffirst) );
+  }
+  f_done = 0;
+  f_run = 1;
+  return base::start();
+}
+
+// Stop and wait for thread exit
+void RecordScan::stop( void ) {
+  if( fmt==0 ) return;
+  f_run = 0;
+  base::quit();
+  br.Quit();
+  delete[] kbuf; kbuf=0;
+  delete[] rmask; rmask=0;
+  fmt = 0;
+}
+
+// Compare record at block offset r over len bytes; returns its differing fields
+qword RecordScan::Record( uint r, uint len, const byte* kp ) {
+  uint i;
+  byte* q[DK_MAXF];
+  for( i=0; i<br.n; i++ ) q[i] = br.buf[i]+r;
+  DiffMask( q, br.n, len, rmask, kp ? kp+r : 0 );
+  if( len<fmt->nchunk*64 ) bzero( rmask+len, fmt->nchunk*64-len );  // Past the record (or the data)
+  return fmt->Fields( rmask, st ? st->fbytes : 0 );
+}
+
+// Thread function - walks all records block by block
+// Equal records are skipped with the first-difference kernel; each record with a difference
+// gets a byte mask, whose 64-byte chunks become bitmaps that the field masks are tested against.
+void RecordScan::thread( void ) {
+  uint i,l,o,d,r,full,rs=fmt->rsize;
+  byte* p[DK_MAXF];
+  byte* kp;
+  qword pos,rec,fl,cover,nr;
+
+  for( pos=from*rs; f_run && (pos<br.maxsize); pos+=l ) {
+    l = uint( Min( qword(bsize), br.maxsize-pos ) );
+    nr = (l+rs-1)/rs;
+
+    // Block equal in all files by the completed overview, or stored at the same physical bytes
+    if( (br.Shared( pos, l )==l) || (map && (map->scanned>=pos+l) && (map->Count(pos,pos+l,&cover)==0) && (cover>0)) ) {
+      if( st ) st->skipped += nr;
+    } else {
+      l = br.Read( pos, l );
+      if( l==0 ) break;
+      kp = (ign || tm) ? BlockKeep( br, l, ign, tm, kbuf ) : 0;
+      full = (br.minlen==l) ? l : br.minlen-br.minlen%rs;  // Records present in all files
+      for( o=0; f_run && (o<full); o=r+rs ) {
+        for( i=0; i<br.n; i++ ) p[i] = br.buf[i]+o;
+        d = o + DiffFirst( p, br.n, full-o, kp ? kp+o : 0 );
+        if( d>=full ) break;
+        r = d - d%rs;
+        fl = Record( r, Min( rs, full-r ), kp );
+        if( fl==0 ) continue;  // Only ignored or tolerance-equal bytes
+        rec = (pos+r)/rs;
+        if( want ) {
+          if( fl & want ) { found=rec; break; }
+          continue;
+        }
+        st->ndiff++;
+        for( i=0; i<fmt->nf; i++ ) if( (fl>>i)&1 ) {
+          if( st->fdiff[i]++==0 ) st->ffirst[i] = rec;
+        }
+      }
+      // Records past the end of some file
+      if( (found==~0ULL) && (full<l) ) {
+        if( want ) found = (pos+full)/rs;
+        else st->nmiss += (l-full+rs-1)/rs;
+      }
+    }
+    if( found!=~0ULL ) { scanned = found; break; }
+    scanned = (pos+l+rs-1)/rs;
+    if( st ) st->scanned = scanned;
+  }
+
+  if( f_run ) {
+    if( st ) { st->scanned = st->nrec; st->f_done = 1; }
+    f_done = 1;
+  }
+  f_run = 0;
+}
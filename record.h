@@ -0,0 +1,95 @@
+// Record mode: files as arrays of fixed-size records, compared field by field
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "common.h"
+#include "thread.h"
+#include "blockread.h"
+#include "minimap.h"
+#include "typecmp.h"
+
+// Record layout: record size and field boundaries
+// Field masks are kept per 64-byte chunk of a record, so a record's difference bitmap answers
+// "which fields differ" with one AND per field and chunk it touches.
+struct recordfmt {
+  enum{ MAXSIZE=1<<16, MAXFIELDS=64, NAMELEN=16, MAXCHUNK=MAXSIZE/64 };
+
+  struct part {
+    uint  c;   // Chunk of the record
+    uint  k;   // Field
+    qword m;   // Bits of the field in the chunk
+  };
+
+  uint  rsize;                      // Record size (0 = record mode off)
+  uint  nf;                         // Number of fields
+  uint  off[MAXFIELDS+1];           // Field k is bytes [off[k],off[k+1]) of a record
+  char  name[MAXFIELDS][NAMELEN];   // Field names ("" = unnamed)
+  uint  nchunk;                     // 64-byte chunks per record
+  uint  npart;                      // Field pieces in parts[]
+  part  parts[MAXCHUNK+MAXFIELDS];  // Field pieces, in chunk order
+
+  // Set record size and layout: comma-separated field widths, each optionally "name:width";
+  // bytes past the last field form one more field. Without a layout the record is split into
+  // equal fields of 4 bytes or more (at most MAXFIELDS). Returns 0 on a bad size or layout.
+  uint Set( uint size, const char* layout=0 );
+
+  // Field index of a number or name, -1 if none
+  int Find( const char* s );
+
+  // Differing fields of one record from its difference mask m (nchunk*64 bytes, 0 = equal byte);
+  // adds differing bytes per field to nbytes (0 = don't count)
+  qword Fields( const byte* m, qword* nbytes );
+};
+
+// Per-field results of a record scan
+struct recordstats {
+  uint  n;                                   // Number of files
+  qword nrec;                                // Records in the longest file past its base offset
+  qword ndiff;                               // Records with a differing field (present in all files)
+  qword nmiss;                               // Records missing or incomplete in some file
+  qword fdiff[recordfmt::MAXFIELDS];         // Records where each field differs
+  qword fbytes[recordfmt::MAXFIELDS];        // Differing bytes per field
+  qword ffirst[recordfmt::MAXFIELDS];        // First record where each field differs (-1 = none)
+  qword skipped;                             // Records skipped as equal without comparing them
+  volatile qword scanned;                    // Records done
+  volatile uint f_done;                      // Set when all records are counted
+};
+
+// Background pass over all records: counts differing fields (count mode) or stops at the next record
+// where one of the wanted fields differs (find mode)
+struct RecordScan : thread<RecordScan> {
+
+  typedef thread<RecordScan> base;
+
+  recordfmt* fmt;          // Layout
+  recordstats* st;         // Results (count mode)
+  qword want;              // Fields to stop at (find mode; 0 = count mode)
+  qword from;              // First record to look at
+  volatile qword found;    // Record found (find mode; -1 = none)
+  volatile qword scanned;  // Records done (find mode)
+  diffmap* map;            // Difference index to skip equal blocks (0 if none)
+  ignoremask* ign;         // Ranges counted as equal (0 if none)
+  typemode* tm;            // Element type: tolerance-equal elements count as equal (0 if none)
+  byte* kbuf;              // Keep mask buffer
+  byte* rmask;             // Difference mask of one record (nchunk*64 bytes)
+  uint  bsize;             // Read block size (whole records)
+  blockread br;            // Private file handles
+  volatile uint f_run;     // Cleared to stop
+  volatile uint f_done;    // Set when the scan has finished (found or end reached)
+
+  // Open files and start: count mode with _st, or find mode from record _from with fields _want;
+  // returns 0 on failure. map, ign, tm and xc are used as by StatScan.
+  uint start( recordfmt& _fmt, recordstats* _st, qword _want, qword _from, char** names, uint n, qword* base,
+              diffmap* _map, ignoremask* _ign=0, typemode* _tm=0, xchain* xc=0 );
+
+  // Stop and wait for thread exit
+  void stop( void );
+
+  // Compare record at block offset r over len bytes; returns its differing fields
+  qword Record( uint r, uint len, const byte* kp );
+
+  // Thread function - walks all records block by block
+  void thread( void );
+};
+
+#endif // RECORD_H
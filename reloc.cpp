@@ -0,0 +1,72 @@
+// Relocation delta detection implementation
+#include "reloc.h"
+
+// Open files and start detecting deltas of R32/R64 words (type _tm) in regions of 2^rbits bytes; returns 0 on failure
+uint RelocScan::start( relocmap& m, char** names, uint n, qword* _base, xchain* xc, typemode& _tm, ignoremask* _ign, uint rbits ) {
+  if( br.Open( names, n, _base, blockread::blklen, xc )==0 ) return 0;
+  rm = &m;
+  tm = _tm;
+  ign = (_ign && _ign->n) ? _ign : 0;
+  kbuf = ign ? new byte[blockread::blklen] : 0;
+  rm->Init( br.n, br.maxsize, rbits );
+  scanned = 0; f_done = 0;
+  f_run = 1;
+  return base::start();
+}
+
+// Stop scan and wait for thread exit
+void RelocScan::stop( void ) {
+  if( rm==0 ) return;
+  f_run = 0;
+  base::quit();
+  br.Quit();
+  delete[] kbuf; kbuf=0;
+  rm = 0;
+}
+
+// Detect the deltas of region r from block offset o, l bytes present in all files (keep = ignore mask or 0)
+void RelocScan::Region( uint r, uint o, uint l, const byte* keep ) {
+  uint i,j,k,h,w,best,s=tm.Size();
+  qword d,mask = (s==4) ? 0xFFFFFFFFULL : ~0ULL;
+  byte* q[2];
+  for( i=1; i<br.n; i++ ) {
+    bzero( ccnt );
+    for( j=0; ; j=w+s ) {
+      q[0] = br.buf[0]+o+j; q[1] = br.buf[i]+o+j;
+      j += DiffFirst( q, 2, l-j, keep ? keep+o+j : 0 );
+      w = j - j%s;  // Word holding the difference
+      if( w+s>l ) break;
+      d = (LoadElem( br.buf[i]+o+w, s, tm.f_be ) - LoadElem( br.buf[0]+o+w, s, tm.f_be )) & mask;
+      // Open addressing; differences past a full table are dropped
+      for( h=uint( (d*0x9E3779B97F4A7C15ULL)>>58 ),k=0; k<NCAND; k++,h=(h+1)%NCAND ) {
+        if( ccnt[h] && (cand[h]!=d) ) continue;
+        cand[h] = d; ccnt[h]++;
+        break;
+      }
+    }
+    for( best=0,k=1; k<NCAND; k++ ) if( ccnt[k]>ccnt[best] ) best=k;
+    if( ccnt[best]>=relocmap::RMIN ) {
+      rm->delta[r*DK_MAXF+i] = cand[best];
+      rm->cnt[r*DK_MAXF+i] = ccnt[best];  // Written last: masks read the count first
+    }
+  }
+}
+
+// Thread function - reads the files sequentially
+void RelocScan::thread( void ) {
+  uint l,o,e,rsize = 1<<rm->rbits;
+  qword pos;
+  const byte* keep;
+  for( pos=0; f_run && (pos<br.maxsize); pos+=l ) {
+    l = br.Read( pos, blockread::blklen );
+    if( l==0 ) break;
+    keep = ign ? BlockKeep( br, br.minlen, ign, 0, kbuf ) : 0;
+    // Regions divide the read size, so blocks hold whole regions; bytes past the end of a file are skipped
+    for( o=0; f_run && (o<br.minlen); o+=rsize ) {
+      e = Min( o+rsize, br.minlen );
+      Region( uint( (pos+o)>>rm->rbits ), o, e-o, keep );
+    }
+    scanned = pos+l;
+  }
+  if( f_run ) { scanned = br.maxsize; f_done = 1; }
+}
@@ -0,0 +1,43 @@
+// Relocation delta detection: memory dumps and binaries loaded at different bases
+#ifndef RELOC_H
+#define RELOC_H
+
+#include "common.h"
+#include "thread.h"
+#include "blockread.h"
+#include "typecmp.h"
+
+// Background scan filling the regions of a relocmap
+// Differing words are found with the SSE2 first-difference kernel; each adds its difference to a small counting
+// table of the region and file, and the most common difference becomes the region's delta if it explains at
+// least relocmap::RMIN words (pointers into one loaded image all move by the same delta).
+struct RelocScan : thread<RelocScan> {
+  enum{ NCAND=64 };  // Differences counted per region and file (more are dropped)
+
+  typedef thread<RelocScan> base;
+
+  relocmap* rm;          // Target regions
+  typemode tm;           // Word size and byte order
+  ignoremask* ign;       // Ranges not looked at (0 if none)
+  byte* kbuf;            // Keep mask buffer (ignore ranges)
+  blockread br;          // Private file handles
+  qword cand[NCAND];     // Differences of the current region and file
+  uint  ccnt[NCAND];     // Their counts
+  volatile qword scanned;  // Scan frontier
+  volatile uint f_run;   // Cleared to stop the scan
+  volatile uint f_done;  // Set when all regions are done
+
+  // Open files and start detecting deltas of R32/R64 words (type _tm) in regions of 2^rbits bytes; returns 0 on failure
+  uint start( relocmap& m, char** names, uint n, qword* base, xchain* xc, typemode& _tm, ignoremask* _ign, uint rbits );
+
+  // Stop scan and wait for thread exit
+  void stop( void );
+
+  // Detect the deltas of region r from block offset o, l bytes present in all files (keep = ignore mask or 0)
+  void Region( uint r, uint o, uint l, const byte* keep );
+
+  // Thread function - reads the files sequentially
+  void thread( void );
+};
+
+#endif // RELOC_H
@@ -0,0 +1,167 @@
+// Sampling-based similarity estimate implementation
+#include <math.h>
+#include "sample.h"
+
+// Greatest common divisor
+static qword Gcd( qword a, qword b ) {
+  while( b ) { qword t=a%b; a=b; b=t; }
+  return a;
+}
+
+// Next pseudo-random number (xorshift64)
+static qword Rand( qword& x ) {
+  x ^= x<<13; x ^= x>>7; x ^= x<<17;
+  return x;
+}
+
+// Set up strata for range [_beg,_end) of n files; seed picks the block order
+void samplestats::Init( uint _n, qword _beg, qword _end, uint _bsize, uint seed ) {
+  uint h;
+  qword nb, r=seed*0x9E3779B97F4A7C15ULL+1;
+  bzero( *this );
+  n = _n; beg = _beg; end = _end; bsize = _bsize;
+  nb = (end-beg+bsize-1)/bsize;
+  slen = (nb+MAXSTRATA-1)/MAXSTRATA*bsize;
+  nstrata = slen ? uint( (end-beg+slen-1)/slen ) : 0;
+  for( h=0; h<nstrata; h++ ) {
+    nblk[h] = (Len(h)+bsize-1)/bsize;
+    next[h] = Rand(r) % nblk[h];
+    // A step coprime to the block count visits every block once per nblk rounds
+    for( step[h]=Rand(r)%nblk[h]; (nblk[h]>1) && (Gcd(step[h],nblk[h])!=1); step[h]=(step[h]+1)%nblk[h] );
+  }
+}
+
+// Estimated fraction of differing bytes p and its 95% confidence interval [lo,hi]
+// Strata not sampled yet are left out; strata with one sample use the variance pooled over all samples.
+// Strata without any differing sample have no variance, so the rule of three over their unsampled blocks
+// (at most 3/m of them differ) widens the upper bound.
+qword samplestats::Estimate( double* p, double* lo, double* hi, qword* dblocks ) {
+  uint h;
+  qword m,cnt=0,m0=0,n0=0;
+  double w,s2,sum=0,var=0,wsum=0,ay=0,ayy=0,pool=0,w0=0,ci;
+  *dblocks = 0;
+  for( h=0; h<nstrata; h++ ) cnt += taken[h], ay += sy[h], ayy += syy[h], *dblocks += dblk[h];
+  if( cnt>1 ) pool = Max( (ayy-ay*ay/cnt)/(cnt-1), 0.0 );
+  for( h=0; h<nstrata; h++ ) {
+    m = taken[h];
+    if( (m==0) || (bytes[h]==0) ) continue;
+    w = double(Len(h))/double(end-beg);
+    wsum += w;
+    sum += w*double(diff[h])/double(bytes[h]);
+    s2 = (m>1) ? Max( (syy[h]-sy[h]*sy[h]/m)/(m-1), 0.0 ) : pool;
+    var += w*w*s2/m*(1.0-double(m)/double(nblk[h]));  // Finite population correction
+    if( dblk[h]==0 ) w0 += w, m0 += m, n0 += nblk[h];
+  }
+  *p = wsum ? sum/wsum : 0;
+  ci = wsum ? 1.96*sqrt(var)/wsum : 1;
+  *lo = Max( *p-ci, 0.0 );
+  *hi = Min( *p+ci + (m0 ? w0/wsum*Min(3.0/m0,1.0)*(1.0-double(m0)/double(n0)) : 0), 1.0 );
+  if( wsum==0 ) *hi = 1;
+  return cnt;
+}
+
+// Every block of the range was sampled
+uint samplestats::Done( void ) {
+  uint h;
+  for( h=0; h<nstrata; h++ ) if( taken[h]<nblk[h] ) return 0;
+  return 1;
+}
+
+// Strata with most estimated differing bytes, largest first; returns number found (up to k)
+uint samplestats::Hot( uint* r, uint k ) {
+  uint h,i,j,c=0;
+  double e[MAXSTRATA];
+  for( h=0; h<nstrata; h++ ) e[h] = bytes[h] ? double(diff[h])/double(bytes[h])*double(Len(h)) : 0;
+  for( h=0; h<nstrata; h++ ) {
+    if( e[h]==0 ) continue;
+    for( i=0; (i<c) && (e[r[i]]>=e[h]); i++ );
+    if( i>=k ) continue;
+    for( j=Min(c,k-1); j>i; j-- ) r[j] = r[j-1];
+    r[i] = h;
+    c = Min( c+1, k );
+  }
+  return c;
+}
+
+// Sample block [pos,pos+l) of stratum h
+void SampleReader::Sample( uint h, qword pos, uint l ) {
+  uint o,d=0;
+  qword cover;
+  byte* keep;
+  samplestats& s = *ss;
+
+  // Block counted as equal in all files by a completed part of the difference index
+  if( map && (map->scanned>=pos+l) && (map->Count(pos,pos+l,&cover)==0) && (cover>0) ) s.skipped++;
+  else {
+    br.Read( pos, l );
+    keep = kbuf ? BlockKeep( br, l, ign, tm, kbuf ) : 0;
+    d = DiffCount( br.buf, br.n, br.minlen, keep );
+    for( o=br.minlen; o<l; o++ ) d += (keep==0) || keep[o];  // Some files ended: the rest differs
+  }
+  s.bytes[h] += l;
+  s.diff[h] += d;
+  s.dblk[h] += (d>0);
+  s.sy[h] += double(d)/l;
+  s.syy[h] += double(d)/l*double(d)/l;
+  s.next[h] = (s.next[h]+s.step[h]) % s.nblk[h];
+  s.taken[h]++;
+}
+
+// Thread function - samples until stopped or every block of its strata is sampled
+void SampleReader::thread( void ) {
+  uint h,left;
+  qword pos;
+  samplestats& s = *ss;
+
+  // One block of each own stratum per round, so all regions get covered early
+  for( left=1; f_run && left; ) {
+    for( left=0,h=k; f_run && (h<s.nstrata); h+=step ) {
+      if( s.taken[h]>=s.nblk[h] ) continue;
+      left++;
+      pos = s.beg + h*s.slen + s.next[h]*s.bsize;
+      Sample( h, pos, uint( Min( qword(s.bsize), s.beg+h*s.slen+s.Len(h)-pos ) ) );
+    }
+  }
+  f_run = 0;
+}
+
+// Open files and start sampling [beg,end) past the base offsets; returns 0 on failure
+uint SampleScan::start( samplestats& _ss, char** names, uint n, qword* _base, qword beg, qword end, diffmap* _map, ignoremask* _ign, typemode* _tm, xchain* xc ) {
+  uint k;
+  for( nrd=0; nrd<samplestats::NREADERS; nrd++ ) {
+    SampleReader& r = rd[nrd];
+    if( r.br.Open( names, n, _base, samplestats::BSIZE, xc )==0 ) { stop(); return 0; }
+    r.map = _map;
+    r.ign = (_ign && _ign->n) ? _ign : 0;
+    r.tm = (_tm && _tm->type) ? _tm : 0;
+    r.kbuf = (r.ign || r.tm) ? new byte[samplestats::BSIZE] : 0;
+  }
+  ss = &_ss;
+  ss->Init( rd[0].br.n, beg, Max( beg, Min( end, rd[0].br.maxsize ) ), samplestats::BSIZE, GetTickCount() );
+  for( k=0; k<nrd; k++ ) {
+    rd[k].ss = ss; rd[k].k = k; rd[k].step = nrd;
+    rd[k].f_run = 1;
+    rd[k].start();
+  }
+  return 1;
+}
+
+// Some reader is still sampling
+uint SampleScan::Running( void ) {
+  uint k,r=0;
+  for( k=0; k<nrd; k++ ) r |= rd[k].f_run;
+  return r;
+}
+
+// Stop readers and wait for them to exit
+void SampleScan::stop( void ) {
+  uint k;
+  for( k=0; k<nrd; k++ ) rd[k].f_run = 0;
+  for( k=0; k<nrd; k++ ) {
+    if( ss ) rd[k].quit();
+    rd[k].br.Quit();
+    delete[] rd[k].kbuf; rd[k].kbuf=0;
+  }
+  nrd = 0;
+  ss = 0;
+}
@@ -0,0 +1,89 @@
+// Sampling-based similarity estimate: stratified random blocks instead of a full scan
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "common.h"
+#include "thread.h"
+#include "blockread.h"
+#include "minimap.h"
+#include "typecmp.h"
+
+// Stratified sample of a range
+// The range is cut into equal strata; each round samples one more block of every stratum, visiting the blocks of
+// a stratum in a random permutation, so the estimate becomes exact once every block was sampled.
+// Filled by the reader threads (each owns every NREADERS-th stratum) and read by the terminal without locking.
+struct samplestats {
+  enum{ MAXSTRATA=1024, NREADERS=4, BSIZE=1<<16 };
+
+  uint  n;                  // Number of files
+  qword beg, end;           // Range past the base offsets
+  uint  bsize;              // Sample block size
+  uint  nstrata;            // Strata in use
+  qword slen;               // Stratum length (multiple of bsize; the last one may be shorter)
+  qword nblk[MAXSTRATA];    // Blocks per stratum
+  qword next[MAXSTRATA];    // Next block to sample in each stratum
+  qword step[MAXSTRATA];    // Permutation step (coprime to nblk)
+  qword bytes[MAXSTRATA];   // Bytes sampled
+  qword diff[MAXSTRATA];    // Differing bytes in the sampled blocks (bytes past the end of some file included)
+  qword dblk[MAXSTRATA];    // Sampled blocks with any difference
+  double sy[MAXSTRATA];     // Sum of the differing fractions of the sampled blocks
+  double syy[MAXSTRATA];    // Sum of their squares
+  volatile qword taken[MAXSTRATA];  // Blocks sampled (updated last)
+  qword skipped;            // Blocks counted as equal by the difference overview
+
+  // Set up strata for range [_beg,_end) of n files; seed picks the block order
+  void Init( uint _n, qword _beg, qword _end, uint _bsize, uint seed );
+
+  // Length of stratum h
+  qword Len( uint h ) { return Min( slen, end-beg-h*slen ); }
+
+  // Estimated fraction of differing bytes p and its 95% confidence interval [lo,hi]
+  // Returns number of blocks sampled; *dblocks = sampled blocks with differences
+  qword Estimate( double* p, double* lo, double* hi, qword* dblocks );
+
+  // Every block of the range was sampled
+  uint Done( void );
+
+  // Strata with most estimated differing bytes, largest first; returns number found (up to k)
+  uint Hot( uint* h, uint k );
+};
+
+// Reader thread: samples every step-th stratum, round by round
+struct SampleReader : thread<SampleReader> {
+
+  typedef thread<SampleReader> base;
+
+  samplestats* ss;      // Target sample
+  blockread br;         // Private file handles
+  diffmap* map;         // Difference index: blocks it counts as equal are not read (0 if none)
+  ignoremask* ign;      // Ranges counted as equal (0 if none)
+  typemode* tm;         // Element type: tolerance-equal elements count as equal (0 if none)
+  byte* kbuf;           // Keep mask buffer (bsize bytes)
+  uint  k, step;        // First stratum and stratum stride
+  volatile uint f_run;  // Cleared to stop
+
+  // Sample block [pos,pos+l) of stratum h
+  void Sample( uint h, qword pos, uint l );
+
+  // Thread function - samples until stopped or every block of its strata is sampled
+  void thread( void );
+};
+
+// Parallel sampler: one reader per group of strata, so several random reads are in flight at once
+struct SampleScan {
+  samplestats* ss;      // Target sample
+  SampleReader rd[samplestats::NREADERS];
+  uint nrd;             // Readers started
+
+  // Open files and start sampling [beg,end) past the base offsets; returns 0 on failure
+  // Same skipping, masking and transform rules as StatScan::start
+  uint start( samplestats& _ss, char** names, uint n, qword* base, qword beg, qword end, diffmap* _map, ignoremask* _ign=0, typemode* _tm=0, xchain* xc=0 );
+
+  // Some reader is still sampling
+  uint Running( void );
+
+  // Stop readers and wait for them to exit
+  void stop( void );
+};
+
+#endif // SAMPLE_H
@@ -0,0 +1,172 @@
+// Difference statistics implementation
+#include "stats.h"
+
+// Append l bytes of type t at position p (runs must be added in order)
+void runstat::Add( uint t, qword p, qword l ) {
+  if( l==0 ) return;
+  if( (run>0) && (cur==t) && (pos+run==p) ) run += l;
+  else cur=t, pos=p, run=l;
+  if( run>lmax[t] ) lmax[t]=run, pmax[t]=pos;
+}
+
+// Allocate histogram and clear counts for range [_beg,_end) of n files
+void diffstats::Init( uint _n, qword* sizes, qword _beg, qword _end ) {
+  uint i;
+  Quit();
+  bzero( *this );
+  n = _n; beg = _beg; end = _end;
+  for( i=0; i<n; i++ ) size[i] = sizes[i];
+  for( hshift=20; ((end-beg)>>hshift)>=HIST_BINS; hshift++ );
+  nhist = uint( (end-beg+(1ULL<<hshift)-1)>>hshift );
+  hist = new qword[nhist+1];
+  bzero( hist, nhist+1 );
+  scanned = beg;
+}
+
+// Free histogram
+void diffstats::Quit( void ) {
+  delete[] hist; hist=0;
+  nhist = 0;
+}
+
+// Open files and start counting [beg,end) past the base offsets; returns 0 on failure
+// Blocks that a completed part of map counts as equal are not read; map must use the same bases.
+uint StatScan::start( diffstats& _st, char** names, uint n, qword* _base, qword beg, qword end, diffmap* _map, ignoremask* _ign, typemode* _tm, xchain* xc ) {
+  uint i;
+  qword sizes[DK_MAXF];
+  if( br.Open( names, n, _base, blockread::blklen, xc )==0 ) return 0;
+  ign = (_ign && _ign->n) ? _ign : 0;
+  tm = (_tm && _tm->type) ? _tm : 0;
+  kbuf = (ign || tm) ? new byte[blockread::blklen] : 0;
+  for( i=0; i<br.n; i++ ) sizes[i] = (br.fsize[i]>br.base[i]) ? br.fsize[i]-br.base[i] : 0;
+  st = &_st;
+  map = _map;
+  st->Init( br.n, sizes, beg, Max( beg, Min( end, br.maxsize ) ) );
+  f_run = 1;
+  return base::start();
+}
+
+// Stop scan and wait for thread exit
+void StatScan::stop( void ) {
+  if( st==0 ) return;
+  f_run = 0;
+  base::quit();
+  br.Quit();
+  delete[] kbuf; kbuf=0;
+  st = 0;
+}
+
+// Add l equal bytes at pos for all pairs
+void StatScan::Equal( qword pos, qword l ) {
+  uint k;
+  st->arun.Add( 0, pos, l );
+  for( k=0; k<br.n*(br.n-1)/2; k++ ) st->prun[k].Add( 0, pos, l );
+}
+
+// Add d differing positions at p to the histogram
+void StatScan::Hist( qword p, uint d ) {
+  uint e,k;
+  qword h;
+  diffstats& s = *st;
+  // Runs may cross histogram bins
+  for( e=0; e<d; e+=k ) {
+    h = p+e-s.beg;
+    k = uint( Min( qword(d-e), (((h>>s.hshift)+1)<<s.hshift)-h ) );
+    s.hist[h>>s.hshift] += k;
+  }
+}
+
+// Add block part [b,e) that is missing in some file to r and cnt; ignored bytes are equal runs
+void StatScan::Tail( runstat& r, qword& cnt, qword pos, uint b, uint e, uint f_hist ) {
+  uint o,d,t;
+  for( o=b; o<e; o+=d ) {
+    t = keep ? (keep[o]!=0) : 1;
+    for( d=1; keep && (o+d<e) && ((keep[o+d]!=0)==t); d++ );
+    if( keep==0 ) d = e-o;
+    r.Add( t, pos+o, d );
+    if( t ) {
+      cnt += d;
+      if( f_hist ) Hist( pos+o, d );
+    }
+  }
+}
+
+// Count one block read by br at position pos
+void StatScan::Block( qword pos, uint l ) {
+  uint i,j,o,d,e,m,x[DK_MAXF];
+  byte* p[DK_MAXF];
+  diffstats& s = *st;
+
+  // Ignored ranges and tolerance-equal elements in this block: mask them out
+  keep = kbuf ? BlockKeep( br, l, ign, tm, kbuf ) : 0;
+
+  // All files: runs and histogram of positions where some file differs
+  for( o=0,m=br.minlen; o<m; o+=d ) {
+    for( i=0; i<br.n; i++ ) p[i] = br.buf[i]+o;
+    d = DiffFirst( p, br.n, m-o, keep ? keep+o : 0 );
+    s.arun.Add( 0, pos+o, d );
+    o += d;
+    if( o>=m ) break;
+    for( i=0; i<br.n; i++ ) p[i] = br.buf[i]+o;
+    d = SameFirst( p, br.n, m-o, keep ? keep+o : 0 );
+    s.arun.Add( 1, pos+o, d );
+    s.adiff += d;
+    Hist( pos+o, d );
+    if( br.n>2 ) OutlierCount( p, br.n, d, s.odd, keep ? keep+o : 0 );
+  }
+  Tail( s.arun, s.adiff, pos, m, l, 1 );  // Some files ended: the rest differs
+
+  // Past the end of some files: files that ended disagree unless most files did
+  if( br.n>2 ) for( o=m; o<l; o++ ) if( (keep==0) || keep[o] ) {
+    for( i=0; i<br.n; i++ ) x[i] = (o<br.len[i]) ? br.buf[i][o] : (uint)-1;
+    e = ConsensusBits( x, br.n );
+    for( i=0; i<br.n; i++ ) s.odd[i] += (e>>i)&1;
+  }
+
+  // File pairs: runs, differing bytes and bit flips of the differing runs
+  for( i=0; i<br.n; i++ ) for( j=i+1; j<br.n; j++ ) {
+    uint t = s.Pair(i,j);
+    runstat& r = s.prun[t];
+    m = Min( br.len[i], br.len[j] );
+    for( o=0; o<m; o+=d ) {
+      p[0] = br.buf[i]+o; p[1] = br.buf[j]+o;
+      d = DiffFirst( p, 2, m-o, keep ? keep+o : 0 );
+      r.Add( 0, pos+o, d );
+      o += d;
+      if( o>=m ) break;
+      p[0] = br.buf[i]+o; p[1] = br.buf[j]+o;
+      d = SameFirst( p, 2, m-o, keep ? keep+o : 0 );
+      r.Add( 1, pos+o, d );
+      s.ndiff[t] += d;
+      BitFlips( p[0], p[1], d, s.bits[t] );
+    }
+    e = Max( br.len[i], br.len[j] );  // Past the end of one file: different
+    Tail( r, s.ndiff[t], pos, m, e, 0 );
+  }
+}
+
+// Thread function - reads the range sequentially
+void StatScan::thread( void ) {
+  uint l;
+  qword pos,cover;
+  diffstats& s = *st;
+
+  for( pos=s.beg; f_run && (pos<s.end); pos+=l ) {
+    // Blocks aligned to the read size after the first one, to match the index bins
+    l = uint( Min( blockread::blklen-(pos&(blockread::blklen-1)), s.end-pos ) );
+
+    // Block counted as equal in all files by a completed part of the difference index
+    if( map && (map->scanned>=pos+l) && (map->Count(pos,pos+l,&cover)==0) && (cover>0) ) {
+      Equal( pos, l );
+      s.skipped += l;
+    } else {
+      l = br.Read( pos, l );
+      if( l==0 ) break;
+      Block( pos, l );
+    }
+    s.scanned = pos+l;
+  }
+
+  if( f_run ) { s.scanned = s.end; s.f_done = 1; }
+  f_run = 0;
+}
@@ -0,0 +1,92 @@
+// Difference statistics over a range of the compared files
+#ifndef STATS_H
+#define STATS_H
+
+#include "common.h"
+#include "thread.h"
+#include "blockread.h"
+#include "minimap.h"
+#include "typecmp.h"
+
+// Longest runs of equal and of differing bytes in a stream of runs
+struct runstat {
+  uint  cur;       // Type of the open run (0 = equal, 1 = different)
+  qword pos;       // Start of the open run
+  qword run;       // Length of the open run
+  qword lmax[2];   // Longest equal / differing run
+  qword pmax[2];   // Start of the longest runs
+
+  // Append l bytes of type t at position p (runs must be added in order)
+  void Add( uint t, qword p, qword l );
+};
+
+// Statistics of one range: per file pair and for all files together
+// Filled by the scan thread and read by the terminal once f_done is set.
+struct diffstats {
+  enum{ MAXPAIRS=DK_MAXF*(DK_MAXF-1)/2, HIST_BINS=1<<16 };
+
+  uint  n;                 // Number of files
+  qword beg, end;          // Range past the base offsets
+  qword size[DK_MAXF];     // File sizes past their base offsets
+  qword ndiff[MAXPAIRS];   // Differing bytes per pair (bytes past the end of one file included)
+  qword bits[MAXPAIRS][8]; // Bit flips per pair and bit position (bytes present in both files)
+  runstat prun[MAXPAIRS];  // Runs per pair
+  qword adiff;             // Positions where not all files hold the same byte
+  qword odd[DK_MAXF];      // Positions where a file disagrees with the consensus (3+ files)
+  runstat arun;            // Runs for all files
+  qword* hist;             // Differing positions (all files) per histogram bin
+  uint  hshift;            // log2 of histogram bin size (1MB, more for huge ranges)
+  uint  nhist;             // Bins in use
+  qword skipped;           // Bytes skipped as equal by the difference index
+  volatile qword scanned;  // Scan frontier
+  volatile uint f_done;    // Set when the whole range is counted
+
+  // Allocate histogram and clear counts for range [_beg,_end) of n files
+  void Init( uint _n, qword* sizes, qword _beg, qword _end );
+
+  // Free histogram
+  void Quit( void );
+
+  // Index of pair i<j
+  uint Pair( uint i, uint j ) { return i*(2*n-i-1)/2 + (j-i-1); }
+};
+
+// Background thread that fills a diffstats
+struct StatScan : thread<StatScan> {
+
+  typedef thread<StatScan> base;
+
+  diffstats* st;        // Target statistics
+  diffmap* map;         // Difference index to skip equal blocks (0 if none)
+  ignoremask* ign;      // Ranges counted as equal (0 if none)
+  typemode* tm;         // Element type: tolerance-equal elements count as equal (0 if none)
+  byte* keep;           // Keep mask of the current block (0 = no ignored bytes in it)
+  byte* kbuf;           // Keep mask buffer (blklen bytes)
+  blockread br;         // Private file handles
+  volatile uint f_run;  // Cleared to stop the scan
+
+  // Open files and start counting [beg,end) past the base offsets; returns 0 on failure
+  // Blocks that a completed part of map counts as equal are not read; map must use the same bases
+  // ignore mask, element type and transforms. Bytes in ign ranges and tolerance-equal elements count as equal.
+  uint start( diffstats& _st, char** names, uint n, qword* base, qword beg, qword end, diffmap* _map, ignoremask* _ign=0, typemode* _tm=0, xchain* xc=0 );
+
+  // Stop scan and wait for thread exit
+  void stop( void );
+
+  // Add d differing positions at p to the histogram
+  void Hist( qword p, uint d );
+
+  // Add block part [b,e) that is missing in some file to r and cnt; ignored bytes are equal runs
+  void Tail( runstat& r, qword& cnt, qword pos, uint b, uint e, uint f_hist );
+
+  // Count one block read by br at position pos
+  void Block( qword pos, uint l );
+
+  // Add l equal bytes at pos for all pairs
+  void Equal( qword pos, qword l );
+
+  // Thread function - reads the range sequentially
+  void thread( void );
+};
+
+#endif // STATS_H
@@ -0,0 +1,217 @@
+// Directory tree comparison implementation
+#include "treecmp.h"
+
+// Make room for need elements in p (allocated: alloc elements)
+template <class T> static void Grow( T*& p, uint& alloc, uint need ) {
+  if( need<=alloc ) return;
+  uint a = Max( need, Max( alloc*2, 1024U ) );
+  T* q = new T[a];
+  if( p ) memcpy( q, p, alloc*sizeof(T) );
+  delete[] p;
+  p = q; alloc = a;
+}
+
+// Order of treefile entries by name
+static int CmpFile( const void* a, const void* b ) {
+  return strcmp( ((treefile*)a)->name, ((treefile*)b)->name );
+}
+
+// Clear lists and set roots
+void treecmp::Init( char** roots, uint _n, uint _f_check ) {
+  uint r,l;
+  Quit();
+  bzero( *this );
+  n = Min( _n, uint(DK_MAXF) );
+  f_check = _f_check;
+  for( r=0; r<n; r++ ) {
+    strncpy( root[r], roots[r], MAX_PATH-1 );
+    // Trailing separators would double in the joined paths
+    for( l=strlen(root[r]); (l>1) && ((root[r][l-1]=='/') || (root[r][l-1]=='\\')); l-- ) root[r][l-1]=0;
+  }
+}
+
+// Free lists and names
+void treecmp::Quit( void ) {
+  uint r;
+  char* p;
+  for( r=0; r<DK_MAXF; r++ ) { delete[] f[r]; f[r]=0; nf[r]=af[r]=0; }
+  delete[] e; e=0; ne=ae=0;
+  while( pool ) { p = *(char**)pool; delete[] pool; pool = p; }
+  pused = psize = 0;
+}
+
+// Copy of string s in the name pool
+char* treecmp::Str( const char* s ) {
+  uint l = strlen(s)+1;
+  if( pused+l>psize ) {
+    psize = Max( uint(POOLCHUNK), uint(l+sizeof(char*)) );
+    char* p = new char[psize];
+    *(char**)p = pool;  // Link to the previous chunk
+    pool = p;
+    pused = sizeof(char*);
+  }
+  char* d = pool+pused;
+  memcpy( d, s, l );
+  pused += l;
+  return d;
+}
+
+// Add files under root r from directory rel ("" = root itself), recursively, until *f_run is cleared
+void treecmp::Walk( uint r, const char* rel, volatile uint* f_run ) {
+  char pat[PATHLEN], sub[PATHLEN];
+  WIN32_FIND_DATAA fd;
+  uint l = strlen(rel);
+  if( strlen(root[r])+l+3>=PATHLEN ) { nerr++; return; }
+  sprintf( pat, l ? "%s/%s/*" : "%s/*", root[r], rel );
+  HANDLE h = FindFirstFileA( pat, &fd );
+  if( h==INVALID_HANDLE_VALUE ) { nerr++; return; }
+  do {
+    if( (strcmp(fd.cFileName,".")==0) || (strcmp(fd.cFileName,"..")==0) ) continue;
+    if( fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT ) continue;  // Links may form loops
+    if( strlen(root[r])+l+strlen(fd.cFileName)+3>=PATHLEN ) { nerr++; continue; }  // Full paths must fit too
+    sprintf( sub, l ? "%s/%s" : "%s%s", rel, fd.cFileName );
+    if( fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) Walk( r, sub, f_run );
+    else {
+      Grow( f[r], af[r], nf[r]+1 );
+      treefile& t = f[r][nf[r]++];
+      t.name = Str( sub );
+      t.size = (qword(fd.nFileSizeHigh)<<32) + fd.nFileSizeLow;
+      t.mtime = (qword(fd.ftLastWriteTime.dwHighDateTime)<<32) + fd.ftLastWriteTime.dwLowDateTime;
+    }
+  } while( *f_run && FindNextFileA( h, &fd ) );
+  FindClose( h );
+}
+
+// Merge the sorted per-root lists into e[] and settle entries that need no reads
+// Missing files and size mismatches are final; equal sizes and modification times count as equal unless f_check.
+void treecmp::Match( void ) {
+  uint r,k[DK_MAXF],f_mtime;
+  char* m;
+  qword mt;
+  bzero( k );
+  for( r=0; r<n; r++ ) qsort( f[r], nf[r], sizeof(treefile), CmpFile );
+  for(;;) {
+    // Smallest name at the heads of the lists
+    for( m=0,r=0; r<n; r++ ) if( (k[r]<nf[r]) && ((m==0) || (strcmp(f[r][k[r]].name,m)<0)) ) m = f[r][k[r]].name;
+    if( m==0 ) break;
+    Grow( e, ae, ne+1 );
+    treeentry& t = e[ne++];
+    bzero( t );
+    t.name = m;
+    for( f_mtime=1,mt=0,r=0; r<n; r++ ) {
+      if( (k[r]>=nf[r]) || (strcmp(f[r][k[r]].name,m)!=0) ) continue;
+      treefile& a = f[r][k[r]++];
+      if( t.mask && (a.mtime!=mt) ) f_mtime=0;
+      mt = a.mtime;
+      t.mask |= 1<<r;
+      t.size[r] = a.size;
+    }
+    t.state = T_PENDING;
+    if( t.mask!=(1U<<n)-1 ) t.state = T_MISSING;
+    else {
+      for( r=1; r<n; r++ ) if( t.size[r]!=t.size[0] ) t.state = T_SIZE;
+      if( t.state==T_PENDING ) {
+        if( t.size[0]==0 ) t.state = T_SAME;
+        else if( f_mtime && !f_check ) t.state = T_QUICK;
+      }
+    }
+  }
+  // Per-root lists are no longer needed; names stay in the pool
+  for( r=0; r<n; r++ ) { delete[] f[r]; f[r]=0; nf[r]=af[r]=0; }
+}
+
+// Full path of entry i under root r
+void treecmp::Path( uint i, uint r, char* out ) {
+  sprintf( out, "%s/%s", root[r], e[i].name );
+}
+
+// Count entries per state into cnt[NSTATES]; returns number compared (not pending)
+uint treecmp::Count( uint* cnt ) {
+  uint i;
+  bzero( cnt, NSTATES );
+  for( i=0; i<ne; i++ ) cnt[e[i].state]++;
+  return ne-cnt[T_PENDING];
+}
+
+// Compare the files of entry i; returns its state
+uint TreeWorker::Compare( uint i ) {
+  uint r,l,d,st=treecmp::T_SAME;
+  qword pos,size=tc->e[i].size[0];
+  char path[treecmp::PATHLEN];
+  for( r=0; r<tc->n; r++ ) f[r].f = 0;
+  for( r=0; r<tc->n; r++ ) {
+    tc->Path( i, r, path );
+    if( f[r].open( path )==0 ) { f[r].f=0; st = treecmp::T_ERROR; break; }
+  }
+  // Blocks of all files in lockstep; the first difference ends the compare
+  for( pos=0; (st==treecmp::T_SAME) && *f_run && (pos<size); pos+=l ) {
+    l = uint( Min( qword(TreeScan::BLKLEN), size-pos ) );
+    for( r=0; r<tc->n; r++ ) if( f[r].sread( buf[r], l )!=l ) st = treecmp::T_ERROR;
+    if( st!=treecmp::T_SAME ) break;
+    d = DiffFirst( buf, tc->n, l );
+    if( d<l ) { tc->e[i].diffpos = pos+d; st = treecmp::T_DIFF; }
+    bytes += l;
+  }
+  for( r=0; r<tc->n; r++ ) if( f[r].f ) f[r].close();
+  if( (*f_run==0) && (st==treecmp::T_SAME) && (pos<size) ) st = treecmp::T_PENDING;  // Stopped
+  return st;
+}
+
+// Thread function - takes entries until none are left
+void TreeWorker::thread( void ) {
+  uint i;
+  while( *f_run ) {
+    i = InterlockedIncrement( next )-1;
+    if( i>=tc->ne ) break;
+    if( tc->e[i].state==treecmp::T_PENDING ) tc->e[i].state = Compare( i );
+  }
+}
+
+// Start comparing the trees under roots; returns 0 if the thread can't be started
+uint TreeScan::start( treecmp& _tc, char** roots, uint n, uint f_check ) {
+  tc = &_tc;
+  tc->Init( roots, n, f_check );
+  next = 0;
+  f_run = 1;
+  return base::start();
+}
+
+// Stop scan and wait for all threads
+void TreeScan::stop( void ) {
+  if( tc==0 ) return;
+  f_run = 0;
+  base::quit();
+  tc = 0;
+}
+
+// Bytes compared by the workers so far
+qword TreeScan::Bytes( void ) {
+  uint k;
+  qword s=0;
+  for( k=0; k<NWORKERS; k++ ) s += wk[k].bytes;
+  return s;
+}
+
+// Thread function - builds the list and runs the workers
+void TreeScan::thread( void ) {
+  uint k,r;
+  treecmp& t = *tc;
+
+  for( r=0; f_run && (r<t.n); r++ ) t.Walk( r, "", &f_run );
+  if( f_run==0 ) return;
+  t.Match();
+  t.f_listed = 1;
+
+  // Files with equal sizes: workers share the list through one counter, so big files don't hold up the rest
+  for( k=0; k<NWORKERS; k++ ) {
+    TreeWorker& w = wk[k];
+    w.tc = tc; w.next = &next; w.f_run = &f_run; w.bytes = 0;
+    for( r=0; r<t.n; r++ ) w.buf[r] = new byte[BLKLEN];
+    w.start();
+  }
+  for( k=0; k<NWORKERS; k++ ) {
+    wk[k].quit();
+    for( r=0; r<t.n; r++ ) { delete[] wk[k].buf[r]; wk[k].buf[r]=0; }
+  }
+  if( f_run ) t.f_done = 1;
+}
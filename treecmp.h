@@ -0,0 +1,111 @@
+// Directory tree comparison: files matched by relative path under two or more roots
+#ifndef TREECMP_H
+#define TREECMP_H
+
+#include "common.h"
+#include "thread.h"
+#include "file_win.h"
+#include "diffkern.h"
+
+// File found under one root
+struct treefile {
+  char* name;   // Path relative to the root ('/' separated)
+  qword size;   // File size
+  qword mtime;  // Last write time (FILETIME units)
+};
+
+// Relative path present under at least one root
+struct treeentry {
+  char* name;             // Path relative to the roots
+  uint  mask;             // Roots holding the file
+  volatile uint state;    // treecmp::T_* (T_PENDING until compared)
+  qword size[DK_MAXF];    // File sizes (0 where missing)
+  qword diffpos;          // First differing byte (T_DIFF)
+};
+
+// Matched file list of the roots
+// Filled by TreeScan: the walk and the metadata checks first (f_listed), then the contents of the remaining
+// files by the workers. The terminal reads it without locking.
+struct treecmp {
+  enum{ T_PENDING=0, T_SAME, T_QUICK, T_DIFF, T_SIZE, T_MISSING, T_ERROR, NSTATES };
+  enum{ POOLCHUNK=1<<20, PATHLEN=4*MAX_PATH };  // Name chunk size, longest full path handled
+
+  uint  n;                     // Number of roots
+  char  root[DK_MAXF][MAX_PATH];  // Root directories
+  uint  f_check;               // Compare contents even when size and modification time match
+  treefile* f[DK_MAXF];        // Files under each root, sorted by name
+  uint  nf[DK_MAXF], af[DK_MAXF];  // Files used / allocated per root
+  treeentry* e;                // Matched paths in name order
+  uint  ne, ae;                // Entries used / allocated
+  char* pool;                  // Current name chunk (starts with a link to the previous chunk)
+  uint  pused, psize;          // Bytes used / allocated in it
+  uint  nerr;                  // Directories that could not be read
+  volatile uint f_listed;      // Walk and metadata checks done; e[] is complete
+  volatile uint f_done;        // All contents compared
+
+  // Clear lists and set roots
+  void Init( char** roots, uint _n, uint _f_check );
+
+  // Free lists and names
+  void Quit( void );
+
+  // Copy of string s in the name pool
+  char* Str( const char* s );
+
+  // Add files under root r from directory rel ("" = root itself), recursively, until *f_run is cleared
+  void Walk( uint r, const char* rel, volatile uint* f_run );
+
+  // Merge the sorted per-root lists into e[] and settle entries that need no reads
+  void Match( void );
+
+  // Full path of entry i under root r
+  void Path( uint i, uint r, char* out );
+
+  // Count entries per state into cnt[NSTATES]; returns number compared (not pending)
+  uint Count( uint* cnt );
+};
+
+// Worker of the tree scan: compares the contents of pending entries taken from a shared counter
+struct TreeWorker : thread<TreeWorker> {
+
+  typedef thread<TreeWorker> base;
+
+  treecmp* tc;                // Target list
+  volatile LONG* next;        // Shared next entry
+  volatile uint* f_run;       // Shared stop flag
+  filehandle0 f[DK_MAXF];     // At most one handle per root at a time
+  byte* buf[DK_MAXF];         // Block buffers
+  volatile qword bytes;       // Bytes compared so far
+
+  // Compare the files of entry i; returns its state
+  uint Compare( uint i );
+
+  // Thread function - takes entries until none are left
+  void thread( void );
+};
+
+// Background tree comparison: walk, metadata checks, then parallel content compare
+struct TreeScan : thread<TreeScan> {
+  enum{ NWORKERS=4, BLKLEN=1<<20 };
+
+  typedef thread<TreeScan> base;
+
+  treecmp* tc;                // Target list
+  TreeWorker wk[NWORKERS];    // Content compare workers (bounded number of open handles)
+  volatile LONG next;         // Next entry for the workers
+  volatile uint f_run;        // Cleared to stop
+
+  // Start comparing the trees under roots; returns 0 if the thread can't be started
+  uint start( treecmp& _tc, char** roots, uint n, uint f_check );
+
+  // Stop scan and wait for all threads
+  void stop( void );
+
+  // Bytes compared by the workers so far
+  qword Bytes( void );
+
+  // Thread function - builds the list and runs the workers
+  void thread( void );
+};
+
+#endif // TREECMP_H
@@ -0,0 +1,347 @@
+// Typed element compare implementation
+#include "typecmp.h"
+
+#ifdef DK_SSE2
+#include <emmintrin.h>
+#endif
+
+// Set from type name ("i16", "i32", "i64", "f32", "f64", optional "le"/"be" suffix)
+// and tolerance ("0.001", "1e-6", "16" or "4ulp"; 0 if tol is 0); returns 0 if invalid
+uint typemode::Set( const char* name, const char* t ) {
+  static const char* names[] = { "i16","i32","i64","f32","f64" };
+  uint k;
+  char* e;
+  const char* q;
+  typemode r;
+  bzero( r );
+  for( k=0; k<5; k++ ) if( strncmp( name, names[k], 3 )==0 ) break;
+  if( k>=5 ) return 0;
+  r.type = T_I16+k;
+  if( strcmp( name+3, "be" )==0 ) r.f_be=1;
+  else if( name[3] && strcmp( name+3, "le" ) ) return 0;
+  if( t && *t ) {
+    q = ParseNum( t, &r.itol );
+    if( (r.type>=T_F32) && (q!=t) && (strcmp( q, "ulp" )==0) ) r.f_ulp=1;  // "<N>ulp"
+    else if( r.type>=T_F32 ) {
+      r.itol = 0;
+      r.tol = strtod( t, &e );
+      if( (e==t) || *e || !(r.tol>=0) ) return 0;
+    } else if( (q==t) || *q ) return 0;
+  }
+  *this = r;
+  return 1;
+}
+
+// Print type and tolerance into s (for listings)
+void typemode::Print( char* s ) {
+  static const char* names[] = { "bytes","i16","i32","i64","f32","f64","r32","r64" };
+  s += sprintf( s, "%s", names[type] );
+  if( type==T_BYTE ) return;
+  s += sprintf( s, f_be ? " big-endian" : " little-endian" );
+  if( type>=T_R32 ) { sprintf( s, ", equal up to relocation deltas" ); return; }
+  if( f_ulp ) sprintf( s, ", tolerance %llu ULP", itol );
+  else if( type>=T_F32 ) sprintf( s, ", tolerance %g", tol );
+  else sprintf( s, ", tolerance %llu", itol );
+}
+
+// Load s-byte element (little- or big-endian) zero-extended
+qword LoadElem( const byte* p, uint s, uint be ) {
+  uint k;
+  qword x=0;
+  for( k=0; k<s; k++ ) x |= qword( p[be ? s-1-k : k] ) << (8*k);
+  return x;
+}
+
+// Elements e[0..n-1] (one element of each file, at position pos for relocation deltas) are within tolerance
+// of each other. NaNs are only equal when byte-identical (left to the byte compare).
+uint TypeEqual( byte** e, uint n, typemode& m, qword pos ) {
+  uint i,s=m.Size(),w;
+  qword x,d[DK_MAXF];
+  sqword k=0,kmin=0,kmax=0;
+  float f,fmin=0,fmax=0;
+  double g,gmin=0,gmax=0;
+  if( m.type==typemode::T_BYTE ) {
+    for( i=1; i<n; i++ ) if( e[i][0]!=e[0][0] ) return 0;
+    return 1;
+  }
+  if( m.type>=typemode::T_R32 ) {
+    // Each file holds the word of file 0 or that word plus its delta
+    qword mask = (s==4) ? 0xFFFFFFFFULL : ~0ULL;
+    if( m.rel ) m.rel->Deltas( pos, d ); else bzero( d );
+    for( x=LoadElem( e[0], s, m.f_be ),i=1; i<n; i++ ) {
+      qword y = (LoadElem( e[i], s, m.f_be )-x) & mask;
+      if( y && (y!=(d[i]&mask)) ) return 0;
+    }
+    return 1;
+  }
+  for( i=0; i<n; i++ ) {
+    x = LoadElem( e[i], s, m.f_be );
+    if( m.type==typemode::T_F32 ) {
+      w = uint(x);
+      if( (w&0x7FFFFFFF)>0x7F800000 ) return 0;  // NaN
+      if( m.f_ulp==0 ) {
+        memcpy( &f, &w, 4 );
+        if( (i==0) || (f<fmin) ) fmin=f;
+        if( (i==0) || (f>fmax) ) fmax=f;
+        continue;
+      }
+      k = sqword( int( w ^ ((int(w)>>31)&0x7FFFFFFF) ) );  // Ordered key: ULP distance is key distance
+    } else if( m.type==typemode::T_F64 ) {
+      if( (x&0x7FFFFFFFFFFFFFFFULL)>0x7FF0000000000000ULL ) return 0;  // NaN
+      if( m.f_ulp==0 ) {
+        memcpy( &g, &x, 8 );
+        if( (i==0) || (g<gmin) ) gmin=g;
+        if( (i==0) || (g>gmax) ) gmax=g;
+        continue;
+      }
+      k = sqword( x ^ ((sqword(x)>>63)&0x7FFFFFFFFFFFFFFFULL) );
+    } else {
+      k = (s==2) ? sqword(short(x)) : (s==4) ? sqword(int(x)) : sqword(x);  // Sign-extend
+    }
+    if( (i==0) || (k<kmin) ) kmin=k;
+    if( (i==0) || (k>kmax) ) kmax=k;
+  }
+  // Float math matches the SSE2 kernels (inf-inf is NaN: not equal)
+  if( (m.type==typemode::T_F32) && (m.f_ulp==0) ) return (fmax-fmin)<=float(m.tol);
+  if( (m.type==typemode::T_F64) && (m.f_ulp==0) ) return (gmax-gmin)<=m.tol;
+  return (qword(kmax)-qword(kmin))<=m.itol;
+}
+
+#ifdef DK_SSE2
+// Load 16 bytes of elements, byte-swapped to little-endian if needed (be = element size, 0 = no swap)
+static inline __m128i LoadSwap( const byte* p, uint be ) {
+  __m128i x = _mm_loadu_si128( (const __m128i*)p );
+  if( be==0 ) return x;
+  x = _mm_or_si128( _mm_slli_epi16(x,8), _mm_srli_epi16(x,8) );  // Swap bytes of 16-bit words
+  if( be==2 ) return x;
+  x = _mm_shufflehi_epi16( _mm_shufflelo_epi16( x, 0xB1 ), 0xB1 );  // Swap words of dwords
+  if( be==4 ) return x;
+  return _mm_shuffle_epi32( x, 0xB1 );  // Swap dwords of qwords
+}
+#endif
+
+// Clear keep bytes of whole words in [0,len) where every buffer holds the word of buffer 0 or that word
+// plus its delta d[i] (32 or 64-bit words as in m); len is a multiple of the word size
+static void RelocMask( byte** p, uint n, uint len, typemode& m, const qword* d, byte* keep ) {
+  uint i,j=0,s=m.Size();
+  qword x,y,mask = (s==4) ? 0xFFFFFFFFULL : ~0ULL;
+
+#ifdef DK_SSE2
+  // Differences to buffer 0 per lane; a lane matches if its difference is 0 or the delta.
+  // SSE2 has 64-bit subtraction but no 64-bit compare: a 64-bit lane is equal if both its dword halves are
+  uint be = m.f_be ? s : 0;
+  const __m128i zero = _mm_setzero_si128();
+  __m128i x0,t,z,w,e,ok,v[DK_MAXF];
+  for( i=1; i<n; i++ ) v[i] = (s==4) ? _mm_set1_epi32( int(d[i]) ) : _mm_set_epi32( int(d[i]>>32), int(d[i]), int(d[i]>>32), int(d[i]) );
+  for( ; j+16<=len; j+=16 ) {
+    x0 = LoadSwap( p[0]+j, be );
+    ok = _mm_cmpeq_epi8( zero, zero );
+    for( i=1; i<n; i++ ) {
+      t = LoadSwap( p[i]+j, be );
+      t = (s==4) ? _mm_sub_epi32( t, x0 ) : _mm_sub_epi64( t, x0 );
+      z = _mm_cmpeq_epi32( t, zero ); w = _mm_cmpeq_epi32( t, v[i] );
+      if( s==8 ) {
+        // Both halves must match the same alternative
+        z = _mm_and_si128( z, _mm_shuffle_epi32( z, 0xB1 ) );
+        w = _mm_and_si128( w, _mm_shuffle_epi32( w, 0xB1 ) );
+      }
+      e = _mm_or_si128( z, w );
+      ok = _mm_and_si128( ok, e );
+    }
+    _mm_storeu_si128( (__m128i*)&keep[j], _mm_andnot_si128( ok, _mm_loadu_si128( (const __m128i*)&keep[j] ) ) );
+  }
+#endif
+
+  for( ; j<len; j+=s ) {
+    for( x=LoadElem( p[0]+j, s, m.f_be ),i=1; i<n; i++ ) {
+      y = (LoadElem( p[i]+j, s, m.f_be )-x) & mask;
+      if( y && (y!=(d[i]&mask)) ) break;
+    }
+    if( i>=n ) memset( keep+j, 0, s );
+  }
+}
+
+// Clear keep bytes of the whole elements in [0,len) that are within tolerance in all n buffers
+// len is rounded down to whole elements; SSE2 for 16/32-bit types, 64-bit floats with absolute tolerance
+// and relocated words; pos = position of p[] past the base offsets (for relocation deltas)
+void TypeMask( byte** p, uint n, uint len, typemode& m, byte* keep, qword pos ) {
+  uint i,j=0,s=m.Size();
+  byte* e[DK_MAXF];
+  if( (m.type==typemode::T_BYTE) || (n<2) ) return;
+  len -= len%s;
+
+  if( m.type>=typemode::T_R32 ) {
+    // Pieces with the same deltas (regions and user ranges)
+    qword d[DK_MAXF],l;
+    for( ; j<len; j+=uint(l) ) {
+      bzero( d );
+      l = m.rel ? m.rel->Deltas( pos+j, d ) : len;
+      l = Max( Min( l, qword(len-j) ) / s * s, qword(s) );
+      for( i=0; i<n; i++ ) e[i] = p[i]+j;
+      RelocMask( e, n, uint(l), m, d, keep+j );
+    }
+    return;
+  }
+
+#ifdef DK_SSE2
+  // Per-lane min/max over all files; a lane is equal if max-min is within tolerance,
+  // and keep is ANDed with the not-equal lane mask (all bytes of an element at once)
+  uint be = m.f_be ? s : 0;
+  __m128i x,mn,mx,c,k;
+
+  if( m.type==typemode::T_I16 ) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i t = _mm_set1_epi16( short( Min( m.itol, 0xFFFFULL ) ) );
+    for( ; j+16<=len; j+=16 ) {
+      mn = mx = LoadSwap( p[0]+j, be );
+      for( i=1; i<n; i++ ) {
+        x = LoadSwap( p[i]+j, be );
+        mn = _mm_min_epi16( mn, x ); mx = _mm_max_epi16( mx, x );
+      }
+      c = _mm_cmpeq_epi16( _mm_subs_epu16( _mm_sub_epi16( mx, mn ), t ), zero );  // Unsigned max-min <= t
+      k = _mm_andnot_si128( c, _mm_loadu_si128( (const __m128i*)&keep[j] ) );
+      _mm_storeu_si128( (__m128i*)&keep[j], k );
+    }
+  }
+
+  if( (m.type==typemode::T_I32) || ((m.type==typemode::T_F32) && m.f_ulp) ) {
+    // Floats with ULP tolerance compare as ordered integer keys; NaN lanes are never equal
+    const __m128i sign = _mm_set1_epi32( 0x80000000 );
+    const __m128i mag = _mm_set1_epi32( 0x7FFFFFFF );
+    const __m128i inf = _mm_set1_epi32( 0x7F800000 );
+    const __m128i t = _mm_xor_si128( _mm_set1_epi32( int( Min( m.itol, 0xFFFFFFFFULL ) ) ), sign );
+    uint f = (m.type==typemode::T_F32);
+    __m128i nan = _mm_setzero_si128();
+    for( ; j+16<=len; j+=16 ) {
+      x = LoadSwap( p[0]+j, be );
+      if( f ) {
+        nan = _mm_cmpgt_epi32( _mm_and_si128(x,mag), inf );
+        x = _mm_xor_si128( x, _mm_and_si128( _mm_srai_epi32(x,31), mag ) );
+      }
+      mn = mx = x;
+      for( i=1; i<n; i++ ) {
+        x = LoadSwap( p[i]+j, be );
+        if( f ) {
+          nan = _mm_or_si128( nan, _mm_cmpgt_epi32( _mm_and_si128(x,mag), inf ) );
+          x = _mm_xor_si128( x, _mm_and_si128( _mm_srai_epi32(x,31), mag ) );
+        }
+        c = _mm_cmpgt_epi32( x, mx ); mx = _mm_or_si128( _mm_and_si128(c,x), _mm_andnot_si128(c,mx) );
+        c = _mm_cmpgt_epi32( mn, x ); mn = _mm_or_si128( _mm_and_si128(c,x), _mm_andnot_si128(c,mn) );
+      }
+      c = _mm_cmpgt_epi32( _mm_xor_si128( _mm_sub_epi32( mx, mn ), sign ), t );  // Unsigned max-min > t
+      if( f ) c = _mm_or_si128( c, nan );
+      k = _mm_and_si128( c, _mm_loadu_si128( (const __m128i*)&keep[j] ) );
+      _mm_storeu_si128( (__m128i*)&keep[j], k );
+    }
+  }
+
+  if( (m.type==typemode::T_F32) && (m.f_ulp==0) ) {
+    // NaN fails cmpord; inf-inf is NaN and fails cmple
+    const __m128 t = _mm_set1_ps( float(m.tol) );
+    __m128 f,fmn,fmx,ord;
+    for( ; j+16<=len; j+=16 ) {
+      f = _mm_castsi128_ps( LoadSwap( p[0]+j, be ) );
+      fmn = fmx = f; ord = _mm_cmpord_ps( f, f );
+      for( i=1; i<n; i++ ) {
+        f = _mm_castsi128_ps( LoadSwap( p[i]+j, be ) );
+        ord = _mm_and_ps( ord, _mm_cmpord_ps( f, f ) );
+        fmn = _mm_min_ps( fmn, f ); fmx = _mm_max_ps( fmx, f );
+      }
+      c = _mm_castps_si128( _mm_and_ps( ord, _mm_cmple_ps( _mm_sub_ps( fmx, fmn ), t ) ) );
+      k = _mm_andnot_si128( c, _mm_loadu_si128( (const __m128i*)&keep[j] ) );
+      _mm_storeu_si128( (__m128i*)&keep[j], k );
+    }
+  }
+
+  if( (m.type==typemode::T_F64) && (m.f_ulp==0) ) {
+    const __m128d t = _mm_set1_pd( m.tol );
+    __m128d g,gmn,gmx,ord;
+    for( ; j+16<=len; j+=16 ) {
+      g = _mm_castsi128_pd( LoadSwap( p[0]+j, be ) );
+      gmn = gmx = g; ord = _mm_cmpord_pd( g, g );
+      for( i=1; i<n; i++ ) {
+        g = _mm_castsi128_pd( LoadSwap( p[i]+j, be ) );
+        ord = _mm_and_pd( ord, _mm_cmpord_pd( g, g ) );
+        gmn = _mm_min_pd( gmn, g ); gmx = _mm_max_pd( gmx, g );
+      }
+      c = _mm_castpd_si128( _mm_and_pd( ord, _mm_cmple_pd( _mm_sub_pd( gmx, gmn ), t ) ) );
+      k = _mm_andnot_si128( c, _mm_loadu_si128( (const __m128i*)&keep[j] ) );
+      _mm_storeu_si128( (__m128i*)&keep[j], k );
+    }
+  }
+#endif
+
+  // Scalar tail, 64-bit integers and 64-bit ULP (SSE2 has no 64-bit compares)
+  for( ; j<len; j+=s ) {
+    for( i=0; i<n; i++ ) e[i] = p[i]+j;
+    if( TypeEqual( e, n, m ) ) memset( keep+j, 0, s );
+  }
+}
+
+// Keep mask for the block last read by br: ignored ranges and tolerance-equal elements cleared
+// Returns 0 if nothing in the block is masked (ign and tm may be 0); kbuf holds br.bufsize bytes
+byte* BlockKeep( blockread& br, uint l, ignoremask* ign, typemode* tm, byte* kbuf ) {
+  uint i,h,s;
+  byte* keep=0;
+  byte* p[DK_MAXF];
+  if( ign && (ign->Next(br.bpos)<br.bpos+l) ) {
+    ign->Fill( br.bpos, kbuf, l );
+    keep = kbuf;
+  }
+  if( tm && tm->type && (br.n>1) ) {
+    if( keep==0 ) { memset( kbuf, 0xFF, l ); keep=kbuf; }
+    s = tm->Size();
+    h = uint( (0-br.bpos) & (s-1) );  // Bytes of an element started in the previous block (compared as bytes)
+    if( h<br.minlen ) {
+      for( i=0; i<br.n; i++ ) p[i] = br.buf[i]+h;
+      TypeMask( p, br.n, br.minlen-h, *tm, keep+h, br.bpos+h );
+    }
+  }
+  return keep;
+}
+
+// Allocate regions of 2^_rbits bytes for _n files of up to _size bytes past their bases
+void relocmap::Init( uint _n, qword _size, uint _rbits ) {
+  Quit();
+  n = _n; rbits = _rbits; size = _size;
+  nreg = uint( (size>>rbits)+1 );
+  delta = new qword[nreg*DK_MAXF];
+  cnt = new uint[nreg*DK_MAXF];
+  bzero( delta, nreg*DK_MAXF );
+  bzero( (uint*)cnt, nreg*DK_MAXF );
+}
+
+// Free regions and user ranges
+void relocmap::Quit( void ) {
+  delete[] delta; delta=0;
+  delete[] (uint*)cnt; cnt=0;
+  nreg = 0; nuser = 0;
+}
+
+// Add a user range [beg,end) where file has the given delta; returns 0 if full or invalid
+uint relocmap::AddUser( uint file, qword d, qword beg, qword end ) {
+  if( (nuser>=MAXUSER) || (file==0) || (file>=n) || (end<=beg) ) return 0;
+  userrange& u = user[nuser];
+  u.beg = beg; u.end = end; u.delta = d; u.file = file;
+  nuser++;
+  return 1;
+}
+
+// Deltas of all files at pos into d[0..n-1] (0 = none); returns bytes from pos on with the same deltas
+qword relocmap::Deltas( qword pos, qword* d ) {
+  uint i,k;
+  qword r,b = pos>>rbits;
+  d[0] = 0;
+  for( i=1; i<n; i++ ) {
+    k = uint(b)*DK_MAXF+i;
+    d[i] = ( (b<nreg) && cnt[k] ) ? delta[k] : 0;
+  }
+  r = (b<nreg) ? ((b+1)<<rbits)-pos : ~0ULL-pos;
+  // User ranges override the regions; later ones win
+  for( k=0; k<nuser; k++ ) {
+    userrange& u = user[k];
+    if( (pos>=u.beg) && (pos<u.end) ) { d[u.file] = u.delta; r = Min( r, u.end-pos ); }
+    else if( u.beg>pos ) r = Min( r, u.beg-pos );
+  }
+  return r;
+}
@@ -0,0 +1,85 @@
+// Typed element compare: integers and floats equal within a tolerance
+#ifndef TYPECMP_H
+#define TYPECMP_H
+
+#include "common.h"
+#include "blockread.h"
+#include "ignore.h"
+
+// Relocation deltas of aligned words, per region of positions past the base offsets
+// A word of file i matches word x of file 0 if it holds x or x+delta (mod 2^bits), delta being the region's delta
+// of file i (found by the relocation scan, or given by the user for a range). The scan fills regions in order
+// while the masks read them: a region's delta is written before its count.
+struct relocmap {
+  enum{ MAXUSER=64, RMIN=4 };  // User ranges; differing words a detected delta must explain
+
+  // Range with a delta given by the user
+  struct userrange {
+    qword beg, end;  // Positions past the base offsets
+    qword delta;     // Delta of file vs file 0
+    uint  file;
+  };
+
+  uint   n;           // Files
+  uint   rbits;       // log2 of region size
+  uint   nreg;        // Regions
+  qword  size;        // Bytes covered (largest file past its base)
+  qword* delta;       // Detected delta per region and file (nreg*DK_MAXF)
+  volatile uint* cnt; // Differing words the delta explains (0 = no delta detected)
+  uint   nuser;       // User ranges in use
+  userrange user[MAXUSER];  // Later ranges win
+
+  // Allocate regions of 2^_rbits bytes for _n files of up to _size bytes past their bases
+  void Init( uint _n, qword _size, uint _rbits );
+
+  // Free regions and user ranges
+  void Quit( void );
+
+  // Add a user range [beg,end) where file has the given delta; returns 0 if full or invalid
+  uint AddUser( uint file, qword delta, qword beg, qword end );
+
+  // Deltas of all files at pos into d[0..n-1] (0 = none); returns bytes from pos on with the same deltas
+  qword Deltas( qword pos, qword* d );
+};
+
+// Element type and tolerance
+// Elements start at position 0 past the base offsets; byte-identical elements are always equal.
+// R32/R64 are words equal up to relocation deltas (rel), used by the reloc command.
+struct typemode {
+  enum{ T_BYTE=0, T_I16, T_I32, T_I64, T_F32, T_F64, T_R32, T_R64 };
+
+  uint   type;   // Element type (T_BYTE = plain byte compare)
+  uint   f_be;   // Big-endian elements
+  uint   f_ulp;  // Float tolerance is in units in the last place (itol) instead of absolute (tol)
+  double tol;    // Absolute float tolerance
+  qword  itol;   // Integer tolerance, or ULP count for floats
+  relocmap* rel; // Relocation deltas (T_R32/T_R64)
+
+  // Element size in bytes
+  uint Size( void ) { static const byte sz[]={1,2,4,8,4,8,4,8}; return sz[type]; }
+
+  // Set from type name ("i16", "i32", "i64", "f32", "f64", optional "le"/"be" suffix)
+  // and tolerance ("0.001", "1e-6", "16" or "4ulp"; 0 if tol is 0); returns 0 if invalid
+  uint Set( const char* name, const char* tol );
+
+  // Print type and tolerance into s (for listings)
+  void Print( char* s );
+};
+
+// Elements e[0..n-1] (one element of each file, at position pos for relocation deltas) are within tolerance
+// of each other. NaNs are only equal when byte-identical (left to the byte compare).
+uint TypeEqual( byte** e, uint n, typemode& m, qword pos=0 );
+
+// Clear keep bytes of the whole elements in [0,len) that are within tolerance in all n buffers
+// len is rounded down to whole elements; SSE2 for 16/32-bit types, 64-bit floats with absolute tolerance
+// and relocated words; pos = position of p[] past the base offsets (for relocation deltas)
+void TypeMask( byte** p, uint n, uint len, typemode& m, byte* keep, qword pos=0 );
+
+// Load s-byte element (little- or big-endian) zero-extended
+qword LoadElem( const byte* p, uint s, uint be );
+
+// Keep mask for the block last read by br: ignored ranges and tolerance-equal elements cleared
+// Returns 0 if nothing in the block is masked (ign and tm may be 0); kbuf holds br.bufsize bytes
+byte* BlockKeep( blockread& br, uint l, ignoremask* ign, typemode* tm, byte* kbuf );
+
+#endif // TYPECMP_H
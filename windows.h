@@ -5,6 +5,11 @@
 #ifndef WINDOWS_H_DUMMY
 #define WINDOWS_H_DUMMY
 
+// 64-bit Linux builds model a Win64 target (pointer-sized values use the *Ptr APIs)
+#if defined(__x86_64__) && !defined(_WIN64)
+#define _WIN64
+#endif
+
 // Basic Windows types
 typedef void* HANDLE;
 typedef void* HWND;
@@ -17,9 +22,9 @@ typedef void* HINSTANCE;
 typedef void* HKEY;
 typedef void* HBRUSH;
 typedef void* LPVOID;
-typedef unsigned long DWORD;
-typedef unsigned long ULONG;
-typedef long LONG;
+typedef unsigned int DWORD;   // 32-bit like on Windows (long is 64-bit on Linux)
+typedef unsigned int ULONG;
+typedef int LONG;
 typedef unsigned int UINT;
 typedef int INT;
 typedef unsigned short WORD;
@@ -221,6 +226,57 @@ typedef struct _FILETIME {
     DWORD dwHighDateTime;
 } FILETIME;
 
+// Directory search result
+#define MAX_PATH 260
+typedef struct _WIN32_FIND_DATAA {
+    DWORD dwFileAttributes;
+    FILETIME ftCreationTime;
+    FILETIME ftLastAccessTime;
+    FILETIME ftLastWriteTime;
+    DWORD nFileSizeHigh;
+    DWORD nFileSizeLow;
+    DWORD dwReserved0;
+    DWORD dwReserved1;
+    CHAR cFileName[MAX_PATH];
+    CHAR cAlternateFileName[14];
+} WIN32_FIND_DATAA;
+
+// 64-bit integer as used by file system controls
+typedef union _LARGE_INTEGER {
+    struct {
+        DWORD LowPart;
+        LONG HighPart;
+    } u;
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+// File information (GetFileInformationByHandle)
+typedef struct _BY_HANDLE_FILE_INFORMATION {
+    DWORD dwFileAttributes;
+    FILETIME ftCreationTime;
+    FILETIME ftLastAccessTime;
+    FILETIME ftLastWriteTime;
+    DWORD dwVolumeSerialNumber;
+    DWORD nFileSizeHigh;
+    DWORD nFileSizeLow;
+    DWORD nNumberOfLinks;
+    DWORD nFileIndexHigh;
+    DWORD nFileIndexLow;
+} BY_HANDLE_FILE_INFORMATION;
+
+// Cluster runs of a file (FSCTL_GET_RETRIEVAL_POINTERS)
+typedef struct {
+    LARGE_INTEGER StartingVcn;
+} STARTING_VCN_INPUT_BUFFER;
+typedef struct RETRIEVAL_POINTERS_BUFFER {
+    DWORD ExtentCount;
+    LARGE_INTEGER StartingVcn;
+    struct {
+        LARGE_INTEGER NextVcn;  // First cluster of the file past this run
+        LARGE_INTEGER Lcn;      // First cluster on the volume (-1 = not allocated, e.g. sparse or compressed)
+    } Extents[1];
+} RETRIEVAL_POINTERS_BUFFER;
+
 // Window messages
 #define WM_NULL                 0x0000
 #define WM_CREATE               0x0001
@@ -234,6 +290,7 @@ typedef struct _FILETIME {
 #define WM_SYSKEYDOWN           0x0104
 #define WM_SYSKEYUP             0x0105
 #define WM_TIMER                0x0113
+#define WM_LBUTTONDOWN          0x0201
 #define WM_MOUSEWHEEL           0x020A
 
 // PeekMessage options
@@ -302,10 +359,16 @@ typedef struct _FILETIME {
 #define OPEN_EXISTING           3
 #define OPEN_ALWAYS             4
 #define FILE_ATTRIBUTE_NORMAL   0x00000080
+#define FILE_ATTRIBUTE_DIRECTORY 0x00000010
+#define FILE_ATTRIBUTE_REPARSE_POINT 0x00000400
 #define FILE_FLAG_BACKUP_SEMANTICS 0x02000000
 #define FILE_BEGIN              0
 #define FILE_CURRENT            1
 #define FILE_END                2
+#define FSCTL_GET_RETRIEVAL_POINTERS 0x00090073
+#define ERROR_INVALID_PARAMETER 87
+#define ERROR_HANDLE_EOF        38
+#define ERROR_MORE_DATA         234
 
 // GDI constants
 #define BI_RGB                  0
@@ -499,6 +562,8 @@ HANDLE CreateThread(SECURITY_ATTRIBUTES* lpThreadAttributes, SIZE_T dwStackSize,
                     DWORD dwCreationFlags, DWORD* lpThreadId);
 DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds);
 void Sleep(DWORD dwMilliseconds);
+HANDLE CreateEvent(SECURITY_ATTRIBUTES* lpEventAttributes, int bManualReset, int bInitialState, LPCSTR lpName);
+int SetEvent(HANDLE hEvent);
 int CloseHandle(HANDLE hObject);
 
 // File I/O functions
@@ -515,7 +580,21 @@ int WriteFile(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToWrite,
 DWORD SetFilePointer(HANDLE hFile, LONG lDistanceToMove, LONG* lpDistanceToMoveHigh,
                      DWORD dwMoveMethod);
 DWORD GetFileSize(HANDLE hFile, LPDWORD lpFileSizeHigh);
+int GetFileTime(HANDLE hFile, FILETIME* lpCreationTime, FILETIME* lpLastAccessTime, FILETIME* lpLastWriteTime);
 int CreateDirectoryW(LPCWSTR lpPathName, SECURITY_ATTRIBUTES* lpSecurityAttributes);
+HANDLE FindFirstFileA(LPCSTR lpFileName, WIN32_FIND_DATAA* lpFindFileData);
+int FindNextFileA(HANDLE hFindFile, WIN32_FIND_DATAA* lpFindFileData);
+int FindClose(HANDLE hFindFile);
+int DeleteFileA(LPCSTR lpFileName);
+DWORD GetTempPathA(DWORD nBufferLength, LPSTR lpBuffer);
+DWORD GetCurrentProcessId(void);
+int GetFileInformationByHandle(HANDLE hFile, BY_HANDLE_FILE_INFORMATION* lpFileInformation);
+int GetVolumePathNameA(LPCSTR lpszFileName, LPSTR lpszVolumePathName, DWORD cchBufferLength);
+int GetDiskFreeSpaceA(LPCSTR lpRootPathName, LPDWORD lpSectorsPerCluster, LPDWORD lpBytesPerSector,
+                      LPDWORD lpNumberOfFreeClusters, LPDWORD lpTotalNumberOfClusters);
+int DeviceIoControl(HANDLE hDevice, DWORD dwIoControlCode, LPVOID lpInBuffer, DWORD nInBufferSize,
+                    LPVOID lpOutBuffer, DWORD nOutBufferSize, LPDWORD lpBytesReturned, OVERLAPPED* lpOverlapped);
+LONG InterlockedIncrement(LONG volatile* lpAddend);
 
 // Registry functions
 LONG RegOpenKeyEx(HKEY hKey, LPCSTR lpSubKey, DWORD ulOptions, DWORD samDesired, HKEY* phkResult);
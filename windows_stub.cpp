@@ -6,6 +6,16 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/statvfs.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
 
 // Global variables for command-line arguments
 int __argc = 0;
@@ -134,16 +144,84 @@ DWORD GetTickCount(void) {
 }
 
 // ===== Thread functions =====
-HANDLE CreateThread(SECURITY_ATTRIBUTES*, SIZE_T, DWORD (*)(LPVOID), LPVOID, DWORD, DWORD*) {
-    return (HANDLE)0x7001;
+// Threads and events are real (pthreads), so background scans and batch mode work on Linux.
+// Both are tagged objects; other handles (files) are left alone by CloseHandle.
+enum { STUB_MAGIC = 0x424F5453, STUB_THREAD = 1, STUB_EVENT = 2 };
+struct StubObj {
+    unsigned magic, kind;
+    pthread_t th;
+    DWORD (*fn)(LPVOID);
+    LPVOID arg;
+    pthread_mutex_t mx;
+    pthread_cond_t cv;
+    int manual, state, done;
+};
+static StubObj* StubCheck(HANDLE h) {
+    StubObj* o = (StubObj*)h;
+    return (o && h != INVALID_HANDLE_VALUE && o->magic == STUB_MAGIC) ? o : nullptr;
+}
+static void* StubThreadMain(void* p) {
+    StubObj* o = (StubObj*)p;
+    o->fn(o->arg);
+    return nullptr;
+}
+HANDLE CreateThread(SECURITY_ATTRIBUTES*, SIZE_T, DWORD (*fn)(LPVOID), LPVOID arg, DWORD, DWORD*) {
+    StubObj* o = new StubObj();
+    o->magic = STUB_MAGIC; o->kind = STUB_THREAD;
+    o->fn = fn; o->arg = arg;
+    if (pthread_create(&o->th, nullptr, StubThreadMain, o) != 0) { delete o; return nullptr; }
+    return (HANDLE)o;
+}
+HANDLE CreateEvent(SECURITY_ATTRIBUTES*, int bManualReset, int bInitialState, LPCSTR) {
+    StubObj* o = new StubObj();
+    o->magic = STUB_MAGIC; o->kind = STUB_EVENT;
+    o->manual = bManualReset; o->state = bInitialState;
+    pthread_mutex_init(&o->mx, nullptr);
+    pthread_cond_init(&o->cv, nullptr);
+    return (HANDLE)o;
+}
+int SetEvent(HANDLE h) {
+    StubObj* o = StubCheck(h);
+    if (!o || o->kind != STUB_EVENT) return 0;
+    pthread_mutex_lock(&o->mx);
+    o->state = 1;
+    pthread_cond_broadcast(&o->cv);
+    pthread_mutex_unlock(&o->mx);
+    return 1;
+}
+DWORD WaitForSingleObject(HANDLE h, DWORD) {
+    StubObj* o = StubCheck(h);
+    if (!o) return 0;
+    if (o->kind == STUB_THREAD) {
+        if (!o->done) { pthread_join(o->th, nullptr); o->done = 1; }
+        return 0;
+    }
+    pthread_mutex_lock(&o->mx);
+    while (!o->state) pthread_cond_wait(&o->cv, &o->mx);
+    if (!o->manual) o->state = 0;  // Auto-reset event releases one waiter
+    pthread_mutex_unlock(&o->mx);
+    return 0;
+}
+void Sleep(DWORD ms) { usleep(ms * 1000); }
+LONG InterlockedIncrement(LONG volatile* p) { return __sync_add_and_fetch(p, 1); }
+int CloseHandle(HANDLE h) {
+    StubObj* o = StubCheck(h);
+    if (!o) return (h && h != INVALID_HANDLE_VALUE) ? fclose((FILE*)h) == 0 : 1;  // Files from CreateFileA
+    if (o->kind == STUB_THREAD && !o->done) pthread_detach(o->th);
+    if (o->kind == STUB_EVENT) { pthread_cond_destroy(&o->cv); pthread_mutex_destroy(&o->mx); }
+    o->magic = 0;
+    delete o;
+    return 1;
 }
-DWORD WaitForSingleObject(HANDLE, DWORD) { return 0; }
-void Sleep(DWORD) { }
-int CloseHandle(HANDLE) { return 1; }
 
 // ===== File I/O functions =====
-HANDLE CreateFileA(LPCSTR lpFileName, DWORD, DWORD, SECURITY_ATTRIBUTES*, DWORD, DWORD, HANDLE) {
-    FILE* f = fopen(lpFileName, "rb");
+HANDLE CreateFileA(LPCSTR lpFileName, DWORD dwDesiredAccess, DWORD, SECURITY_ATTRIBUTES*, DWORD dwCreationDisposition, DWORD, HANDLE) {
+    const char* mode = "rb";
+    if (dwDesiredAccess & GENERIC_WRITE) {
+        mode = (dwCreationDisposition == CREATE_ALWAYS) ? "w+b" : "r+b";
+    }
+    FILE* f = fopen(lpFileName, mode);
+    if (!f && (dwDesiredAccess & GENERIC_WRITE) && dwCreationDisposition == OPEN_ALWAYS) f = fopen(lpFileName, "w+b");
     return f ? (HANDLE)f : INVALID_HANDLE_VALUE;
 }
 HANDLE CreateFileW(LPCWSTR, DWORD, DWORD, SECURITY_ATTRIBUTES*, DWORD, DWORD, HANDLE) {
@@ -166,7 +244,7 @@ int WriteFile(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToWrite,
 DWORD SetFilePointer(HANDLE hFile, LONG lDistanceToMove, LONG* lpDistanceToMoveHigh, DWORD dwMoveMethod) {
     if (!hFile || hFile == INVALID_HANDLE_VALUE) return 0xFFFFFFFF;
 
-    long long offset = lDistanceToMove;
+    long long offset = (unsigned int)lDistanceToMove;
     if (lpDistanceToMoveHigh) {
         offset |= ((long long)*lpDistanceToMoveHigh) << 32;
     }
@@ -195,8 +273,179 @@ DWORD GetFileSize(HANDLE hFile, LPDWORD lpFileSizeHigh) {
     if (lpFileSizeHigh) *lpFileSizeHigh = 0;
     return size;
 }
+int GetFileTime(HANDLE hFile, FILETIME* lpCreationTime, FILETIME* lpLastAccessTime, FILETIME* lpLastWriteTime) {
+    struct stat st;
+    if (!hFile || hFile == INVALID_HANDLE_VALUE || fstat(fileno((FILE*)hFile), &st) != 0) return 0;
+    // FILETIME counts 100ns intervals since 1601
+    unsigned long long t = ((unsigned long long)st.st_mtime + 11644473600ULL) * 10000000ULL;
+    FILETIME ft = { (DWORD)t, (DWORD)(t >> 32) };
+    if (lpCreationTime) *lpCreationTime = ft;
+    if (lpLastAccessTime) *lpLastAccessTime = ft;
+    if (lpLastWriteTime) *lpLastWriteTime = ft;
+    return 1;
+}
 int CreateDirectoryW(LPCWSTR, SECURITY_ATTRIBUTES*) { return 1; }
 
+// Directory search: only "<dir>/*" patterns, entries come in readdir order
+struct StubFind {
+    DIR* d;
+    char dir[4096];
+};
+static int StubFindNext(StubFind* s, WIN32_FIND_DATAA* fd) {
+    struct dirent* de;
+    struct stat st;
+    char path[8192];
+    while ((de = readdir(s->d)) != nullptr) {
+        snprintf(path, sizeof(path), "%s/%s", s->dir, de->d_name);
+        if (lstat(path, &st) != 0) continue;
+        int link = S_ISLNK(st.st_mode);
+        if (link && stat(path, &st) != 0) continue;
+        memset(fd, 0, sizeof(*fd));
+        fd->dwFileAttributes = S_ISDIR(st.st_mode) ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL;
+        if (link) fd->dwFileAttributes |= FILE_ATTRIBUTE_REPARSE_POINT;
+        unsigned long long t = ((unsigned long long)st.st_mtime + 11644473600ULL) * 10000000ULL;
+        fd->ftLastWriteTime.dwLowDateTime = (DWORD)t;
+        fd->ftLastWriteTime.dwHighDateTime = (DWORD)(t >> 32);
+        fd->nFileSizeLow = (DWORD)st.st_size;
+        fd->nFileSizeHigh = (DWORD)((unsigned long long)st.st_size >> 32);
+        strncpy(fd->cFileName, de->d_name, MAX_PATH - 1);
+        return 1;
+    }
+    return 0;
+}
+HANDLE FindFirstFileA(LPCSTR lpFileName, WIN32_FIND_DATAA* fd) {
+    StubFind* s = new StubFind();
+    strncpy(s->dir, lpFileName, sizeof(s->dir) - 1);
+    char* e = strrchr(s->dir, '/');
+    if (e && strcmp(e, "/*") == 0) *e = 0;
+    s->d = opendir(s->dir);
+    if (!s->d || !StubFindNext(s, fd)) { if (s->d) closedir(s->d); delete s; return INVALID_HANDLE_VALUE; }
+    return (HANDLE)s;
+}
+int FindNextFileA(HANDLE h, WIN32_FIND_DATAA* fd) {
+    return StubFindNext((StubFind*)h, fd);
+}
+int FindClose(HANDLE h) {
+    StubFind* s = (StubFind*)h;
+    closedir(s->d);
+    delete s;
+    return 1;
+}
+int DeleteFileA(LPCSTR name) { return unlink(name) == 0; }
+DWORD GetTempPathA(DWORD n, LPSTR buf) {
+    const char* t = getenv("TMPDIR");
+    if (!t || !*t) t = "/tmp";
+    DWORD l = strlen(t) + 1;  // With the trailing separator
+    if (l + 1 > n) return l + 1;
+    sprintf(buf, "%s/", t);
+    return l;
+}
+DWORD GetCurrentProcessId(void) { return getpid(); }
+int GetFileInformationByHandle(HANDLE hFile, BY_HANDLE_FILE_INFORMATION* fi) {
+    struct stat st;
+    if (!hFile || hFile == INVALID_HANDLE_VALUE || StubCheck(hFile) || fstat(fileno((FILE*)hFile), &st) != 0) return 0;
+    memset(fi, 0, sizeof(*fi));
+    fi->dwFileAttributes = S_ISDIR(st.st_mode) ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL;
+    fi->dwVolumeSerialNumber = (DWORD)st.st_dev;
+    fi->nFileSizeHigh = (DWORD)((unsigned long long)st.st_size >> 32);
+    fi->nFileSizeLow = (DWORD)st.st_size;
+    fi->nNumberOfLinks = (DWORD)st.st_nlink;
+    fi->nFileIndexHigh = (DWORD)((unsigned long long)st.st_ino >> 32);
+    fi->nFileIndexLow = (DWORD)st.st_ino;
+    return 1;
+}
+// Any path works with statvfs, so the "volume" of a file is the file itself
+int GetVolumePathNameA(LPCSTR name, LPSTR path, DWORD n) {
+    if (strlen(name) + 1 > n) return 0;
+    strcpy(path, name);
+    return 1;
+}
+// Clusters are file system blocks (one "sector" each)
+int GetDiskFreeSpaceA(LPCSTR root, LPDWORD spc, LPDWORD bps, LPDWORD nfree, LPDWORD ntotal) {
+    struct statvfs vs;
+    if (statvfs(root, &vs) != 0) return 0;
+    if (spc) *spc = 1;
+    if (bps) *bps = vs.f_bsize;
+    if (nfree) *nfree = (DWORD)vs.f_bavail;
+    if (ntotal) *ntotal = (DWORD)vs.f_blocks;
+    return 1;
+}
+// Only FSCTL_GET_RETRIEVAL_POINTERS on files, answered from the FIEMAP extent list:
+// holes and extents that FIEMAP can't locate exactly (inline, delayed, encoded, unwritten) get Lcn -1
+int DeviceIoControl(HANDLE h, DWORD code, LPVOID in, DWORD inlen, LPVOID out, DWORD outlen, LPDWORD ret, OVERLAPPED*) {
+#ifdef __linux__
+    enum { NEXT = 64 };
+    const unsigned BAD = FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_ENCODED |
+                         FIEMAP_EXTENT_DATA_ENCRYPTED | FIEMAP_EXTENT_NOT_ALIGNED | FIEMAP_EXTENT_DATA_INLINE |
+                         FIEMAP_EXTENT_DATA_TAIL | FIEMAP_EXTENT_UNWRITTEN;
+    RETRIEVAL_POINTERS_BUFFER* rp = (RETRIEVAL_POINTERS_BUFFER*)out;
+    struct stat st;
+    struct statvfs vs;
+    if (ret) *ret = 0;
+    if (code != FSCTL_GET_RETRIEVAL_POINTERS || !h || h == INVALID_HANDLE_VALUE || StubCheck(h) ||
+        inlen < sizeof(STARTING_VCN_INPUT_BUFFER) || outlen < sizeof(RETRIEVAL_POINTERS_BUFFER)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return 0;
+    }
+    int fd = fileno((FILE*)h);
+    if (fstat(fd, &st) != 0 || fstatvfs(fd, &vs) != 0 || vs.f_bsize == 0) { SetLastError(ERROR_INVALID_PARAMETER); return 0; }
+    unsigned long long cl = vs.f_bsize, size = st.st_size;
+    unsigned long long vcn = ((STARTING_VCN_INPUT_BUFFER*)in)->StartingVcn.QuadPart, end = (size + cl - 1) / cl;
+    DWORD k = 0, kmax = (outlen - sizeof(RETRIEVAL_POINTERS_BUFFER)) / sizeof(rp->Extents[0]) + 1;
+    if (vcn >= end) { SetLastError(ERROR_HANDLE_EOF); return 0; }
+    rp->StartingVcn.QuadPart = vcn;
+    char mem[sizeof(struct fiemap) + NEXT * sizeof(struct fiemap_extent)];
+    struct fiemap* fm = (struct fiemap*)mem;
+    // Adds run [vcn,next) at lcn, merging it into the previous one if that continues it
+    auto Run = [&](unsigned long long next, long long lcn) {
+        if (next <= vcn) return 1;
+        if (k > 0) {
+            long long pl = rp->Extents[k - 1].Lcn.QuadPart;
+            unsigned long long pb = (k > 1) ? rp->Extents[k - 2].NextVcn.QuadPart : rp->StartingVcn.QuadPart;
+            if ((lcn < 0 && pl < 0) || (lcn >= 0 && pl >= 0 && (unsigned long long)(pl + (vcn - pb)) == (unsigned long long)lcn)) {
+                rp->Extents[k - 1].NextVcn.QuadPart = next;
+                vcn = next;
+                return 1;
+            }
+        }
+        if (k >= kmax) return 0;
+        rp->Extents[k].NextVcn.QuadPart = next;
+        rp->Extents[k].Lcn.QuadPart = lcn;
+        k++;
+        vcn = next;
+        return 1;
+    };
+    int full = 0;
+    while (!full && vcn < end) {
+        memset(fm, 0, sizeof(mem));
+        fm->fm_start = vcn * cl;
+        fm->fm_length = end * cl - fm->fm_start;
+        fm->fm_flags = FIEMAP_FLAG_SYNC;
+        fm->fm_extent_count = NEXT;
+        if (ioctl(fd, FS_IOC_FIEMAP, fm) != 0) { SetLastError(ERROR_INVALID_PARAMETER); return 0; }
+        if (fm->fm_mapped_extents == 0) break;
+        unsigned last = 0;
+        unsigned long long v0 = vcn;
+        for (unsigned i = 0; !full && i < fm->fm_mapped_extents; i++) {
+            struct fiemap_extent* e = &fm->fm_extents[i];
+            unsigned long long b = e->fe_logical / cl, n = (e->fe_logical + e->fe_length + cl - 1) / cl;
+            int known = !(e->fe_flags & BAD) && e->fe_logical % cl == 0 && e->fe_physical % cl == 0;
+            full = !Run(b, -1) || !Run(n, known ? (long long)(e->fe_physical / cl + (vcn - b)) : -1);
+            last = e->fe_flags & FIEMAP_EXTENT_LAST;
+        }
+        if (last || vcn == v0) break;
+    }
+    if (!full) full = !Run(end, -1);  // Trailing hole
+    rp->ExtentCount = k;
+    if (ret) *ret = sizeof(RETRIEVAL_POINTERS_BUFFER) + (k ? k - 1 : 0) * sizeof(rp->Extents[0]);
+    if (full) { SetLastError(ERROR_MORE_DATA); return 0; }
+    return 1;
+#else
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return 0;
+#endif
+}
+
 // ===== Registry functions =====
 LONG RegOpenKeyEx(HKEY, LPCSTR, DWORD, DWORD, HKEY* phkResult) {
     if (phkResult) *phkResult = (HKEY)0x8001;
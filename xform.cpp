@@ -0,0 +1,164 @@
+// Transform chain implementation
+#include "xform.h"
+#include "diffkern.h"
+
+#ifdef DK_SSE2
+#include <emmintrin.h>
+#endif
+
+// Parse steps: "xor <hex key>", "swap16", "swap32", "swap64", "nibble", "delta", separated by spaces
+// or commas; returns 0 if invalid (chain unchanged)
+uint xchain::Parse( const char* str ) {
+  static const char* names[] = { "xor","swap16","swap32","swap64","nibble","delta" };
+  uint k,l,h;
+  xchain r;
+  bzero( r );
+  while( 1 ) {
+    while( (*str==' ') || (*str=='\t') || (*str==',') ) str++;
+    if( *str==0 ) break;
+    for( l=0; str[l] && (str[l]!=' ') && (str[l]!='\t') && (str[l]!=','); l++ );
+    for( k=0; k<6; k++ ) if( (strlen(names[k])==l) && (strncmp( str, names[k], l )==0) ) break;
+    if( (k>=6) || (r.n>=MAXSTEPS) ) return 0;
+    xstep& x = r.s[r.n++];
+    x.type = xstep::X_XOR+k;
+    str += l;
+    if( x.type!=xstep::X_XOR ) continue;
+    // Key: hex digits, optional 0x prefix, two per byte
+    while( (*str==' ') || (*str=='\t') ) str++;
+    if( (str[0]=='0') && ((str[1]=='x') || (str[1]=='X')) ) str+=2;
+    for( h=0; ; h++,str++ ) {
+      if( (*str>='0') && (*str<='9') ) k = *str-'0';
+      else if( (*str>='a') && (*str<='f') ) k = *str-'a'+10;
+      else if( (*str>='A') && (*str<='F') ) k = *str-'A'+10;
+      else break;
+      if( h>=2*xstep::MAXKEY ) return 0;
+      x.key[h>>1] = (h&1) ? (x.key[h>>1]|k) : (k<<4);
+    }
+    if( (h==0) || (h&1) ) return 0;
+    x.klen = h>>1;
+  }
+  *this = r;
+  return 1;
+}
+
+// Print steps into out (for listings)
+void xchain::Print( char* out ) {
+  static const char* names[] = { "","xor","swap16","swap32","swap64","nibble","delta" };
+  uint i,k;
+  if( n==0 ) { strcpy( out, "none" ); return; }
+  for( *out=0,i=0; i<n; i++ ) {
+    out += sprintf( out, "%s%s", i ? " " : "", names[s[i].type] );
+    if( s[i].type!=xstep::X_XOR ) continue;
+    out += sprintf( out, " " );
+    for( k=0; k<s[i].klen; k++ ) out += sprintf( out, "%02X", s[i].key[k] );
+  }
+}
+
+// Bytes of context needed before a block
+uint xchain::Ctx( void ) {
+  uint i,c=0;
+  for( i=0; i<n; i++ ) c += (s[i].type==xstep::X_DELTA) ? 8 : 0;
+  return c;
+}
+
+// XOR p[0..len) with the key repeated from file position pos
+static void XorKey( byte* p, uint len, qword pos, const xstep& x ) {
+  uint j=0,k;
+  byte ek[xstep::MAXKEY*16+16];  // Key repeated so that any 16 bytes at a key phase are contiguous
+  uint period = x.klen*16;       // Multiple of both 16 and the key length
+  for( k=0; k<period+16; k++ ) ek[k] = x.key[k%x.klen];
+  k = uint( pos%x.klen );
+#ifdef DK_SSE2
+  for( ; j+16<=len; j+=16 ) {
+    __m128i v = _mm_xor_si128( _mm_loadu_si128( (const __m128i*)&p[j] ), _mm_loadu_si128( (const __m128i*)&ek[k] ) );
+    _mm_storeu_si128( (__m128i*)&p[j], v );
+    k += 16; if( k>=period ) k-=period;
+  }
+#endif
+  for( k%=x.klen; j<len; j++ ) { p[j] ^= ek[k]; if( ++k>=x.klen ) k=0; }
+}
+
+// Reverse bytes of each e-byte element in p[0..len) (len multiple of e)
+static void SwapElems( byte* p, uint len, uint e ) {
+  uint j=0,k;
+  byte t;
+#ifdef DK_SSE2
+  // Swap bytes in 16-bit lanes, then reverse 16-bit words within 32/64-bit lanes
+  for( ; j+16<=len; j+=16 ) {
+    __m128i v = _mm_loadu_si128( (const __m128i*)&p[j] );
+    v = _mm_or_si128( _mm_slli_epi16(v,8), _mm_srli_epi16(v,8) );
+    if( e==4 ) v = _mm_shufflehi_epi16( _mm_shufflelo_epi16( v, _MM_SHUFFLE(2,3,0,1) ), _MM_SHUFFLE(2,3,0,1) );
+    if( e==8 ) v = _mm_shufflehi_epi16( _mm_shufflelo_epi16( v, _MM_SHUFFLE(0,1,2,3) ), _MM_SHUFFLE(0,1,2,3) );
+    _mm_storeu_si128( (__m128i*)&p[j], v );
+  }
+#endif
+  for( ; j<len; j+=e ) for( k=0; k<e/2; k++ ) t=p[j+k], p[j+k]=p[j+e-1-k], p[j+e-1-k]=t;
+}
+
+// Swap high and low nibbles of p[0..len)
+static void SwapNibbles( byte* p, uint len ) {
+  uint j=0;
+#ifdef DK_SSE2
+  const __m128i lo = _mm_set1_epi8(0x0F);
+  for( ; j+16<=len; j+=16 ) {
+    __m128i v = _mm_loadu_si128( (const __m128i*)&p[j] );
+    v = _mm_or_si128( _mm_and_si128( _mm_srli_epi16(v,4), lo ), _mm_andnot_si128( lo, _mm_slli_epi16(v,4) ) );
+    _mm_storeu_si128( (__m128i*)&p[j], v );
+  }
+#endif
+  for( ; j<len; j++ ) p[j] = (p[j]>>4) | (p[j]<<4);
+}
+
+// Replace p[j] by p[j]-p[j-1] for j=len-1..1 (p[0] is left as is)
+static void Delta( byte* p, uint len ) {
+  uint j=len;
+#ifdef DK_SSE2
+  // Backwards, so each 16-byte step reads bytes that are not yet replaced
+  for( ; j>=17; j-=16 ) {
+    __m128i v = _mm_sub_epi8( _mm_loadu_si128( (const __m128i*)&p[j-16] ), _mm_loadu_si128( (const __m128i*)&p[j-17] ) );
+    _mm_storeu_si128( (__m128i*)&p[j-16], v );
+  }
+#endif
+  for( ; j>=2; j-- ) p[j-1] -= p[j-2];
+}
+
+// Transform file bytes [pos,pos+len) in place; pos must be a multiple of 8
+// Returns number of valid bytes: a partial element at the end is valid only at EOF (f_eof)
+uint xchain::Apply( byte* p, uint len, qword pos, uint f_eof ) {
+  uint i,e,v=len;
+  for( i=0; i<n; i++ ) {
+    xstep& x = s[i];
+    switch( x.type ) {
+      case xstep::X_XOR: XorKey( p, len, pos, x ); break;
+      case xstep::X_SWAP16: case xstep::X_SWAP32: case xstep::X_SWAP64:
+        e = 1<<(x.type-xstep::X_SWAP16+1);
+        SwapElems( p, len/e*e, e );
+        if( f_eof==0 ) v = Min( v, len/e*e );
+        break;
+      case xstep::X_NIBBLE: SwapNibbles( p, len ); break;
+      case xstep::X_DELTA: Delta( p, len ); break;
+    }
+  }
+  return v;
+}
+
+// Range to read for transformed bytes [pos,pos+len) of a file of fsize bytes:
+// returns its start and sets *rlen; the buffer must hold len+PAD bytes
+qword xchain::Span( qword pos, uint len, qword fsize, uint* rlen ) {
+  uint c = Ctx();
+  qword r = pos & ~7ULL;
+  r = (r>=c) ? r-c : 0;
+  qword e = Min( (pos+len+7) & ~7ULL, Max( fsize, pos ) );
+  *rlen = uint( e-r );
+  return r;
+}
+
+// Transform got bytes read at r (from Span) in place and move the bytes from pos to buf[0]
+// Returns number of valid bytes at pos
+uint xchain::Finish( byte* buf, uint got, qword r, qword pos, qword fsize ) {
+  uint v = Apply( buf, got, r, r+got>=fsize );
+  if( r+v<=pos ) return 0;
+  v = uint( r+v-pos );
+  memmove( buf, buf+uint(pos-r), v );
+  return v;
+}
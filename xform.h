@@ -0,0 +1,49 @@
+// Per-file transform chain applied to file data before comparison (XOR key, byte swaps, delta, nibble swap)
+#ifndef XFORM_H
+#define XFORM_H
+
+#include "common.h"
+
+// One step of a transform chain
+struct xstep {
+  enum{ X_XOR=1, X_SWAP16, X_SWAP32, X_SWAP64, X_NIBBLE, X_DELTA };
+  enum{ MAXKEY=32 };
+
+  uint type;
+  uint klen;          // XOR key length
+  byte key[MAXKEY];   // XOR key, repeated from file position 0
+};
+
+// Transform chain of one file; steps are applied in order
+// Byte swaps work on elements aligned to file position 0; delta replaces each byte by its difference
+// to the previous one (the first byte of the file is kept), so it needs the bytes before a block.
+struct xchain {
+  enum{ MAXSTEPS=8, CTX=8*MAXSTEPS, PAD=CTX+16 };
+
+  uint n;                  // Steps in use (0 = untransformed)
+  xstep s[MAXSTEPS];
+
+  // Parse steps: "xor <hex key>", "swap16", "swap32", "swap64", "nibble", "delta", separated by spaces
+  // or commas; returns 0 if invalid (chain unchanged)
+  uint Parse( const char* str );
+
+  // Print steps into out (for listings)
+  void Print( char* out );
+
+  // Bytes of context needed before a block
+  uint Ctx( void );
+
+  // Transform file bytes [pos,pos+len) in place; pos must be a multiple of 8
+  // Returns number of valid bytes: a partial element at the end is valid only at EOF (f_eof)
+  uint Apply( byte* p, uint len, qword pos, uint f_eof );
+
+  // Range to read for transformed bytes [pos,pos+len) of a file of fsize bytes:
+  // returns its start and sets *rlen; the buffer must hold len+PAD bytes
+  qword Span( qword pos, uint len, qword fsize, uint* rlen );
+
+  // Transform got bytes read at r (from Span) in place and move the bytes from pos to buf[0]
+  // Returns number of valid bytes at pos
+  uint Finish( byte* buf, uint got, qword r, qword pos, qword fsize );
+};
+
+#endif // XFORM_H